@@ -119,6 +119,7 @@ LOCAL_SRC_FILES := \
     android/utils/panic.c \
     android/utils/path.cpp \
     android/utils/path_system.cpp \
+    android/utils/pixel_diff.c \
     android/utils/property_file.c \
     android/utils/reflist.c \
     android/utils/refset.c \
@@ -220,6 +221,7 @@ LOCAL_SRC_FILES := \
     android/emulation/control/LineConsumer.cpp \
     android/emulation/CpuAccelerator.cpp \
     android/emulation/nand_limits.c \
+    android/emulation/nand_overlay.c \
     android/emulation/qemud/android_qemud_client.cpp \
     android/emulation/qemud/android_qemud_multiplexer.cpp \
     android/emulation/qemud/android_qemud_serial.cpp \
@@ -450,6 +452,7 @@ LOCAL_SRC_FILES := \
   android/utils/format_unittest.cpp \
   android/utils/host_bitness_unittest.cpp \
   android/utils/path_unittest.cpp \
+  android/utils/pixel_diff_unittest.cpp \
   android/utils/property_file_unittest.cpp \
   android/utils/string_unittest.cpp \
   android/utils/x86_cpuid_unittest.cpp \
@@ -469,6 +472,7 @@ LOCAL_SRC_FILES += \
 else
 LOCAL_SRC_FILES += \
   android/emulation/nand_limits_unittest.cpp \
+  android/emulation/nand_overlay_unittest.cpp \
 
 endif
 
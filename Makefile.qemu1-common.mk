@@ -185,6 +185,7 @@ LOCAL_SRC_FILES += \
     block.c \
     blockdev.c \
     block/qcow2.c \
+    block/qcow2-cache.c \
     block/qcow2-refcount.c \
     block/qcow2-snapshot.c \
     block/qcow2-cluster.c \
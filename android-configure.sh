@@ -607,6 +607,7 @@ clean_temp
 feature_check_header HAVE_BYTESWAP_H      "<byteswap.h>"
 feature_check_header HAVE_MACHINE_BSWAP_H "<machine/bswap.h>"
 feature_check_header HAVE_FNMATCH_H       "<fnmatch.h>"
+feature_check_header HAVE_USERFAULTFD_H   "<linux/userfaultfd.h>"
 
 # check for Mingw version.
 if [ "$HOST_OS" = "windows" ]; then
@@ -1014,6 +1015,9 @@ fi
 if [ "$HAVE_FNMATCH_H" = "yes" ] ; then
   echo "#define CONFIG_FNMATCH  1" >> $config_h
 fi
+if [ "$HAVE_USERFAULTFD_H" = "yes" ] ; then
+  echo "#define CONFIG_USERFAULTFD  1" >> $config_h
+fi
 echo "#define CONFIG_GDBSTUB  1" >> $config_h
 echo "#define CONFIG_SLIRP    1" >> $config_h
 echo "#define CONFIG_SKINS    1" >> $config_h
@@ -1086,6 +1090,7 @@ fi
 case "$HOST_OS" in
     linux)
         echo "#define CONFIG_SIGNALFD       1" >> $config_h
+        echo "#define CONFIG_PREADV         1" >> $config_h
         ;;
 esac
 
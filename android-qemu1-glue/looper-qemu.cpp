@@ -18,6 +18,10 @@
 typedef ::Looper CLooper;
 
 void qemu_looper_setForThread(void) {
-    looper_setForThread(
-            reinterpret_cast<CLooper*>(::android::qemu::createLooper()));
+    // All threads share the same instance, see the comment above
+    // createLooper(). The first call comes from the main thread, before
+    // any other thread is started.
+    static CLooper* sLooper =
+            reinterpret_cast<CLooper*>(::android::qemu::createLooper());
+    looper_setForThread(sLooper);
 }
@@ -17,9 +17,11 @@
 
 ANDROID_BEGIN_HEADER
 
-/* Create a new looper which is implemented on top of the QEMU main event
- * loop. You should only use this when implementing the emulator UI and Core
- * features in a single program executable.
+/* Set the looper of the current thread to one which is implemented on top
+ * of the QEMU main event loop. All threads calling this share the same
+ * looper, and must hold the global QEMU mutex when using it. You should only
+ * use this when implementing the emulator UI and Core features in a single
+ * program executable.
  */
 void  qemu_looper_setForThread(void);
 
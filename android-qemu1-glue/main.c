@@ -584,6 +584,18 @@ int main(int argc, char **argv) {
         if (opts->no_snapshot_update_time) {
             args[n++] = "-snapshot-no-time-update";
         }
+
+        if (opts->snapshot_compress) {
+            args[n++] = "-snapshot-compress";
+        }
+
+        if (opts->snapshot_lazy_ram) {
+            args[n++] = "-snapshot-lazy-ram";
+        }
+
+        if (opts->snapshot_incremental) {
+            args[n++] = "-snapshot-incremental";
+        }
     }
 
     if (!opts->logcat || opts->logcat[0] == 0) {
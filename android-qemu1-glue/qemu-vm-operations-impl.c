@@ -20,6 +20,7 @@
 #include "monitor/monitor.h"
 #include "sysemu/sysemu.h"
 
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -79,6 +80,33 @@ static bool qemu_snapshot_delete(const char* name,
     return !ret;
 }
 
+static int GCC_FMT_ATTR(2, 3)
+qemu_monitor_fprintf(FILE* stream, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    monitor_vprintf((Monitor*)stream, fmt, ap);
+    va_end(ap);
+    return 0;
+}
+
+static bool qemu_jit_stats(int hotCount,
+                           void* opaque,
+                           LineConsumerCallback outConsumer) {
+    Monitor* out = monitor_fake_new(opaque, outConsumer);
+    dump_exec_info((FILE*)out, qemu_monitor_fprintf);
+    if (tb_exec_profiling) {
+        qemu_monitor_fprintf((FILE*)out, "\n");
+        dump_tb_hot_blocks((FILE*)out, qemu_monitor_fprintf, hotCount);
+    }
+    monitor_fake_free(out);
+    return true;
+}
+
+static bool qemu_jit_set_profiling(bool enable) {
+    tb_set_exec_profiling(enable);
+    return true;
+}
+
 static const QAndroidVmOperations sQAndroidVmOperations = {
     .vmStop = qemu_vm_stop,
     .vmStart = qemu_vm_start,
@@ -86,6 +114,8 @@ static const QAndroidVmOperations sQAndroidVmOperations = {
     .snapshotList = qemu_snapshot_list,
     .snapshotLoad = qemu_snapshot_load,
     .snapshotSave = qemu_snapshot_save,
-    .snapshotDelete = qemu_snapshot_delete
+    .snapshotDelete = qemu_snapshot_delete,
+    .jitStats = qemu_jit_stats,
+    .jitSetProfiling = qemu_jit_set_profiling,
 };
 const QAndroidVmOperations * const gQAndroidVmOperations = &sQAndroidVmOperations;
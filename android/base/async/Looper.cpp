@@ -21,6 +21,8 @@
 
 #include <sys/time.h>
 
+#include <unordered_map>
+
 #include <stdio.h>
 
 namespace android {
@@ -28,12 +30,13 @@ namespace base {
 
 namespace {
 
-// Generic looper implementation based on select().
+// Generic looper implementation based on SocketWaiter.
 class GenLooper : public Looper {
 public:
     GenLooper() :
             Looper(),
-            mWaiter(SocketWaiter::create()),
+            mWaiter(SocketWaiter::createPersistent()),
+            mFdWatchMap(),
             mFdWatches(),
             mPendingFdWatches(),
             mTimers(),
@@ -158,9 +161,14 @@ public:
 
     void addFdWatch(FdWatch* watch) {
         mFdWatches.add(watch);
+        mFdWatchMap[watch->fd()] = watch;
     }
 
     void delFdWatch(FdWatch* watch) {
+        FdWatchMap::iterator it = mFdWatchMap.find(watch->fd());
+        if (it != mFdWatchMap.end() && it->second == watch) {
+            mFdWatchMap.erase(it);
+        }
         mFdWatches.pick(watch);
     }
 
@@ -374,14 +382,9 @@ public:
                         }
 
                         // Find the FdWatch for this file descriptor.
-                        // TODO(digit): Improve efficiency with a map?
-                        FdWatchSet::Iterator iter(&mFdWatches);
-                        while (iter.hasNext()) {
-                            FdWatch* watch = iter.next();
-                            if (watch->fd() == fd) {
-                                watch->setPending(events);
-                                break;
-                            }
+                        FdWatchMap::iterator it = mFdWatchMap.find(fd);
+                        if (it != mFdWatchMap.end()) {
+                            it->second->setPending(events);
                         }
                     }
                 }
@@ -438,9 +441,13 @@ public:
 
     typedef TailQueueList<FdWatch> FdWatchList;
     typedef ScopedPointerSet<FdWatch> FdWatchSet;
+    typedef std::unordered_map<int, FdWatch*> FdWatchMap;
 
 private:
     ScopedPtr<SocketWaiter> mWaiter;
+    // NOTE: Must be declared before |mFdWatches|, since deleting the
+    // watches from its destructor updates this map.
+    FdWatchMap mFdWatchMap;        // Map from fd to watch.
     FdWatchSet mFdWatches;         // Set of all fd watches.
     FdWatchList mPendingFdWatches;  // Queue of pending fd watches.
 
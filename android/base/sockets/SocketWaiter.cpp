@@ -21,10 +21,18 @@
 #  include <sys/select.h>
 #endif
 
+#ifdef __linux__
+#  include <sys/epoll.h>
+#  include <unistd.h>
+#endif
 
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace android {
 namespace base {
 
@@ -41,8 +49,10 @@ public:
     virtual void reset() {
         FD_ZERO(mReads);
         FD_ZERO(mWrites);
+        FD_ZERO(mExcepts);
         FD_ZERO(mReadsResult);
         FD_ZERO(mWritesResult);
+        FD_ZERO(mExceptsResult);
         mMaxFd = -1;
         mMaxFdValid = true;
         mPendingFd = 0;
@@ -60,6 +70,9 @@ public:
         if (FD_ISSET(fd, mWrites)) {
             events |= kEventWrite;
         }
+        if (FD_ISSET(fd, mExcepts)) {
+            events |= kEventUrgent;
+        }
         return events;
     }
 
@@ -75,6 +88,9 @@ public:
         if (FD_ISSET(fd, mWritesResult)) {
             events |= kEventWrite;
         }
+        if (FD_ISSET(fd, mExceptsResult)) {
+            events |= kEventUrgent;
+        }
         return events;
     }
 
@@ -107,6 +123,13 @@ public:
                 clearFdInSet(fd, mWrites);
             }
         }
+        if ((changed & kEventUrgent) != 0) {
+            if ((events & kEventUrgent) != 0) {
+                setFdInSet(fd, mExcepts);
+            } else {
+                clearFdInSet(fd, mExcepts);
+            }
+        }
 
         // Update mMaxFd / mMaxFdValid
         if (oldEvents == 0 && mMaxFdValid && fd > mMaxFd) {
@@ -147,13 +170,12 @@ public:
 
         int ret;
         do {
-            fd_set errs;
-            FD_ZERO(&errs);
-
             mReadsResult[0] = mReads[0];
             mWritesResult[0] = mWrites[0];
+            mExceptsResult[0] = mExcepts[0];
 
-            ret = ::select(count, mReadsResult, mWritesResult, &errs, tm);
+            ret = ::select(count, mReadsResult, mWritesResult,
+                           mExceptsResult, tm);
             if (ret == 0) {
                 errno = ETIMEDOUT;
             }
@@ -178,6 +200,9 @@ public:
             if (FD_ISSET(fd, mWritesResult)) {
                 events |= kEventWrite;
             }
+            if (FD_ISSET(fd, mExceptsResult)) {
+                events |= kEventUrgent;
+            }
             if (events) {
                 *fdEvents = events;
                 mPendingFd = fd;
@@ -225,7 +250,8 @@ public:
         // Recompute the maximum file descriptor.
         maxFd = -1;
         for (int fd = 0; fd < FD_SETSIZE; ++fd) {
-            if (!FD_ISSET(fd, mReads) && !FD_ISSET(fd, mWrites)) {
+            if (!FD_ISSET(fd, mReads) && !FD_ISSET(fd, mWrites) &&
+                !FD_ISSET(fd, mExcepts)) {
                 continue;
             }
             maxFd = fd;
@@ -240,13 +266,260 @@ public:
 private:
     fd_set mReads[1];
     fd_set mWrites[1];
+    fd_set mExcepts[1];
     fd_set mReadsResult[1];
     fd_set mWritesResult[1];
+    fd_set mExceptsResult[1];
     mutable int mMaxFd;
     mutable bool mMaxFdValid;
     int mPendingFd;
 };
 
+#ifdef __linux__
+
+// An epoll() based implementation. Descriptors stay registered in the
+// kernel between calls to wait(), so each one only costs a system call
+// when its wanted events change, and wait() doesn't depend on the value
+// of the largest descriptor.
+class EpollSocketWaiter : public SocketWaiter {
+public:
+    // Return a new instance, or NULL if epoll is not available.
+    static EpollSocketWaiter* create() {
+        int epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            return NULL;
+        }
+        return new EpollSocketWaiter(epollFd);
+    }
+
+    virtual ~EpollSocketWaiter() {
+        ::close(mEpollFd);
+    }
+
+    virtual void reset() {
+        for (size_t fd = 0; fd < mWanted.size(); ++fd) {
+            if (mWanted[fd]) {
+                ::epoll_ctl(mEpollFd, EPOLL_CTL_DEL, (int)fd, NULL);
+            }
+        }
+        mWanted.clear();
+        mReadyFds.clear();
+        mFdCount = 0;
+        clearPending();
+    }
+
+    virtual unsigned wantedEventsFor(int fd) const {
+        if (fd < 0 || (size_t)fd >= mWanted.size()) {
+            return 0U;
+        }
+        return mWanted[fd];
+    }
+
+    virtual unsigned pendingEventsFor(int fd) const {
+        if (fd < 0 || (size_t)fd >= mPendingEvents.size()) {
+            return 0U;
+        }
+        return mPendingEvents[fd];
+    }
+
+    virtual bool hasFds() const {
+        return mFdCount > 0;
+    }
+
+    virtual void update(int fd, unsigned events) {
+        DCHECK(fd >= 0) << "fd " << fd;
+
+        unsigned oldEvents = wantedEventsFor(fd);
+        if (events == oldEvents) {
+            return;
+        }
+        if ((size_t)fd >= mWanted.size()) {
+            mWanted.resize(fd + 1, 0);
+        }
+        mWanted[fd] = static_cast<unsigned char>(events);
+
+        std::vector<int>::iterator ready =
+                std::find(mReadyFds.begin(), mReadyFds.end(), fd);
+
+        if (events == 0) {
+            if (ready != mReadyFds.end()) {
+                mReadyFds.erase(ready);
+            } else {
+                // This fails harmlessly if |fd| was already closed.
+                ::epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
+            }
+            mFdCount--;
+            return;
+        }
+        if (oldEvents == 0) {
+            mFdCount++;
+        } else if (ready != mReadyFds.end()) {
+            // Only the wanted events changed.
+            return;
+        }
+
+        struct epoll_event ev;
+        ev.events = toEpollEvents(events);
+        ev.data.fd = fd;
+        int op = (oldEvents == 0) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        int ret = ::epoll_ctl(mEpollFd, op, fd, &ev);
+        if (ret < 0) {
+            // The descriptor was closed and reopened without being
+            // unregistered, or the other way around.
+            if (errno == ENOENT) {
+                ret = ::epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev);
+            } else if (errno == EEXIST) {
+                ret = ::epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &ev);
+            }
+        }
+        if (ret < 0 && errno == EPERM) {
+            // epoll doesn't support regular files and some character
+            // devices like /dev/null, which select() always reports as
+            // ready. Do the same.
+            mReadyFds.push_back(fd);
+        }
+    }
+
+    virtual int wait(int64_t timeout_ms) {
+        clearPending();
+
+        // Nothing to wait on.
+        if (mFdCount <= 0) {
+            return 0;
+        }
+
+        int timeout;
+        if (timeout_ms < 0 || timeout_ms == INT64_MAX) {
+            timeout = -1;
+        } else if (timeout_ms > INT_MAX) {
+            timeout = INT_MAX;
+        } else {
+            timeout = (int)timeout_ms;
+        }
+
+        // Don't block if some descriptors are always ready.
+        int readyCount = (int)mReadyFds.size();
+        int epollCount = mFdCount - readyCount;
+        if (readyCount > 0) {
+            timeout = 0;
+        }
+
+        mEvents.resize(mFdCount);
+
+        int ret = 0;
+        if (epollCount > 0) {
+            do {
+                ret = ::epoll_wait(mEpollFd, &mEvents[0], epollCount,
+                                   timeout);
+            } while (ret < 0 && errno == EINTR);
+
+            if (ret < 0) {
+                LOG(ERROR) << LogString("Error: %s\n", strerror(errno));
+                return ret;
+            }
+        }
+        for (int n = 0; n < readyCount; ++n) {
+            int fd = mReadyFds[n];
+            mEvents[ret].data.fd = fd;
+            mEvents[ret].events = EPOLLIN | EPOLLOUT;
+            ret++;
+        }
+        if (ret == 0) {
+            errno = ETIMEDOUT;
+        }
+
+        mEventCount = ret;
+        for (int n = 0; n < ret; ++n) {
+            int fd = mEvents[n].data.fd;
+            unsigned events =
+                    fromEpollEvents(mEvents[n].events) & wantedEventsFor(fd);
+            mEvents[n].events = events;
+            if ((size_t)fd >= mPendingEvents.size()) {
+                mPendingEvents.resize(fd + 1, 0);
+            }
+            mPendingEvents[fd] = static_cast<unsigned char>(events);
+        }
+        return ret;
+    }
+
+    virtual int nextPendingFd(unsigned* fdEvents) {
+        while (mPendingIndex < mEventCount) {
+            const struct epoll_event& ev = mEvents[mPendingIndex++];
+            if (ev.events) {
+                *fdEvents = ev.events;
+                return ev.data.fd;
+            }
+        }
+        *fdEvents = 0;
+        return -1;
+    }
+
+private:
+    explicit EpollSocketWaiter(int epollFd) :
+            SocketWaiter(),
+            mEpollFd(epollFd),
+            mFdCount(0),
+            mWanted(),
+            mReadyFds(),
+            mPendingEvents(),
+            mEvents(),
+            mEventCount(0),
+            mPendingIndex(0) {}
+
+    static uint32_t toEpollEvents(unsigned events) {
+        uint32_t result = 0;
+        if (events & kEventRead) {
+            result |= EPOLLIN;
+        }
+        if (events & kEventWrite) {
+            result |= EPOLLOUT;
+        }
+        if (events & kEventUrgent) {
+            result |= EPOLLPRI;
+        }
+        return result;
+    }
+
+    // Note: like select(), report errors and hang-ups as both readable
+    // and writable, the next read or write will return the error.
+    static unsigned fromEpollEvents(uint32_t events) {
+        unsigned result = 0;
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            result |= kEventRead;
+        }
+        if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            result |= kEventWrite;
+        }
+        if (events & EPOLLPRI) {
+            result |= kEventUrgent;
+        }
+        return result;
+    }
+
+    // Clear the results of the previous wait().
+    void clearPending() {
+        for (int n = 0; n < mEventCount; ++n) {
+            int fd = mEvents[n].data.fd;
+            if ((size_t)fd < mPendingEvents.size()) {
+                mPendingEvents[fd] = 0;
+            }
+        }
+        mEventCount = 0;
+        mPendingIndex = 0;
+    }
+
+    int mEpollFd;
+    int mFdCount;
+    std::vector<unsigned char> mWanted;         // Indexed by fd.
+    std::vector<int> mReadyFds;  // Registered fds that epoll doesn't support.
+    std::vector<unsigned char> mPendingEvents;  // Indexed by fd.
+    std::vector<struct epoll_event> mEvents;
+    int mEventCount;
+    int mPendingIndex;
+};
+
+#endif  // __linux__
+
 }  // namespace
 
 // static
@@ -254,5 +527,16 @@ SocketWaiter* SocketWaiter::create() {
     return new SelectSocketWaiter();
 }
 
+// static
+SocketWaiter* SocketWaiter::createPersistent() {
+#ifdef __linux__
+    SocketWaiter* waiter = EpollSocketWaiter::create();
+    if (waiter) {
+        return waiter;
+    }
+#endif
+    return new SelectSocketWaiter();
+}
+
 }  // namespace base
 }  // namespace android
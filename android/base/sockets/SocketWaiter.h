@@ -63,11 +63,20 @@ public:
     enum Event {
         kEventRead = (1U << 0),
         kEventWrite = (1U << 1),
+        // Out-of-band data is available for reading.
+        kEventUrgent = (1U << 2),
     };
 
     // Create new SocketWaiter instance.
     static SocketWaiter* create();
 
+    // Create new SocketWaiter instance for long-lived users that update
+    // a few descriptors between calls to wait(). On Linux, this uses
+    // epoll(), which keeps the registered descriptors in the kernel and
+    // isn't limited to FD_SETSIZE, but costs a system call per update().
+    // Other platforms use select().
+    static SocketWaiter* createPersistent();
+
     // Destroy the instance.
     virtual ~SocketWaiter() {}
 
@@ -86,7 +95,11 @@ public:
     virtual bool hasFds() const = 0;
 
     // Tell the waiter to look for i/o events on socket descriptor |fd|.
-    // |events| is a bitmask containing kEventRead, kEventWrite or both.
+    // |events| is a bitmask containing kEventRead, kEventWrite and/or
+    // kEventUrgent.
+    //
+    // NOTE: Call update(fd, 0) before closing a registered descriptor,
+    // otherwise a new one reusing the same number may not be watched.
     virtual void update(int fd, unsigned events) = 0;
 
     // Wait at most |timeout_ms| milli-seconds for i/o events to occur
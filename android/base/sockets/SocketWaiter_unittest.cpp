@@ -15,6 +15,8 @@
 
 #include <gtest/gtest.h>
 
+#include <stdio.h>
+
 namespace android {
 namespace base {
 
@@ -121,6 +123,99 @@ TEST(SocketWaiter, waitOnWriteEvent) {
     socketClose(s1);
 }
 
+TEST(SocketWaiter, waitOnManySockets) {
+    ScopedPtr<SocketWaiter> waiter(SocketWaiter::createPersistent());
+
+    const int kCount = 64;
+    int s1[kCount], s2[kCount];
+    for (int n = 0; n < kCount; ++n) {
+        ASSERT_EQ(0, socketCreatePair(&s1[n], &s2[n]));
+        waiter->update(s1[n], SocketWaiter::kEventRead);
+    }
+
+    EXPECT_EQ(1, socketSend(s2[kCount / 2], "!", 1));
+    EXPECT_EQ(1, waiter->wait(0));
+    EXPECT_EQ(SocketWaiter::kEventRead,
+              waiter->pendingEventsFor(s1[kCount / 2]));
+    EXPECT_EQ(0U, waiter->pendingEventsFor(s1[0]));
+
+    unsigned events = 0;
+    EXPECT_EQ(s1[kCount / 2], waiter->nextPendingFd(&events));
+    EXPECT_EQ(SocketWaiter::kEventRead, events);
+    EXPECT_EQ(-1, waiter->nextPendingFd(&events));
+
+    // The results of a previous wait() are cleared by the next one.
+    char c;
+    EXPECT_EQ(1, socketRecv(s1[kCount / 2], &c, 1));
+    EXPECT_EQ(0, waiter->wait(0));
+    EXPECT_EQ(0U, waiter->pendingEventsFor(s1[kCount / 2]));
+
+    for (int n = 0; n < kCount; ++n) {
+        waiter->update(s1[n], 0);
+        socketClose(s2[n]);
+        socketClose(s1[n]);
+    }
+    EXPECT_FALSE(waiter->hasFds());
+}
+
+TEST(SocketWaiter, updateAfterReopen) {
+    ScopedPtr<SocketWaiter> waiter(SocketWaiter::createPersistent());
+
+    int s1, s2;
+    ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+    waiter->update(s1, SocketWaiter::kEventRead);
+    waiter->update(s1, 0);
+    socketClose(s2);
+    socketClose(s1);
+
+    // The new sockets are likely to reuse the same descriptor numbers.
+    ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+    waiter->update(s1, SocketWaiter::kEventRead);
+    EXPECT_EQ(1, socketSend(s2, "!", 1));
+    EXPECT_EQ(1, waiter->wait(0));
+    EXPECT_EQ(SocketWaiter::kEventRead, waiter->pendingEventsFor(s1));
+
+    socketClose(s2);
+    socketClose(s1);
+}
+
+#ifndef _WIN32
+TEST(SocketWaiter, regularFileIsAlwaysReady) {
+    ScopedPtr<SocketWaiter> waiter(SocketWaiter::createPersistent());
+
+    // epoll() rejects regular files, which select() always reports as
+    // ready. Check that the waiter does the same instead of blocking.
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file);
+    int fd = fileno(file);
+
+    int s1, s2;
+    ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+    waiter->update(s1, SocketWaiter::kEventRead);
+    waiter->update(fd, SocketWaiter::kEventRead);
+    EXPECT_TRUE(waiter->hasFds());
+
+    EXPECT_EQ(1, waiter->wait(INT64_MAX));
+    EXPECT_EQ(SocketWaiter::kEventRead, waiter->pendingEventsFor(fd));
+    EXPECT_EQ(0U, waiter->pendingEventsFor(s1));
+
+    unsigned events = 0;
+    EXPECT_EQ(fd, waiter->nextPendingFd(&events));
+    EXPECT_EQ(SocketWaiter::kEventRead, events);
+    EXPECT_EQ(-1, waiter->nextPendingFd(&events));
+
+    waiter->update(fd, 0);
+    EXPECT_EQ(0, waiter->wait(0));
+    EXPECT_EQ(0U, waiter->pendingEventsFor(fd));
+
+    waiter->update(s1, 0);
+    EXPECT_FALSE(waiter->hasFds());
+
+    socketClose(s2);
+    socketClose(s1);
+    fclose(file);
+}
+#endif  // !_WIN32
 
 }  // namespace base
 }  // namespace android
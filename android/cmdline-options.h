@@ -86,6 +86,9 @@ OPT_FLAG ( no_snapshot_save, "do not auto-save to snapshot on exit: abandon chan
 OPT_FLAG ( no_snapshot_load, "do not auto-start from snapshot: perform a full boot" )
 OPT_FLAG ( snapshot_list,  "show a list of available snapshots" )
 OPT_FLAG ( no_snapshot_update_time, "do not do try to correct snapshot time on restore" )
+OPT_FLAG ( snapshot_compress, "compress RAM pages when saving snapshots" )
+OPT_FLAG ( snapshot_lazy_ram, "load snapshot RAM pages on demand, after the guest resumes" )
+OPT_FLAG ( snapshot_incremental, "only save the disk blocks modified since the last snapshot" )
 OPT_FLAG ( wipe_data, "reset the user data image (copy it from initdata)" )
 CFG_PARAM( avd, "<name>", "use a specific android virtual device" )
 CFG_PARAM( skindir, "<dir>", "search skins in <dir> (default <system>/skins)" )
@@ -2202,6 +2202,61 @@ static const CommandDefRec  snapshot_commands[] =
 
 
 
+/* Finding the hottest blocks takes time proportional to their count. */
+#define JIT_STATS_MAX_COUNT  1000
+
+static int do_jit_stats(ControlClient client, char* args) {
+    int hotCount = 10;
+
+    if (args != NULL) {
+        char* end;
+        long count = strtol(args, &end, 10);
+        if (end == args || *end != '\0' || count < 0 ||
+            count > JIT_STATS_MAX_COUNT) {
+            control_write(client,
+                          "KO: invalid block count, try 'avd jit stats [<count>]' "
+                          "with at most %d blocks\r\n", JIT_STATS_MAX_COUNT);
+            return -1;
+        }
+        hotCount = (int)count;
+    }
+
+    bool success =
+            vmopers(client)->jitStats(hotCount, client, control_write_out_cb);
+    return success ? 0 : -1;
+}
+
+static int do_jit_profile(ControlClient client, char* args) {
+    bool enable;
+
+    if (args != NULL && !strcmp(args, "on")) {
+        enable = true;
+    } else if (args != NULL && !strcmp(args, "off")) {
+        enable = false;
+    } else {
+        control_write(client,
+                      "KO: usage: 'avd jit profile on|off'\r\n");
+        return -1;
+    }
+    return vmopers(client)->jitSetProfiling(enable) ? 0 : -1;
+}
+
+static const CommandDefRec  jit_commands[] =
+{
+    { "stats", "show translated code statistics",
+    "'avd jit stats [<count>]' will show the state of the translated code cache, lookup and\r\n"
+    "translation counters, and the <count> most executed blocks (10 by default, 1000 at most)\r\n"
+    "when profiling is enabled\r\n",
+    NULL, do_jit_stats, NULL },
+
+    { "profile", "enable or disable block execution counts",
+    "'avd jit profile on|off' will start or stop counting the executions of each translated\r\n"
+    "block. This discards all translated code, and slows down execution while enabled\r\n",
+    NULL, do_jit_profile, NULL },
+
+    { NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
 /********************************************************************************************/
 /********************************************************************************************/
 /*****                                                                                 ******/
@@ -2267,6 +2322,10 @@ static const CommandDefRec  vm_commands[] =
     "allows you to save and restore the virtual device state in snapshots\r\n",
     NULL, NULL, snapshot_commands },
 
+    { "jit", "translated code statistics",
+    "allows you to inspect the dynamic translator while the virtual device runs\r\n",
+    NULL, NULL, jit_commands },
+
     { NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
@@ -44,6 +44,15 @@ typedef struct QAndroidVmOperations {
     bool (*snapshotDelete)(const char* name,
                            void* opaque,
                            LineConsumerCallback errConsumer);
+
+    // Translator statistics. |jitStats| reports the state of the translated
+    // code cache, followed by the |hotCount| most executed blocks when
+    // execution profiling is enabled with |jitSetProfiling|. Enabling or
+    // disabling it discards all translated code.
+    bool (*jitStats)(int hotCount,
+                     void* opaque,
+                     LineConsumerCallback outConsumer);
+    bool (*jitSetProfiling)(bool enable);
 } QAndroidVmOperations;
 
 ANDROID_END_HEADER
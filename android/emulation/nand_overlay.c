@@ -0,0 +1,171 @@
+// Copyright 2016 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/emulation/nand_overlay.h"
+
+#include "android/utils/eintr_wrapper.h"
+#include "android/utils/file_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+struct AndroidNandOverlay {
+    int base_fd;
+    uint32_t block_size;
+    uint32_t block_count;
+    // One byte per erase block, non-zero once copied to the disk image.
+    uint8_t* copied;
+    // Scratch buffer for one erase block.
+    uint8_t* buffer;
+};
+
+AndroidNandOverlay* android_nand_overlay_new(const char* base_path,
+                                             uint32_t block_size,
+                                             uint32_t block_count) {
+    AndroidNandOverlay* overlay = calloc(1, sizeof(*overlay));
+    if (!overlay) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    overlay->base_fd = -1;
+    overlay->block_size = block_size;
+    overlay->block_count = block_count;
+    overlay->copied = calloc(block_count ? block_count : 1, 1);
+    overlay->buffer = malloc(block_size);
+    if (!overlay->copied || !overlay->buffer) {
+        android_nand_overlay_free(overlay);
+        errno = ENOMEM;
+        return NULL;
+    }
+    overlay->base_fd = android_open(base_path, O_RDONLY | O_BINARY);
+    if (overlay->base_fd < 0) {
+        int err = errno;
+        android_nand_overlay_free(overlay);
+        errno = err;
+        return NULL;
+    }
+    return overlay;
+}
+
+void android_nand_overlay_free(AndroidNandOverlay* overlay) {
+    if (!overlay) {
+        return;
+    }
+    if (overlay->base_fd >= 0) {
+        close(overlay->base_fd);
+    }
+    free(overlay->copied);
+    free(overlay->buffer);
+    free(overlay);
+}
+
+int android_nand_overlay_base_fd(const AndroidNandOverlay* overlay) {
+    return overlay->base_fd;
+}
+
+bool android_nand_overlay_has_block(const AndroidNandOverlay* overlay,
+                                    uint32_t index) {
+    return index >= overlay->block_count || overlay->copied[index] != 0;
+}
+
+// Copy the erase block at |index| from the base image to |fd|. Anything
+// past the end of the base image is copied as erased (0xff) bytes.
+// Return 0 on success, or -errno on failure.
+static int overlay_copy_block(AndroidNandOverlay* overlay,
+                              int fd,
+                              uint32_t index) {
+    off_t offset = (off_t)index * overlay->block_size;
+    int ret;
+
+    if (HANDLE_EINTR(lseek(overlay->base_fd, offset, SEEK_SET)) == -1) {
+        return -errno;
+    }
+    ret = HANDLE_EINTR(read(overlay->base_fd, overlay->buffer,
+                            overlay->block_size));
+    if (ret < 0) {
+        return -errno;
+    }
+    if ((uint32_t)ret < overlay->block_size) {
+        memset(overlay->buffer + ret, 0xff, overlay->block_size - ret);
+    }
+
+    if (HANDLE_EINTR(lseek(fd, offset, SEEK_SET)) == -1) {
+        return -errno;
+    }
+    ret = HANDLE_EINTR(write(fd, overlay->buffer, overlay->block_size));
+    if (ret < 0) {
+        return -errno;
+    }
+    return ((uint32_t)ret == overlay->block_size) ? 0 : -EIO;
+}
+
+int android_nand_overlay_fill(AndroidNandOverlay* overlay,
+                              int fd,
+                              uint64_t addr,
+                              uint64_t len,
+                              bool preserve) {
+    uint64_t index, last;
+
+    if (!len) {
+        return 0;
+    }
+    last = (addr + len - 1) / overlay->block_size;
+    for (index = addr / overlay->block_size;
+         index <= last && index < overlay->block_count; index++) {
+        uint64_t start = index * overlay->block_size;
+
+        if (overlay->copied[index]) {
+            continue;
+        }
+        if (preserve || addr > start ||
+            addr + len < start + overlay->block_size) {
+            int ret = overlay_copy_block(overlay, fd, (uint32_t)index);
+            if (ret) {
+                return ret;
+            }
+        }
+        overlay->copied[index] = 1;
+    }
+    return 0;
+}
+
+int android_nand_overlay_merge(AndroidNandOverlay* overlay, int fd) {
+    off_t base_size = HANDLE_EINTR(lseek(overlay->base_fd, 0, SEEK_END));
+    uint32_t index;
+
+    if (base_size == -1) {
+        return -errno;
+    }
+    // Blocks past the end of the base image read as erased from either
+    // file, and don't need to be copied.
+    for (index = 0; index < overlay->block_count &&
+                    (off_t)index * overlay->block_size < base_size;
+         index++) {
+        if (!overlay->copied[index]) {
+            int ret = overlay_copy_block(overlay, fd, index);
+            if (ret) {
+                return ret;
+            }
+            overlay->copied[index] = 1;
+        }
+    }
+    return 0;
+}
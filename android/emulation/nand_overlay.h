@@ -0,0 +1,63 @@
+// Copyright 2016 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/utils/compiler.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+// A copy-on-write overlay for an emulated NAND disk. The disk image file
+// starts empty, and each erase block is copied into it from a read-only
+// base image right before its first modification. Blocks that were not
+// copied yet must be read from the base image instead.
+typedef struct AndroidNandOverlay AndroidNandOverlay;
+
+// Create a new overlay for a disk of |block_count| erase blocks of
+// |block_size| bytes each, on top of the base image at |base_path|.
+// Return NULL on failure, with errno set.
+AndroidNandOverlay* android_nand_overlay_new(const char* base_path,
+                                             uint32_t block_size,
+                                             uint32_t block_count);
+
+// Close the base image and release |overlay|. Blocks that were not copied
+// yet are lost, call android_nand_overlay_merge() first to keep them.
+void android_nand_overlay_free(AndroidNandOverlay* overlay);
+
+// Return the file descriptor of the base image.
+int android_nand_overlay_base_fd(const AndroidNandOverlay* overlay);
+
+// Return true if the erase block at |index| was copied to the disk image,
+// or is past the end of the disk, and must be read from the disk image.
+// Return false if it must be read from the base image.
+bool android_nand_overlay_has_block(const AndroidNandOverlay* overlay,
+                                    uint32_t index);
+
+// Call this before the range [addr, addr + len) of the disk image at |fd|
+// is modified. Copies each erase block that is still only in the base image
+// to |fd|. Blocks that are entirely inside the range are about to be
+// overwritten, and are only copied if |preserve| is true.
+// Return 0 on success, or -errno on failure.
+int android_nand_overlay_fill(AndroidNandOverlay* overlay,
+                              int fd,
+                              uint64_t addr,
+                              uint64_t len,
+                              bool preserve);
+
+// Copy all the blocks that are still only in the base image to the disk
+// image at |fd|, which then holds the whole disk contents.
+// Return 0 on success, or -errno on failure.
+int android_nand_overlay_merge(AndroidNandOverlay* overlay, int fd);
+
+ANDROID_END_HEADER
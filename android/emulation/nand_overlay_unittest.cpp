@@ -0,0 +1,140 @@
+// Copyright 2016 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/emulation/nand_overlay.h"
+
+#include "android/base/String.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+
+using android::base::String;
+using android::base::TestTempDir;
+
+namespace {
+
+const uint32_t kBlockSize = 1024;
+const uint32_t kBlockCount = 4;
+
+// A base image with a different fill byte in each block, and a disk image
+// that starts empty, as set up for temporary partitions.
+class NandOverlayTest : public testing::Test {
+protected:
+    NandOverlayTest() : mTempDir("nand_overlay") {}
+
+    virtual void SetUp() override {
+        ASSERT_TRUE(mTempDir.path());
+        mBasePath = mTempDir.makeSubPath("base.img");
+        mDiskPath = mTempDir.makeSubPath("disk.img");
+
+        std::string base;
+        for (uint32_t n = 0; n < kBlockCount; ++n) {
+            base.append(kBlockSize, 'a' + n);
+        }
+        FILE* file = fopen(mBasePath.c_str(), "wb");
+        ASSERT_TRUE(file);
+        ASSERT_EQ(base.size(), fwrite(base.data(), 1, base.size(), file));
+        fclose(file);
+
+        mDiskFd = open(mDiskPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        ASSERT_GE(mDiskFd, 0);
+        mOverlay = android_nand_overlay_new(mBasePath.c_str(), kBlockSize,
+                                            kBlockCount);
+        ASSERT_TRUE(mOverlay);
+    }
+
+    virtual void TearDown() override {
+        android_nand_overlay_free(mOverlay);
+        if (mDiskFd >= 0) {
+            close(mDiskFd);
+        }
+    }
+
+    // Write |len| bytes of |c| at |offset| of the disk image, like the
+    // NAND device does after calling android_nand_overlay_fill().
+    void writeDisk(uint64_t offset, size_t len, char c) {
+        std::string data(len, c);
+        ASSERT_EQ(0, android_nand_overlay_fill(mOverlay, mDiskFd, offset, len,
+                                               false));
+        ASSERT_EQ((ssize_t)len,
+                  pwrite(mDiskFd, data.data(), data.size(), offset));
+    }
+
+    std::string readDisk() {
+        std::string data(kBlockSize * kBlockCount, '\0');
+        ssize_t ret = pread(mDiskFd, &data[0], data.size(), 0);
+        data.resize(ret > 0 ? ret : 0);
+        return data;
+    }
+
+    TestTempDir mTempDir;
+    String mBasePath;
+    String mDiskPath;
+    int mDiskFd = -1;
+    AndroidNandOverlay* mOverlay = nullptr;
+};
+
+}  // namespace
+
+TEST_F(NandOverlayTest, FillCopiesPartialBlocksOnly) {
+    // Overwrite block 1 entirely, and the start of block 2.
+    writeDisk(kBlockSize, kBlockSize + 10, 'X');
+
+    EXPECT_FALSE(android_nand_overlay_has_block(mOverlay, 0));
+    EXPECT_TRUE(android_nand_overlay_has_block(mOverlay, 1));
+    EXPECT_TRUE(android_nand_overlay_has_block(mOverlay, 2));
+    EXPECT_FALSE(android_nand_overlay_has_block(mOverlay, 3));
+    EXPECT_TRUE(android_nand_overlay_has_block(mOverlay, kBlockCount));
+
+    // Block 0 was never copied, block 2 was copied before being modified.
+    std::string expected(kBlockSize, '\0');
+    expected.append(kBlockSize + 10, 'X');
+    expected.append(kBlockSize - 10, 'c');
+    EXPECT_EQ(expected, readDisk().substr(0, expected.size()));
+}
+
+TEST_F(NandOverlayTest, FillPreserve) {
+    ASSERT_EQ(0, android_nand_overlay_fill(mOverlay, mDiskFd, 0, kBlockSize,
+                                           true));
+    EXPECT_EQ(std::string(kBlockSize, 'a'), readDisk());
+}
+
+TEST_F(NandOverlayTest, MergeBeforeSnapshot) {
+    // This is what happens when saving a snapshot: everything the guest
+    // didn't write yet must end up in the disk image.
+    writeDisk(kBlockSize, kBlockSize, 'X');
+    writeDisk(2 * kBlockSize + 100, 10, 'Y');
+
+    ASSERT_EQ(0, android_nand_overlay_merge(mOverlay, mDiskFd));
+    for (uint32_t n = 0; n < kBlockCount; ++n) {
+        EXPECT_TRUE(android_nand_overlay_has_block(mOverlay, n));
+    }
+
+    std::string expected(kBlockSize, 'a');
+    expected.append(kBlockSize, 'X');
+    expected.append(100, 'c');
+    expected.append(10, 'Y');
+    expected.append(kBlockSize - 110, 'c');
+    expected.append(kBlockSize, 'd');
+    EXPECT_EQ(expected, readDisk());
+}
+
+TEST_F(NandOverlayTest, MissingBase) {
+    String path = mTempDir.makeSubPath("missing.img");
+    EXPECT_FALSE(android_nand_overlay_new(path.c_str(), kBlockSize,
+                                          kBlockCount));
+}
@@ -47,6 +47,7 @@ const QAndroidUserEventAgent* user_event_agent;
 static bool s_use_emugl_subwindow = 1;
 
 static void emulator_window_refresh(EmulatorWindow* emulator);
+static void emulator_window_check_updates(EmulatorWindow* emulator);
 extern void qemu_system_shutdown_request(void);
 
 static void write_window_name(char* buff,
@@ -115,7 +116,7 @@ static bool emulator_window_network_toggle(void) {
 
 static void emulator_window_framebuffer_invalidate(void) {
     qframebuffer_invalidate_all();
-    qframebuffer_check_updates();
+    emulator_window_check_updates(qemulator);
 }
 
 static void emulator_window_keyboard_event(void* opaque, SkinKeyCode keycode, int down) {
@@ -284,7 +285,16 @@ emulator_window_fb_update( void*   _emulator, int  x, int  y, int  w, int  h )
     }
 
     if (!s_use_emugl_subwindow) {
-        skin_ui_update_display(emulator->ui, x, y, w, h);
+        if (emulator->fb_batching) {
+            SkinRect  r;
+            r.pos.x  = x;
+            r.pos.y  = y;
+            r.size.w = w;
+            r.size.h = h;
+            skin_region_union_rect(emulator->fb_dirty, &r);
+        } else {
+            skin_ui_update_display(emulator->ui, x, y, w, h);
+        }
     }
 }
 
@@ -364,6 +374,8 @@ emulator_window_init(
     }
 
     emulator->ui = NULL;
+    skin_region_init_empty(emulator->fb_dirty);
+    emulator->fb_batching = false;
     emulator->win_x = x;
     emulator->win_y = y;
     *(emulator->opts) = *opts;
@@ -403,6 +415,7 @@ emulator_window_done(EmulatorWindow* emulator)
         skin_file_free(emulator->layout_file);
         emulator->layout_file = NULL;
     }
+    skin_region_reset(emulator->fb_dirty);
 }
 
 QFrameBuffer*
@@ -418,12 +431,29 @@ emulator_window_get_first_framebuffer(EmulatorWindow* emulator)
     return NULL;
 }
 
+/* check the framebuffers for changes. The producers can report several
+ * rectangles per framebuffer, so collect them into a region first, to
+ * redraw each changed pixel once and nothing between the rectangles. */
+static void emulator_window_check_updates(EmulatorWindow* emulator)
+{
+    emulator->fb_batching = true;
+    qframebuffer_check_updates();
+    emulator->fb_batching = false;
+
+    if (!skin_region_is_empty(emulator->fb_dirty)) {
+        if (emulator->ui) {
+            skin_ui_update_display_region(emulator->ui, emulator->fb_dirty);
+        }
+        skin_region_reset(emulator->fb_dirty);
+    }
+}
+
 /* called periodically to poll for user input events */
 static void emulator_window_refresh(EmulatorWindow* emulator)
 {
    /* this will eventually call sdl_update if the content of the VGA framebuffer
     * has changed */
-    qframebuffer_check_updates();
+    emulator_window_check_updates(emulator);
 
     if (emulator->ui) {
         if (skin_ui_process_events(emulator->ui)) {
@@ -16,6 +16,7 @@
 #include "android/framebuffer.h"
 #include "android/skin/file.h"
 #include "android/skin/keyboard.h"
+#include "android/skin/region.h"
 #include "android/skin/window.h"
 #include "android/utils/aconfig-file.h"
 
@@ -34,6 +35,10 @@ typedef struct {
     SkinRotation   onion_rotation;
     int            onion_alpha;
 
+    /* framebuffer updates accumulated during emulator_window_refresh() */
+    SkinRegion     fb_dirty[1];
+    bool           fb_batching;
+
     AndroidOptions opts[1];  /* copy of options */
     UiEmuAgent     uiEmuAgent[1];
 } EmulatorWindow;
@@ -27,6 +27,7 @@ typedef struct {
     char** error_message;
     AndroidPartitionSetupFunction setup_func;
     void* setup_opaque;
+    bool copy_on_write;
     PartitionConfigBackend* backend;
 } PartitionConfigState;
 
@@ -119,7 +120,9 @@ typedef enum {
 //
 // If |part_init_file| is not NULL, its content will be used to erase
 // the content of the main partition image. This is automatically handled
-// by the NAND code though.
+// by the NAND code though. For temporary partition images, and if the setup
+// function supports it, |part_init_file| is passed to it instead of being
+// copied, and the image is read from it until it is modified.
 //
 // If |readonly| is true, then either the |part_file| or |part_init_file| will
 // be mounted as read-only devices. This also prevents locking the partition
@@ -236,6 +239,10 @@ static bool addNandImage(PartitionConfigState* state,
     // Must be here to avoid freeing the string too early.
     std::string tempFile;
 
+    // Initial image passed to the setup function, only for copy-on-write
+    // temporary partitions.
+    const char* overlay_base = NULL;
+
     if (readonly) {
         if (!state->backend->pathExists(part_file)) {
             return partition_config_error(
@@ -287,6 +294,17 @@ static bool addNandImage(PartitionConfigState* state,
                           part_file);
 
             need_make_empty = true;
+
+            // A temporary image is thrown away on exit, so there is no point
+            // in copying its initial content: read it from the initial
+            // image until each block is written to.
+            if (part_init_file && state->copy_on_write) {
+                VERBOSE_PRINT(init, "Using %s as base of '%s' partition image",
+                              part_init_file, part_name);
+                overlay_base = part_init_file;
+                part_init_file = NULL;
+                need_make_empty = false;
+            }
         }
 
         // Do we need to copy the initial partition file into the real one?
@@ -316,7 +334,7 @@ static bool addNandImage(PartitionConfigState* state,
     }
 
     (*state->setup_func)(state->setup_opaque, part_name, part_size, part_file,
-                         part_type, readonly);
+                         overlay_base, part_type, readonly);
 
     return true;
 }
@@ -331,6 +349,7 @@ bool android_partition_configuration_setup(
             .error_message = error_message,
             .setup_func = setup_func,
             .setup_opaque = setup_opaque,
+            .copy_on_write = config->copy_on_write,
             .backend = PartitionConfigBackend::get(),
     }};
 
@@ -25,12 +25,17 @@ ANDROID_BEGIN_HEADER
 // |name| is the partition's name (e.g. 'system', 'userdata' or 'cache')
 // |size| is its size in bytes.
 // |path| is the file path for the partition image.
+// |init_path| is NULL, unless the configuration's |copy_on_write| flag is
+// set and |path| is a new, empty temporary file. In this case, it is the
+// path of the initial partition image, which must be read for all blocks
+// that were not written to |path| yet.
 // |format| is the partition's type.
 // |readonly| is true to indicate that the image is read-only.
 typedef void (*AndroidPartitionSetupFunction)(void* opaque,
                                               const char* name,
                                               uint64_t size,
                                               const char* path,
+                                              const char* init_path,
                                               AndroidPartitionType format,
                                               bool readonly);
 
@@ -62,6 +67,9 @@ typedef struct {
 // be wiped.
 // |writable_system| can be true to indicate that a writable system partition
 // is desired. This may create a temporary copy of the system partition image.
+// |copy_on_write| can be true to indicate that the setup function supports
+// its |init_path| parameter. Temporary partition images are then left empty
+// instead of receiving a copy of their initial image.
 typedef struct {
     const char* ramdisk_path;
     const char* fstab_name;
@@ -71,6 +79,7 @@ typedef struct {
     bool kernel_supports_yaffs2;
     bool wipe_data;
     bool writable_system;
+    bool copy_on_write;
 } AndroidPartitionConfiguration;
 
 // Setup emulated NAND partition according to misc configuration parameters:
@@ -187,6 +187,7 @@ public:
         std::string path;
         AndroidPartitionType format;
         bool readonly;
+        std::string init_path;
     };
 
     // All virtual partitions, as a simple public vector.
@@ -199,6 +200,7 @@ public:
                                const char* name,
                                uint64_t size,
                                const char* path,
+                               const char* init_path,
                                AndroidPartitionType format,
                                bool readonly) {
         auto collector = static_cast<PartitionCollector*>(opaque);
@@ -209,6 +211,7 @@ public:
         part.path = path;
         part.format = format;
         part.readonly = readonly;
+        part.init_path = init_path ? init_path : "";
 
         collector->partitions.push_back(part);
     }
@@ -249,6 +252,7 @@ static void checkConfig(const AndroidPartitionConfiguration* config,
             EXPECT_EQ(expected.path, partitions[n].path) << "#" << n;
             EXPECT_EQ(expected.format, partitions[n].format);
             EXPECT_EQ(expected.readonly, partitions[n].readonly);
+            EXPECT_EQ(expected.init_path, partitions[n].init_path) << "#" << n;
         }
     }
 
@@ -570,6 +574,112 @@ TEST(PartitionConfig, LockedFiles) {
                 kExpectedPartitionsSize);
 }
 
+TEST(PartitionConfig, copyOnWriteWritableSystem) {
+    AndroidPartitionConfiguration config = {
+            .ramdisk_path = "/foo/ramdisk.img",
+            .fstab_name = "fstab.unittest",
+            .system_partition =
+                    {
+                            .size = 123456ULL,
+                            .path = nullptr,
+                            .init_path = "/images/system.img",
+                    },
+            .data_partition =
+                    {
+                            .size = 400000ULL,
+                            .path = "/avd/userdata-qemu.img",
+                            .init_path = "/images/userdata.img",
+                    },
+            .cache_partition =
+                    {
+                            .size = 100000ULL,
+                            .path = "/avd/cache.img",
+                            .init_path = nullptr,
+                    },
+            .kernel_supports_yaffs2 = false,
+            .wipe_data = true,
+            .writable_system = true,
+            .copy_on_write = true,
+    };
+
+    // The temporary system image is not initialized, but persistent
+    // images are still copied.
+    static const char kExpectedCommands[] =
+            "TEMPFILE [/tmp/tempfile1]\n"
+            "LOCK [/avd/userdata-qemu.img]\n"
+            "COPY [/avd/userdata-qemu.img] <- [/images/userdata.img]\n"
+            "EXT4_RESIZE size=400000 [/avd/userdata-qemu.img]\n"
+            "LOCK [/avd/cache.img]\n"
+            "EMPTY_PARTITION format=ext4 size=100000 [/avd/cache.img]\n";
+
+    static const Partition kExpectedPartitions[3] = {
+            {"system", 123456ULL, "/tmp/tempfile1", ANDROID_PARTITION_TYPE_EXT4,
+             false, "/images/system.img"},
+            {"userdata", 400000ULL, "/avd/userdata-qemu.img",
+             ANDROID_PARTITION_TYPE_EXT4, false},
+            {"cache", 100000ULL, "/avd/cache.img", ANDROID_PARTITION_TYPE_EXT4,
+             false},
+    };
+
+    const size_t kExpectedPartitionsSize = ARRAY_SIZE(kExpectedPartitions);
+
+    checkConfig(&config, kExpectedCommands, kExpectedPartitions,
+                kExpectedPartitionsSize);
+}
+
+TEST(PartitionConfig, copyOnWriteLockedFiles) {
+    static const char kLockedDataFile[] = CANNOT_LOCK_PREFIX "_data";
+    static const char kLockedSystemFile[] = CANNOT_LOCK_PREFIX "_system";
+    static const char kLockedCacheFile[] = CANNOT_LOCK_PREFIX "_cache";
+
+    AndroidPartitionConfiguration config = {
+            .ramdisk_path = "/foo/ramdisk.img",
+            .fstab_name = "fstab.unittest",
+            .system_partition =
+                    {
+                            .size = 123456ULL,
+                            .path = kLockedSystemFile,
+                            .init_path = "/images/system.img",
+                    },
+            .data_partition =
+                    {
+                            .size = 400000ULL,
+                            .path = kLockedDataFile,
+                            .init_path = "/images/userdata.img",
+                    },
+            .cache_partition =
+                    {
+                            .size = 100000ULL,
+                            .path = kLockedCacheFile,
+                            .init_path = nullptr,
+                    },
+            .kernel_supports_yaffs2 = false,
+            .wipe_data = false,
+            .writable_system = true,
+            .copy_on_write = true,
+    };
+
+    static const char kExpectedCommands[] =
+            "TEMPFILE [/tmp/tempfile1]\n"
+            "TEMPFILE [/tmp/tempfile2]\n"
+            "TEMPFILE [/tmp/tempfile3]\n"
+            "EMPTY_PARTITION format=ext4 size=100000 [/tmp/tempfile3]\n";
+
+    static const Partition kExpectedPartitions[3] = {
+            {"system", 123456ULL, "/tmp/tempfile1", ANDROID_PARTITION_TYPE_EXT4,
+             false, "/images/system.img"},
+            {"userdata", 400000ULL, "/tmp/tempfile2",
+             ANDROID_PARTITION_TYPE_EXT4, false, "/images/userdata.img"},
+            {"cache", 100000ULL, "/tmp/tempfile3", ANDROID_PARTITION_TYPE_EXT4,
+             false},
+    };
+
+    const size_t kExpectedPartitionsSize = ARRAY_SIZE(kExpectedPartitions);
+
+    checkConfig(&config, kExpectedCommands, kExpectedPartitions,
+                kExpectedPartitionsSize);
+}
+
 TEST(PartitionConfig, MissingDataPartition) {
     static const char kMissingDataFile[] = DOESNT_EXIST_PREFIX "_data";
 
@@ -757,6 +757,48 @@ help_no_snapshot_update_time(stralloc_t*  out)
     );
 }
 
+static void
+help_snapshot_compress(stralloc_t*  out)
+{
+    PRINTF(
+    "  Compress the RAM pages saved to the snapshot storage. This makes\n"
+    "  snapshots noticeably smaller, and faster to load from slow disks,\n"
+    "  at the cost of some CPU time. Snapshots saved with this option\n"
+    "  can't be loaded by older emulator binaries.\n\n"
+    );
+}
+
+static void
+help_snapshot_lazy_ram(stralloc_t*  out)
+{
+    PRINTF(
+    "  Save the RAM pages to the snapshot storage in a layout that lets\n"
+    "  them be read on demand, and resume the guest before its RAM has\n"
+    "  been read when loading such a snapshot. The remaining pages are\n"
+    "  read when first accessed, or in the background. This requires a\n"
+    "  Linux host that supports userfaultfd; elsewhere, the pages are\n"
+    "  read before the guest resumes as usual. This option can't be\n"
+    "  combined with -snapshot-compress, and compressed pages of\n"
+    "  existing snapshots are always read before the guest resumes.\n"
+    "  Snapshots saved with this option can't be loaded by older\n"
+    "  emulator binaries.\n\n"
+    );
+}
+
+static void
+help_snapshot_incremental(stralloc_t*  out)
+{
+    PRINTF(
+    "  Keep track of the writable disk blocks modified since the last\n"
+    "  snapshot was saved or loaded, and only save these blocks to the\n"
+    "  snapshot storage when saving over that same snapshot. A later\n"
+    "  emulator run can only load such a snapshot if the disk images were\n"
+    "  not modified since it was saved, which is the case when it was\n"
+    "  saved on exit. Snapshots saved with this option can't be loaded by\n"
+    "  older emulator binaries.\n\n"
+    );
+}
+
 static void
 help_snapshot_list(stralloc_t*  out)
 {
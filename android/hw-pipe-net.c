@@ -549,6 +549,214 @@ static const AndroidPipeFuncs  netPipeUnix_funcs = {
 };
 #endif
 
+/**********************************************************************
+ **********************************************************************
+ *****
+ *****  I N - P R O C E S S   O P E N G L E S   P I P E S
+ *****
+ *****/
+
+/* A RingPipe connects the guest to an in-process GLES channel, which
+ * avoids the socket round-trip of a NetPipe: commands are copied once, into
+ * a ring buffer from which the renderer decodes them directly.
+ *
+ * The channel's wake function can be called from a render thread, so it
+ * only writes a byte to a socket pair, whose other end is watched by the
+ * main loop. The corresponding handler then wakes up or closes the guest
+ * pipe, since this can't be done from another thread.
+ */
+typedef struct {
+    void*    hwpipe;
+    void*    channel;
+    int      wakeWanted;
+    int      wakeFd;
+    LoopIo*  io;
+} RingPipe;
+
+static void
+ringPipe_free( RingPipe*  pipe )
+{
+    int  fd;
+
+    if (pipe->channel) {
+        android_gles_channel_close(pipe->channel);
+    }
+    if (pipe->io) {
+        fd = loopIo_fd(pipe->io);
+        loopIo_free(pipe->io);
+        socket_close(fd);
+    }
+    if (pipe->wakeFd >= 0) {
+        socket_close(pipe->wakeFd);
+    }
+    AFREE(pipe);
+}
+
+/* Called by the channel, from any thread. */
+static void
+ringPipe_wake_func( void* opaque, int flags )
+{
+    RingPipe*  pipe = opaque;
+    char       dummy = 0;
+
+    DD("%s: flags=%d", __FUNCTION__, flags);
+
+    /* If the socket buffer is full, a wake-up is already pending. */
+    socket_send(pipe->wakeFd, &dummy, 1);
+}
+
+static void
+ringPipe_io_func( void* opaque, int fd, unsigned events )
+{
+    RingPipe*  pipe = opaque;
+    char       buf[64];
+    int        flags, wakeFlags = 0;
+
+    /* Drain the socket, the channel state is polled below anyway. */
+    while (socket_recv(fd, buf, sizeof(buf)) > 0) {
+    }
+
+    if (pipe->hwpipe == NULL) {
+        return;
+    }
+
+    flags = android_gles_channel_poll(pipe->channel);
+    if ((flags & ANDROID_GLES_CHANNEL_CLOSED) != 0) {
+        /* The renderer closed the channel. If the guest is blocked waiting
+         * for a wake signal, it will receive an error. */
+        android_pipe_close(pipe->hwpipe);
+        pipe->hwpipe = NULL;
+        return;
+    }
+
+    if ((flags & ANDROID_GLES_CHANNEL_CAN_READ) != 0) {
+        wakeFlags |= pipe->wakeWanted & PIPE_WAKE_READ;
+    }
+    if ((flags & ANDROID_GLES_CHANNEL_CAN_WRITE) != 0) {
+        wakeFlags |= pipe->wakeWanted & PIPE_WAKE_WRITE;
+    }
+    if (wakeFlags != 0) {
+        android_pipe_wake(pipe->hwpipe, wakeFlags);
+        pipe->wakeWanted &= ~wakeFlags;
+    }
+}
+
+static RingPipe*
+ringPipe_init( void* hwpipe, Looper* looper )
+{
+    RingPipe*  pipe;
+    int        fds[2];
+
+    if (socket_pair(&fds[0], &fds[1]) < 0) {
+        D("%s: Could not create socket pair: %s", __FUNCTION__, errno_str);
+        return NULL;
+    }
+    socket_set_nonblock(fds[0]);
+    socket_set_nonblock(fds[1]);
+
+    ANEW0(pipe);
+    pipe->hwpipe = hwpipe;
+    pipe->wakeFd = fds[0];
+    pipe->io     = loopIo_new(looper, fds[1], ringPipe_io_func, pipe);
+    loopIo_wantRead(pipe->io);
+
+    pipe->channel = android_gles_channel_open(ringPipe_wake_func, pipe);
+    if (pipe->channel == NULL) {
+        ringPipe_free(pipe);
+        return NULL;
+    }
+    return pipe;
+}
+
+static int
+ringPipe_sendBuffers( RingPipe* pipe, const AndroidPipeBuffer* buffers, int numBuffers )
+{
+    const AndroidPipeBuffer* buff = buffers;
+    const AndroidPipeBuffer* buffEnd = buff + numBuffers;
+    int  ret = 0;
+
+    if (pipe->hwpipe == NULL) {
+        return PIPE_ERROR_IO;
+    }
+
+    for (; buff < buffEnd; buff++) {
+        int  len = android_gles_channel_write(pipe->channel, buff->data, buff->size);
+        if (len < 0) {
+            return (ret > 0) ? ret : PIPE_ERROR_IO;
+        }
+        ret += len;
+        if ((size_t)len < buff->size) {
+            break;
+        }
+    }
+    return (ret > 0) ? ret : PIPE_ERROR_AGAIN;
+}
+
+static int
+ringPipe_recvBuffers( RingPipe* pipe, AndroidPipeBuffer* buffers, int numBuffers )
+{
+    AndroidPipeBuffer* buff = buffers;
+    AndroidPipeBuffer* buffEnd = buff + numBuffers;
+    int  ret = 0;
+
+    for (; buff < buffEnd; buff++) {
+        int  len = android_gles_channel_read(pipe->channel, buff->data, buff->size);
+        if (len < 0) {
+            return (ret > 0) ? ret : PIPE_ERROR_IO;
+        }
+        ret += len;
+        if ((size_t)len < buff->size) {
+            break;
+        }
+    }
+    return (ret > 0) ? ret : PIPE_ERROR_AGAIN;
+}
+
+static unsigned
+ringPipe_poll( RingPipe* pipe )
+{
+    int       flags = android_gles_channel_poll(pipe->channel);
+    unsigned  ret   = 0;
+
+    if (flags & ANDROID_GLES_CHANNEL_CAN_READ)
+        ret |= PIPE_POLL_IN;
+    if (flags & ANDROID_GLES_CHANNEL_CAN_WRITE)
+        ret |= PIPE_POLL_OUT;
+    if (flags & ANDROID_GLES_CHANNEL_CLOSED)
+        ret |= PIPE_POLL_HUP;
+
+    return ret;
+}
+
+static void
+ringPipe_wakeOn( RingPipe* pipe, int flags )
+{
+    int  channelFlags = 0;
+
+    DD("%s: flags=%d", __FUNCTION__, flags);
+
+    pipe->wakeWanted |= flags;
+    if (flags & PIPE_WAKE_READ)
+        channelFlags |= ANDROID_GLES_CHANNEL_CAN_READ;
+    if (flags & PIPE_WAKE_WRITE)
+        channelFlags |= ANDROID_GLES_CHANNEL_CAN_WRITE;
+    android_gles_channel_wake_on(pipe->channel, channelFlags);
+}
+
+/**********************************************************************
+ **********************************************************************
+ *****
+ *****  O P E N G L E S   P I P E S
+ *****
+ *****/
+
+/* An OpenGLES pipe uses an in-process channel when the renderer provides
+ * one, and a NetPipe connected to the renderer's socket otherwise. */
+typedef struct {
+    NetPipe*   net;
+    RingPipe*  ring;
+} OpenglesPipe;
+
 /* This is set to 1 in android_init_opengles() below, and tested
  * by openglesPipe_init() to refuse a pipe connection if the function
  * was never called.
@@ -568,10 +776,21 @@ openglesPipe_init( void* hwpipe, void* _looper, const char* args )
     }
 
     // for qemu1, _looper and looper_getForThread() is the same, i.e.,
-    // the looper of main_thread;
+    // the looper of main_thread, which the vCPU thread shares when
+    // -vcpu-thread is used;
     // for qemu2, _looper is the looper of main thread; however,
     // looper_getForThread() belongs to vcpu
     void* thread_looper = looper_getForThread();
+
+    RingPipe* ring = ringPipe_init(hwpipe, thread_looper);
+    if (ring != NULL) {
+        OpenglesPipe* gles;
+        D("Creating in-process OpenGLES pipe for GPU emulation");
+        ANEW0(gles);
+        gles->ring = ring;
+        return gles;
+    }
+
     char server_addr[PATH_MAX];
     android_gles_server_path(server_addr, sizeof(server_addr));
 #ifndef _WIN32
@@ -613,16 +832,81 @@ openglesPipe_init( void* hwpipe, void* _looper, const char* args )
 #endif /* !_WIN32 */
     }
 
-    return pipe;
+    if (pipe == NULL) {
+        return NULL;
+    }
+
+    OpenglesPipe* gles;
+    ANEW0(gles);
+    gles->net = pipe;
+    return gles;
+}
+
+static void
+openglesPipe_closeFromGuest( void* opaque )
+{
+    OpenglesPipe*  gles = opaque;
+
+    if (gles->ring) {
+        ringPipe_free(gles->ring);
+    } else {
+        netPipe_closeFromGuest(gles->net);
+    }
+    AFREE(gles);
+}
+
+static int
+openglesPipe_sendBuffers( void* opaque, const AndroidPipeBuffer* buffers, int numBuffers )
+{
+    OpenglesPipe*  gles = opaque;
+
+    if (gles->ring) {
+        return ringPipe_sendBuffers(gles->ring, buffers, numBuffers);
+    }
+    return netPipe_sendBuffers(gles->net, buffers, numBuffers);
+}
+
+static int
+openglesPipe_recvBuffers( void* opaque, AndroidPipeBuffer* buffers, int numBuffers )
+{
+    OpenglesPipe*  gles = opaque;
+
+    if (gles->ring) {
+        return ringPipe_recvBuffers(gles->ring, buffers, numBuffers);
+    }
+    return netPipe_recvBuffers(gles->net, buffers, numBuffers);
+}
+
+static unsigned
+openglesPipe_poll( void* opaque )
+{
+    OpenglesPipe*  gles = opaque;
+
+    if (gles->ring) {
+        return ringPipe_poll(gles->ring);
+    }
+    return netPipe_poll(gles->net);
+}
+
+static void
+openglesPipe_wakeOn( void* opaque, int flags )
+{
+    OpenglesPipe*  gles = opaque;
+
+    if (gles->ring) {
+        ringPipe_wakeOn(gles->ring, flags);
+    } else {
+        netPipe_wakeOn(gles->net, flags);
+    }
 }
 
 static const AndroidPipeFuncs  openglesPipe_funcs = {
     openglesPipe_init,
-    netPipe_closeFromGuest,
-    netPipe_sendBuffers,
-    netPipe_recvBuffers,
-    netPipe_poll,
-    netPipe_wakeOn,
+    openglesPipe_closeFromGuest,
+    openglesPipe_sendBuffers,
+    openglesPipe_recvBuffers,
+    openglesPipe_poll,
+    openglesPipe_wakeOn,
     NULL,  /* we can't save these */
     NULL,  /* we can't load these */
 };
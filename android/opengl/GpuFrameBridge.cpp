@@ -18,7 +18,6 @@
 #include "android/base/Log.h"
 #include "android/base/synchronization/Lock.h"
 #include "android/base/sockets/SocketUtils.h"
-#include "android/base/synchronization/MessageChannel.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -30,30 +29,48 @@
 namespace android {
 namespace opengl {
 
+using android::base::AutoLock;
+using android::base::Lock;
 using android::base::Looper;
-using android::base::MessageChannel;
 
 namespace {
 
 // A small structure to model a single frame of the GPU display,
-// as passed between the EmuGL and main loop thread.
+// as passed between the EmuGL and main loop thread. Its pixel buffer
+// is only reallocated when a larger frame comes in.
 struct Frame {
     int width;
     int height;
     void* pixels;
+    size_t capacity;
 
-    Frame(int w, int h, const void* pixels) :
-            width(w), height(h), pixels(NULL) {
-        this->pixels = ::calloc(w * 4, h);
-        ::memcpy(this->pixels, pixels, w * 4 * h);
-    }
+    Frame() : width(0), height(0), pixels(NULL), capacity(0) {}
 
     ~Frame() {
         ::free(pixels);
     }
+
+    void set(int w, int h, const void* newPixels) {
+        size_t size = (size_t)w * 4 * h;
+        if (size > capacity) {
+            ::free(pixels);
+            pixels = ::malloc(size);
+            capacity = size;
+        }
+        width = w;
+        height = h;
+        ::memcpy(pixels, newPixels, size);
+    }
 };
 
 // Real implementation of GpuFrameBridge interface.
+//
+// Frames go through three buffers: the EmuGL thread writes to the back one,
+// the looper thread reads from the front one, and the pending one holds the
+// latest complete frame in between. Each side swaps its buffer with the
+// pending one under |mLock|, so a new frame simply replaces one that the
+// looper thread didn't get to yet, and nothing is ever allocated or copied
+// again once the buffers have grown to the frame size.
 class Bridge : public GpuFrameBridge {
 public:
     // Constructor.
@@ -63,7 +80,11 @@ public:
             mInSocket(-1),
             mOutSocket(-1),
             mFdWatch(NULL),
-            mFrames(),
+            mLock(),
+            mBack(&mFrames[0]),
+            mPending(&mFrames[1]),
+            mFront(&mFrames[2]),
+            mHasPending(false),
             mCallback(callback),
             mCallbackOpaque(callbackOpaque) {
         if (::android::base::socketCreatePair(&mInSocket, &mOutSocket) < 0) {
@@ -97,19 +118,26 @@ public:
         if (mInSocket < 0) {
             return;
         }
-        Frame* frame = new Frame(width, height, pixels);
-        ::memcpy(frame->pixels, pixels, width * 4 * height);
-        mFrames.send(frame);
-        char c = 1;
-        android::base::socketSend(mInSocket, &c, 1);
+        mBack->set(width, height, pixels);
+
+        AutoLock lock(mLock);
+        Frame* frame = mPending;
+        mPending = mBack;
+        mBack = frame;
+        bool wakeUp = !mHasPending;
+        mHasPending = true;
+        lock.unlock();
+
+        // The looper thread is only woken up once per batch of frames, the
+        // ones posted before it runs replace each other.
+        if (wakeUp) {
+            char c = 1;
+            android::base::socketSend(mInSocket, &c, 1);
+        }
     }
 
 private:
-    enum {
-        kMaxFrames = 16
-    };
-
-    // Called from the looper thread when a new Frame instance is available.
+    // Called from the looper thread when a new frame is available.
     static void onSocketEvent(void* opaque, int fd, unsigned events) {
         Bridge* bridge = reinterpret_cast<Bridge*>(opaque);
         if (events & Looper::FdWatch::kEventRead) {
@@ -117,23 +145,28 @@ private:
             android::base::socketRecv(bridge->mOutSocket, &c, 1);
             // char c; is the "confirmation" bit
             // that actual data was grabbed by the socket.
-            // In a more multithreaded situation,
-            // we aren't guaranteed 1:1
-            // onSocketEvent and postFrame calls.
             // If we simply quit if the confirm bit is not set,
             // we can avoid a deadlock.
             if (!c) {
                 return;
             }
-            Frame* frame = NULL;
-            bridge->mFrames.receive(&frame);
-            if (frame) {
-                bridge->mCallback(bridge->mCallbackOpaque,
-                                  frame->width,
-                                  frame->height,
-                                  frame->pixels);
-                delete frame;
+
+            AutoLock lock(bridge->mLock);
+            if (!bridge->mHasPending) {
+                return;
             }
+            Frame* frame = bridge->mPending;
+            bridge->mPending = bridge->mFront;
+            bridge->mFront = frame;
+            bridge->mHasPending = false;
+            lock.unlock();
+
+            // Only this thread touches the front buffer, so it remains
+            // valid during the callback even if new frames come in.
+            bridge->mCallback(bridge->mCallbackOpaque,
+                              frame->width,
+                              frame->height,
+                              frame->pixels);
         }
     }
 
@@ -141,7 +174,12 @@ private:
     int mInSocket;
     int mOutSocket;
     Looper::FdWatch* mFdWatch;
-    MessageChannel<Frame*, kMaxFrames> mFrames;
+    Lock mLock;
+    Frame mFrames[3];
+    Frame* mBack;
+    Frame* mPending;
+    Frame* mFront;
+    bool mHasPending;
     Callback* mCallback;
     void* mCallbackOpaque;
 };
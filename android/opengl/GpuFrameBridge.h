@@ -42,8 +42,8 @@ public:
     // Type of function that is called to transfer the content of a new
     // GPU frame to the main thread. |opaque| is a user-provided pointer,
     // |width| and |height| are dimensions in pixels, and |pixels| is
-    // the memory buffer of 32-bit RGBA image data. This buffer is freed
-    // when the function returns.
+    // the memory buffer of 32-bit RGBA image data. This buffer is reused
+    // for later frames, and must not be accessed after the function returns.
     typedef void (Callback)(void* opaque,
                             int width,
                             int height,
@@ -59,7 +59,9 @@ public:
     // Destructor
     virtual ~GpuFrameBridge() {}
 
-    // Post a new frame from the EmuGL thread.
+    // Post a new frame from the EmuGL thread. The pixels are copied, so the
+    // caller can reuse its buffer right away. If the main loop didn't get
+    // the previous frame yet, it is dropped and only the new one is sent.
     virtual void postFrame(int width, int height, const void* pixels) = 0;
 
 protected:
@@ -126,5 +126,48 @@ TEST(GpuFrameBridge, postFrameWithinSingleThread) {
     }
 }
 
+TEST(GpuFrameBridge, postFrameKeepsLatestOnly) {
+    ScopedPtr<Looper> looper(Looper::create());
+    ASSERT_TRUE(looper.get());
+
+    FrameList list;
+    ScopedPtr<GpuFrameBridge> bridge(
+            GpuFrameBridge::create(looper.get(), FrameList::add, &list));
+    EXPECT_TRUE(bridge.get());
+
+    static const unsigned char kFrame0[4] = { 0x01, 0x02, 0x03, 0x04 };
+    static const unsigned char kFrame1[8] = {
+        0x11, 0x12, 0x13, 0x14, 0x21, 0x22, 0x23, 0x24,
+    };
+    static const unsigned char kFrame2[4] = { 0x31, 0x32, 0x33, 0x34 };
+
+    // Frames posted before the looper runs replace each other.
+    bridge->postFrame(1, 1, kFrame0);
+    bridge->postFrame(2, 1, kFrame1);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(1, list.count());
+    ScopedPtr<Frame> frame(list.popFront());
+    EXPECT_TRUE(frame.get());
+    EXPECT_EQ(2, frame->width);
+    EXPECT_EQ(1, frame->height);
+    EXPECT_EQ(0, ::memcmp(kFrame1, frame->pixels, sizeof(kFrame1)));
+
+    // The next frame is delivered on its own, into a reused buffer.
+    bridge->postFrame(1, 1, kFrame2);
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+
+    EXPECT_EQ(1, list.count());
+    frame.reset(list.popFront());
+    EXPECT_TRUE(frame.get());
+    EXPECT_EQ(1, frame->width);
+    EXPECT_EQ(1, frame->height);
+    EXPECT_EQ(0, ::memcmp(kFrame2, frame->pixels, sizeof(kFrame2)));
+
+    // Nothing else is delivered without a new frame.
+    EXPECT_EQ(ETIMEDOUT, looper->runWithTimeoutMs(100));
+    EXPECT_EQ(0, list.count());
+}
+
 }  // namespace opengl
 }  // namespace android
@@ -295,3 +295,49 @@ android_gles_server_path(char* buff, size_t buffsize)
 {
     strncpy_safe(buff, rendererAddress, buffsize);
 }
+
+#if ANDROID_GLES_CHANNEL_CAN_READ != RENDER_CHANNEL_CAN_READ || \
+    ANDROID_GLES_CHANNEL_CAN_WRITE != RENDER_CHANNEL_CAN_WRITE || \
+    ANDROID_GLES_CHANNEL_CLOSED != RENDER_CHANNEL_CLOSED
+#error "ANDROID_GLES_CHANNEL_XXX flags don't match render_api.h"
+#endif
+
+void*
+android_gles_channel_open(AndroidGlesChannelWakeFunc wakeFunc,
+                          void* wakeOpaque)
+{
+    if (!rendererStarted) {
+        return NULL;
+    }
+    return openRenderChannel(wakeFunc, wakeOpaque);
+}
+
+int
+android_gles_channel_write(void* channel, const void* buf, size_t len)
+{
+    return renderChannelWrite(channel, buf, len);
+}
+
+int
+android_gles_channel_read(void* channel, void* buf, size_t len)
+{
+    return renderChannelRead(channel, buf, len);
+}
+
+int
+android_gles_channel_poll(void* channel)
+{
+    return renderChannelPoll(channel);
+}
+
+void
+android_gles_channel_wake_on(void* channel, int flags)
+{
+    renderChannelWakeOn(channel, flags);
+}
+
+void
+android_gles_channel_close(void* channel)
+{
+    renderChannelClose(channel);
+}
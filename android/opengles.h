@@ -72,4 +72,26 @@ extern int  android_gles_fast_pipes;
  */
 void android_gles_server_path(char* buff, size_t buffsize);
 
+/* In-process GLES channels, which can be used instead of connecting to the
+ * address above. They never block, see the description of the renderChannel
+ * functions in render_api.h for details.
+ *
+ * android_gles_channel_open() returns NULL if the renderer is not started.
+ * The wake function can be called from any thread, with a set of the
+ * following flags.
+ */
+#define ANDROID_GLES_CHANNEL_CAN_READ   (1 << 0)
+#define ANDROID_GLES_CHANNEL_CAN_WRITE  (1 << 1)
+#define ANDROID_GLES_CHANNEL_CLOSED     (1 << 2)
+
+typedef void (*AndroidGlesChannelWakeFunc)(void* opaque, int flags);
+
+void* android_gles_channel_open(AndroidGlesChannelWakeFunc wakeFunc,
+                                void* wakeOpaque);
+int android_gles_channel_write(void* channel, const void* buf, size_t len);
+int android_gles_channel_read(void* channel, void* buf, size_t len);
+int android_gles_channel_poll(void* channel);
+void android_gles_channel_wake_on(void* channel, int flags);
+void android_gles_channel_close(void* channel);
+
 ANDROID_END_HEADER
@@ -504,6 +504,12 @@ void skin_ui_update_display(SkinUI* ui, int x, int y, int w, int h) {
     }
 }
 
+void skin_ui_update_display_region(SkinUI* ui, SkinRegion* region) {
+    if (ui->window) {
+        skin_window_update_display_region(ui->window, region);
+    }
+}
+
 void skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels) {
     if (ui->window) {
         skin_window_update_gpu_frame(ui->window, w, h, pixels);
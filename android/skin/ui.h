@@ -15,6 +15,7 @@
 #include "android/skin/rect.h"
 #include "android/skin/keyboard.h"
 #include "android/skin/keycode-buffer.h"
+#include "android/skin/region.h"
 
 #include <stdbool.h>
 
@@ -116,6 +117,9 @@ void skin_ui_set_scale(SkinUI* ui, double scale);
 
 void skin_ui_update_display(SkinUI* ui, int x, int y, int w, int h);
 
+// Same as skin_ui_update_display(), for all rectangles of |region|.
+void skin_ui_update_display_region(SkinUI* ui, SkinRegion* region);
+
 void skin_ui_update_gpu_frame(SkinUI* ui, int w, int h, const void* pixels);
 
 // Return the current SkinLayout used by the user interface.
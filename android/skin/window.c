@@ -2089,6 +2089,20 @@ skin_window_update_display( SkinWindow*  window, int  x, int  y, int  w, int  h
     }
 }
 
+void
+skin_window_update_display_region( SkinWindow*  window, SkinRegion*  region )
+{
+    SkinRegionIterator  iter;
+    SkinRect            r;
+
+    if ( !window->surface )
+        return;
+
+    skin_region_iterator_init( &iter, region );
+    while ( skin_region_iterator_next( &iter, &r ) )
+        skin_window_update_display( window, r.pos.x, r.pos.y, r.size.w, r.size.h );
+}
+
 
 void skin_window_update_gpu_frame(SkinWindow* window,
                                   int w,
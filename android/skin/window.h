@@ -14,6 +14,7 @@
 
 #include "android/skin/event.h"
 #include "android/skin/file.h"
+#include "android/skin/region.h"
 #include "android/skin/trackball.h"
 
 typedef struct SkinWindow  SkinWindow;
@@ -105,4 +106,7 @@ typedef struct {
 extern void             skin_window_get_display( SkinWindow*  window, ADisplayInfo  *info );
 extern void             skin_window_update_display( SkinWindow*  window, int  x, int  y, int  w, int  h );
 
+/* redraw all rectangles of 'region', in framebuffer coordinates */
+extern void             skin_window_update_display_region( SkinWindow*  window, SkinRegion*  region );
+
 extern void skin_window_update_gpu_frame(SkinWindow* window, int w, int h, const void* pixels);
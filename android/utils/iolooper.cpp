@@ -22,6 +22,9 @@ unsigned toWaiterEvents(int flags) {
     if (flags & IOLOOPER_WRITE) {
         events |= SocketWaiter::kEventWrite;
     }
+    if (flags & IOLOOPER_URGENT) {
+        events |= SocketWaiter::kEventUrgent;
+    }
     return events;
 }
 
@@ -31,6 +34,10 @@ IoLooper* iolooper_new(void) {
     return reinterpret_cast<IoLooper*>(SocketWaiter::create());
 }
 
+IoLooper* iolooper_new_persistent(void) {
+    return reinterpret_cast<IoLooper*>(SocketWaiter::createPersistent());
+}
+
 void iolooper_free(IoLooper*  iol) {
     delete asWaiter(iol);
 }
@@ -79,6 +86,10 @@ int iolooper_is_write(IoLooper* iol, int  fd) {
     return asWaiter(iol)->pendingEventsFor(fd) & SocketWaiter::kEventWrite;
 }
 
+int iolooper_is_urgent(IoLooper* iol, int fd) {
+    return asWaiter(iol)->pendingEventsFor(fd) & SocketWaiter::kEventUrgent;
+}
+
 int iolooper_has_operations(IoLooper* iol) {
     return asWaiter(iol)->hasFds();
 }
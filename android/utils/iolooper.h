@@ -11,6 +11,10 @@ ANDROID_BEGIN_HEADER
 typedef struct IoLooper  IoLooper;
 
 IoLooper*  iolooper_new(void);
+/* Same as iolooper_new(), for a looper that lives long, and whose set of
+ * descriptors changes little between calls to iolooper_wait(). This uses
+ * epoll() on Linux. */
+IoLooper*  iolooper_new_persistent(void);
 void       iolooper_free( IoLooper*  iol );
 void       iolooper_reset( IoLooper*  iol );
 
@@ -22,6 +26,7 @@ void       iolooper_del_write( IoLooper*  iol, int  fd );
 enum {
     IOLOOPER_READ = (1<<0),
     IOLOOPER_WRITE = (1<<1),
+    IOLOOPER_URGENT = (1<<2),  /* out-of-band data */
 };
 void       iolooper_modify( IoLooper*  iol, int fd, int oldflags, int newflags);
 
@@ -35,6 +40,7 @@ int        iolooper_wait( IoLooper*  iol, int64_t  duration );
 
 int        iolooper_is_read( IoLooper*  iol, int  fd );
 int        iolooper_is_write( IoLooper*  iol, int  fd );
+int        iolooper_is_urgent( IoLooper*  iol, int  fd );
 /* Returns 1 if this IoLooper has one or more file descriptor to interact with */
 int        iolooper_has_operations( IoLooper*  iol );
 /* Gets current time in milliseconds.
@@ -39,6 +39,15 @@
 #include <signal.h>
 #endif
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+/* Older kernel headers don't define FICLONE, the generic version of
+ * the btrfs clone ioctl. */
+#ifndef FICLONE
+#define FICLONE  _IOW(0x94, 9, int)
+#endif
+#endif
+
 #define  D(...)  VERBOSE_PRINT(init,__VA_ARGS__)
 
 #ifdef _WIN32
@@ -236,11 +245,121 @@ path_get_size( const char*  path, uint64_t  *psize )
  **  path_empty_file() creates an empty file at a given path location.
  **  if the file already exists, it is truncated without warning
  **
- **  path_copy_file() copies one file into another.
+ **  path_copy_file() copies one file into another. when the file system
+ **  supports it, the copy shares its blocks with the source file until
+ **  either of them is modified. otherwise, only the data extents of the
+ **  source are copied, and its holes stay holes in the destination.
  **
  **  both functions return 0 on success, and -1 on error
  **/
 
+#define  COPY_BUFFER_SIZE  65536
+
+#ifdef _WIN32
+static int
+copy_file_data( int  fd, int  fs, char*  buf, size_t  buf_size )
+{
+    ssize_t n;
+    while ((n = read(fs, buf, buf_size)) > 0) {
+        if (write(fd, buf, n) != n) {
+            return -1;
+        }
+    }
+    return (n < 0) ? -1 : 0;
+}
+#else  /* !_WIN32 */
+static int
+copy_buffer_is_zero( const char*  buf, ssize_t  len )
+{
+    ssize_t  n;
+    for (n = 0; n < len; n++) {
+        if (buf[n] != 0)
+            return 0;
+    }
+    return 1;
+}
+
+/* copies [start, end) of |fs| to the same offsets of |fd|, or everything
+ * from |start| if |end| is -1. with |skip_zeroes|, blocks of zeroes are
+ * seeked over instead of being written. */
+static int
+copy_file_range_at( int  fd, int  fs, off_t  start, off_t  end,
+                    int  skip_zeroes, char*  buf, size_t  buf_size )
+{
+    if (lseek(fs, start, SEEK_SET) < 0 || lseek(fd, start, SEEK_SET) < 0) {
+        return -1;
+    }
+    while (end < 0 || start < end) {
+        size_t len = buf_size;
+        ssize_t n;
+        if (end >= 0 && (off_t)len > end - start) {
+            len = (size_t)(end - start);
+        }
+        n = HANDLE_EINTR(read(fs, buf, len));
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (skip_zeroes && copy_buffer_is_zero(buf, n)) {
+            if (lseek(fd, n, SEEK_CUR) < 0) {
+                return -1;
+            }
+        } else if (HANDLE_EINTR(write(fd, buf, n)) != n) {
+            return -1;
+        }
+        start += n;
+    }
+    return 0;
+}
+
+/* copies the data extents of |fs| to |fd|, leaving holes in between. if
+ * the file system can't report them, falls back to skipping blocks of
+ * zeroes, which still requires reading the whole source. */
+static int
+copy_file_data( int  fd, int  fs, char*  buf, size_t  buf_size )
+{
+    struct stat  st;
+    off_t  pos = 0;
+    int  scan = 1;
+
+    if (fstat(fs, &st) < 0) {
+        return -1;
+    }
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    scan = 0;
+    while (pos < st.st_size) {
+        off_t data = lseek(fs, pos, SEEK_DATA);
+        off_t hole;
+        if (data < 0 && errno == ENXIO) {
+            /* only a hole is left */
+            break;
+        }
+        if (data < 0 && errno == EINVAL) {
+            /* not supported by this file system */
+            scan = 1;
+            break;
+        }
+        if (data < 0) {
+            return -1;
+        }
+        hole = lseek(fs, data, SEEK_HOLE);
+        if (hole < 0 ||
+            copy_file_range_at(fd, fs, data, hole, 0, buf, buf_size) < 0) {
+            return -1;
+        }
+        pos = hole;
+    }
+#endif
+    if (scan && copy_file_range_at(fd, fs, pos, -1, 1, buf, buf_size) < 0) {
+        return -1;
+    }
+    /* a trailing hole doesn't extend the destination by itself */
+    return HANDLE_EINTR(ftruncate(fd, st.st_size));
+}
+#endif  /* !_WIN32 */
+
 APosixStatus
 path_empty_file( const char*  path )
 {
@@ -282,20 +401,19 @@ path_copy_file( const char*  dest, const char*  source )
     fs = open(source, S_IREAD);
 #endif
     if (fs >= 0 && fd >= 0) {
-        char buf[4096];
-        ssize_t total = 0;
-        ssize_t n;
+        char buf[COPY_BUFFER_SIZE];
+        int cloned = 0;
         result = 0; /* success */
-        while ((n = read(fs, buf, 4096)) > 0) {
-            if (write(fd, buf, n) != n) {
-                /* write failed. Make it return -1 so that an
-                 * empty file be created. */
-                D("Failed to copy '%s' to '%s': %s (%d)",
-                       source, dest, strerror(errno), errno);
-                result = -1;
-                break;
-            }
-            total += n;
+#ifdef __linux__
+        /* share the source blocks when the file system allows it, this
+         * is instantaneous even for multi-gigabyte images. */
+        cloned = (ioctl(fd, FICLONE, fs) == 0);
+#endif
+        if (!cloned && copy_file_data(fd, fs, buf, sizeof(buf)) < 0) {
+            /* Make it return -1 so that an empty file be created. */
+            D("Failed to copy '%s' to '%s': %s (%d)",
+                   source, dest, strerror(errno), errno);
+            result = -1;
         }
     }
 
@@ -11,11 +11,15 @@
 
 #include "android/utils/path.h"
 
+#include "android/base/String.h"
 #include "android/base/testing/TestSystem.h"
 #include "android/base/testing/TestTempDir.h"
 
 #include "gtest/gtest.h"
 
+#include <string>
+
+using android::base::String;
 using android::base::TestTempDir;
 
 namespace android {
@@ -117,5 +121,40 @@ TEST(Path, EscapePath) {
     free(result);
 }
 
+TEST(Path, CopyFile) {
+    TestTempDir myDir("path_copy_file");
+    ASSERT_TRUE(myDir.path());
+    String source = myDir.makeSubPath("source.img");
+    String dest = myDir.makeSubPath("dest.img");
+
+    // Data, followed by a hole and more data, and ending with a hole,
+    // to check that the copy keeps the right size.
+    std::string content(300000, '\0');
+    content.replace(0, 5, "hello");
+    content.replace(200000, 5, "world");
+
+    FILE* file = fopen(source.c_str(), "wb");
+    ASSERT_TRUE(file);
+    ASSERT_EQ(5U, fwrite("hello", 1, 5, file));
+    ASSERT_EQ(0, fseek(file, 200000, SEEK_SET));
+    ASSERT_EQ(5U, fwrite("world", 1, 5, file));
+    ASSERT_EQ(0, fseek(file, content.size() - 1, SEEK_SET));
+    ASSERT_EQ(1U, fwrite("", 1, 1, file));
+    fclose(file);
+
+    EXPECT_EQ(0, path_copy_file(dest.c_str(), source.c_str()));
+
+    uint64_t size = 0;
+    EXPECT_EQ(0, path_get_size(dest.c_str(), &size));
+    EXPECT_EQ(content.size(), size);
+
+    std::string copy(content.size(), 'x');
+    file = fopen(dest.c_str(), "rb");
+    ASSERT_TRUE(file);
+    EXPECT_EQ(copy.size(), fread(&copy[0], 1, copy.size(), file));
+    fclose(file);
+    EXPECT_TRUE(copy == content);
+}
+
 }  // namespace path
 }  // namespace android
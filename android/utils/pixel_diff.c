@@ -0,0 +1,247 @@
+// Copyright 2016 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/pixel_diff.h"
+
+#include "android/utils/x86_cpuid.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#  define PIXEL_DIFF_HAS_SSE2 1
+#  include <emmintrin.h>
+#endif
+
+// Older compilers can't use AVX2 intrinsics in a function-level target
+// without enabling AVX2 for the whole file.
+#if defined(PIXEL_DIFF_HAS_SSE2) && \
+    ((defined(__clang__) && __clang_major__ >= 4) || \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 5))
+#  define PIXEL_DIFF_HAS_AVX2 1
+#  include <immintrin.h>
+#endif
+
+// Each implementation provides two functions:
+//   find_first(a, b, len) returns the offset of the first byte that differs
+//   between |a| and |b|, or |len| if they are identical.
+//   find_last(a, b, len) returns the offset of the last byte that differs,
+//   and must only be called when there is at least one.
+typedef struct {
+    PixelDiffImpl impl;
+    size_t (*find_first)(const uint8_t* a, const uint8_t* b, size_t len);
+    size_t (*find_last)(const uint8_t* a, const uint8_t* b, size_t len);
+} PixelDiffKernels;
+
+static size_t find_first_scalar(const uint8_t* a, const uint8_t* b,
+                                size_t len) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t wa, wb;
+        memcpy(&wa, a + i, sizeof(wa));
+        memcpy(&wb, b + i, sizeof(wb));
+        if (wa != wb) {
+            break;
+        }
+    }
+    while (i < len && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+static size_t find_last_scalar(const uint8_t* a, const uint8_t* b,
+                               size_t len) {
+    size_t i = len;
+    while (i >= sizeof(uint64_t)) {
+        uint64_t wa, wb;
+        memcpy(&wa, a + i - sizeof(wa), sizeof(wa));
+        memcpy(&wb, b + i - sizeof(wb), sizeof(wb));
+        if (wa != wb) {
+            break;
+        }
+        i -= sizeof(uint64_t);
+    }
+    while (i > 0 && a[i - 1] == b[i - 1]) {
+        i--;
+    }
+    return i - 1;
+}
+
+#ifdef PIXEL_DIFF_HAS_SSE2
+static size_t find_first_sse2(const uint8_t* a, const uint8_t* b,
+                              size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffffU;
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + find_first_scalar(a + i, b + i, len - i);
+}
+
+static size_t find_last_sse2(const uint8_t* a, const uint8_t* b,
+                             size_t len) {
+    size_t i = len;
+    while (i >= 16) {
+        i -= 16;
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffffU;
+        if (mask) {
+            return i + 31 - __builtin_clz(mask);
+        }
+    }
+    return find_last_scalar(a, b, i);
+}
+#endif  // PIXEL_DIFF_HAS_SSE2
+
+#ifdef PIXEL_DIFF_HAS_AVX2
+__attribute__((target("avx2")))
+static size_t find_first_avx2(const uint8_t* a, const uint8_t* b,
+                              size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(va, vb));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + find_first_sse2(a + i, b + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t find_last_avx2(const uint8_t* a, const uint8_t* b,
+                             size_t len) {
+    size_t i = len;
+    while (i >= 32) {
+        i -= 32;
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(va, vb));
+        if (mask) {
+            return i + 31 - __builtin_clz(mask);
+        }
+    }
+    return find_last_sse2(a, b, i);
+}
+#endif  // PIXEL_DIFF_HAS_AVX2
+
+static const PixelDiffKernels kScalarKernels = {
+    PIXEL_DIFF_IMPL_SCALAR, find_first_scalar, find_last_scalar
+};
+
+#ifdef PIXEL_DIFF_HAS_SSE2
+static const PixelDiffKernels kSse2Kernels = {
+    PIXEL_DIFF_IMPL_SSE2, find_first_sse2, find_last_sse2
+};
+#endif
+
+#ifdef PIXEL_DIFF_HAS_AVX2
+static const PixelDiffKernels kAvx2Kernels = {
+    PIXEL_DIFF_IMPL_AVX2, find_first_avx2, find_last_avx2
+};
+#endif
+
+// Returns the kernels for |impl|, or NULL if unsupported.
+static const PixelDiffKernels* pixel_diff_kernels_for(PixelDiffImpl impl) {
+    switch (impl) {
+    case PIXEL_DIFF_IMPL_AUTO:
+#ifdef PIXEL_DIFF_HAS_AVX2
+        if (android_get_x86_cpuid_avx2_support()) {
+            return &kAvx2Kernels;
+        }
+#endif
+#ifdef PIXEL_DIFF_HAS_SSE2
+        return &kSse2Kernels;
+#else
+        return &kScalarKernels;
+#endif
+    case PIXEL_DIFF_IMPL_SCALAR:
+        return &kScalarKernels;
+    case PIXEL_DIFF_IMPL_SSE2:
+#ifdef PIXEL_DIFF_HAS_SSE2
+        return &kSse2Kernels;
+#else
+        return NULL;
+#endif
+    case PIXEL_DIFF_IMPL_AVX2:
+#ifdef PIXEL_DIFF_HAS_AVX2
+        if (android_get_x86_cpuid_avx2_support()) {
+            return &kAvx2Kernels;
+        }
+#endif
+        return NULL;
+    }
+    return NULL;
+}
+
+// The selected kernels. Concurrent first calls may race to initialize
+// this, but they all store the same value.
+static const PixelDiffKernels* volatile s_kernels = NULL;
+
+static const PixelDiffKernels* pixel_diff_kernels(void) {
+    const PixelDiffKernels* kernels = s_kernels;
+    if (!kernels) {
+        kernels = pixel_diff_kernels_for(PIXEL_DIFF_IMPL_AUTO);
+        s_kernels = kernels;
+    }
+    return kernels;
+}
+
+bool pixel_diff_set_impl(PixelDiffImpl impl) {
+    const PixelDiffKernels* kernels = pixel_diff_kernels_for(impl);
+    if (!kernels) {
+        return false;
+    }
+    s_kernels = kernels;
+    return true;
+}
+
+PixelDiffImpl pixel_diff_get_impl(void) {
+    return pixel_diff_kernels()->impl;
+}
+
+bool pixel_diff_range(const uint8_t* a, const uint8_t* b, size_t len,
+                      size_t* first, size_t* last) {
+    const PixelDiffKernels* kernels = pixel_diff_kernels();
+    size_t start = kernels->find_first(a, b, len);
+    if (start == len) {
+        return false;
+    }
+    *first = start;
+    *last = start + kernels->find_last(a + start, b + start, len - start);
+    return true;
+}
+
+bool pixel_diff_update_line(const uint8_t* src, uint8_t* dst,
+                            int width, int bytes_per_pixel,
+                            int* xmin, int* xmax) {
+    size_t first, last;
+    if (width <= 0 || bytes_per_pixel <= 0 ||
+        !pixel_diff_range(src, dst, (size_t)width * bytes_per_pixel,
+                          &first, &last)) {
+        return false;
+    }
+    int x1 = (int)(first / bytes_per_pixel);
+    int x2 = (int)(last / bytes_per_pixel);
+    memcpy(dst + x1 * bytes_per_pixel, src + x1 * bytes_per_pixel,
+           (size_t)(x2 - x1 + 1) * bytes_per_pixel);
+    *xmin = x1;
+    *xmax = x2;
+    return true;
+}
@@ -0,0 +1,56 @@
+// Copyright 2016 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/utils/compiler.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+ANDROID_BEGIN_HEADER
+
+// Helpers used to find and copy the pixels that changed between two
+// framebuffer lines. On x86 hosts, these use SSE2 or AVX2 kernels
+// selected at runtime, with a portable scalar fallback.
+
+// Compare the |len| bytes at |a| and |b|. Return false if they are
+// identical. Otherwise, set |*first| and |*last| to the offsets of the
+// first and last differing bytes, and return true.
+bool pixel_diff_range(const uint8_t* a, const uint8_t* b, size_t len,
+                      size_t* first, size_t* last);
+
+// Compare a line of |width| pixels of |bytes_per_pixel| bytes each at
+// |src| with the one at |dst|, and copy the changed span to |dst|.
+// Return false if the lines are identical. Otherwise, set |*xmin| and
+// |*xmax| to the first and last changed pixel indices, and return true.
+bool pixel_diff_update_line(const uint8_t* src, uint8_t* dst,
+                            int width, int bytes_per_pixel,
+                            int* xmin, int* xmax);
+
+// Kernel implementations, mostly useful for testing and benchmarking.
+typedef enum {
+    PIXEL_DIFF_IMPL_AUTO = 0,   // Best one supported by the host CPU.
+    PIXEL_DIFF_IMPL_SCALAR,
+    PIXEL_DIFF_IMPL_SSE2,
+    PIXEL_DIFF_IMPL_AVX2,
+} PixelDiffImpl;
+
+// Force the implementation used by the functions above. Return false
+// (and leave the current one unchanged) if |impl| is not supported by
+// the host CPU or was not compiled in.
+bool pixel_diff_set_impl(PixelDiffImpl impl);
+
+// Return the implementation currently in use, never PIXEL_DIFF_IMPL_AUTO.
+PixelDiffImpl pixel_diff_get_impl(void);
+
+ANDROID_END_HEADER
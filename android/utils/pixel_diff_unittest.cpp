@@ -0,0 +1,105 @@
+// Copyright 2016 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/utils/pixel_diff.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <vector>
+
+namespace {
+
+// Runs |func| once for each implementation supported by the host, then
+// restores automatic selection.
+template <typename Func>
+void forEachImpl(Func func) {
+    static const PixelDiffImpl kImpls[] = {
+        PIXEL_DIFF_IMPL_SCALAR, PIXEL_DIFF_IMPL_SSE2, PIXEL_DIFF_IMPL_AVX2,
+    };
+    for (size_t n = 0; n < sizeof(kImpls) / sizeof(kImpls[0]); ++n) {
+        if (!pixel_diff_set_impl(kImpls[n])) {
+            continue;
+        }
+        SCOPED_TRACE(::testing::Message() << "impl=" << kImpls[n]);
+        func();
+    }
+    EXPECT_TRUE(pixel_diff_set_impl(PIXEL_DIFF_IMPL_AUTO));
+}
+
+}  // namespace
+
+TEST(pixel_diff, ScalarAlwaysSupported) {
+    EXPECT_TRUE(pixel_diff_set_impl(PIXEL_DIFF_IMPL_SCALAR));
+    EXPECT_EQ(PIXEL_DIFF_IMPL_SCALAR, pixel_diff_get_impl());
+    EXPECT_TRUE(pixel_diff_set_impl(PIXEL_DIFF_IMPL_AUTO));
+    EXPECT_NE(PIXEL_DIFF_IMPL_AUTO, pixel_diff_get_impl());
+}
+
+TEST(pixel_diff, IdenticalBuffers) {
+    forEachImpl([] {
+        for (size_t len = 0; len < 100; ++len) {
+            std::vector<uint8_t> a(len, 0x5a), b(len, 0x5a);
+            size_t first = 1234, last = 5678;
+            EXPECT_FALSE(pixel_diff_range(a.data(), b.data(), len,
+                                          &first, &last)) << "len=" << len;
+            EXPECT_EQ(1234U, first);
+            EXPECT_EQ(5678U, last);
+        }
+    });
+}
+
+TEST(pixel_diff, AllRanges) {
+    // Check every (first, last) pair for lengths that cover the vector
+    // bodies and scalar tails of all kernels.
+    forEachImpl([] {
+        for (size_t len = 1; len < 80; ++len) {
+            for (size_t i = 0; i < len; ++i) {
+                for (size_t j = i; j < len; ++j) {
+                    std::vector<uint8_t> a(len, 0), b(len, 0);
+                    b[i] = 1;
+                    b[j] = 2;
+                    size_t first = 0, last = 0;
+                    ASSERT_TRUE(pixel_diff_range(a.data(), b.data(), len,
+                                                 &first, &last))
+                            << "len=" << len << " i=" << i << " j=" << j;
+                    EXPECT_EQ(i, first);
+                    EXPECT_EQ(j, last);
+                }
+            }
+        }
+    });
+}
+
+TEST(pixel_diff, UpdateLine) {
+    forEachImpl([] {
+        for (int bpp = 2; bpp <= 4; ++bpp) {
+            const int width = 67;
+            std::vector<uint8_t> src(width * bpp), dst(width * bpp);
+            for (size_t n = 0; n < src.size(); ++n) {
+                src[n] = dst[n] = (uint8_t)n;
+            }
+            int xmin = -1, xmax = -1;
+            EXPECT_FALSE(pixel_diff_update_line(src.data(), dst.data(),
+                                                width, bpp, &xmin, &xmax));
+
+            // Change the last byte of pixel 5 and the first one of pixel 40.
+            src[6 * bpp - 1] ^= 0xff;
+            src[40 * bpp] ^= 0xff;
+            EXPECT_TRUE(pixel_diff_update_line(src.data(), dst.data(),
+                                               width, bpp, &xmin, &xmax));
+            EXPECT_EQ(5, xmin);
+            EXPECT_EQ(40, xmax);
+            EXPECT_EQ(0, memcmp(src.data(), dst.data(), src.size()));
+        }
+    });
+}
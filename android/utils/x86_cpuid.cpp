@@ -193,6 +193,37 @@ bool android_get_x86_cpuid_svm_support()
     return false;
 }
 
+bool android_get_x86_cpuid_avx2_support()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (android_get_x86_cpuid_function_max() < 7) {
+        return false;
+    }
+
+    uint32_t cpuid_function1_ecx;
+    android_get_x86_cpuid(1, 0, NULL, NULL, &cpuid_function1_ecx, NULL);
+    const uint32_t avx_mask = CPUID_ECX_OSXSAVE | CPUID_ECX_AVX;
+    if ((cpuid_function1_ecx & avx_mask) != avx_mask) {
+        return false;
+    }
+
+    // Check that the OS enabled saving of the XMM and YMM registers.
+    uint32_t xcr0_eax, xcr0_edx;
+    asm volatile(".byte 0x0f, 0x01, 0xd0"  // xgetbv
+                 : "=a"(xcr0_eax), "=d"(xcr0_edx)
+                 : "c"(0));
+    if ((xcr0_eax & 6) != 6) {
+        return false;
+    }
+
+    uint32_t cpuid_function7_ebx;
+    android_get_x86_cpuid(7, 0, NULL, &cpuid_function7_ebx, NULL, NULL);
+    return (cpuid_function7_ebx & CPUID_EBX_AVX2) != 0;
+#else
+    return false;
+#endif
+}
+
 bool android_get_x86_cpuid_is_vcpu()
 {
     uint32_t cpuid_function1_ecx;
@@ -46,6 +46,10 @@ uint32_t android_get_x86_cpuid_extended_function_max();
 #define CPUID_ECX_SSE41    (1 << 19)
 #define CPUID_ECX_SSE42    (1 << 20)
 #define CPUID_ECX_POPCNT   (1 << 23)
+#define CPUID_ECX_OSXSAVE  (1 << 27)
+#define CPUID_ECX_AVX      (1 << 28)
+/* Applicable when calling CPUID with EAX=7 and ECX=0 */
+#define CPUID_EBX_AVX2     (1 << 5)
 
 /*
  * android_get_x86_cpuid: retrieve x86 CPUID for host CPU.
@@ -143,6 +147,13 @@ bool android_get_x86_cpuid_svm_support();
  */
 bool android_get_x86_cpuid_nx_support();
 
+/*
+ * android_get_x86_cpuid_avx2_support: returns 1 if both the CPU and the
+ * operating system support AVX2 instructions (i.e. the OS saves the YMM
+ * registers on context switches), returns 0 otherwise
+ */
+bool android_get_x86_cpuid_avx2_support();
+
 /*
  * android_get_x86_cpuid_is_vcpu: returns 1 if the CPU is a running under
  * a Hypervisor
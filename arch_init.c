@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/mman.h>
 #endif
+#include <zlib.h>
 #include "config.h"
 #include "monitor/monitor.h"
 #include "sysemu/sysemu.h"
@@ -42,6 +43,15 @@
 #include "net/net.h"
 #include "exec/gdbstub.h"
 #include "exec/ram_addr.h"
+#include "qemu/thread.h"
+
+#ifdef CONFIG_USERFAULTFD
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#endif
 #include "hw/i386/smbios.h"
 
 #ifdef TARGET_SPARC
@@ -94,31 +104,663 @@ const uint32_t arch_type = QEMU_ARCH;
 #define RAM_SAVE_FLAG_PAGE     0x08
 #define RAM_SAVE_FLAG_EOS      0x10
 #define RAM_SAVE_FLAG_CONTINUE 0x20
+/* Page deflated with zlib, preceded by its 32-bit compressed length. */
+#define RAM_SAVE_FLAG_DEFLATE  0x40
+/* Pages of a block, see ram_put_page_batch(). */
+#define RAM_SAVE_FLAG_PAGE_BATCH 0x80
+
+static int is_dup_page(uint8_t *page)
+{
+    VECTYPE *p = (VECTYPE *)page;
+    VECTYPE val = SPLAT(page);
+    int i;
+
+    for (i = 0; i < TARGET_PAGE_SIZE / sizeof(VECTYPE); i++) {
+        if (!ALL_EQ(val, p[i])) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/***********************************************************/
+/* ram page compression */
+
+/* Pages that aren't filled with a single byte value can be deflated when
+ * saving. To keep this from becoming the bottleneck, pages are handed in
+ * batches to a pool of worker threads, which compress them on save and
+ * inflate them straight into guest RAM on load. The stream itself is still
+ * written and read by the caller's thread only, in the original order.
+ */
+#define RAM_COMPRESS_THREADS  4
+#define RAM_COMPRESS_BATCH    64
+
+typedef struct {
+    uint8_t *page;  /* guest page to deflate, or to inflate into */
+    uint8_t *data;  /* compressed page, TARGET_PAGE_SIZE bytes at most */
+    int len;        /* compressed length, 0 if the page didn't shrink */
+} RamCompressJob;
+
+static struct {
+    QemuMutex lock;
+    QemuCond work_cond;
+    QemuCond done_cond;
+    RamCompressJob jobs[RAM_COMPRESS_BATCH];
+    int num_jobs;   /* jobs in the current batch */
+    int next_job;   /* next job to hand out to a worker */
+    int pending;    /* jobs of the current batch not done yet */
+    int inflate;    /* 1 if the current batch is to be inflated */
+    int failed;     /* set when a page couldn't be processed */
+    int started;
+} ram_compress;
+
+static int ram_compress_enabled;
+
+void ram_set_compression(int enable)
+{
+    ram_compress_enabled = enable;
+}
+
+static void ram_compress_do_job(RamCompressJob *job, int inflating,
+                                z_stream *zdef, z_stream *zinf)
+{
+    if (!inflating) {
+        deflateReset(zdef);
+        zdef->next_in = job->page;
+        zdef->avail_in = TARGET_PAGE_SIZE;
+        zdef->next_out = job->data;
+        /* Anything that doesn't save at least one byte is sent raw. */
+        zdef->avail_out = TARGET_PAGE_SIZE - 1;
+        if (deflate(zdef, Z_FINISH) == Z_STREAM_END) {
+            job->len = TARGET_PAGE_SIZE - 1 - zdef->avail_out;
+        } else {
+            job->len = 0;
+        }
+    } else {
+        inflateReset(zinf);
+        zinf->next_in = job->data;
+        zinf->avail_in = job->len;
+        zinf->next_out = job->page;
+        zinf->avail_out = TARGET_PAGE_SIZE;
+        if (inflate(zinf, Z_FINISH) != Z_STREAM_END || zinf->avail_out != 0) {
+            qemu_mutex_lock(&ram_compress.lock);
+            ram_compress.failed = 1;
+            qemu_mutex_unlock(&ram_compress.lock);
+        }
+    }
+}
+
+static void *ram_compress_thread(void *opaque)
+{
+    z_stream zdef, zinf;
+    int ok;
+
+    memset(&zdef, 0, sizeof(zdef));
+    memset(&zinf, 0, sizeof(zinf));
+    /* Raw streams, no zlib header, like compressed qcow2 clusters. */
+    ok = deflateInit2(&zdef, Z_BEST_SPEED, Z_DEFLATED, -12, 9,
+                      Z_DEFAULT_STRATEGY) == Z_OK &&
+         inflateInit2(&zinf, -12) == Z_OK;
+    if (!ok) {
+        /* Keep taking jobs, but fail all of them. */
+        fprintf(stderr, "Could not initialize RAM page compression\n");
+    }
+
+    qemu_mutex_lock(&ram_compress.lock);
+    for (;;) {
+        RamCompressJob *job;
+        int inflating;
+
+        while (ram_compress.next_job >= ram_compress.num_jobs) {
+            qemu_cond_wait(&ram_compress.work_cond, &ram_compress.lock);
+        }
+        job = &ram_compress.jobs[ram_compress.next_job++];
+        inflating = ram_compress.inflate;
+        qemu_mutex_unlock(&ram_compress.lock);
+
+        if (ok) {
+            ram_compress_do_job(job, inflating, &zdef, &zinf);
+        }
+
+        qemu_mutex_lock(&ram_compress.lock);
+        if (!ok) {
+            ram_compress.failed = 1;
+        }
+        if (--ram_compress.pending == 0) {
+            qemu_cond_signal(&ram_compress.done_cond);
+        }
+    }
+    return NULL;
+}
 
-static int is_dup_page(uint8_t *page, uint8_t ch)
+static void ram_compress_init(void)
 {
-    uint32_t val = ch << 24 | ch << 16 | ch << 8 | ch;
-    uint32_t *array = (uint32_t *)page;
     int i;
 
-    for (i = 0; i < (TARGET_PAGE_SIZE / 4); i++) {
-        if (array[i] != val) {
+    if (ram_compress.started) {
+        return;
+    }
+    ram_compress.started = 1;
+
+    qemu_mutex_init(&ram_compress.lock);
+    qemu_cond_init(&ram_compress.work_cond);
+    qemu_cond_init(&ram_compress.done_cond);
+    for (i = 0; i < RAM_COMPRESS_BATCH; i++) {
+        ram_compress.jobs[i].data = g_malloc(TARGET_PAGE_SIZE);
+    }
+    for (i = 0; i < RAM_COMPRESS_THREADS; i++) {
+        QemuThread thread;
+        qemu_thread_create(&thread, "ram-compress", ram_compress_thread,
+                           NULL, QEMU_THREAD_DETACHED);
+    }
+}
+
+/* Process the first |num_jobs| entries of ram_compress.jobs on the worker
+ * threads, and wait until they're all done. Returns -1 if a page couldn't
+ * be processed. */
+static int ram_compress_run(int num_jobs, int inflating)
+{
+    int ret;
+
+    if (num_jobs == 0) {
+        return 0;
+    }
+
+    qemu_mutex_lock(&ram_compress.lock);
+    ram_compress.num_jobs = num_jobs;
+    ram_compress.next_job = 0;
+    ram_compress.pending = num_jobs;
+    ram_compress.inflate = inflating;
+    qemu_cond_broadcast(&ram_compress.work_cond);
+    while (ram_compress.pending > 0) {
+        qemu_cond_wait(&ram_compress.done_cond, &ram_compress.lock);
+    }
+    ram_compress.num_jobs = 0;
+    ram_compress.next_job = 0;
+    ret = ram_compress.failed ? -1 : 0;
+    ram_compress.failed = 0;
+    qemu_mutex_unlock(&ram_compress.lock);
+
+    return ret;
+}
+
+/***********************************************************/
+/* lazy ram restore */
+
+/* When lazy restore is enabled, the pages that aren't dup pages are saved
+ * in batch records whose page data is aligned in the stream, and thus in
+ * the snapshot's VM state. Loading such a snapshot only records where
+ * each page is stored in the image file instead of reading it. Once the
+ * rest of the VM state is loaded, the recorded pages are dropped from
+ * guest RAM, which is registered with userfaultfd, and the guest resumes
+ * right away. A thread then reads every page from the image file when it
+ * is first touched, by the guest or by the emulator itself, and prefetches
+ * the others in the background.
+ *
+ * The pages must all be loaded before the clusters that store them may
+ * be reused, see ram_lazy_load_finish().
+ */
+#define RAM_PAGE_BATCH     ((1 << 20) / TARGET_PAGE_SIZE)
+#define RAM_LAZY_PREFETCH  64   /* host pages prefetched at once */
+#define RAM_LAZY_PREFETCH_DELAY_MS  1   /* between prefetch batches */
+
+typedef struct {
+    RAMBlock *block;
+    /* Image file offset + 1 of each page that's still to be read, or 0. */
+    uint64_t *pages;
+} RamLazyRegion;
+
+static struct {
+    int enabled;
+    BlockDriverState *bs;       /* snapshot being loaded */
+    RamLazyRegion *regions;
+    int num_regions;
+    int64_t num_pages;          /* pages still to be read */
+    int fd;                     /* image file */
+    /* Last VM state extent that was mapped to the image file. */
+    int64_t map_pos;
+    int64_t map_len;
+    int64_t map_offset;
+#ifdef CONFIG_USERFAULTFD
+    int uffd;
+    int stop_fds[2];
+    QemuThread thread;
+    int running;
+#endif
+} ram_lazy = {
+    .fd = -1,
+#ifdef CONFIG_USERFAULTFD
+    .uffd = -1,
+#endif
+};
+
+void ram_set_lazy_load(int enable)
+{
+    ram_lazy.enabled = enable;
+}
+
+static RamLazyRegion *ram_lazy_find_region(uint8_t *host)
+{
+    int i;
+
+    for (i = 0; i < ram_lazy.num_regions; i++) {
+        RamLazyRegion *r = &ram_lazy.regions[i];
+
+        if (host >= r->block->host && host < r->block->host + r->block->length) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+/* Forget the page at |host|, which is being loaded from the stream. */
+static void ram_lazy_forget(void *host)
+{
+    RamLazyRegion *r;
+    uint64_t *entry;
+
+    if (!ram_lazy.regions || !(r = ram_lazy_find_region(host))) {
+        return;
+    }
+    entry = &r->pages[((uint8_t *)host - r->block->host) / TARGET_PAGE_SIZE];
+    if (*entry) {
+        *entry = 0;
+        ram_lazy.num_pages--;
+    }
+}
+
+/* Record that the page at |host| is stored at stream position |pos|.
+ * Returns 0 if it can't be loaded lazily, and must be read right away. */
+static int ram_lazy_record(void *host, int64_t pos)
+{
+    RamLazyRegion *r;
+    uint64_t *entry;
+
+    if (!ram_lazy.regions || !(r = ram_lazy_find_region(host))) {
+        return 0;
+    }
+    if (pos < ram_lazy.map_pos ||
+        pos + TARGET_PAGE_SIZE > ram_lazy.map_pos + ram_lazy.map_len) {
+        int64_t len;
+        int64_t offset = bdrv_map_vmstate(ram_lazy.bs, pos, &len);
+
+        if (offset < 0) {
+            ram_lazy.map_len = 0;
+            return 0;
+        }
+        ram_lazy.map_pos = pos;
+        ram_lazy.map_len = len;
+        ram_lazy.map_offset = offset;
+        if (len < TARGET_PAGE_SIZE) {
             return 0;
         }
     }
 
+    entry = &r->pages[((uint8_t *)host - r->block->host) / TARGET_PAGE_SIZE];
+    if (!*entry) {
+        ram_lazy.num_pages++;
+    }
+    *entry = ram_lazy.map_offset + (pos - ram_lazy.map_pos) + 1;
     return 1;
 }
 
+/* Read the target pages of |r| from |index| to |index + count| into
+ * |buf|. Returns -1 if one of them couldn't be read. */
+static int ram_lazy_read_pages(RamLazyRegion *r, ram_addr_t index, int count,
+                               uint8_t *buf)
+{
+    int ret = 0;
+    int i;
+
+    for (i = 0; i < count; i++, buf += TARGET_PAGE_SIZE) {
+        uint64_t entry = r->pages[index + i];
+
+        if (!entry) {
+            memset(buf, 0, TARGET_PAGE_SIZE);
+            continue;
+        }
+        if (pread(ram_lazy.fd, buf, TARGET_PAGE_SIZE, entry - 1) !=
+            TARGET_PAGE_SIZE) {
+            memset(buf, 0, TARGET_PAGE_SIZE);
+            ret = -1;
+        }
+        r->pages[index + i] = 0;
+    }
+    return ret;
+}
+
+/* Read all the pages that weren't loaded yet straight into guest RAM. */
+static void ram_lazy_read_all(void)
+{
+    int i;
+
+    for (i = 0; i < ram_lazy.num_regions; i++) {
+        RamLazyRegion *r = &ram_lazy.regions[i];
+        ram_addr_t n, count = r->block->length / TARGET_PAGE_SIZE;
+
+        for (n = 0; n < count; n++) {
+            if (r->pages[n] &&
+                ram_lazy_read_pages(r, n, 1, r->block->host +
+                                    n * TARGET_PAGE_SIZE) < 0) {
+                fprintf(stderr, "Could not read RAM page from snapshot\n");
+            }
+        }
+    }
+}
+
+static void ram_lazy_free(void)
+{
+    int i;
+
+    for (i = 0; i < ram_lazy.num_regions; i++) {
+        g_free(ram_lazy.regions[i].pages);
+    }
+    g_free(ram_lazy.regions);
+    ram_lazy.regions = NULL;
+    ram_lazy.num_regions = 0;
+    ram_lazy.num_pages = 0;
+    ram_lazy.bs = NULL;
+    ram_lazy.map_len = 0;
+    if (ram_lazy.fd >= 0) {
+        close(ram_lazy.fd);
+        ram_lazy.fd = -1;
+    }
+}
+
+#ifdef CONFIG_USERFAULTFD
+/* Load the host page at |host|, that belongs to |r|, with UFFDIO_COPY,
+ * which wakes up the threads that were waiting for it. */
+static void ram_lazy_serve_page(RamLazyRegion *r, uint8_t *host,
+                                uint8_t *buf)
+{
+    size_t host_page_size = getpagesize();
+    ram_addr_t index = (host - r->block->host) / TARGET_PAGE_SIZE;
+    struct uffdio_copy copy;
+
+    if (!r->pages[index]) {
+        /* Never sent or sent as a zero page, and dropped since. */
+        struct uffdio_zeropage zero;
+
+        zero.range.start = (uintptr_t)host;
+        zero.range.len = host_page_size;
+        zero.mode = 0;
+        ioctl(ram_lazy.uffd, UFFDIO_ZEROPAGE, &zero);
+        return;
+    }
+
+    if (ram_lazy_read_pages(r, index, host_page_size / TARGET_PAGE_SIZE,
+                            buf) < 0) {
+        fprintf(stderr, "Could not read RAM page from snapshot\n");
+    }
+    copy.dst = (uintptr_t)host;
+    copy.src = (uintptr_t)buf;
+    copy.len = host_page_size;
+    copy.mode = 0;
+    /* EEXIST only means that the page was there already. */
+    ioctl(ram_lazy.uffd, UFFDIO_COPY, &copy);
+}
+
+static void ram_lazy_unregister(void)
+{
+    int i;
+
+    for (i = 0; i < ram_lazy.num_regions; i++) {
+        struct uffdio_range range;
+
+        range.start = (uintptr_t)ram_lazy.regions[i].block->host;
+        range.len = ram_lazy.regions[i].block->length;
+        ioctl(ram_lazy.uffd, UFFDIO_UNREGISTER, &range);
+    }
+}
+
+static void *ram_lazy_thread(void *opaque)
+{
+    size_t host_page_size = getpagesize();
+    uint8_t *buf = qemu_memalign(host_page_size, host_page_size);
+    int region = 0;
+    ram_addr_t next = 0;    /* next host page to prefetch in |region| */
+
+    for (;;) {
+        struct pollfd pfd[2];
+        struct uffd_msg msg;
+        int i;
+
+        pfd[0].fd = ram_lazy.uffd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = ram_lazy.stop_fds[0];
+        pfd[1].events = POLLIN;
+        /* Faults are served as soon as they arrive, but the prefetching
+         * pauses between batches to leave the host CPU to the guest. */
+        if (poll(pfd, 2, RAM_LAZY_PREFETCH_DELAY_MS) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (pfd[1].revents) {
+            break;
+        }
+
+        if (pfd[0].revents & POLLIN) {
+            while (read(ram_lazy.uffd, &msg, sizeof(msg)) == sizeof(msg)) {
+                uint8_t *host;
+                RamLazyRegion *r;
+
+                if (msg.event != UFFD_EVENT_PAGEFAULT) {
+                    continue;
+                }
+                host = (uint8_t *)(uintptr_t)
+                       (msg.arg.pagefault.address & ~(host_page_size - 1));
+                r = ram_lazy_find_region(host);
+                if (r) {
+                    ram_lazy_serve_page(r, host, buf);
+                }
+            }
+            continue;
+        }
+
+        for (i = 0; i < RAM_LAZY_PREFETCH && region < ram_lazy.num_regions;) {
+            RamLazyRegion *r = &ram_lazy.regions[region];
+            uint8_t *host = r->block->host + next;
+
+            if (next >= r->block->length) {
+                region++;
+                next = 0;
+                continue;
+            }
+            if (r->pages[next / TARGET_PAGE_SIZE]) {
+                ram_lazy_serve_page(r, host, buf);
+                i++;
+            }
+            next += host_page_size;
+        }
+        if (region == ram_lazy.num_regions) {
+            /* Everything is loaded, the pages that are still missing are
+             * the dropped zero pages, leave them to the kernel. Nothing
+             * else uses the rest of the state until the thread is joined,
+             * so release it now instead of at the next snapshot command. */
+            ram_lazy_unregister();
+            close(ram_lazy.uffd);
+            ram_lazy.uffd = -1;
+            ram_lazy_free();
+            break;
+        }
+    }
+
+    qemu_vfree(buf);
+    return NULL;
+}
+
+/* Drop the recorded pages from guest RAM and have them faulted in on
+ * demand. Returns -1 if userfaultfd isn't usable here. */
+static int ram_lazy_start_faults(void)
+{
+    size_t host_page_size = getpagesize();
+    int pages_per_host_page = host_page_size / TARGET_PAGE_SIZE;
+    struct uffdio_api api;
+    int i;
+
+    if (host_page_size < TARGET_PAGE_SIZE ||
+        host_page_size % TARGET_PAGE_SIZE) {
+        return -1;
+    }
+    ram_lazy.uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (ram_lazy.uffd < 0) {
+        return -1;
+    }
+    api.api = UFFD_API;
+    api.features = 0;
+    if (ioctl(ram_lazy.uffd, UFFDIO_API, &api) < 0 ||
+        qemu_pipe(ram_lazy.stop_fds) < 0) {
+        close(ram_lazy.uffd);
+        ram_lazy.uffd = -1;
+        return -1;
+    }
+
+    for (i = 0; i < ram_lazy.num_regions; i++) {
+        RamLazyRegion *r = &ram_lazy.regions[i];
+        ram_addr_t n, count = r->block->length / TARGET_PAGE_SIZE;
+        struct uffdio_register reg;
+
+        reg.range.start = (uintptr_t)r->block->host;
+        reg.range.len = r->block->length;
+        reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+        if (reg.range.start % host_page_size ||
+            reg.range.len % host_page_size ||
+            ioctl(ram_lazy.uffd, UFFDIO_REGISTER, &reg) < 0) {
+            /* Read the pages of this block right away instead. */
+            for (n = 0; n < count; n++) {
+                if (r->pages[n]) {
+                    ram_lazy_read_pages(r, n, 1, r->block->host +
+                                        n * TARGET_PAGE_SIZE);
+                }
+            }
+            continue;
+        }
+
+        /* A host page can only be dropped if all its target pages are to
+         * be read, the other pages are read right away. */
+        for (n = 0; n < count; n += pages_per_host_page) {
+            uint8_t *host = r->block->host + n * TARGET_PAGE_SIZE;
+            int k, lazy = 0;
+
+            for (k = 0; k < pages_per_host_page; k++) {
+                lazy += r->pages[n + k] != 0;
+            }
+            if (lazy == pages_per_host_page) {
+                qemu_madvise(host, host_page_size, QEMU_MADV_DONTNEED);
+            } else if (lazy > 0) {
+                for (k = 0; k < pages_per_host_page; k++) {
+                    if (r->pages[n + k]) {
+                        ram_lazy_read_pages(r, n + k, 1,
+                                            host + k * TARGET_PAGE_SIZE);
+                    }
+                }
+            }
+        }
+    }
+
+    ram_lazy.running = 1;
+    qemu_thread_create(&ram_lazy.thread, "ram-lazy-load", ram_lazy_thread,
+                       NULL, QEMU_THREAD_JOINABLE);
+    return 0;
+}
+
+static void ram_lazy_stop_faults(void)
+{
+    if (!ram_lazy.running) {
+        return;
+    }
+
+    while (write(ram_lazy.stop_fds[1], "", 1) < 0 && errno == EINTR) {
+    }
+    qemu_thread_join(&ram_lazy.thread);
+    ram_lazy.running = 0;
+
+    if (ram_lazy.uffd >= 0) {
+        ram_lazy_unregister();
+        close(ram_lazy.uffd);
+        ram_lazy.uffd = -1;
+    }
+    close(ram_lazy.stop_fds[0]);
+    close(ram_lazy.stop_fds[1]);
+}
+#endif /* CONFIG_USERFAULTFD */
+
+void ram_lazy_load_begin(BlockDriverState *bs)
+{
+    RAMBlock *block;
+    int n = 0;
+
+    ram_lazy_load_finish();
+    if (!ram_lazy.enabled) {
+        return;
+    }
+
+    ram_lazy.fd = bdrv_open_vmstate_file(bs);
+    if (ram_lazy.fd < 0) {
+        ram_lazy.fd = -1;
+        return;
+    }
+    ram_lazy.bs = bs;
+
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        n++;
+    }
+    ram_lazy.regions = g_malloc0(n * sizeof(RamLazyRegion));
+    QTAILQ_FOREACH(block, &ram_list.blocks, next) {
+        RamLazyRegion *r = &ram_lazy.regions[ram_lazy.num_regions++];
+
+        r->block = block;
+        r->pages = g_malloc0((block->length / TARGET_PAGE_SIZE) *
+                             sizeof(uint64_t));
+    }
+}
+
+void ram_lazy_load_end(int success)
+{
+    if (!ram_lazy.regions) {
+        return;
+    }
+    ram_lazy.bs = NULL;
+    if (!success || ram_lazy.num_pages == 0) {
+        ram_lazy_free();
+        return;
+    }
+#ifdef CONFIG_USERFAULTFD
+    if (ram_lazy_start_faults() == 0) {
+        return;
+    }
+#endif
+    ram_lazy_read_all();
+    ram_lazy_free();
+}
+
+void ram_lazy_load_finish(void)
+{
+#ifdef CONFIG_USERFAULTFD
+    /* The thread may have released everything already. */
+    ram_lazy_stop_faults();
+#endif
+    if (!ram_lazy.regions) {
+        return;
+    }
+    ram_lazy_read_all();
+    ram_lazy_free();
+}
+
 static RAMBlock *last_block;
 static ram_addr_t last_offset;
 
-static int ram_save_block(QEMUFile *f)
+/* Find the next dirty page, starting from the last one that was found,
+ * and clear its dirty bit. Returns 0 if there are no dirty pages left. */
+static int ram_find_dirty_page(RAMBlock **pblock, ram_addr_t *poffset)
 {
     RAMBlock *block = last_block;
     ram_addr_t offset = last_offset;
     ram_addr_t current_addr;
-    int bytes_sent = 0;
+    int found = 0;
 
     if (!block)
         block = QTAILQ_FIRST(&ram_list.blocks);
@@ -128,35 +770,10 @@ static int ram_save_block(QEMUFile *f)
     do {
         if (cpu_physical_memory_get_dirty(current_addr, TARGET_PAGE_SIZE,
                                           DIRTY_MEMORY_MIGRATION)) {
-            uint8_t *p;
-            int cont = (block == last_block) ? RAM_SAVE_FLAG_CONTINUE : 0;
-
             cpu_physical_memory_reset_dirty(current_addr,
                                             TARGET_PAGE_SIZE,
                                             DIRTY_MEMORY_MIGRATION);
-
-            p = block->host + offset;
-
-            if (is_dup_page(p, *p)) {
-                qemu_put_be64(f, offset | cont | RAM_SAVE_FLAG_COMPRESS);
-                if (!cont) {
-                    qemu_put_byte(f, strlen(block->idstr));
-                    qemu_put_buffer(f, (uint8_t *)block->idstr,
-                                    strlen(block->idstr));
-                }
-                qemu_put_byte(f, *p);
-                bytes_sent = 1;
-            } else {
-                qemu_put_be64(f, offset | cont | RAM_SAVE_FLAG_PAGE);
-                if (!cont) {
-                    qemu_put_byte(f, strlen(block->idstr));
-                    qemu_put_buffer(f, (uint8_t *)block->idstr,
-                                    strlen(block->idstr));
-                }
-                qemu_put_buffer(f, p, TARGET_PAGE_SIZE);
-                bytes_sent = TARGET_PAGE_SIZE;
-            }
-
+            found = 1;
             break;
         }
 
@@ -175,9 +792,173 @@ static int ram_save_block(QEMUFile *f)
     last_block = block;
     last_offset = offset;
 
+    *pblock = block;
+    *poffset = offset;
+    return found;
+}
+
+/* Block of the last page record written, which the next record can refer
+ * to with RAM_SAVE_FLAG_CONTINUE. */
+static RAMBlock *last_sent_block;
+
+static void ram_put_page_header(QEMUFile *f, RAMBlock *block,
+                                ram_addr_t offset, int flag)
+{
+    int cont = (block == last_sent_block) ? RAM_SAVE_FLAG_CONTINUE : 0;
+
+    qemu_put_be64(f, offset | cont | flag);
+    if (!cont) {
+        qemu_put_byte(f, strlen(block->idstr));
+        qemu_put_buffer(f, (uint8_t *)block->idstr, strlen(block->idstr));
+    }
+    last_sent_block = block;
+}
+
+/* Write the page at |offset| in |block|. |job| is the result of its
+ * compression, or NULL if it wasn't compressed. Returns the number of
+ * bytes of page data sent. */
+static int ram_save_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset,
+                         RamCompressJob *job)
+{
+    uint8_t *p = block->host + offset;
+
+    if (job && job->len > 0) {
+        ram_put_page_header(f, block, offset, RAM_SAVE_FLAG_DEFLATE);
+        qemu_put_be32(f, job->len);
+        qemu_put_buffer(f, job->data, job->len);
+        return job->len;
+    }
+    if (!job && is_dup_page(p)) {
+        ram_put_page_header(f, block, offset, RAM_SAVE_FLAG_COMPRESS);
+        qemu_put_byte(f, *p);
+        return 1;
+    }
+    ram_put_page_header(f, block, offset, RAM_SAVE_FLAG_PAGE);
+    qemu_put_buffer(f, p, TARGET_PAGE_SIZE);
+    return TARGET_PAGE_SIZE;
+}
+
+/* Send up to RAM_COMPRESS_BATCH dirty pages, deflating the ones that
+ * aren't duplicate pages in parallel. */
+static int ram_save_compressed_batch(QEMUFile *f)
+{
+    RAMBlock *blocks[RAM_COMPRESS_BATCH];
+    ram_addr_t offsets[RAM_COMPRESS_BATCH];
+    RamCompressJob *jobs[RAM_COMPRESS_BATCH];
+    int num_pages, num_jobs = 0;
+    int bytes_sent = 0;
+    int i;
+
+    ram_compress_init();
+
+    for (num_pages = 0; num_pages < RAM_COMPRESS_BATCH; num_pages++) {
+        uint8_t *p;
+
+        if (!ram_find_dirty_page(&blocks[num_pages], &offsets[num_pages])) {
+            break;
+        }
+        p = blocks[num_pages]->host + offsets[num_pages];
+        jobs[num_pages] = NULL;
+        if (!is_dup_page(p)) {
+            jobs[num_pages] = &ram_compress.jobs[num_jobs++];
+            jobs[num_pages]->page = p;
+        }
+    }
+
+    if (ram_compress_run(num_jobs, 0) < 0) {
+        qemu_file_set_error(f, -EIO);
+        return 0;
+    }
+
+    for (i = 0; i < num_pages; i++) {
+        bytes_sent += ram_save_page(f, blocks[i], offsets[i], jobs[i]);
+    }
+
+    return bytes_sent;
+}
+
+/* Write the pages at |offsets| in |block| as a single record, where the
+ * page data is contiguous and aligned on TARGET_PAGE_SIZE in the stream,
+ * so that a lazy load can find it in the snapshot file. */
+static int ram_put_page_batch(QEMUFile *f, RAMBlock *block,
+                              ram_addr_t *offsets, int num_pages)
+{
+    int64_t pos;
+    int i, pad;
+
+    if (num_pages == 0) {
+        return 0;
+    }
+
+    ram_put_page_header(f, block, 0, RAM_SAVE_FLAG_PAGE_BATCH);
+    qemu_put_be32(f, num_pages);
+    for (i = 0; i < num_pages; i++) {
+        qemu_put_be64(f, offsets[i]);
+    }
+    pos = qemu_ftell(f) + 2;
+    pad = -pos & (TARGET_PAGE_SIZE - 1);
+    qemu_put_be16(f, pad);
+    for (i = 0; i < pad; i++) {
+        qemu_put_byte(f, 0);
+    }
+    for (i = 0; i < num_pages; i++) {
+        qemu_put_buffer(f, block->host + offsets[i], TARGET_PAGE_SIZE);
+    }
+    return num_pages * TARGET_PAGE_SIZE;
+}
+
+/* Send up to RAM_PAGE_BATCH dirty pages, grouping the ones that aren't
+ * duplicate pages into batch records. */
+static int ram_save_page_batch(QEMUFile *f)
+{
+    ram_addr_t offsets[RAM_PAGE_BATCH];
+    RAMBlock *batch_block = NULL;
+    RAMBlock *block;
+    ram_addr_t offset;
+    int num_pages = 0;
+    int bytes_sent = 0;
+    int i;
+
+    for (i = 0; i < RAM_PAGE_BATCH; i++) {
+        if (!ram_find_dirty_page(&block, &offset)) {
+            break;
+        }
+        if (is_dup_page(block->host + offset)) {
+            bytes_sent += ram_save_page(f, block, offset, NULL);
+            continue;
+        }
+        if (block != batch_block) {
+            bytes_sent += ram_put_page_batch(f, batch_block, offsets,
+                                             num_pages);
+            batch_block = block;
+            num_pages = 0;
+        }
+        offsets[num_pages++] = offset;
+    }
+    bytes_sent += ram_put_page_batch(f, batch_block, offsets, num_pages);
+
     return bytes_sent;
 }
 
+static int ram_save_block(QEMUFile *f)
+{
+    RAMBlock *block;
+    ram_addr_t offset;
+
+    if (ram_compress_enabled) {
+        return ram_save_compressed_batch(f);
+    }
+    if (ram_lazy.enabled) {
+        return ram_save_page_batch(f);
+    }
+
+    if (!ram_find_dirty_page(&block, &offset)) {
+        return 0;
+    }
+
+    return ram_save_page(f, block, offset, NULL);
+}
+
 static uint64_t bytes_transferred;
 
 static ram_addr_t ram_save_remaining(void)
@@ -275,6 +1056,7 @@ int ram_save_live(QEMUFile *f, int stage, void *opaque)
         bytes_transferred = 0;
         last_block = NULL;
         last_offset = 0;
+        last_sent_block = NULL;
         sort_ram_list();
 
         /* Make sure all dirty bits are set */
@@ -375,6 +1157,7 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
 {
     ram_addr_t addr;
     int flags;
+    int num_jobs = 0;
 
     if (version_id < 3 || version_id > 4) {
         return -EINVAL;
@@ -386,6 +1169,17 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
         flags = addr & ~TARGET_PAGE_MASK;
         addr &= TARGET_PAGE_MASK;
 
+        /* Queued pages must be inflated before any other record writes to
+         * guest RAM, which could be one of the same pages. */
+        if (num_jobs > 0 && (flags & (RAM_SAVE_FLAG_COMPRESS |
+                                      RAM_SAVE_FLAG_PAGE |
+                                      RAM_SAVE_FLAG_PAGE_BATCH))) {
+            if (ram_compress_run(num_jobs, 1) < 0) {
+                return -EINVAL;
+            }
+            num_jobs = 0;
+        }
+
         if (flags & RAM_SAVE_FLAG_MEM_SIZE) {
             if (version_id != 3) {
                 if (addr != ram_bytes_total()) {
@@ -436,6 +1230,7 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
             }
 
             ch = qemu_get_byte(f);
+            ram_lazy_forget(host);
             memset(host, ch, TARGET_PAGE_SIZE);
 #ifndef _WIN32
             if (ch == 0 &&
@@ -451,13 +1246,74 @@ int ram_load(QEMUFile *f, void *opaque, int version_id)
             else
                 host = host_from_stream_offset(f, addr, flags);
 
+            ram_lazy_forget(host);
             qemu_get_buffer(f, host, TARGET_PAGE_SIZE);
+        } else if (flags & RAM_SAVE_FLAG_DEFLATE) {
+            RamCompressJob *job;
+            void *host;
+            uint32_t len;
+
+            if (version_id != 3)
+                host = qemu_get_ram_ptr(addr);
+            else
+                host = host_from_stream_offset(f, addr, flags);
+            len = qemu_get_be32(f);
+            if (!host || len == 0 || len >= TARGET_PAGE_SIZE) {
+                return -EINVAL;
+            }
+
+            /* Queue the page, it is inflated with the rest of the batch. */
+            ram_lazy_forget(host);
+            ram_compress_init();
+            job = &ram_compress.jobs[num_jobs++];
+            job->page = host;
+            job->len = len;
+            qemu_get_buffer(f, job->data, len);
+            if (num_jobs == RAM_COMPRESS_BATCH) {
+                num_jobs = 0;
+                if (ram_compress_run(RAM_COMPRESS_BATCH, 1) < 0) {
+                    return -EINVAL;
+                }
+            }
+        } else if (flags & RAM_SAVE_FLAG_PAGE_BATCH) {
+            uint8_t *base;
+            ram_addr_t *offsets;
+            uint32_t i, count;
+
+            if (version_id != 3) {
+                return -EINVAL;
+            }
+            base = host_from_stream_offset(f, 0, flags);
+            count = qemu_get_be32(f);
+            if (!base || count > RAM_PAGE_BATCH) {
+                return -EINVAL;
+            }
+
+            offsets = g_malloc(count * sizeof(ram_addr_t));
+            for (i = 0; i < count; i++) {
+                offsets[i] = qemu_get_be64(f);
+            }
+            qemu_get_skip(f, qemu_get_be16(f));
+            for (i = 0; i < count; i++) {
+                uint8_t *host = base + offsets[i];
+
+                if (ram_lazy_record(host, qemu_get_pos(f))) {
+                    qemu_get_skip(f, TARGET_PAGE_SIZE);
+                } else {
+                    ram_lazy_forget(host);
+                    qemu_get_buffer(f, host, TARGET_PAGE_SIZE);
+                }
+            }
+            g_free(offsets);
         }
         if (qemu_file_get_error(f)) {
             return -EIO;
         }
     } while (!(flags & RAM_SAVE_FLAG_EOS));
 
+    if (ram_compress_run(num_jobs, 1) < 0) {
+        return -EINVAL;
+    }
     return 0;
 }
 #endif
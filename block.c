@@ -28,6 +28,7 @@
 #include "qemu/iov.h"
 #include "qemu/module.h"
 //#include "qapi/qmp/types.h"
+#include "qapi/qmp/qint.h"
 #include "qapi/qmp/qjson.h"
 
 #ifdef CONFIG_BSD
@@ -1290,6 +1291,14 @@ void bdrv_set_translation_hint(BlockDriverState *bs, int translation)
     bs->translation = translation;
 }
 
+void bdrv_set_metadata_cache_hint(BlockDriverState *bs,
+                                  int64_t l2_cache_size,
+                                  int64_t refcount_cache_size)
+{
+    bs->l2_cache_size_hint = l2_cache_size;
+    bs->refcount_cache_size_hint = refcount_cache_size;
+}
+
 void bdrv_get_geometry_hint(BlockDriverState *bs,
                             int *pcyls, int *pheads, int *psecs)
 {
@@ -1646,12 +1655,22 @@ static void bdrv_stats_iter(QObject *data, void *opaque)
     monitor_printf(mon, " rd_bytes=%" PRId64
                         " wr_bytes=%" PRId64
                         " rd_operations=%" PRId64
-                        " wr_operations=%" PRId64
-                        "\n",
+                        " wr_operations=%" PRId64,
                         qdict_get_int(qdict, "rd_bytes"),
                         qdict_get_int(qdict, "wr_bytes"),
                         qdict_get_int(qdict, "rd_operations"),
                         qdict_get_int(qdict, "wr_operations"));
+    if (qdict_haskey(qdict, "l2_cache_hits")) {
+        monitor_printf(mon, " l2_cache_hits=%" PRId64
+                            " l2_cache_misses=%" PRId64
+                            " refcount_cache_hits=%" PRId64
+                            " refcount_cache_misses=%" PRId64,
+                            qdict_get_int(qdict, "l2_cache_hits"),
+                            qdict_get_int(qdict, "l2_cache_misses"),
+                            qdict_get_int(qdict, "refcount_cache_hits"),
+                            qdict_get_int(qdict, "refcount_cache_misses"));
+    }
+    monitor_printf(mon, "\n");
 }
 
 void bdrv_stats_print(Monitor *mon, const QObject *data)
@@ -1663,6 +1682,7 @@ static QObject* bdrv_info_stats_bs(BlockDriverState *bs)
 {
     QObject *res;
     QDict *dict;
+    BlockDriverInfo bdi;
 
     res = qobject_from_jsonf("{ 'stats': {"
                              "'rd_bytes': %" PRId64 ","
@@ -1677,6 +1697,18 @@ static QObject* bdrv_info_stats_bs(BlockDriverState *bs)
                              (uint64_t)BDRV_SECTOR_SIZE);
     dict  = qobject_to_qdict(res);
 
+    if (bdrv_get_info(bs, &bdi) == 0 &&
+        (bdi.l2_cache_hits || bdi.l2_cache_misses)) {
+        QDict *stats = qobject_to_qdict(qdict_get(dict, "stats"));
+        qdict_put(stats, "l2_cache_hits", qint_from_int(bdi.l2_cache_hits));
+        qdict_put(stats, "l2_cache_misses",
+                  qint_from_int(bdi.l2_cache_misses));
+        qdict_put(stats, "refcount_cache_hits",
+                  qint_from_int(bdi.refcount_cache_hits));
+        qdict_put(stats, "refcount_cache_misses",
+                  qint_from_int(bdi.refcount_cache_misses));
+    }
+
     if (*bs->device_name) {
         qdict_put(dict, "device", qstring_from_str(bs->device_name));
     }
@@ -1780,6 +1812,34 @@ int bdrv_load_vmstate(BlockDriverState *bs, uint8_t *buf,
     return -ENOTSUP;
 }
 
+/* The VM state can only be mapped if the image is a plain file that can
+ * be read directly. */
+static int bdrv_vmstate_in_file(BlockDriverState *bs)
+{
+    return bs->drv && bs->drv->bdrv_map_vmstate &&
+           bs->file && bs->file->drv && bs->file->drv->protocol_name &&
+           !strcmp(bs->file->drv->protocol_name, "file");
+}
+
+int64_t bdrv_map_vmstate(BlockDriverState *bs, int64_t pos, int64_t *pnum)
+{
+    if (!bs->drv)
+        return -ENOMEDIUM;
+    if (!bdrv_vmstate_in_file(bs))
+        return -ENOTSUP;
+    return bs->drv->bdrv_map_vmstate(bs, pos, pnum);
+}
+
+int bdrv_open_vmstate_file(BlockDriverState *bs)
+{
+    int fd;
+
+    if (!bdrv_vmstate_in_file(bs))
+        return -ENOTSUP;
+    fd = qemu_open(bs->file->filename, O_RDONLY | O_BINARY);
+    return fd < 0 ? -errno : fd;
+}
+
 void bdrv_debug_event(BlockDriverState *bs, BlkDebugEvent event)
 {
     BlockDriver *drv = bs->drv;
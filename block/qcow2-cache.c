@@ -0,0 +1,215 @@
+/*
+ * Metadata table cache for the QCOW version 2 format
+ *
+ * Copyright (c) 2016 The Android Open Source Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "qemu-common.h"
+#include "block/block_int.h"
+#include "block/qcow2.h"
+
+/*
+ * The cache keeps a fixed number of tables, all of the same size. Tables are
+ * found through a hash of their image file offset, with one chain of entries
+ * per bucket, and are evicted with the CLOCK algorithm: each entry has a
+ * reference bit that is set when it is used, and a hand that goes around the
+ * entries clears these bits until it finds an entry that wasn't used since
+ * its last visit.
+ *
+ * The cache is write-through: callers write any table they modify to the
+ * image file themselves, so evicting an entry never requires any I/O.
+ */
+
+typedef struct Qcow2CacheEntry {
+    uint64_t offset;    /* 0 if the entry is free */
+    int next;           /* next entry in the same bucket, or -1 */
+    int referenced;
+} Qcow2CacheEntry;
+
+struct Qcow2Cache {
+    Qcow2CacheEntry *entries;
+    int size;
+    int *buckets;       /* first entry of each bucket, or -1 */
+    int bucket_mask;
+    int clock_hand;
+    int table_size;
+    uint8_t *tables;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+static inline int qcow2_cache_bucket(Qcow2Cache *c, uint64_t offset)
+{
+    /* Table offsets are cluster-aligned, mix the upper bits down. */
+    return (int)(((offset >> 9) * 0x9E3779B97F4A7C15ULL) >> 40) &
+           c->bucket_mask;
+}
+
+static inline void *qcow2_cache_table(Qcow2Cache *c, int i)
+{
+    return c->tables + (size_t)i * c->table_size;
+}
+
+Qcow2Cache *qcow2_cache_create(int num_tables, int table_size)
+{
+    Qcow2Cache *c;
+    int num_buckets, i;
+
+    assert(num_tables > 0);
+
+    num_buckets = 1;
+    while (num_buckets < num_tables) {
+        num_buckets <<= 1;
+    }
+
+    c = g_malloc0(sizeof(*c));
+    c->size = num_tables;
+    c->table_size = table_size;
+    c->entries = g_malloc0(num_tables * sizeof(Qcow2CacheEntry));
+    c->buckets = g_malloc(num_buckets * sizeof(int));
+    c->bucket_mask = num_buckets - 1;
+    c->tables = g_malloc((size_t)num_tables * table_size);
+
+    for (i = 0; i < num_buckets; i++) {
+        c->buckets[i] = -1;
+    }
+    for (i = 0; i < num_tables; i++) {
+        c->entries[i].next = -1;
+    }
+    return c;
+}
+
+void qcow2_cache_destroy(Qcow2Cache *c)
+{
+    if (!c) {
+        return;
+    }
+    g_free(c->tables);
+    g_free(c->buckets);
+    g_free(c->entries);
+    g_free(c);
+}
+
+static int qcow2_cache_find(Qcow2Cache *c, uint64_t offset)
+{
+    int i;
+
+    for (i = c->buckets[qcow2_cache_bucket(c, offset)]; i >= 0;
+         i = c->entries[i].next) {
+        if (c->entries[i].offset == offset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void qcow2_cache_unlink(Qcow2Cache *c, int i)
+{
+    int *link = &c->buckets[qcow2_cache_bucket(c, c->entries[i].offset)];
+
+    while (*link != i) {
+        link = &c->entries[*link].next;
+    }
+    *link = c->entries[i].next;
+    c->entries[i].next = -1;
+    c->entries[i].offset = 0;
+    c->entries[i].referenced = 0;
+}
+
+void *qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int i = qcow2_cache_find(c, offset);
+
+    if (i < 0) {
+        c->misses++;
+        return NULL;
+    }
+    c->hits++;
+    c->entries[i].referenced = 1;
+    return qcow2_cache_table(c, i);
+}
+
+void *qcow2_cache_insert(Qcow2Cache *c, uint64_t offset)
+{
+    Qcow2CacheEntry *e;
+    int i, bucket;
+
+    assert(offset != 0);
+
+    i = qcow2_cache_find(c, offset);
+    if (i >= 0) {
+        c->entries[i].referenced = 1;
+        return qcow2_cache_table(c, i);
+    }
+
+    /* Free entries are taken right away, used ones get a second chance
+     * if they were referenced since the hand last went past them. */
+    for (;;) {
+        i = c->clock_hand;
+        c->clock_hand = (i + 1 == c->size) ? 0 : i + 1;
+        e = &c->entries[i];
+        if (e->offset == 0) {
+            break;
+        }
+        if (!e->referenced) {
+            qcow2_cache_unlink(c, i);
+            break;
+        }
+        e->referenced = 0;
+    }
+
+    bucket = qcow2_cache_bucket(c, offset);
+    e->offset = offset;
+    e->referenced = 1;
+    e->next = c->buckets[bucket];
+    c->buckets[bucket] = i;
+    return qcow2_cache_table(c, i);
+}
+
+void qcow2_cache_discard(Qcow2Cache *c, uint64_t offset)
+{
+    int i = qcow2_cache_find(c, offset);
+
+    if (i >= 0) {
+        qcow2_cache_unlink(c, i);
+    }
+}
+
+void qcow2_cache_reset(Qcow2Cache *c)
+{
+    int i;
+
+    for (i = 0; i <= c->bucket_mask; i++) {
+        c->buckets[i] = -1;
+    }
+    for (i = 0; i < c->size; i++) {
+        c->entries[i].offset = 0;
+        c->entries[i].next = -1;
+        c->entries[i].referenced = 0;
+    }
+    c->clock_hand = 0;
+}
+
+void qcow2_cache_get_stats(Qcow2Cache *c, uint64_t *hits, uint64_t *misses)
+{
+    *hits = c->hits;
+    *misses = c->misses;
+}
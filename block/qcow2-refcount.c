@@ -56,12 +56,12 @@ static int write_refcount_block(BlockDriverState *bs)
 /*********************************************************/
 /* refcount handling */
 
-int qcow2_refcount_init(BlockDriverState *bs)
+int qcow2_refcount_init(BlockDriverState *bs, int cache_tables)
 {
     BDRVQcowState *s = bs->opaque;
     int ret, refcount_table_size2, i;
 
-    s->refcount_block_cache = g_malloc(s->cluster_size);
+    s->refcount_cache = qcow2_cache_create(cache_tables, s->cluster_size);
     refcount_table_size2 = s->refcount_table_size * sizeof(uint64_t);
     s->refcount_table = g_malloc(refcount_table_size2);
     if (s->refcount_table_size > 0) {
@@ -81,7 +81,7 @@ int qcow2_refcount_init(BlockDriverState *bs)
 void qcow2_refcount_close(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
-    g_free(s->refcount_block_cache);
+    qcow2_cache_destroy(s->refcount_cache);
     g_free(s->refcount_table);
 }
 
@@ -90,6 +90,7 @@ static int load_refcount_block(BlockDriverState *bs,
                                int64_t refcount_block_offset)
 {
     BDRVQcowState *s = bs->opaque;
+    uint16_t *refcount_block;
     int ret;
 
     if (cache_refcount_updates) {
@@ -99,17 +100,39 @@ static int load_refcount_block(BlockDriverState *bs,
         }
     }
 
-    BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_LOAD);
-    ret = bdrv_pread(bs->file, refcount_block_offset, s->refcount_block_cache,
-                     s->cluster_size);
-    if (ret < 0) {
-        return ret;
+    refcount_block = qcow2_cache_lookup(s->refcount_cache,
+                                        refcount_block_offset);
+    if (refcount_block == NULL) {
+        refcount_block = qcow2_cache_insert(s->refcount_cache,
+                                            refcount_block_offset);
+        BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_LOAD);
+        ret = bdrv_pread(bs->file, refcount_block_offset, refcount_block,
+                         s->cluster_size);
+        if (ret < 0) {
+            qcow2_cache_discard(s->refcount_cache, refcount_block_offset);
+            s->refcount_block_cache_offset = 0;
+            return ret;
+        }
     }
 
+    s->refcount_block_cache = refcount_block;
     s->refcount_block_cache_offset = refcount_block_offset;
     return 0;
 }
 
+/*
+ * Makes a new, zeroed refcount block at the given offset the current one.
+ * The caller is responsible for writing it to the image file.
+ */
+static void new_refcount_block(BlockDriverState *bs, int64_t offset)
+{
+    BDRVQcowState *s = bs->opaque;
+
+    s->refcount_block_cache = qcow2_cache_insert(s->refcount_cache, offset);
+    memset(s->refcount_block_cache, 0, s->cluster_size);
+    s->refcount_block_cache_offset = offset;
+}
+
 /*
  * Returns the refcount of the cluster given by its index. Any non-negative
  * return value is the refcount of the cluster, negative values are -errno
@@ -246,8 +269,7 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 
     if (in_same_refcount_block(s, new_block, cluster_index << s->cluster_bits)) {
         /* Zero the new refcount block before updating it */
-        memset(s->refcount_block_cache, 0, s->cluster_size);
-        s->refcount_block_cache_offset = new_block;
+        new_refcount_block(bs, new_block);
 
         /* The block describes itself, need to update the cache */
         int block_index = (new_block >> s->cluster_bits) &
@@ -263,8 +285,7 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 
         /* Initialize the new refcount block only after updating its refcount,
          * update_refcount uses the refcount cache itself */
-        memset(s->refcount_block_cache, 0, s->cluster_size);
-        s->refcount_block_cache_offset = new_block;
+        new_refcount_block(bs, new_block);
     }
 
     /* Now the new refcount block needs to be written to disk */
@@ -417,6 +438,10 @@ static int64_t alloc_refcount_block(BlockDriverState *bs, int64_t cluster_index)
 fail_table:
     g_free(new_table);
 fail_block:
+    /* the current block may not match the image file anymore */
+    if (s->refcount_block_cache_offset != 0) {
+        qcow2_cache_discard(s->refcount_cache, s->refcount_block_cache_offset);
+    }
     s->refcount_block_cache_offset = 0;
     return ret;
 }
@@ -454,7 +479,6 @@ static int write_refcount_block_entries(BlockDriverState *bs,
     return 0;
 }
 
-/* XXX: cache several refcount block clusters ? */
 static int QEMU_WARN_UNUSED_RESULT update_refcount(BlockDriverState *bs,
     int64_t offset, int64_t length, int addend)
 {
@@ -136,6 +136,26 @@ static int qcow_read_extensions(BlockDriverState *bs, uint64_t start_offset,
 }
 
 
+/* Number of tables of a metadata cache of |size| bytes, 0 meaning the
+ * default of |default_tables|. Both L2 tables and refcount blocks are one
+ * cluster. */
+static int qcow_cache_tables(BDRVQcowState *s, int64_t size,
+                             int default_tables)
+{
+    int64_t tables;
+
+    if (size <= 0) {
+        return default_tables;
+    }
+    tables = size >> s->cluster_bits;
+    if (tables < 1) {
+        tables = 1;
+    } else if (tables > INT_MAX / s->cluster_size) {
+        tables = INT_MAX / s->cluster_size;
+    }
+    return (int)tables;
+}
+
 static int qcow_open(BlockDriverState *bs, int flags)
 {
     BDRVQcowState *s = bs->opaque;
@@ -204,14 +224,19 @@ static int qcow_open(BlockDriverState *bs, int flags)
         }
     }
     /* alloc L2 cache */
-    s->l2_cache = g_malloc(s->l2_size * L2_CACHE_SIZE * sizeof(uint64_t));
+    s->l2_cache = qcow2_cache_create(
+        qcow_cache_tables(s, bs->l2_cache_size_hint,
+                          QCOW2_DEFAULT_L2_CACHE_TABLES),
+        s->l2_size * sizeof(uint64_t));
     s->cluster_cache = g_malloc(s->cluster_size);
     /* one more sector for decompressed data alignment */
     s->cluster_data = g_malloc(QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size
                                   + 512);
     s->cluster_cache_offset = -1;
 
-    if (qcow2_refcount_init(bs) < 0)
+    if (qcow2_refcount_init(bs,
+            qcow_cache_tables(s, bs->refcount_cache_size_hint,
+                              QCOW2_DEFAULT_REFCOUNT_CACHE_TABLES)) < 0)
         goto fail;
 
     QLIST_INIT(&s->cluster_allocs);
@@ -245,7 +270,7 @@ static int qcow_open(BlockDriverState *bs, int flags)
     qcow2_free_snapshots(bs);
     qcow2_refcount_close(bs);
     g_free(s->l1_table);
-    g_free(s->l2_cache);
+    qcow2_cache_destroy(s->l2_cache);
     g_free(s->cluster_cache);
     g_free(s->cluster_data);
     return -1;
@@ -662,7 +687,7 @@ static void qcow_close(BlockDriverState *bs)
 {
     BDRVQcowState *s = bs->opaque;
     g_free(s->l1_table);
-    g_free(s->l2_cache);
+    qcow2_cache_destroy(s->l2_cache);
     g_free(s->cluster_cache);
     g_free(s->cluster_data);
     qcow2_refcount_close(bs);
@@ -1235,6 +1260,10 @@ static int qcow_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
     BDRVQcowState *s = bs->opaque;
     bdi->cluster_size = s->cluster_size;
     bdi->vm_state_offset = qcow_vm_state_offset(s);
+    qcow2_cache_get_stats(s->l2_cache, &bdi->l2_cache_hits,
+                          &bdi->l2_cache_misses);
+    qcow2_cache_get_stats(s->refcount_cache, &bdi->refcount_cache_hits,
+                          &bdi->refcount_cache_misses);
     return 0;
 }
 
@@ -1295,6 +1324,31 @@ static int qcow_load_vmstate(BlockDriverState *bs, uint8_t *buf,
     return ret;
 }
 
+static int64_t qcow_map_vmstate(BlockDriverState *bs, int64_t pos,
+                                int64_t *pnum)
+{
+    BDRVQcowState *s = bs->opaque;
+    uint64_t offset = qcow_vm_state_offset(s) + pos;
+    uint64_t cluster_offset;
+    int num = INT_MAX >> 9;
+    int ret;
+
+    if (s->crypt_method) {
+        return -ENOTSUP;
+    }
+
+    ret = qcow2_get_cluster_offset(bs, offset, &num, &cluster_offset);
+    if (ret < 0) {
+        return ret;
+    }
+    if (!cluster_offset || (cluster_offset & QCOW_OFLAG_COMPRESSED)) {
+        return -ENOTSUP;
+    }
+
+    *pnum = ((int64_t)num << 9) - (offset & 511);
+    return cluster_offset + (offset & (s->cluster_size - 1));
+}
+
 static QEMUOptionParameter qcow_create_options[] = {
     {
         .name = BLOCK_OPT_SIZE,
@@ -1356,6 +1410,7 @@ static BlockDriver bdrv_qcow2 = {
 
     .bdrv_save_vmstate    = qcow_save_vmstate,
     .bdrv_load_vmstate    = qcow_load_vmstate,
+    .bdrv_map_vmstate     = qcow_map_vmstate,
 
     .bdrv_change_backing_file   = qcow2_change_backing_file,
 
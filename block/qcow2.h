@@ -49,7 +49,10 @@
 #define MIN_CLUSTER_BITS 9
 #define MAX_CLUSTER_BITS 21
 
-#define L2_CACHE_SIZE 16
+/* default number of tables kept in the L2 and refcount block caches, the
+ * l2-cache-size and refcount-cache-size drive options override them */
+#define QCOW2_DEFAULT_L2_CACHE_TABLES       16
+#define QCOW2_DEFAULT_REFCOUNT_CACHE_TABLES 4
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -78,6 +81,8 @@ typedef struct QCowSnapshot {
     uint64_t vm_clock_nsec;
 } QCowSnapshot;
 
+typedef struct Qcow2Cache Qcow2Cache;
+
 typedef struct BDRVQcowState {
     BlockDriverState *hd;
     int cluster_bits;
@@ -92,9 +97,7 @@ typedef struct BDRVQcowState {
     uint64_t cluster_offset_mask;
     uint64_t l1_table_offset;
     uint64_t *l1_table;
-    uint64_t *l2_cache;
-    uint64_t l2_cache_offsets[L2_CACHE_SIZE];
-    uint32_t l2_cache_counts[L2_CACHE_SIZE];
+    Qcow2Cache *l2_cache;
     uint8_t *cluster_cache;
     uint8_t *cluster_data;
     uint64_t cluster_cache_offset;
@@ -103,6 +106,8 @@ typedef struct BDRVQcowState {
     uint64_t *refcount_table;
     uint64_t refcount_table_offset;
     uint32_t refcount_table_size;
+    Qcow2Cache *refcount_cache;
+    /* the refcount block being worked on, which is in refcount_cache */
     uint64_t refcount_block_cache_offset;
     uint16_t *refcount_block_cache;
     int64_t free_cluster_index;
@@ -170,7 +175,7 @@ int qcow2_backing_read1(BlockDriverState *bs,
                   int64_t sector_num, uint8_t *buf, int nb_sectors);
 
 /* qcow2-refcount.c functions */
-int qcow2_refcount_init(BlockDriverState *bs);
+int qcow2_refcount_init(BlockDriverState *bs, int cache_tables);
 void qcow2_refcount_close(BlockDriverState *bs);
 
 int64_t qcow2_alloc_clusters(BlockDriverState *bs, int64_t size);
@@ -206,6 +211,23 @@ uint64_t qcow2_alloc_compressed_cluster_offset(BlockDriverState *bs,
 
 int qcow2_alloc_cluster_link_l2(BlockDriverState *bs, QCowL2Meta *m);
 
+/* qcow2-cache.c functions */
+Qcow2Cache *qcow2_cache_create(int num_tables, int table_size);
+void qcow2_cache_destroy(Qcow2Cache *c);
+
+/* Return the cached table at |offset|, or NULL if it isn't cached. The
+ * table stays valid until the next qcow2_cache_insert() call. */
+void *qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset);
+
+/* Return the table buffer for |offset|, evicting another table if needed.
+ * Its contents are undefined unless the table was already cached, and the
+ * caller must either fill it or call qcow2_cache_discard(). */
+void *qcow2_cache_insert(Qcow2Cache *c, uint64_t offset);
+
+void qcow2_cache_discard(Qcow2Cache *c, uint64_t offset);
+void qcow2_cache_reset(Qcow2Cache *c);
+void qcow2_cache_get_stats(Qcow2Cache *c, uint64_t *hits, uint64_t *misses);
+
 /* qcow2-snapshot.c functions */
 int qcow2_snapshot_create(BlockDriverState *bs, QEMUSnapshotInfo *sn_info);
 int qcow2_snapshot_goto(BlockDriverState *bs, const char *snapshot_id);
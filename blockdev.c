@@ -422,6 +422,9 @@ DriveInfo *drive_init(QemuOpts *opts, int default_to_scsi, int *fatal_error)
     QTAILQ_INSERT_TAIL(&drives, dinfo, next);
 
     bdrv_set_on_error(dinfo->bdrv, on_read_error, on_write_error);
+    bdrv_set_metadata_cache_hint(dinfo->bdrv,
+                                 qemu_opt_get_size(opts, "l2-cache-size", 0),
+                                 qemu_opt_get_size(opts, "refcount-cache-size", 0));
 
     switch(type) {
     case IF_IDE:
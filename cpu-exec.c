@@ -125,6 +125,7 @@ static TranslationBlock *tb_find_slow(CPUArchState *env,
     target_ulong phys_pc, phys_page1, phys_page2, virt_page2;
 
     tcg_ctx.tb_ctx.tb_invalidated_flag = 0;
+    tcg_ctx.tb_ctx.tb_find_slow_count++;
 
     /* find translated block using physical mappings */
     phys_pc = get_page_addr_code(env, pc);
@@ -155,6 +156,7 @@ static TranslationBlock *tb_find_slow(CPUArchState *env,
     }
  not_found:
    /* if no translated code available, then translate it now */
+    tcg_ctx.tb_ctx.tb_find_miss_count++;
     tb = tb_gen_code(env, pc, cs_base, flags, 0);
 
  found:
@@ -179,6 +181,7 @@ static inline TranslationBlock *tb_find_fast(CPUArchState *env)
        always be the same before a given translated block
        is executed. */
     cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    tcg_ctx.tb_ctx.tb_find_count++;
     tb = env->tb_jmp_cache[tb_jmp_cache_hash_func(pc)];
     if (unlikely(!tb || tb->pc != pc || tb->cs_base != cs_base ||
                  tb->flags != flags)) {
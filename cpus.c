@@ -33,12 +33,37 @@
 #include "sysemu/kvm.h"
 #include "exec/exec-all.h"
 #include "exec/hax.h"
+#include "qemu/thread.h"
 
 #include "sysemu/cpus.h"
 
+#include "android-qemu1-glue/looper-qemu.h"
+
 static CPUState *cur_cpu;
 static CPUState *next_cpu;
 
+/* By default, the virtual CPUs run on the main loop thread, in between
+ * two waits for I/O, and nothing needs to be locked.
+ *
+ * With qemu_start_vcpu_thread(), TCG runs all the virtual CPUs on a thread
+ * of their own, while the main loop thread only handles I/O, timers and
+ * bottom halves. The emulator state is then protected by the global
+ * mutex: the vCPU thread holds it while it executes guest code, and the
+ * main loop thread while it runs anything but its host waits. When the
+ * latter wants the mutex, it sets iothread_requesting_mutex and kicks the
+ * CPUs out of cpu_exec(); the vCPU thread then waits on io_proceeded_cond
+ * until the main loop thread has taken the mutex.
+ */
+static bool vcpu_thread_enabled;
+static QemuThread vcpu_thread;
+static QemuMutex qemu_global_mutex;
+static QemuCond qemu_halt_cond;     /* wakes up the vCPU thread */
+static QemuCond qemu_pause_cond;    /* signals vcpu_paused changes */
+static QemuCond qemu_io_proceeded_cond;
+static bool iothread_requesting_mutex;
+static bool vcpu_pause_requested;
+static bool vcpu_paused;
+
 /***********************************************************/
 void hw_error(const char *fmt, ...)
 {
@@ -112,20 +137,63 @@ void qemu_init_vcpu(CPUState *cpu)
 
 bool qemu_cpu_is_self(CPUState *cpu)
 {
-    return true;
+    if (!vcpu_thread_enabled) {
+        return true;
+    }
+    return qemu_thread_is_self(&vcpu_thread);
+}
+
+bool qemu_vcpu_thread_enabled(void)
+{
+    return vcpu_thread_enabled;
+}
+
+/* Make all the CPUs leave cpu_exec() as soon as possible. */
+static void qemu_kick_all_cpus(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        cpu_exit(cpu);
+    }
 }
 
 void resume_all_vcpus(void)
 {
+    if (!vcpu_thread_enabled) {
+        return;
+    }
+    vcpu_pause_requested = false;
+    qemu_cond_broadcast(&qemu_halt_cond);
 }
 
 void pause_all_vcpus(void)
 {
+    if (!vcpu_thread_enabled) {
+        return;
+    }
+    vcpu_pause_requested = true;
+    if (qemu_thread_is_self(&vcpu_thread)) {
+        /* Called from a device or helper, the CPUs stop as soon as
+         * the vCPU thread is back in its loop. */
+        qemu_kick_all_cpus();
+        return;
+    }
+    /* The caller holds the global mutex, so the vCPU thread is not in
+     * cpu_exec(), and goes to sleep as soon as it gets the mutex. */
+    qemu_cond_broadcast(&qemu_halt_cond);
+    while (!vcpu_paused) {
+        qemu_cond_wait(&qemu_pause_cond, &qemu_global_mutex);
+    }
 }
 
 void qemu_cpu_kick(CPUState *cpu)
 {
-    return;
+    if (!vcpu_thread_enabled) {
+        return;
+    }
+    cpu_exit(cpu);
+    qemu_cond_broadcast(&qemu_halt_cond);
 }
 
 // In main-loop.c
@@ -137,6 +205,14 @@ void qemu_notify_event(void)
 {
     CPUState *cpu = current_cpu;
 
+    if (vcpu_thread_enabled) {
+        /* Only the main loop needs to wake up, it kicks the CPUs when it
+         * wants the global mutex. This can be called from a signal
+         * handler or from any thread. */
+        qemu_main_loop_wakeup();
+        return;
+    }
+
     if (cpu) {
         cpu_exit(cpu);
     /*
@@ -164,10 +240,26 @@ void qemu_notify_event(void)
 
 void qemu_mutex_lock_iothread(void)
 {
+    if (!vcpu_thread_enabled) {
+        return;
+    }
+    iothread_requesting_mutex = true;
+    if (qemu_mutex_trylock(&qemu_global_mutex)) {
+        qemu_kick_all_cpus();
+        qemu_mutex_lock(&qemu_global_mutex);
+    }
+    iothread_requesting_mutex = false;
+    qemu_cond_broadcast(&qemu_io_proceeded_cond);
 }
 
 void qemu_mutex_unlock_iothread(void)
 {
+    if (!vcpu_thread_enabled) {
+        return;
+    }
+    /* Whatever the main loop did may have given work to halted CPUs. */
+    qemu_cond_broadcast(&qemu_halt_cond);
+    qemu_mutex_unlock(&qemu_global_mutex);
 }
 
 void vm_stop(int reason)
@@ -228,7 +320,11 @@ void tcg_cpu_exec(void)
 
         if (!vm_running)
             break;
-        if (qemu_timer_alarm_pending()) {
+        if (vcpu_thread_enabled) {
+            if (iothread_requesting_mutex || vcpu_pause_requested) {
+                break;
+            }
+        } else if (qemu_timer_alarm_pending()) {
             break;
         }
         if (cpu_can_run(env))
@@ -241,6 +337,81 @@ void tcg_cpu_exec(void)
     }
 }
 
+static bool qemu_vcpu_thread_can_run(void)
+{
+    return vm_running && !vcpu_pause_requested && tcg_has_work();
+}
+
+static void qemu_vcpu_thread_wait_io_event(void)
+{
+    while (!qemu_vcpu_thread_can_run()) {
+        if (vcpu_pause_requested && !vcpu_paused) {
+            vcpu_paused = true;
+            qemu_cond_broadcast(&qemu_pause_cond);
+        }
+        qemu_cond_wait(&qemu_halt_cond, &qemu_global_mutex);
+    }
+    vcpu_paused = false;
+
+    while (iothread_requesting_mutex) {
+        qemu_cond_wait(&qemu_io_proceeded_cond, &qemu_global_mutex);
+    }
+}
+
+static void *qemu_vcpu_thread_fn(void *arg)
+{
+    /* Device emulation now runs on this thread, and some of it creates
+     * Looper objects, which must use the main loop like on the main
+     * thread instead of a looper of its own that nothing runs. */
+    qemu_looper_setForThread();
+
+    qemu_mutex_lock(&qemu_global_mutex);
+    for (;;) {
+        qemu_vcpu_thread_wait_io_event();
+        tcg_cpu_exec();
+        if (debug_requested) {
+            /* Stay stopped until the main loop stops the VM, and the
+             * debugger resumes it. */
+            vcpu_pause_requested = true;
+            qemu_main_loop_wakeup();
+        }
+    }
+    return NULL;
+}
+
+void qemu_start_vcpu_thread(void)
+{
+    if (vcpu_thread_enabled) {
+        return;
+    }
+    /* KVM and HAX vCPUs only leave the hypervisor on their own, or
+     * through a signal, which can't be sent reliably without support
+     * for KVM_SET_SIGNAL_MASK. They stay on the main loop thread. */
+    if (kvm_enabled()) {
+        fprintf(stderr, "Warning: -vcpu-thread is ignored with KVM\n");
+        return;
+    }
+#ifdef CONFIG_HAX
+    if (hax_enabled()) {
+        fprintf(stderr, "Warning: -vcpu-thread is ignored with HAX\n");
+        return;
+    }
+#endif
+
+    qemu_mutex_init(&qemu_global_mutex);
+    qemu_cond_init(&qemu_halt_cond);
+    qemu_cond_init(&qemu_pause_cond);
+    qemu_cond_init(&qemu_io_proceeded_cond);
+
+    /* The calling thread becomes the main loop thread, which holds the
+     * mutex unless it is waiting for I/O. */
+    qemu_mutex_lock(&qemu_global_mutex);
+    vcpu_pause_requested = !vm_running;
+    vcpu_thread_enabled = true;
+    qemu_thread_create(&vcpu_thread, "vcpu", qemu_vcpu_thread_fn, NULL,
+                       QEMU_THREAD_DETACHED);
+}
+
 /***********************************************************/
 /* guest cycle counter */
 
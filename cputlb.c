@@ -25,6 +25,8 @@
 
 /* statistics */
 int tlb_flush_count;
+uint64_t tlb_victim_hits;
+uint64_t tlb_victim_misses;
 
 static const CPUTLBEntry s_cputlb_empty_entry = {
     .addr_read  = -1,
@@ -63,6 +65,14 @@ void tlb_flush(CPUArchState *env, int flush_global)
             env->tlb_table[mmu_idx][i] = s_cputlb_empty_entry;
         }
     }
+    for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        int mmu_idx;
+
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            env->tlb_v_table[mmu_idx][i] = s_cputlb_empty_entry;
+        }
+    }
+    env->vtlb_index = 0;
 
     memset(env->tb_jmp_cache, 0, TB_JMP_CACHE_SIZE * sizeof (void *));
 
@@ -111,6 +121,15 @@ void tlb_flush_page(CPUArchState *env, target_ulong addr)
         tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
     }
 
+    /* check whether there are entries that need to be flushed in the vtlb */
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        int k;
+
+        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+            tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], addr);
+        }
+    }
+
     tb_flush_jmp_cache(env, addr);
 }
 
@@ -130,6 +149,21 @@ void tlb_unprotect_code_phys(CPUArchState *env, ram_addr_t ram_addr,
     cpu_physical_memory_set_dirty_flag(ram_addr, DIRTY_MEMORY_CODE);
 }
 
+static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
+{
+    return te->addr_read == -1 && te->addr_write == -1 && te->addr_code == -1;
+}
+
+/* Return true if |te| maps the page at |vaddr| for any access type. */
+static inline bool tlb_entry_is_page(const CPUTLBEntry *te, target_ulong vaddr)
+{
+    target_ulong mask = TARGET_PAGE_MASK | TLB_INVALID_MASK;
+
+    return (te->addr_read & mask) == vaddr ||
+           (te->addr_write & mask) == vaddr ||
+           (te->addr_code & mask) == vaddr;
+}
+
 static bool tlb_is_dirty_ram(CPUTLBEntry *tlbe)
 {
     return (tlbe->addr_write & ~TARGET_PAGE_MASK) == IO_MEM_RAM;
@@ -165,6 +199,11 @@ void cpu_tlb_reset_dirty_all(ram_addr_t start1, ram_addr_t length)
                 tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                       start1, length);
             }
+
+            for (i = 0; i < CPU_VTLB_SIZE; i++) {
+                tlb_reset_dirty_range(&env->tlb_v_table[mmu_idx][i],
+                                      start1, length);
+            }
         }
     }
 }
@@ -188,6 +227,14 @@ void tlb_set_dirty(CPUArchState *env, target_ulong vaddr)
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
     }
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        int k;
+
+        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+            tlb_set_dirty1(&env->tlb_v_table[mmu_idx][k], vaddr);
+        }
+    }
 }
 
 /* Our TLB does not support large pages, so remember the area covered by
@@ -229,6 +276,7 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr,
     CPUTLBEntry *te;
     CPUWatchpoint *wp;
     hwaddr iotlb;
+    unsigned int vidx;
 
     assert(size >= TARGET_PAGE_SIZE);
     if (size != TARGET_PAGE_SIZE) {
@@ -287,8 +335,22 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr,
     }
 
     index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-    env->iotlb[mmu_idx][index] = iotlb - vaddr;
     te = &env->tlb_table[mmu_idx][index];
+
+    /* The new entry supersedes any older one for the same page. */
+    for (vidx = 0; vidx < CPU_VTLB_SIZE; vidx++) {
+        tlb_flush_entry(&env->tlb_v_table[mmu_idx][vidx], vaddr);
+    }
+
+    /* Keep the translation that is replaced in the victim TLB, unless it
+       is invalid or for the same page. */
+    if (!tlb_entry_is_empty(te) && !tlb_entry_is_page(te, vaddr)) {
+        vidx = env->vtlb_index++ % CPU_VTLB_SIZE;
+        env->tlb_v_table[mmu_idx][vidx] = *te;
+        env->iotlb_v[mmu_idx][vidx] = env->iotlb[mmu_idx][index];
+    }
+
+    env->iotlb[mmu_idx][index] = iotlb - vaddr;
     te->addend = addend - vaddr;
     if (prot & PAGE_READ) {
         te->addr_read = address;
@@ -317,6 +379,38 @@ void tlb_set_page(CPUArchState *env, target_ulong vaddr,
     }
 }
 
+/* Called by the softmmu helpers when the TLB entry at |index| doesn't map
+   the page of |addr|, before they resort to tlb_fill(). If the victim TLB
+   has the page, its entry is swapped with the direct-mapped one. |elt_ofs|
+   is the offset in CPUTLBEntry of the address field for the access type.
+   Returns true on a hit. */
+bool tlb_victim_hit(CPUArchState *env, int mmu_idx, int index,
+                    size_t elt_ofs, target_ulong addr)
+{
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    int vidx;
+
+    for (vidx = 0; vidx < CPU_VTLB_SIZE; vidx++) {
+        CPUTLBEntry *vtlb = &env->tlb_v_table[mmu_idx][vidx];
+        target_ulong cmp = *(target_ulong *)((uintptr_t)vtlb + elt_ofs);
+
+        if ((cmp & (TARGET_PAGE_MASK | TLB_INVALID_MASK)) == page) {
+            CPUTLBEntry *tlb = &env->tlb_table[mmu_idx][index];
+            CPUTLBEntry tmptlb = *tlb;
+            hwaddr tmpiotlb = env->iotlb[mmu_idx][index];
+
+            *tlb = *vtlb;
+            *vtlb = tmptlb;
+            env->iotlb[mmu_idx][index] = env->iotlb_v[mmu_idx][vidx];
+            env->iotlb_v[mmu_idx][vidx] = tmpiotlb;
+            tlb_victim_hits++;
+            return true;
+        }
+    }
+    tlb_victim_misses++;
+    return false;
+}
+
 /* NOTE: this function can trigger an exception */
 /* NOTE2: the returned address is not exactly the physical address: it
    is the offset relative to phys_ram_base */
@@ -20,6 +20,13 @@ typedef void (*OnPostFn)(void* context, int width, int height, int ydir,
                          int format, int type, unsigned char* pixels);
 typedef void (*emugl_crash_func_t)(const char* format, ...);
 
+/* flags used by the renderChannel functions */
+#define RENDER_CHANNEL_CAN_READ   (1 << 0)
+#define RENDER_CHANNEL_CAN_WRITE  (1 << 1)
+#define RENDER_CHANNEL_CLOSED     (1 << 2)
+
+typedef void (*RenderChannelWakeFn)(void* opaque, int flags);
+
 #define LIST_RENDER_API_FUNCTIONS(X) \
   X(int, initLibrary, (), ()) \
   X(int, setStreamMode, (int mode), (mode)) \
@@ -32,6 +39,12 @@ typedef void (*emugl_crash_func_t)(const char* format, ...);
   X(void, setOpenGLDisplayTranslation, (float px, float py), (px, py)) \
   X(void, repaintOpenGLDisplay, (), ()) \
   X(int, stopOpenGLRenderer, (), ()) \
+  X(void*, openRenderChannel, (RenderChannelWakeFn wakeFn, void* wakeOpaque), (wakeFn, wakeOpaque)) \
+  X(int, renderChannelWrite, (void* channel, const void* buf, size_t len), (channel, buf, len)) \
+  X(int, renderChannelRead, (void* channel, void* buf, size_t len), (channel, buf, len)) \
+  X(int, renderChannelPoll, (void* channel), (channel)) \
+  X(void, renderChannelWakeOn, (void* channel, int flags), (channel, flags)) \
+  X(void, renderChannelClose, (void* channel), (channel)) \
 
 
 #endif  // RENDER_API_FUNCTIONS_H
@@ -28,6 +28,7 @@ host_common_SRC_FILES := \
     RenderControl.cpp \
     RenderServer.cpp \
     RenderThread.cpp \
+    RingStream.cpp \
     RenderThreadInfo.cpp \
     render_api.cpp \
     RenderWindow.cpp \
@@ -68,3 +69,31 @@ LOCAL_SYMBOL_FILE := render_api.entries
 $(call emugl-export,CFLAGS,$(EMUGL_USER_CFLAGS))
 
 $(call emugl-end-module)
+
+### emugl_stream_replay ##################################################
+# Replays a GL command stream recorded with RENDERER_DUMP_DIR through the
+# decoders and reports their throughput. See stream_replay.cpp.
+# Not built on Windows, where the GL entry points use the stdcall calling
+# convention, which the tool's catch-all no-op function can't match.
+ifneq ($(BUILD_TARGET_OS),windows)
+$(call emugl-begin-host-executable,emugl$(BUILD_TARGET_SUFFIX)_stream_replay)
+
+$(call emugl-import,libGLESv1_dec libGLESv2_dec lib_renderControl_dec libOpenglCodecCommon)
+
+LOCAL_LDLIBS += $(host_common_LDLIBS)
+
+LOCAL_SRC_FILES := $(host_common_SRC_FILES) stream_replay.cpp
+
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/include
+LOCAL_C_INCLUDES += $(LOCAL_PATH)
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/Translator/include
+LOCAL_C_INCLUDES += $(EMUGL_PATH)/host/libs/libOpenGLESDispatch
+
+LOCAL_STATIC_LIBRARIES += libemugl_common
+LOCAL_STATIC_LIBRARIES += libOpenGLESDispatch
+
+LOCAL_INSTALL := false
+
+$(call emugl-end-module)
+
+endif  # BUILD_TARGET_OS != windows
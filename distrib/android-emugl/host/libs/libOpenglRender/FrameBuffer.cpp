@@ -974,6 +974,7 @@ bool FrameBuffer::bindContext(HandleType p_context,
 
 HandleType FrameBuffer::createClientImage(HandleType context, EGLenum target, GLuint buffer)
 {
+    emugl::Mutex::AutoLock mutex(m_lock);
     RenderContextPtr ctx(NULL);
 
     if (context) {
@@ -66,6 +66,31 @@ int ReadBuffer::getData(IOStream *stream)
     return -1;
 }
 
+int ReadBuffer::append(const unsigned char *data, size_t len)
+{
+    if ((m_validData > 0) && (m_readPtr > m_buf)) {
+        memmove(m_buf, m_readPtr, m_validData);
+    }
+    m_readPtr = m_buf;
+    if (m_size - m_validData < len) {
+        size_t new_size = m_size;
+        while (new_size - m_validData < len) {
+            new_size *= 2;
+        }
+        unsigned char* new_buf = (unsigned char*)realloc(m_buf, new_size);
+        if (!new_buf) {
+            ERR("Failed to alloc %zu bytes for ReadBuffer\n", new_size);
+            return -1;
+        }
+        m_size = new_size;
+        m_buf = new_buf;
+        m_readPtr = m_buf;
+    }
+    memcpy(m_buf + m_validData, data, len);
+    m_validData += len;
+    return len;
+}
+
 void ReadBuffer::consume(size_t amount)
 {
     assert(amount <= m_validData);
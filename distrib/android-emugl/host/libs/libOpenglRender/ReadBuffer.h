@@ -23,6 +23,7 @@ public:
     ReadBuffer(size_t bufSize);
     ~ReadBuffer();
     int getData(IOStream *stream); // get fresh data from the stream
+    int append(const unsigned char *data, size_t len); // copy data after the valid one
     unsigned char *buf() { return m_readPtr; } // return the next read location
     size_t validData() { return m_validData; } // return the amount of valid data in readptr
     void consume(size_t amount); // notify that 'amount' data has been consumed;
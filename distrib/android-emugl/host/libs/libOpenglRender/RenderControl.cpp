@@ -20,6 +20,7 @@
 #include "FrameBuffer.h"
 #include "RenderThreadInfo.h"
 #include "ChecksumCalculatorThreadInfo.h"
+#include "DecoderProfiler.h"
 
 #include "OpenGLESDispatch/EGLDispatch.h"
 
@@ -383,6 +384,20 @@ static void rcSelectChecksumCalculator(uint32_t protocol, uint32_t reserved) {
     ChecksumCalculatorThreadInfo::setVersion(protocol);
 }
 
+// Copies the per-command statistics of the host decoders, as a text report,
+// to |buffer|. Like rcGetGLString, returns the size of the report including
+// its terminating zero, negated if it doesn't fit in |bufferSize|.
+static EGLint rcGetDecoderProfile(void* buffer, EGLint bufferSize)
+{
+    std::string report = DecoderProfiler::report();
+    EGLint len = (EGLint)report.size() + 1;
+    if (!buffer || len > bufferSize) {
+        return -len;
+    }
+    memcpy(buffer, report.c_str(), len);
+    return len;
+}
+
 void initRenderControlContext(renderControl_decoder_context_t *dec)
 {
     dec->rcGetRendererVersion = rcGetRendererVersion;
@@ -414,4 +429,5 @@ void initRenderControlContext(renderControl_decoder_context_t *dec)
     dec->rcCreateClientImage = rcCreateClientImage;
     dec->rcDestroyClientImage = rcDestroyClientImage;
     dec->rcSelectChecksumCalculator = rcSelectChecksumCalculator;
+    dec->rcGetDecoderProfile = rcGetDecoderProfile;
 }
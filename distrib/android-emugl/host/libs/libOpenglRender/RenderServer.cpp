@@ -35,7 +35,6 @@
 typedef std::set<RenderThread *> RenderThreadsSet;
 
 RenderServer::RenderServer() :
-    m_lock(),
     m_listenSock(NULL),
     m_exiting(false)
 {
@@ -118,7 +117,7 @@ intptr_t RenderServer::main()
             break;
         }
 
-        RenderThread *rt = RenderThread::create(stream, &m_lock);
+        RenderThread *rt = RenderThread::create(stream);
         if (!rt) {
             fprintf(stderr,"Failed to create RenderThread\n");
             delete stream;
@@ -19,64 +19,84 @@
 #include "ReadBuffer.h"
 #include "RenderControl.h"
 #include "RenderThreadInfo.h"
-#include "TimeUtils.h"
+#include "RingStream.h"
 
 #include "OpenGLESDispatch/EGLDispatch.h"
 #include "OpenGLESDispatch/GLESv2Dispatch.h"
 #include "OpenGLESDispatch/GLESv1Dispatch.h"
 #include "../../../shared/OpenglCodecCommon/ChecksumCalculatorThreadInfo.h"
+#include "../../../shared/OpenglCodecCommon/DecoderProfiler.h"
 
 #define STREAM_BUFFER_SIZE 4*1024*1024
 
-RenderThread::RenderThread(IOStream *stream, emugl::Mutex *lock) :
+RenderThread::RenderThread(IOStream *stream, RingStream *ringStream) :
         emugl::Thread(),
-        m_lock(lock),
-        m_stream(stream) {}
+        m_stream(stream),
+        m_ringStream(ringStream) {}
 
 RenderThread::~RenderThread() {
     delete m_stream;
 }
 
 // static
-RenderThread* RenderThread::create(IOStream *stream, emugl::Mutex *lock) {
-    return new RenderThread(stream, lock);
+RenderThread* RenderThread::create(IOStream *stream) {
+    return new RenderThread(stream, NULL);
+}
+
+// static
+RenderThread* RenderThread::create(RingStream *stream) {
+    return new RenderThread(stream, stream);
 }
 
 void RenderThread::forceStop() {
     m_stream->forceStop();
 }
 
-intptr_t RenderThread::main() {
-    RenderThreadInfo tInfo;
-    ChecksumCalculatorThreadInfo tChecksumInfo;
-
-    //
-    // initialize decoders
-    //
-    tInfo.m_glDec.initGL(gles1_dispatch_get_proc_func, NULL);
-    tInfo.m_gl2Dec.initGL(gles2_dispatch_get_proc_func, NULL);
-    initRenderControlContext(&tInfo.m_rcDec);
+// static
+size_t RenderThread::decodeCommands(RenderThreadInfo* tInfo,
+                                    unsigned char* buf,
+                                    size_t len,
+                                    IOStream* stream) {
+    size_t total = 0;
+    bool progress;
+    do {
+        progress = false;
 
-    ReadBuffer readBuf(STREAM_BUFFER_SIZE);
+        //
+        // try to process some of the command buffer using the GLESv1 decoder
+        //
+        size_t last = tInfo->m_glDec.decode(buf + total, len - total, stream);
+        if (last > 0) {
+            progress = true;
+            total += last;
+        }
 
-    int stats_totalBytes = 0;
-    long long stats_t0 = GetCurrentTimeMS();
+        //
+        // try to process some of the command buffer using the GLESv2 decoder
+        //
+        last = tInfo->m_gl2Dec.decode(buf + total, len - total, stream);
+        if (last > 0) {
+            progress = true;
+            total += last;
+        }
 
-    //
-    // open dump file if RENDER_DUMP_DIR is defined
-    //
-    const char *dump_dir = getenv("RENDERER_DUMP_DIR");
-    FILE *dumpFP = NULL;
-    if (dump_dir) {
-        size_t bsize = strlen(dump_dir) + 32;
-        char *fname = new char[bsize];
-        snprintf(fname,bsize,"%s/stream_%p", dump_dir, this);
-        dumpFP = fopen(fname, "wb");
-        if (!dumpFP) {
-            fprintf(stderr,"Warning: stream dump failed to open file %s\n",fname);
+        //
+        // try to process some of the command buffer using the
+        // renderControl decoder
+        //
+        last = tInfo->m_rcDec.decode(buf + total, len - total, stream);
+        if (last > 0) {
+            progress = true;
+            total += last;
         }
-        delete [] fname;
-    }
+
+    } while( progress );
+
+    return total;
+}
+
+void RenderThread::socketLoop(RenderThreadInfo* tInfo, FILE* dumpFP) {
+    ReadBuffer readBuf(STREAM_BUFFER_SIZE);
 
     while (1) {
 
@@ -86,69 +106,127 @@ intptr_t RenderThread::main() {
         }
 
         //
-        // log received bandwidth statistics
+        // dump stream to file if needed
         //
-        stats_totalBytes += readBuf.validData();
-        long long dt = GetCurrentTimeMS() - stats_t0;
-        if (dt > 1000) {
-            //float dts = (float)dt / 1000.0f;
-            //printf("Used Bandwidth %5.3f MB/s\n", ((float)stats_totalBytes / dts) / (1024.0f*1024.0f));
-            stats_totalBytes = 0;
-            stats_t0 = GetCurrentTimeMS();
+        if (dumpFP) {
+            int skip = readBuf.validData() - stat;
+            fwrite(readBuf.buf()+skip, 1, readBuf.validData()-skip, dumpFP);
+            fflush(dumpFP);
+        }
+
+        readBuf.consume(decodeCommands(tInfo,
+                                       readBuf.buf(),
+                                       readBuf.validData(),
+                                       m_stream));
+
+        //
+        // write the decoder statistics, including the bandwidth, if
+        // RENDERER_PROFILE_FILE is defined and they're due
+        //
+        DecoderProfiler::dump(false);
+    }
+}
+
+void RenderThread::ringLoop(RenderThreadInfo* tInfo, FILE* dumpFP) {
+    RingChannel* channel = m_ringStream->channel();
+
+    // Commands are normally decoded in place from the ring buffer. Only
+    // when a partial command reaches the end of the ring's storage area,
+    // or doesn't fit in it, is it copied to |readBuf| and decoded from
+    // there, until that buffer is empty again.
+    ReadBuffer readBuf(STREAM_BUFFER_SIZE);
+
+    // Guest clients start by sending their flags, which the RenderServer
+    // reads for socket streams.
+    unsigned int clientFlags;
+    if (!channel->readCommands(&clientFlags, sizeof(clientFlags))) {
+        return;
+    }
+
+    // Number of bytes at the start of the ring that were already seen,
+    // but that don't contain a full command.
+    size_t pending = 0;
+
+    while (1) {
+        size_t size;
+        unsigned char* data = channel->peekCommands(pending, &size);
+        if (!data) {
+            break;
         }
 
         //
         // dump stream to file if needed
         //
-        if (dumpFP) {
-            int skip = readBuf.validData() - stat;
-            fwrite(readBuf.buf()+skip, 1, readBuf.validData()-skip, dumpFP);
+        if (dumpFP && size > pending) {
+            fwrite(data + pending, 1, size - pending, dumpFP);
             fflush(dumpFP);
         }
 
-        bool progress;
-        do {
-            progress = false;
-
-            m_lock->lock();
-            //
-            // try to process some of the command buffer using the GLESv1 decoder
-            //
-            size_t last = tInfo.m_glDec.decode(readBuf.buf(), readBuf.validData(), m_stream);
-            if (last > 0) {
-                progress = true;
-                readBuf.consume(last);
+        if (readBuf.validData() > 0 || size <= pending) {
+            // Either a command is already being assembled in |readBuf|,
+            // or the contiguous data can't grow: copy it out.
+            if (readBuf.append(data, size) < 0) {
+                break;
             }
+            channel->consumeCommands(size);
+            pending = 0;
+            readBuf.consume(decodeCommands(tInfo,
+                                           readBuf.buf(),
+                                           readBuf.validData(),
+                                           m_stream));
+            continue;
+        }
 
-            //
-            // try to process some of the command buffer using the GLESv2 decoder
-            //
-            last = tInfo.m_gl2Dec.decode(readBuf.buf(), readBuf.validData(), m_stream);
-            if (last > 0) {
-                progress = true;
-                readBuf.consume(last);
-            }
+        size_t consumed = decodeCommands(tInfo, data, size, m_stream);
+        if (consumed > 0) {
+            channel->consumeCommands(consumed);
+        }
+        pending = size - consumed;
+        DecoderProfiler::dump(false);
+    }
+}
 
-            //
-            // try to process some of the command buffer using the
-            // renderControl decoder
-            //
-            last = tInfo.m_rcDec.decode(readBuf.buf(), readBuf.validData(), m_stream);
-            if (last > 0) {
-                readBuf.consume(last);
-                progress = true;
-            }
+intptr_t RenderThread::main() {
+    RenderThreadInfo tInfo;
+    ChecksumCalculatorThreadInfo tChecksumInfo;
 
-            m_lock->unlock();
+    //
+    // initialize decoders
+    //
+    tInfo.m_glDec.initGL(gles1_dispatch_get_proc_func, NULL);
+    tInfo.m_gl2Dec.initGL(gles2_dispatch_get_proc_func, NULL);
+    initRenderControlContext(&tInfo.m_rcDec);
 
-        } while( progress );
+    //
+    // open dump file if RENDER_DUMP_DIR is defined
+    //
+    const char *dump_dir = getenv("RENDERER_DUMP_DIR");
+    FILE *dumpFP = NULL;
+    if (dump_dir) {
+        size_t bsize = strlen(dump_dir) + 32;
+        char *fname = new char[bsize];
+        snprintf(fname,bsize,"%s/stream_%p", dump_dir, this);
+        dumpFP = fopen(fname, "wb");
+        if (!dumpFP) {
+            fprintf(stderr,"Warning: stream dump failed to open file %s\n",fname);
+        }
+        delete [] fname;
+    }
 
+    if (m_ringStream) {
+        ringLoop(&tInfo, dumpFP);
+        // Let the guest know that nothing more will be read or written.
+        m_ringStream->channel()->hostClose();
+    } else {
+        socketLoop(&tInfo, dumpFP);
     }
 
     if (dumpFP) {
         fclose(dumpFP);
     }
 
+    DecoderProfiler::dump(true);
+
     //
     // Release references to the current thread's context/surfaces if any
     //
@@ -18,21 +18,29 @@
 
 #include "IOStream.h"
 
-#include "emugl/common/mutex.h"
 #include "emugl/common/thread.h"
 
+class RenderThreadInfo;
+class RingStream;
+
 // A class used to model a thread of the RenderServer. Each one of them
 // handles a single guest client / protocol byte stream.
+//
+// Render threads decode and issue GL commands concurrently. Each one has
+// its own decoders and current context, and the state they share (the
+// FrameBuffer's contexts, surfaces and color buffers) is protected by
+// the FrameBuffer lock.
 class RenderThread : public emugl::Thread {
 public:
     // Create a new RenderThread instance.
     // |stream| is an input stream that will be read from the thread,
     // and deleted by it when it exits.
-    // |mutex| is a pointer to a shared mutex used to serialize
-    // decoding operations between all threads.
-    // TODO(digit): Why is this needed here? Shouldn't this be handled
-    //              by the decoders themselves or at a lower-level?
-    static RenderThread* create(IOStream* stream, emugl::Mutex* mutex);
+    static RenderThread* create(IOStream* stream);
+
+    // Same as above, but for a stream connected to an in-process guest
+    // pipe. Commands are then decoded directly from the stream's ring
+    // buffer, without being copied.
+    static RenderThread* create(RingStream* stream);
 
     // Destructor.
     virtual ~RenderThread();
@@ -44,15 +52,27 @@ public:
     // Force a thread to stop.
     void forceStop();
 
+    // Decode as many commands as possible from |buf|, and return the
+    // number of bytes consumed. Replies are sent to |stream|.
+    // This is also used by the stream_replay tool.
+    static size_t decodeCommands(RenderThreadInfo* tInfo,
+                                 unsigned char* buf,
+                                 size_t len,
+                                 IOStream* stream);
+
 private:
     RenderThread();  // No default constructor
 
-    RenderThread(IOStream* stream, emugl::Mutex* mutex);
+    RenderThread(IOStream* stream, RingStream* ringStream);
 
     virtual intptr_t main();
 
-    emugl::Mutex* m_lock;
+    // Main loops for socket streams and ring streams, respectively.
+    void socketLoop(RenderThreadInfo* tInfo, FILE* dumpFP);
+    void ringLoop(RenderThreadInfo* tInfo, FILE* dumpFP);
+
     IOStream* m_stream;
+    RingStream* m_ringStream;
 };
 
 #endif
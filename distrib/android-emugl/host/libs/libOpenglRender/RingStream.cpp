@@ -0,0 +1,237 @@
+/*
+* Copyright (C) 2016 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#include "RingStream.h"
+
+#include "ErrorLog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+RingChannel::RingChannel(size_t commandSize,
+                         size_t replySize,
+                         RenderChannelWakeFn wakeFn,
+                         void* wakeOpaque) :
+        mCommands(commandSize),
+        mReplies(replySize),
+        mLock(),
+        mWakeFn(wakeFn),
+        mWakeOpaque(wakeOpaque),
+        mWakeWanted(0),
+        mGuestClosed(false),
+        mHostClosed(false),
+        mRefCount(1) {}
+
+RingChannel::~RingChannel() {}
+
+void RingChannel::addRef() {
+    emugl::Mutex::AutoLock lock(mLock);
+    mRefCount++;
+}
+
+void RingChannel::release() {
+    mLock.lock();
+    bool last = (--mRefCount == 0);
+    mLock.unlock();
+    if (last) {
+        delete this;
+    }
+}
+
+int RingChannel::guestWrite(const void* buf, size_t len) {
+    if (mCommands.isClosed()) {
+        return -1;
+    }
+    return (int)mCommands.tryWrite(buf, len);
+}
+
+int RingChannel::guestRead(void* buf, size_t len) {
+    size_t count = mReplies.tryRead(buf, len);
+    if (count == 0 && mReplies.isClosed()) {
+        return -1;
+    }
+    return (int)count;
+}
+
+int RingChannel::pollFlags() {
+    int flags = 0;
+    if (mReplies.readableBytes() > 0) {
+        flags |= RENDER_CHANNEL_CAN_READ;
+    }
+    if (mCommands.writableBytes() > 0) {
+        flags |= RENDER_CHANNEL_CAN_WRITE;
+    }
+    if (mHostClosed) {
+        flags |= RENDER_CHANNEL_CLOSED;
+    }
+    return flags;
+}
+
+int RingChannel::guestPoll() {
+    emugl::Mutex::AutoLock lock(mLock);
+    return pollFlags();
+}
+
+void RingChannel::checkWake_locked() {
+    int flags = pollFlags() & mWakeWanted;
+    if (flags != 0 && mWakeFn) {
+        mWakeWanted &= ~flags;
+        mWakeFn(mWakeOpaque, flags);
+    }
+}
+
+void RingChannel::guestWakeOn(int flags) {
+    emugl::Mutex::AutoLock lock(mLock);
+    mWakeWanted |= flags & (RENDER_CHANNEL_CAN_READ | RENDER_CHANNEL_CAN_WRITE);
+    checkWake_locked();
+}
+
+void RingChannel::guestClose() {
+    mLock.lock();
+    mGuestClosed = true;
+    mWakeFn = NULL;
+    mLock.unlock();
+
+    mCommands.close();
+    mReplies.close();
+    release();
+}
+
+void RingChannel::consumeCommands(size_t size) {
+    mCommands.consume(size);
+
+    emugl::Mutex::AutoLock lock(mLock);
+    if (mWakeWanted & RENDER_CHANNEL_CAN_WRITE) {
+        checkWake_locked();
+    }
+}
+
+bool RingChannel::readCommands(void* buf, size_t len) {
+    unsigned char* dst = static_cast<unsigned char*>(buf);
+    while (len > 0) {
+        size_t size;
+        unsigned char* data = mCommands.peek(0, &size);
+        if (!data) {
+            return false;
+        }
+        if (size > len) {
+            size = len;
+        }
+        memcpy(dst, data, size);
+        consumeCommands(size);
+        dst += size;
+        len -= size;
+    }
+    return true;
+}
+
+bool RingChannel::writeReply(const void* buf, size_t len) {
+    // Write the reply in pieces, and wake up the guest after each one:
+    // it might not fit in the buffer, which the guest must then drain.
+    const unsigned char* src = static_cast<const unsigned char*>(buf);
+    while (len > 0) {
+        size_t count = mReplies.tryWrite(src, len);
+        if (count == 0) {
+            // The buffer is full (or closed), wait for some free space.
+            if (!mReplies.writeFully(src, 1)) {
+                return false;
+            }
+            count = 1;
+        }
+        src += count;
+        len -= count;
+
+        emugl::Mutex::AutoLock lock(mLock);
+        if (mWakeWanted & RENDER_CHANNEL_CAN_READ) {
+            checkWake_locked();
+        }
+    }
+    return true;
+}
+
+void RingChannel::hostClose() {
+    mCommands.close();
+    mReplies.close();
+
+    emugl::Mutex::AutoLock lock(mLock);
+    if (!mHostClosed) {
+        mHostClosed = true;
+        if (mWakeFn) {
+            mWakeFn(mWakeOpaque, RENDER_CHANNEL_CLOSED);
+        }
+    }
+}
+
+RingStream::RingStream(RingChannel* channel, size_t bufSize) :
+        IOStream(bufSize),
+        m_channel(channel),
+        m_bufsize(bufSize),
+        m_buf(NULL) {
+    m_channel->addRef();
+}
+
+RingStream::~RingStream() {
+    m_channel->hostClose();
+    m_channel->release();
+    free(m_buf);
+}
+
+void *RingStream::allocBuffer(size_t minSize) {
+    size_t allocSize = (m_bufsize < minSize ? minSize : m_bufsize);
+    if (!m_buf || m_bufsize < allocSize) {
+        unsigned char* p = (unsigned char*)realloc(m_buf, allocSize);
+        if (!p) {
+            ERR("%s: realloc (%zu) failed\n", __FUNCTION__, allocSize);
+            return NULL;
+        }
+        m_buf = p;
+        m_bufsize = allocSize;
+    }
+    return m_buf;
+}
+
+int RingStream::commitBuffer(size_t size) {
+    return writeFully(m_buf, size);
+}
+
+int RingStream::writeFully(const void* buf, size_t len) {
+    return m_channel->writeReply(buf, len) ? 0 : -1;
+}
+
+const unsigned char *RingStream::readFully(void *buf, size_t len) {
+    if (!buf || !m_channel->readCommands(buf, len)) {
+        return NULL;
+    }
+    return (const unsigned char *)buf;
+}
+
+const unsigned char *RingStream::read(void *buf, size_t *inout_len) {
+    size_t size;
+    unsigned char* data = m_channel->peekCommands(0, &size);
+    if (!buf || !data) {
+        return NULL;
+    }
+    if (size > *inout_len) {
+        size = *inout_len;
+    }
+    memcpy(buf, data, size);
+    m_channel->consumeCommands(size);
+    *inout_len = size;
+    return (const unsigned char *)buf;
+}
+
+void RingStream::forceStop() {
+    m_channel->hostClose();
+}
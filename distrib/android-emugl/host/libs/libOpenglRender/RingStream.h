@@ -0,0 +1,112 @@
+/*
+* Copyright (C) 2016 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#ifndef _LIB_OPENGL_RENDER_RING_STREAM_H
+#define _LIB_OPENGL_RENDER_RING_STREAM_H
+
+#include "IOStream.h"
+
+#include "OpenglRender/render_api.h"
+
+#include "emugl/common/mutex.h"
+#include "emugl/common/ring_buffer.h"
+
+// A RingChannel connects a guest pipe implemented in the emulator's
+// process to a RenderThread, without going through a socket. Commands
+// from the guest are copied into a ring buffer that the RenderThread
+// decodes in place, and replies go through a second ring buffer in the
+// other direction.
+//
+// The emulator side never blocks. Instead, it asks to be notified with
+// guestWakeOn(), and the wake function passed to the constructor is
+// then called, possibly from the RenderThread, when the channel becomes
+// readable, writable or closed.
+//
+// Instances are reference-counted, since the emulator and the
+// RenderThread can each close their side first.
+class RingChannel {
+public:
+    // Create a new channel, with a reference count of 1.
+    RingChannel(size_t commandSize,
+                size_t replySize,
+                RenderChannelWakeFn wakeFn,
+                void* wakeOpaque);
+
+    void addRef();
+    void release();
+
+    // Emulator side. These mirror the renderChannel functions from
+    // render_api.h.
+    int guestWrite(const void* buf, size_t len);
+    int guestRead(void* buf, size_t len);
+    int guestPoll();
+    void guestWakeOn(int flags);
+    // Close the channel. The wake function is never called after this.
+    void guestClose();
+
+    // RenderThread side.
+
+    // Same as emugl::RingBuffer::peek() for the command buffer.
+    unsigned char* peekCommands(size_t minSize, size_t* size) {
+        return mCommands.peek(minSize, size);
+    }
+    void consumeCommands(size_t size);
+    bool readCommands(void* buf, size_t len);
+    bool writeReply(const void* buf, size_t len);
+    void hostClose();
+
+private:
+    ~RingChannel();
+
+    // Compute the RENDER_CHANNEL_XXX flags of the channel.
+    int pollFlags();
+    // Call the wake function for the wanted conditions that are met.
+    // Must be called with |mLock| held.
+    void checkWake_locked();
+
+    emugl::RingBuffer mCommands;
+    emugl::RingBuffer mReplies;
+    emugl::Mutex mLock;
+    RenderChannelWakeFn mWakeFn;
+    void* mWakeOpaque;
+    int mWakeWanted;
+    bool mGuestClosed;
+    bool mHostClosed;
+    int mRefCount;
+};
+
+// The IOStream used by a RenderThread to talk to a RingChannel.
+class RingStream : public IOStream {
+public:
+    // Takes a new reference to |channel|.
+    explicit RingStream(RingChannel* channel, size_t bufSize = 10000);
+    virtual ~RingStream();
+
+    RingChannel* channel() const { return m_channel; }
+
+    virtual void *allocBuffer(size_t minSize);
+    virtual int commitBuffer(size_t size);
+    virtual const unsigned char *readFully(void *buf, size_t len);
+    virtual const unsigned char *read(void *buf, size_t *inout_len);
+    virtual int writeFully(const void *buf, size_t len);
+    virtual void forceStop();
+
+private:
+    RingChannel* m_channel;
+    size_t m_bufsize;
+    unsigned char* m_buf;
+};
+
+#endif  // _LIB_OPENGL_RENDER_RING_STREAM_H
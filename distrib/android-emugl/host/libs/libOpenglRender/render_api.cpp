@@ -17,7 +17,9 @@
 
 #include "IOStream.h"
 #include "RenderServer.h"
+#include "RenderThread.h"
 #include "RenderWindow.h"
+#include "RingStream.h"
 #include "TimeUtils.h"
 
 #include "TcpStream.h"
@@ -35,6 +37,9 @@
 
 #include "emugl/common/crash_reporter.h"
 #include "emugl/common/logging.h"
+#include "emugl/common/mutex.h"
+
+#include <set>
 
 #include <string.h>
 
@@ -45,6 +50,17 @@ static char s_renderAddr[256];
 
 static RenderWindow* s_renderWindow = NULL;
 
+// Size of the ring buffers of in-process render channels. Commands use the
+// same size as the RenderThread's read buffer, replies are much smaller.
+#define RENDER_CHANNEL_COMMAND_SIZE  (4 * 1024 * 1024)
+#define RENDER_CHANNEL_REPLY_SIZE    (1024 * 1024)
+
+// The RenderThreads serving in-process render channels. These are not
+// known to the RenderServer, so are tracked here instead.
+typedef std::set<RenderThread*> RenderThreadsSet;
+static emugl::Mutex s_channelLock;
+static RenderThreadsSet s_channelThreads;
+
 static IOStream *createRenderThread(int p_stream_buffer_size,
                                     unsigned int clientFlags);
 
@@ -171,6 +187,18 @@ RENDER_APICALL int RENDER_APIENTRY stopOpenGLRenderer(void)
     IOStream *dummy = createRenderThread(8, IOSTREAM_CLIENT_EXIT_SERVER);
     if (!dummy) return false;
 
+    {
+        emugl::Mutex::AutoLock lock(s_channelLock);
+        for (RenderThreadsSet::iterator t = s_channelThreads.begin();
+             t != s_channelThreads.end();
+             t++) {
+            (*t)->forceStop();
+            (*t)->wait(NULL);
+            delete (*t);
+        }
+        s_channelThreads.clear();
+    }
+
     if (s_renderThread) {
         // wait for the thread to exit
         ret = s_renderThread->wait(NULL);
@@ -269,6 +297,70 @@ RENDER_APICALL void RENDER_APIENTRY repaintOpenGLDisplay(void)
             __FUNCTION__);
 }
 
+RENDER_APICALL void* RENDER_APIENTRY openRenderChannel(
+        RenderChannelWakeFn wakeFn, void* wakeOpaque)
+{
+    if (!s_renderThread) {
+        return NULL;
+    }
+
+    RingChannel* channel = new RingChannel(RENDER_CHANNEL_COMMAND_SIZE,
+                                           RENDER_CHANNEL_REPLY_SIZE,
+                                           wakeFn,
+                                           wakeOpaque);
+    RenderThread* rt = RenderThread::create(new RingStream(channel));
+    if (!rt->start()) {
+        ERR("%s: Failed to start RenderThread\n", __FUNCTION__);
+        delete rt;
+        channel->guestClose();
+        return NULL;
+    }
+
+    emugl::Mutex::AutoLock lock(s_channelLock);
+
+    // remove threads which are no longer running
+    for (RenderThreadsSet::iterator n, t = s_channelThreads.begin();
+         t != s_channelThreads.end();
+         t = n) {
+        n = t;
+        n++;
+        if ((*t)->isFinished()) {
+            delete (*t);
+            s_channelThreads.erase(t);
+        }
+    }
+    s_channelThreads.insert(rt);
+
+    return channel;
+}
+
+RENDER_APICALL int RENDER_APIENTRY renderChannelWrite(
+        void* channel, const void* buf, size_t len)
+{
+    return static_cast<RingChannel*>(channel)->guestWrite(buf, len);
+}
+
+RENDER_APICALL int RENDER_APIENTRY renderChannelRead(
+        void* channel, void* buf, size_t len)
+{
+    return static_cast<RingChannel*>(channel)->guestRead(buf, len);
+}
+
+RENDER_APICALL int RENDER_APIENTRY renderChannelPoll(void* channel)
+{
+    return static_cast<RingChannel*>(channel)->guestPoll();
+}
+
+RENDER_APICALL void RENDER_APIENTRY renderChannelWakeOn(
+        void* channel, int flags)
+{
+    static_cast<RingChannel*>(channel)->guestWakeOn(flags);
+}
+
+RENDER_APICALL void RENDER_APIENTRY renderChannelClose(void* channel)
+{
+    static_cast<RingChannel*>(channel)->guestClose();
+}
 
 /* NOTE: For now, always use TCP mode by default, until the emulator
  *        has been updated to support Unix and Win32 pipes
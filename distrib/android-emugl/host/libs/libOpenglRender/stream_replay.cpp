@@ -0,0 +1,296 @@
+/*
+* Copyright (C) 2016 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// A small tool that replays a GL command stream, as recorded by the
+// renderer when RENDERER_DUMP_DIR is defined, through the GLESv1, GLESv2
+// and renderControl decoders, and reports the decoding throughput.
+//
+// By default, the decoders dispatch to functions that do nothing, which
+// measures the cost of the decoders and the wire protocol alone, without
+// any GPU or driver involved. With -real, the commands are sent to the
+// EGL/GLES translator libraries, just like a RenderThread would do.
+
+#include "FrameBuffer.h"
+#include "IOStream.h"
+#include "RenderControl.h"
+#include "RenderThread.h"
+#include "RenderThreadInfo.h"
+#include "TimeUtils.h"
+
+#include "OpenglRender/render_api.h"
+#include "OpenGLESDispatch/GLESv1Dispatch.h"
+#include "OpenGLESDispatch/GLESv2Dispatch.h"
+#include "../../../shared/OpenglCodecCommon/ChecksumCalculatorThreadInfo.h"
+#include "../../../shared/OpenglCodecCommon/DecoderProfiler.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+namespace {
+
+// An IOStream that drops the decoders' replies, and has nothing to read.
+class ReplayStream : public IOStream {
+public:
+    ReplayStream() : IOStream(kBufferSize), mBuffer(kBufferSize) {}
+
+    virtual void* allocBuffer(size_t minSize) {
+        if (mBuffer.size() < minSize) {
+            mBuffer.resize(minSize);
+        }
+        return &mBuffer[0];
+    }
+
+    virtual int commitBuffer(size_t size) {
+        return (int)size;
+    }
+
+    virtual const unsigned char* readFully(void* buf, size_t len) {
+        return NULL;
+    }
+
+    virtual const unsigned char* read(void* buf, size_t* inout_len) {
+        return NULL;
+    }
+
+    virtual int writeFully(const void* buf, size_t len) {
+        return 0;
+    }
+
+    virtual void forceStop() {}
+
+private:
+    static const size_t kBufferSize = 64 * 1024;
+
+    std::vector<unsigned char> mBuffer;
+};
+
+// Used for most GL and renderControl entry points in null dispatch mode.
+// The decoders call it with all kinds of parameters, which only works with
+// calling conventions where the caller cleans up the stack. That's why the
+// tool isn't built on Windows, where the GL entry points are stdcall.
+// Return values and output parameters are left as is, and only copied back
+// to the reply stream.
+intptr_t nullFunction() {
+    return 0;
+}
+
+// glGetIntegerv() is also called by the GLESv2 decoder itself, which uses
+// the result to check the size of a reply, so it must be initialized.
+void GL_APIENTRY nullGetIntegerv(GLenum pname, GLint* params) {
+    params[0] = 0;
+}
+
+void* nullGetProc(const char* name, void* userData) {
+    if (!strcmp(name, "glGetIntegerv")) {
+        return (void*)&nullGetIntegerv;
+    }
+    return (void*)&nullFunction;
+}
+
+// The stream selects its checksum calculator through renderControl, which
+// must still happen in null dispatch mode so that the following commands
+// are decoded with the right checksum size.
+void nullSelectChecksumCalculator(uint32_t protocol, uint32_t reserved) {
+    ChecksumCalculatorThreadInfo::setVersion(protocol);
+}
+
+bool readFile(const char* path, std::vector<unsigned char>* data) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+    unsigned char chunk[64 * 1024];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        data->insert(data->end(), chunk, chunk + count);
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "Could not read %s\n", path);
+    }
+    return ok;
+}
+
+// Walk the packet headers of |data| to count its commands. Returns the
+// size of the complete packets, which is less than |len| if the recording
+// was cut in the middle of one.
+size_t countCommands(const unsigned char* data, size_t len, size_t* count) {
+    size_t pos = 0;
+    *count = 0;
+    while (len - pos >= 8) {
+        uint32_t packetLen;
+        memcpy(&packetLen, data + pos + 4, sizeof(packetLen));
+        if (packetLen < 8 || packetLen > len - pos) {
+            break;
+        }
+        pos += packetLen;
+        (*count)++;
+    }
+    return pos;
+}
+
+void usage(const char* progName) {
+    fprintf(stderr,
+            "Usage: %s [options] <stream-file>\n"
+            "\t-n <count>: replay the stream <count> times (null dispatch "
+            "only)\n"
+            "\t-real: dispatch the commands to the GLES translator libraries\n"
+            "\t-size <width>x<height>: framebuffer size for -real, "
+            "default 1080x1920\n",
+            progName);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const char* path = NULL;
+    int iterations = 1;
+    bool realDispatch = false;
+    int width = 1080;
+    int height = 1920;
+
+    for (int n = 1; n < argc; n++) {
+        const char* arg = argv[n];
+        if (!strcmp(arg, "-n") && n + 1 < argc) {
+            iterations = atoi(argv[++n]);
+        } else if (!strcmp(arg, "-real")) {
+            realDispatch = true;
+        } else if (!strcmp(arg, "-size") && n + 1 < argc) {
+            if (sscanf(argv[++n], "%dx%d", &width, &height) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg[0] == '-' || path) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            path = arg;
+        }
+    }
+    if (!path || iterations < 1 || width <= 0 || height <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // The stream refers to the contexts, surfaces and color buffers it
+    // created by the handles that the renderer returned while recording.
+    // A fresh renderer hands out the same ones, but only once.
+    if (realDispatch && iterations > 1) {
+        fprintf(stderr, "-n can't be used with -real, replaying once\n");
+        iterations = 1;
+    }
+
+    std::vector<unsigned char> stream;
+    if (!readFile(path, &stream)) {
+        return 1;
+    }
+    size_t commands = 0;
+    size_t streamLen = countCommands(stream.data(), stream.size(), &commands);
+    if (streamLen < stream.size()) {
+        fprintf(stderr, "Ignoring %zu bytes at the end of the stream\n",
+                stream.size() - streamLen);
+    }
+    if (commands == 0) {
+        fprintf(stderr, "No commands found in %s\n", path);
+        return 1;
+    }
+
+    if (realDispatch) {
+        if (!initLibrary()) {
+            fprintf(stderr, "Could not load the GLES translator libraries\n");
+            return 1;
+        }
+        if (!FrameBuffer::initialize(width, height, false)) {
+            fprintf(stderr, "Could not initialize the framebuffer\n");
+            return 1;
+        }
+    }
+
+    RenderThreadInfo tInfo;
+    ChecksumCalculatorThreadInfo tChecksumInfo;
+
+    if (realDispatch) {
+        tInfo.m_glDec.initGL(gles1_dispatch_get_proc_func, NULL);
+        tInfo.m_gl2Dec.initGL(gles2_dispatch_get_proc_func, NULL);
+        initRenderControlContext(&tInfo.m_rcDec);
+    } else {
+        tInfo.m_glDec.initGL(nullGetProc, NULL);
+        tInfo.m_gl2Dec.initGL(nullGetProc, NULL);
+        tInfo.m_rcDec.initDispatchByName(nullGetProc, NULL);
+        tInfo.m_rcDec.rcSelectChecksumCalculator =
+                nullSelectChecksumCalculator;
+    }
+
+    ReplayStream replies;
+    std::vector<unsigned char> buffer(streamLen);
+    long long totalMs = 0;
+    bool ok = true;
+
+    for (int n = 0; n < iterations && ok; n++) {
+        // Each replay starts from the original data, and with no checksums,
+        // as a new guest connection would.
+        memcpy(&buffer[0], stream.data(), streamLen);
+        ChecksumCalculatorThreadInfo::setVersion(0);
+
+        long long t0 = GetCurrentTimeMS();
+        size_t consumed = RenderThread::decodeCommands(&tInfo,
+                                                       &buffer[0],
+                                                       streamLen,
+                                                       &replies);
+        totalMs += GetCurrentTimeMS() - t0;
+
+        if (consumed != streamLen) {
+            fprintf(stderr, "Decoding stopped at offset %zu of %zu, "
+                    "unknown opcode %u\n", consumed, streamLen,
+                    *(uint32_t*)&buffer[consumed]);
+            ok = false;
+        }
+    }
+
+    if (realDispatch) {
+        FrameBuffer* fb = FrameBuffer::getFB();
+        fb->bindContext(0, 0, 0);
+        fb->drainWindowSurface();
+        fb->drainRenderContext();
+        fb->finalize();
+    }
+
+    if (!ok) {
+        return 1;
+    }
+
+    double seconds = (totalMs > 0 ? totalMs : 1) / 1000.0;
+    double totalCommands = (double)commands * iterations;
+    double totalBytes = (double)streamLen * iterations;
+    printf("%s dispatch: %zu commands, %zu bytes, %d iteration(s) in "
+           "%lld ms\n",
+           realDispatch ? "real" : "null", commands, streamLen, iterations,
+           totalMs);
+    printf("%.0f commands/s, %.2f MB/s\n",
+           totalCommands / seconds,
+           totalBytes / seconds / (1024.0 * 1024.0));
+
+    // With RENDERER_PROFILE_FILE defined, this gives the cost of each
+    // command of the stream.
+    DecoderProfiler::dump(true);
+    return 0;
+}
@@ -15,6 +15,7 @@
 */
 #include "ApiGen.h"
 #include "EntryPoint.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "strUtils.h"
@@ -800,379 +801,515 @@ int ApiGen::genContextImpl(const std::string &filename, SideType side)
     return 0;
 }
 
-int ApiGen::genDecoderImpl(const std::string &filename)
+// Append printf-style formatted text to |out|.
+static void appendf(std::string* out, const char* format, ...)
 {
-    FILE *fp = fopen(filename.c_str(), "wt");
-    if (fp == NULL) {
-        perror(filename.c_str());
-        return -1;
+    va_list args;
+    va_list args2;
+    va_start(args, format);
+    va_copy(args2, args);
+    int len = vsnprintf(NULL, 0, format, args);
+    if (len > 0) {
+        size_t oldSize = out->size();
+        out->resize(oldSize + len + 1);
+        vsnprintf(&(*out)[oldSize], len + 1, format, args2);
+        out->resize(oldSize + len);
     }
+    va_end(args2);
+    va_end(args);
+}
 
-    printHeader(fp);
-
-    std::string classname = m_basename + "_decoder_context_t";
-
-    size_t n = size();
-
-    fprintf(fp, "\n\n#include <string.h>\n");
-    fprintf(fp, "#include \"%s_opcodes.h\"\n\n", m_basename.c_str());
-    fprintf(fp, "#include \"%s_dec.h\"\n\n\n", m_basename.c_str());
-    fprintf(fp, "#include \"ProtocolUtils.h\"\n\n");
-    fprintf(fp, "#include \"ChecksumCalculatorThreadInfo.h\"\n\n");
-    fprintf(fp, "#include <stdio.h>\n\n");
-    fprintf(fp, "typedef unsigned int tsize_t; // Target \"size_t\", which is 32-bit for now. It may or may not be the same as host's size_t when emugen is compiled.\n\n");
-
-    // helper macros
-    fprintf(fp,
-            "#ifdef OPENGL_DEBUG_PRINTOUT\n"
-            "#  define DEBUG(...) do { if (emugl_cxt_logger) { emugl_cxt_logger(__VA_ARGS__); } } while(0)\n"
-            "#else\n"
-            "#  define DEBUG(...)  ((void)0)\n"
-            "#endif\n\n");
+// Write |text| to |fp|, removing |dedent| leading tabs from each line.
+static void writeDedented(FILE* fp, const std::string& text, size_t dedent)
+{
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        end = (end == std::string::npos) ? text.size() : end + 1;
+        size_t skip = 0;
+        while (skip < dedent && pos + skip < end && text[pos + skip] == '\t') {
+            skip++;
+        }
+        fwrite(text.data() + pos + skip, 1, end - pos - skip, fp);
+        pos = end;
+    }
+}
 
-    fprintf(fp,
-            "#ifdef CHECK_GLERROR\n"
-            "#  define SET_LASTCALL(name)  sprintf(lastCall, #name)\n"
-            "#else\n"
-            "#  define SET_LASTCALL(name)  ((void)0)\n"
-            "#endif\n\n");
+// Returns true if |e| only takes fixed-size arguments and returns nothing,
+// i.e. it doesn't need any reply buffer. The decoder handles these inline
+// in its main loop, the others through its handler table.
+static bool isFixedSizeEntry(EntryPoint* e)
+{
+    if (!e->retval().isVoid()) {
+        return false;
+    }
+    VarsArray & evars = e->vars();
+    for (size_t j = 0; j < evars.size(); j++) {
+        if (!evars[j].isVoid() && evars[j].isPointer()) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    // helper templates
-    fprintf(fp, "using namespace emugl;\n\n");
+// Generate the code that decodes one |e| command at |ptr|, indented for a
+// case of the decoder's switch. |self| is the expression of the decoder
+// context, and the code also refers to |stream| and |checksum|.
+static void genDecoderEntry(std::string* body,
+                            EntryPoint* e,
+                            const std::string& basename,
+                            const std::string& classname,
+                            const char* self)
+{
+    enum Pass_t {
+        PASS_FIRST = 0,
+        PASS_VariableDeclarations = PASS_FIRST,
+        PASS_Protocol,
+        PASS_TmpBuffAlloc,
+        PASS_MemAlloc,
+        PASS_DebugPrint,
+        PASS_FunctionCall,
+        PASS_FlushOutput,
+        PASS_Epilog,
+        PASS_LAST };
+    
+    // construct a printout string;
+    std::string printString = "";
+    for (size_t i = 0; i < e->vars().size(); i++) {
+        Var *v = &e->vars()[i];
+        if (!v->isVoid())  printString += (v->isPointer() ? "%p(%u)" : v->type()->printFormat()) + " ";
+    }
+    printString += "";
+    // TODO - add for return value;
 
-    // decoder switch;
-    fprintf(fp, "size_t %s::decode(void *buf, size_t len, IOStream *stream)\n{\n", classname.c_str());
-    fprintf(fp,
-            "                           \n\
-\tsize_t pos = 0;\n\
-\tif (len < 8) return pos; \n\
-\tunsigned char *ptr = (unsigned char *)buf;\n\
-\tbool unknownOpcode = false;  \n\
-#ifdef CHECK_GL_ERROR \n\
-\tchar lastCall[256] = {0}; \n\
-#endif \n\
-\twhile ((len - pos >= 8) && !unknownOpcode) {   \n\
-\t\tuint32_t opcode = *(uint32_t *)ptr;   \n\
-\t\tsize_t packetLen = *(uint32_t *)(ptr + 4);\n\
-\t\tif (len - pos < packetLen)  return pos; \n\
-\t\tbool useChecksum = ChecksumCalculatorThreadInfo::getVersion() > 0;\n\
-\t\tsize_t checksumSize = 0;\n\
-\t\tif (useChecksum) {\n\
-\t\t\tchecksumSize = ChecksumCalculatorThreadInfo::checksumByteSize();\n\
-\t\t}\n\
-\t\tswitch(opcode) {\n");
+    bool totalTmpBuffExist = false;
+    std::string totalTmpBuffOffset = "0";
+    std::string *tmpBufOffset = new std::string[e->vars().size()];
 
-    for (size_t f = 0; f < n; f++) {
-        enum Pass_t {
-            PASS_FIRST = 0,
-            PASS_VariableDeclarations = PASS_FIRST,
-            PASS_Protocol,
-            PASS_TmpBuffAlloc,
-            PASS_MemAlloc,
-            PASS_DebugPrint,
-            PASS_FunctionCall,
-            PASS_FlushOutput,
-            PASS_Epilog,
-            PASS_LAST };
-        EntryPoint *e = &at(f);
+    // construct retval type string
+    std::string retvalType;
+    if (!e->retval().isVoid()) {
+        retvalType = e->retval().type()->name();
+    }
 
-        // construct a printout string;
-        std::string printString = "";
-        for (size_t i = 0; i < e->vars().size(); i++) {
-            Var *v = &e->vars()[i];
-            if (!v->isVoid())  printString += (v->isPointer() ? "%p(%u)" : v->type()->printFormat()) + " ";
+    for (int pass = PASS_FIRST; pass < PASS_LAST; pass++) {
+        if (pass == PASS_FunctionCall &&
+            !e->retval().isVoid() &&
+            !e->retval().isPointer()) {
+            appendf(body, "\t\t\t*(%s *)(&tmpBuf[%s]) = ", retvalType.c_str(),
+                    totalTmpBuffOffset.c_str());
         }
-        printString += "";
-        // TODO - add for return value;
-
-        fprintf(fp, "\t\tcase OP_%s: {\n", e->name().c_str());
 
-        bool totalTmpBuffExist = false;
-        std::string totalTmpBuffOffset = "0";
-        std::string *tmpBufOffset = new std::string[e->vars().size()];
 
-        // construct retval type string
-        std::string retvalType;
-        if (!e->retval().isVoid()) {
-            retvalType = e->retval().type()->name();
+        if (pass == PASS_FunctionCall) {
+            appendf(body, "\t\t\t%s->%s(", self, e->name().c_str());
+            if (e->customDecoder()) {
+                appendf(body, "%s", self); // add a context to the call
+            }
+        } else if (pass == PASS_DebugPrint) {
+            appendf(body,
+                    "\t\t\tDEBUG(\"%s(%%p): %s(%s)\\n\", stream",
+                    basename.c_str(),
+                    e->name().c_str(),
+                    printString.c_str());
+            if (e->vars().size() > 0 && !e->vars()[0].isVoid()) {
+                appendf(body, ",");
+            }
         }
 
-        for (int pass = PASS_FIRST; pass < PASS_LAST; pass++) {
-            if (pass == PASS_FunctionCall &&
-                !e->retval().isVoid() &&
-                !e->retval().isPointer()) {
-                fprintf(fp, "\t\t\t*(%s *)(&tmpBuf[%s]) = ", retvalType.c_str(),
-                        totalTmpBuffOffset.c_str());
+        std::string varoffset = "8"; // skip the header
+        VarsArray & evars = e->vars();
+        // allocate memory for out pointers;
+        for (size_t j = 0; j < evars.size(); j++) {
+            Var *v = & evars[j];
+            if (v->isVoid()) {
+                continue;
             }
+            const char* var_name = v->name().c_str();
+            const char* var_type_name = v->type()->name().c_str();
+            const unsigned var_type_bytes = v->type()->bytes();
 
-
-            if (pass == PASS_FunctionCall) {
-                fprintf(fp, "\t\t\tthis->%s(", e->name().c_str());
-                if (e->customDecoder()) {
-                    fprintf(fp, "this"); // add a context to the call
-                }
-            } else if (pass == PASS_DebugPrint) {
-                fprintf(fp,
-                        "\t\t\tDEBUG(\"%s(%%p): %s(%s)\\n\", stream",
-                        m_basename.c_str(),
-                        e->name().c_str(),
-                        printString.c_str());
-                if (e->vars().size() > 0 && !e->vars()[0].isVoid()) {
-                    fprintf(fp, ",");
-                }
+            if ((pass == PASS_FunctionCall) &&
+                (j != 0 || e->customDecoder())) {
+                appendf(body, ", ");
+            }
+            if (pass == PASS_DebugPrint && j != 0) {
+                appendf(body, ", ");
             }
 
-            std::string varoffset = "8"; // skip the header
-            VarsArray & evars = e->vars();
-            // allocate memory for out pointers;
-            for (size_t j = 0; j < evars.size(); j++) {
-                Var *v = & evars[j];
-                if (v->isVoid()) {
-                    continue;
+            if (!v->isPointer()) {
+                if (pass == PASS_VariableDeclarations) {
+                    appendf(body,
+                            "\t\t\t%s var_%s = Unpack<%s,uint%u_t>(ptr + %s);\n",
+                            var_type_name,
+                            var_name,
+                            var_type_name,
+                            var_type_bytes * 8U,
+                            varoffset.c_str());
                 }
-                const char* var_name = v->name().c_str();
-                const char* var_type_name = v->type()->name().c_str();
-                const unsigned var_type_bytes = v->type()->bytes();
 
-                if ((pass == PASS_FunctionCall) &&
-                    (j != 0 || e->customDecoder())) {
-                    fprintf(fp, ", ");
-                }
-                if (pass == PASS_DebugPrint && j != 0) {
-                    fprintf(fp, ", ");
+                if (pass == PASS_FunctionCall ||
+                    pass == PASS_DebugPrint) {
+                    appendf(body, "var_%s", var_name);
                 }
+                varoffset += " + " + toString(var_type_bytes);
+                continue;
+            }
 
-                if (!v->isPointer()) {
-                    if (pass == PASS_VariableDeclarations) {
-                        fprintf(fp,
-                                "\t\t\t%s var_%s = Unpack<%s,uint%u_t>(ptr + %s);\n",
-                                var_type_name,
-                                var_name,
-                                var_type_name,
-                                var_type_bytes * 8U,
-                                varoffset.c_str());
-                    }
-
-                    if (pass == PASS_FunctionCall ||
-                        pass == PASS_DebugPrint) {
-                        fprintf(fp, "var_%s", var_name);
-                    }
-                    varoffset += " + " + toString(var_type_bytes);
-                    continue;
-                }
+            if (pass == PASS_VariableDeclarations) {
+                appendf(body,
+                        "\t\t\tuint32_t size_%s __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + %s);\n",
+                        var_name,
+                        varoffset.c_str());
+            }
 
+            if (v->pointerDir() == Var::POINTER_IN ||
+                v->pointerDir() == Var::POINTER_INOUT) {
                 if (pass == PASS_VariableDeclarations) {
-                    fprintf(fp,
-                            "\t\t\tuint32_t size_%s __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + %s);\n",
+#if USE_ALIGNED_BUFFERS
+                    appendf(body,
+                            "\t\t\tInputBuffer inptr_%s(ptr + %s + 4, size_%s);\n",
                             var_name,
-                            varoffset.c_str());
+                            varoffset.c_str(),
+                            var_name);
                 }
-
-                if (v->pointerDir() == Var::POINTER_IN ||
-                    v->pointerDir() == Var::POINTER_INOUT) {
-                    if (pass == PASS_VariableDeclarations) {
-#if USE_ALIGNED_BUFFERS
-                        fprintf(fp,
-                                "\t\t\tInputBuffer inptr_%s(ptr + %s + 4, size_%s);\n",
+                if (pass == PASS_FunctionCall) {
+                    if (v->nullAllowed()) {
+                        appendf(body,
+                                "size_%s == 0 ? NULL : (%s)(inptr_%s.get())",
                                 var_name,
-                                varoffset.c_str(),
+                                var_type_name,
                                 var_name);
-                    }
-                    if (pass == PASS_FunctionCall) {
-                        if (v->nullAllowed()) {
-                            fprintf(fp,
-                                    "size_%s == 0 ? NULL : (%s)(inptr_%s.get())",
-                                    var_name,
-                                    var_type_name,
-                                    var_name);
-                        } else {
-                            fprintf(fp,
-                                    "(%s)(inptr_%s.get())",
-                                    var_type_name,
-                                    var_name);
-                        }
-                    } else if (pass == PASS_DebugPrint) {
-                        fprintf(fp,
-                                "(%s)(inptr_%s.get()), size_%s",
+                    } else {
+                        appendf(body,
+                                "(%s)(inptr_%s.get())",
                                 var_type_name,
-                                var_name,
                                 var_name);
                     }
+                } else if (pass == PASS_DebugPrint) {
+                    appendf(body,
+                            "(%s)(inptr_%s.get()), size_%s",
+                            var_type_name,
+                            var_name,
+                            var_name);
+                }
 #else  // !USE_ALIGNED_BUFFERS
-                        fprintf(fp,
-                                "unsigned char *inptr_%s = (ptr + %s + 4);\n",
+                    appendf(body,
+                            "unsigned char *inptr_%s = (ptr + %s + 4);\n",
+                            var_name,
+                            varoffset.c_str());
+                }
+                if (pass == PASS_FunctionCall) {
+                    if (v->nullAllowed()) {
+                        appendf(body,
+                                "size_%s == 0 ? NULL : (%s)(inptr_%s)",
                                 var_name,
-                                varoffset.c_str());
-                    }
-                    if (pass == PASS_FunctionCall) {
-                        if (v->nullAllowed()) {
-                            fprintf(fp,
-                                    "size_%s == 0 ? NULL : (%s)(inptr_%s)",
-                                    var_name,
-                                    var_type_name,
-                                    var_name);
-                        } else {
-                            fprintf(fp,
-                                    "(%s)(inptr_%s)",
-                                    var_type_name,
-                                    var_name);
-                        }
-                    } else if (pass == PASS_DebugPrint) {
-                        fprintf(fp,
-                                "(%s)(inptr_%s), size_%s",
                                 var_type_name,
-                                var_name,
+                                var_name);
+                    } else {
+                        appendf(body,
+                                "(%s)(inptr_%s)",
+                                var_type_name,
                                 var_name);
                     }
+                } else if (pass == PASS_DebugPrint) {
+                    appendf(body,
+                            "(%s)(inptr_%s), size_%s",
+                            var_type_name,
+                            var_name,
+                            var_name);
+                }
 #endif  // !USE_ALIGNED_BUFFERS
-                    varoffset += " + 4 + size_";
-                    varoffset += var_name;
-                } else { // out pointer;
-                    if (pass == PASS_TmpBuffAlloc) {
-                        if (!totalTmpBuffExist) {
-                            fprintf(fp,
-                                    "\t\t\tsize_t totalTmpSize = size_%s;\n",
-                                    var_name);
-                        } else {
-                            fprintf(fp,
-                                    "\t\t\ttotalTmpSize += size_%s;\n",
-                                    var_name);
-                        }
-                        tmpBufOffset[j] = totalTmpBuffOffset;
-                        totalTmpBuffOffset += " + size_";
-                        totalTmpBuffOffset += var_name;
-                        totalTmpBuffExist = true;
-                    } else if (pass == PASS_MemAlloc) {
+                varoffset += " + 4 + size_";
+                varoffset += var_name;
+            } else { // out pointer;
+                if (pass == PASS_TmpBuffAlloc) {
+                    if (!totalTmpBuffExist) {
+                        appendf(body,
+                                "\t\t\tsize_t totalTmpSize = size_%s;\n",
+                                var_name);
+                    } else {
+                        appendf(body,
+                                "\t\t\ttotalTmpSize += size_%s;\n",
+                                var_name);
+                    }
+                    tmpBufOffset[j] = totalTmpBuffOffset;
+                    totalTmpBuffOffset += " + size_";
+                    totalTmpBuffOffset += var_name;
+                    totalTmpBuffExist = true;
+                } else if (pass == PASS_MemAlloc) {
 #if USE_ALIGNED_BUFFERS
-                        fprintf(fp,
-                                "\t\t\tOutputBuffer outptr_%s(&tmpBuf[%s], size_%s);\n",
+                    appendf(body,
+                            "\t\t\tOutputBuffer outptr_%s(&tmpBuf[%s], size_%s);\n",
+                            var_name,
+                            tmpBufOffset[j].c_str(),
+                            var_name);
+                } else if (pass == PASS_FunctionCall) {
+                    if (v->nullAllowed()) {
+                        appendf(body,
+                                "size_%s == 0 ? NULL : (%s)(outptr_%s.get())",
                                 var_name,
-                                tmpBufOffset[j].c_str(),
-                                var_name);
-                    } else if (pass == PASS_FunctionCall) {
-                        if (v->nullAllowed()) {
-                            fprintf(fp,
-                                    "size_%s == 0 ? NULL : (%s)(outptr_%s.get())",
-                                    var_name,
-                                    var_type_name,
-                                    var_name);
-                        } else {
-                            fprintf(fp,
-                                    "(%s)(outptr_%s.get())",
-                                    var_type_name,
-                                    var_name);
-                        }
-                    } else if (pass == PASS_DebugPrint) {
-                        fprintf(fp,
-                                "(%s)(outptr_%s.get()), size_%s",
                                 var_type_name,
-                                var_name,
                                 var_name);
-                    }
-                    if (pass == PASS_FlushOutput) {
-                        fprintf(fp,
-                                "\t\t\toutptr_%s.flush();\n",
+                    } else {
+                        appendf(body,
+                                "(%s)(outptr_%s.get())",
+                                var_type_name,
                                 var_name);
                     }
+                } else if (pass == PASS_DebugPrint) {
+                    appendf(body,
+                            "(%s)(outptr_%s.get()), size_%s",
+                            var_type_name,
+                            var_name,
+                            var_name);
+                }
+                if (pass == PASS_FlushOutput) {
+                    appendf(body,
+                            "\t\t\toutptr_%s.flush();\n",
+                            var_name);
+                }
 #else  // !USE_ALIGNED_BUFFERS
-                        fprintf(fp,
-                                "\t\t\tunsigned char *outptr_%s = &tmpBuf[%s];\n",
-                                var_name,
-                                tmpBufOffset[j].c_str());
-                        fprintf(fp,
-                                "\t\t\tmemset(outptr_%s, 0, %s);\n",
+                    appendf(body,
+                            "\t\t\tunsigned char *outptr_%s = &tmpBuf[%s];\n",
+                            var_name,
+                            tmpBufOffset[j].c_str());
+                    appendf(body,
+                            "\t\t\tmemset(outptr_%s, 0, %s);\n",
+                            var_name,
+                            toString(v->type()->bytes()).c_str());
+                } else if (pass == PASS_FunctionCall) {
+                    if (v->nullAllowed()) {
+                        appendf(body,
+                                "size_%s == 0 ? NULL : (%s)(outptr_%s)",
                                 var_name,
-                                toString(v->type()->bytes()).c_str());
-                    } else if (pass == PASS_FunctionCall) {
-                        if (v->nullAllowed()) {
-                            fprintf(fp,
-                                    "size_%s == 0 ? NULL : (%s)(outptr_%s)",
-                                    var_name,
-                                    var_type_name,
-                                    var_name);
-                        } else {
-                            fprintf(fp,
-                                    "(%s)(outptr_%s)",
-                                    var_type_name,
-                                    var_name);
-                        }
-                    } else if (pass == PASS_DebugPrint) {
-                        fprintf(fp,
-                                "(%s)(outptr_%s), size_%s",
                                 var_type_name,
-                                var_name,
-                                varoffset.c_str());
+                                var_name);
+                    } else {
+                        appendf(body,
+                                "(%s)(outptr_%s)",
+                                var_type_name,
+                                var_name);
                     }
-#endif  // !USE_ALIGNED_BUFFERS
-                    varoffset += " + 4";
+                } else if (pass == PASS_DebugPrint) {
+                    appendf(body,
+                            "(%s)(outptr_%s), size_%s",
+                            var_type_name,
+                            var_name,
+                            varoffset.c_str());
                 }
+#endif  // !USE_ALIGNED_BUFFERS
+                varoffset += " + 4";
             }
+        }
 
-            if (pass == PASS_Protocol) {
-                fprintf(fp,
-                        "\t\t\tif (useChecksum) {\n"
-                        "\t\t\t\tChecksumCalculatorThreadInfo::validOrDie(ptr, %s, "
-                        "ptr + %s, checksumSize, "
-                        "\n\t\t\t\t\t\"%s::decode,"
-                        " OP_%s: GL checksumCalculator failure\\n\");\n"
-                        "\t\t\t}\n",
-                        varoffset.c_str(),
-                        varoffset.c_str(),
-                        varoffset.c_str(),
-                        classname.c_str(),
-                        e->name().c_str()
-                        );
+        if (pass == PASS_Protocol) {
+            appendf(body,
+                    "\t\t\tif (checksum.enabled) {\n"
+                    "\t\t\t\tChecksumCalculatorThreadInfo::validOrDie("
+                    "checksum.calc, ptr, %s, ptr + %s, checksum.size, "
+                    "\n\t\t\t\t\t\"%s::decode,"
+                    " OP_%s: GL checksumCalculator failure\\n\");\n"
+                    "\t\t\t}\n",
+                    varoffset.c_str(),
+                    varoffset.c_str(),
+                    classname.c_str(),
+                    e->name().c_str()
+                    );
+
+            varoffset += " + 4";
+        }
 
-                varoffset += " + 4";
+        if (pass == PASS_FunctionCall ||
+            pass == PASS_DebugPrint) {
+            appendf(body, ");\n");
+        }
+
+        if (pass == PASS_TmpBuffAlloc) {
+            if (!e->retval().isVoid() && !e->retval().isPointer()) {
+                if (!totalTmpBuffExist)
+                    appendf(body,
+                            "\t\t\tsize_t totalTmpSize = sizeof(%s);\n",
+                            retvalType.c_str());
+                else
+                    appendf(body,
+                            "\t\t\ttotalTmpSize += sizeof(%s);\n",
+                            retvalType.c_str());
+
+                totalTmpBuffExist = true;
+            }
+            if (totalTmpBuffExist) {
+                appendf(body,
+                        "\t\t\ttotalTmpSize += checksum.size;\n"
+                        "\t\t\tunsigned char *tmpBuf = stream->alloc(totalTmpSize);\n");
             }
+        }
 
-            if (pass == PASS_FunctionCall ||
-                pass == PASS_DebugPrint) {
-                fprintf(fp, ");\n");
+        if (pass == PASS_Epilog) {
+            // send back out pointers data as well as retval
+            if (totalTmpBuffExist) {
+                appendf(body,
+                        "\t\t\tif (checksum.enabled) {\n"
+                        "\t\t\t\tChecksumCalculatorThreadInfo::writeChecksum("
+                        "checksum.calc, &tmpBuf[0], totalTmpSize - checksum.size, "
+                        "&tmpBuf[totalTmpSize - checksum.size], checksum.size);\n"
+                        "\t\t\t}\n"
+                        "\t\t\tstream->flush();\n");
             }
+        }
 
-            if (pass == PASS_TmpBuffAlloc) {
-                if (!e->retval().isVoid() && !e->retval().isPointer()) {
-                    if (!totalTmpBuffExist)
-                        fprintf(fp,
-                                "\t\t\tsize_t totalTmpSize = sizeof(%s);\n",
-                                retvalType.c_str());
-                    else
-                        fprintf(fp,
-                                "\t\t\ttotalTmpSize += sizeof(%s);\n",
-                                retvalType.c_str());
+    } // pass;
 
-                    totalTmpBuffExist = true;
-                }
-                if (totalTmpBuffExist) {
-                    fprintf(fp,
-                            "\t\t\ttotalTmpSize += checksumSize;\n"
-                            "\t\t\tunsigned char *tmpBuf = stream->alloc(totalTmpSize);\n");
-                }
-            }
+    if (e->checksumConfig()) {
+        appendf(body, "\t\t\tchecksum.refresh();\n");
+    }
 
-            if (pass == PASS_Epilog) {
-                // send back out pointers data as well as retval
-                if (totalTmpBuffExist) {
-                    fprintf(fp,
-                            "\t\t\tif (useChecksum) {\n"
-                            "\t\t\t\tChecksumCalculatorThreadInfo::writeChecksum("
-                            "&tmpBuf[0], totalTmpSize - checksumSize, "
-                            "&tmpBuf[totalTmpSize - checksumSize], checksumSize);\n"
-                            "\t\t\t}\n"
-                            "\t\t\tstream->flush();\n");
-                }
-            }
+    delete [] tmpBufOffset;
+}
+
+int ApiGen::genDecoderImpl(const std::string &filename)
+{
+    FILE *fp = fopen(filename.c_str(), "wt");
+    if (fp == NULL) {
+        perror(filename.c_str());
+        return -1;
+    }
 
-        } // pass;
+    printHeader(fp);
+
+    std::string classname = m_basename + "_decoder_context_t";
+
+    size_t n = size();
+
+    fprintf(fp, "\n\n#include <string.h>\n");
+    fprintf(fp, "#include \"%s_opcodes.h\"\n\n", m_basename.c_str());
+    fprintf(fp, "#include \"%s_dec.h\"\n\n\n", m_basename.c_str());
+    fprintf(fp, "#include \"ProtocolUtils.h\"\n\n");
+    fprintf(fp, "#include \"ChecksumCalculatorThreadInfo.h\"\n");
+    fprintf(fp, "#include \"DecoderProfiler.h\"\n\n");
+    fprintf(fp, "#include <stdio.h>\n\n");
+    fprintf(fp, "typedef unsigned int tsize_t; // Target \"size_t\", which is 32-bit for now. It may or may not be the same as host's size_t when emugen is compiled.\n\n");
+
+    // helper macros
+    fprintf(fp,
+            "#ifdef OPENGL_DEBUG_PRINTOUT\n"
+            "#  define DEBUG(...) do { if (emugl_cxt_logger) { emugl_cxt_logger(__VA_ARGS__); } } while(0)\n"
+            "#else\n"
+            "#  define DEBUG(...)  ((void)0)\n"
+            "#endif\n\n");
+
+    fprintf(fp,
+            "#ifdef CHECK_GLERROR\n"
+            "#  define SET_LASTCALL(name)  snprintf(lastCall, sizeof(lastCall), \"%%s\", name)\n"
+            "#else\n"
+            "#  define SET_LASTCALL(name)  ((void)0)\n"
+            "#endif\n\n");
+
+    // helper templates
+    fprintf(fp, "using namespace emugl;\n\n");
+
+    fprintf(fp,
+            "namespace {\n\n"
+            "// Checksum configuration of the decoding thread. It is looked up once\n"
+            "// per decode() call, and only refreshed after commands that change it.\n"
+            "struct ChecksumState {\n"
+            "\tChecksumCalculator *calc;\n"
+            "\tbool enabled;\n"
+            "\tsize_t size;\n\n"
+            "\tChecksumState() : calc(ChecksumCalculatorThreadInfo::get()) {\n"
+            "\t\trefresh();\n"
+            "\t}\n\n"
+            "\tvoid refresh() {\n"
+            "\t\tenabled = calc->getVersion() > 0;\n"
+            "\t\tsize = enabled ? calc->checksumByteSize() : 0;\n"
+            "\t}\n"
+            "};\n\n"
+            "typedef void (*DecoderHandler)(%s *ctx, unsigned char *ptr, IOStream *stream, ChecksumState &checksum);\n\n",
+            classname.c_str());
+
+    // out-of-line handlers, for commands with pointers or a return value
+    for (size_t f = 0; f < n; f++) {
+        EntryPoint *e = &at(f);
+        if (isFixedSizeEntry(e)) {
+            continue;
+        }
+        std::string body;
+        genDecoderEntry(&body, e, m_basename, classname, "ctx");
+        fprintf(fp,
+                "void decode_%s(%s *ctx, unsigned char *ptr, IOStream *stream, ChecksumState &checksum)\n{\n",
+                e->name().c_str(), classname.c_str());
+        writeDedented(fp, body, 2);
+        fprintf(fp, "}\n\n");
+    }
+
+    // handler and name tables, indexed by opcode
+    fprintf(fp,
+            "// Commands with fixed-size arguments only are decoded inline, and\n"
+            "// have no handler.\n"
+            "const DecoderHandler kDecoderHandlers[] = {\n");
+    for (size_t f = 0; f < n; f++) {
+        EntryPoint *e = &at(f);
+        if (isFixedSizeEntry(e)) {
+            fprintf(fp, "\tNULL,\n");
+        } else {
+            fprintf(fp, "\tdecode_%s,\n", e->name().c_str());
+        }
+    }
+    fprintf(fp, "};\n\n");
+    fprintf(fp, "const char *const kDecoderNames[] = {\n");
+    for (size_t f = 0; f < n; f++) {
+        fprintf(fp, "\t\"%s\",\n", at(f).name().c_str());
+    }
+    fprintf(fp, "};\n\n");
+    fprintf(fp,
+            "DecoderProfiler sProfiler(\"%s\", %uU, %uU, kDecoderNames);\n\n",
+            m_basename.c_str(), (unsigned int)m_baseOpcode, (unsigned int)n);
+    fprintf(fp, "}  // namespace\n\n");
+
+    // decoder loop
+    fprintf(fp, "size_t %s::decode(void *buf, size_t len, IOStream *stream)\n{\n", classname.c_str());
+    fprintf(fp,
+            "\tsize_t pos = 0;\n"
+            "\tif (len < 8) return pos;\n"
+            "\tunsigned char *ptr = (unsigned char *)buf;\n"
+            "\tbool unknownOpcode = false;\n"
+            "#ifdef CHECK_GL_ERROR\n"
+            "\tchar lastCall[256] = {0};\n"
+            "#endif\n"
+            "\tChecksumState checksum;\n"
+            "\tconst bool profiling = DecoderProfiler::isEnabled();\n"
+            "\twhile ((len - pos >= 8) && !unknownOpcode) {\n"
+            "\t\tuint32_t opcode = *(uint32_t *)ptr;\n"
+            "\t\tsize_t packetLen = *(uint32_t *)(ptr + 4);\n"
+            "\t\tif (len - pos < packetLen)  return pos;\n"
+            "\t\tuint64_t startNs = profiling ? DecoderProfiler::nowNs() : 0;\n"
+            "\t\tswitch(opcode) {\n");
+
+    for (size_t f = 0; f < n; f++) {
+        EntryPoint *e = &at(f);
+        if (!isFixedSizeEntry(e)) {
+            continue;
+        }
+        std::string body;
+        genDecoderEntry(&body, e, m_basename, classname, "this");
+        fprintf(fp, "\t\tcase OP_%s: {\n", e->name().c_str());
+        writeDedented(fp, body, 0);
         fprintf(fp, "\t\t\tSET_LASTCALL(\"%s\");\n", e->name().c_str());
         fprintf(fp, "\t\t\tbreak;\n");
         fprintf(fp, "\t\t}\n");
-
-        delete [] tmpBufOffset;
     }
-    fprintf(fp, "\t\t\tdefault:\n");
-    fprintf(fp, "\t\t\t\tunknownOpcode = true;\n");
+    fprintf(fp,
+            "\t\tdefault: {\n"
+            "\t\t\tuint32_t index = opcode - %uU;\n"
+            "\t\t\tDecoderHandler handler = index < %uU ? kDecoderHandlers[index] : NULL;\n"
+            "\t\t\tif (handler) {\n"
+            "\t\t\t\thandler(this, ptr, stream, checksum);\n"
+            "\t\t\t\tSET_LASTCALL(kDecoderNames[index]);\n"
+            "\t\t\t} else {\n"
+            "\t\t\t\tunknownOpcode = true;\n"
+            "\t\t\t}\n"
+            "\t\t}\n",
+            (unsigned int)m_baseOpcode, (unsigned int)n);
     fprintf(fp, "\t\t} //switch\n");
     if (strstr(m_basename.c_str(), "gl")) {
         fprintf(fp, "#ifdef CHECK_GL_ERROR\n");
@@ -1182,6 +1319,11 @@ int ApiGen::genDecoderImpl(const std::string &filename)
     }
 
     fprintf(fp, "\t\tif (!unknownOpcode) {\n");
+    fprintf(fp,
+            "\t\t\tif (profiling) {\n"
+            "\t\t\t\tsProfiler.record(opcode - %uU, packetLen, DecoderProfiler::nowNs() - startNs);\n"
+            "\t\t\t}\n",
+            (unsigned int)m_baseOpcode);
     fprintf(fp, "\t\t\tpos += packetLen;\n");
     fprintf(fp, "\t\t\tptr += packetLen;\n");
     fprintf(fp, "\t\t}\n");
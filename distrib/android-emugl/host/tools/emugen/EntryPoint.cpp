@@ -39,6 +39,7 @@ void EntryPoint::reset()
     m_customDecoder = false;
     m_notApi = false;
     m_flushOnEncode = false;
+    m_checksumConfig = false;
     m_vars.empty();
 }
 
@@ -338,6 +339,8 @@ int EntryPoint::setAttribute(const std::string &line, size_t lc)
             setNotApi(true);
         } else if (flag == "flushOnEncode") {
             setFlushOnEncode(true);
+        } else if (flag == "checksum_config") {
+            setChecksumConfig(true);
         } else {
             fprintf(stderr, "WARNING: %u: unknown flag %s\n", (unsigned int)lc, flag.c_str());
         }
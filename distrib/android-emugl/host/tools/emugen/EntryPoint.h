@@ -49,6 +49,8 @@ public:
     void setNotApi(bool state) { m_notApi = state; }
     bool flushOnEncode() const { return m_flushOnEncode; }
     void setFlushOnEncode(bool state) { m_flushOnEncode = state; }
+    bool checksumConfig() const { return m_checksumConfig; }
+    void setChecksumConfig(bool state) { m_checksumConfig = state; }
     int setAttribute(const std::string &line, size_t lc);
 
 private:
@@ -60,6 +62,7 @@ private:
     bool m_customDecoder;
     bool m_notApi;
     bool m_flushOnEncode;
+    bool m_checksumConfig;
 
     void err(unsigned int lc, const char *msg) {
         fprintf(stderr, "line %d: %s\n", lc, msg);
@@ -11,6 +11,7 @@
 #include "ProtocolUtils.h"
 
 #include "ChecksumCalculatorThreadInfo.h"
+#include "DecoderProfiler.h"
 
 #include <stdio.h>
 
@@ -23,103 +24,154 @@ typedef unsigned int tsize_t; // Target "size_t", which is 32-bit for now. It ma
 #endif
 
 #ifdef CHECK_GLERROR
-#  define SET_LASTCALL(name)  sprintf(lastCall, #name)
+#  define SET_LASTCALL(name)  snprintf(lastCall, sizeof(lastCall), "%s", name)
 #else
 #  define SET_LASTCALL(name)  ((void)0)
 #endif
 
 using namespace emugl;
 
+namespace {
+
+// Checksum configuration of the decoding thread. It is looked up once
+// per decode() call, and only refreshed after commands that change it.
+struct ChecksumState {
+	ChecksumCalculator *calc;
+	bool enabled;
+	size_t size;
+
+	ChecksumState() : calc(ChecksumCalculatorThreadInfo::get()) {
+		refresh();
+	}
+
+	void refresh() {
+		enabled = calc->getVersion() > 0;
+		size = enabled ? calc->checksumByteSize() : 0;
+	}
+};
+
+typedef void (*DecoderHandler)(foo_decoder_context_t *ctx, unsigned char *ptr, IOStream *stream, ChecksumState &checksum);
+
+void decode_fooIsBuffer(foo_decoder_context_t *ctx, unsigned char *ptr, IOStream *stream, ChecksumState &checksum)
+{
+	uint32_t size_stuff __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
+	InputBuffer inptr_stuff(ptr + 8 + 4, size_stuff);
+	if (checksum.enabled) {
+		ChecksumCalculatorThreadInfo::validOrDie(checksum.calc, ptr, 8 + 4 + size_stuff, ptr + 8 + 4 + size_stuff, checksum.size, 
+			"foo_decoder_context_t::decode, OP_fooIsBuffer: GL checksumCalculator failure\n");
+	}
+	size_t totalTmpSize = sizeof(FooBoolean);
+	totalTmpSize += checksum.size;
+	unsigned char *tmpBuf = stream->alloc(totalTmpSize);
+	DEBUG("foo(%p): fooIsBuffer(%p(%u) )\n", stream,(void*)(inptr_stuff.get()), size_stuff);
+	*(FooBoolean *)(&tmpBuf[0]) = 			ctx->fooIsBuffer((void*)(inptr_stuff.get()));
+	if (checksum.enabled) {
+		ChecksumCalculatorThreadInfo::writeChecksum(checksum.calc, &tmpBuf[0], totalTmpSize - checksum.size, &tmpBuf[totalTmpSize - checksum.size], checksum.size);
+	}
+	stream->flush();
+}
+
+void decode_fooUnsupported(foo_decoder_context_t *ctx, unsigned char *ptr, IOStream *stream, ChecksumState &checksum)
+{
+	uint32_t size_params __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
+	InputBuffer inptr_params(ptr + 8 + 4, size_params);
+	if (checksum.enabled) {
+		ChecksumCalculatorThreadInfo::validOrDie(checksum.calc, ptr, 8 + 4 + size_params, ptr + 8 + 4 + size_params, checksum.size, 
+			"foo_decoder_context_t::decode, OP_fooUnsupported: GL checksumCalculator failure\n");
+	}
+	DEBUG("foo(%p): fooUnsupported(%p(%u) )\n", stream,(void*)(inptr_params.get()), size_params);
+	ctx->fooUnsupported((void*)(inptr_params.get()));
+}
+
+void decode_fooTakeConstVoidPtrConstPtr(foo_decoder_context_t *ctx, unsigned char *ptr, IOStream *stream, ChecksumState &checksum)
+{
+	uint32_t size_param __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
+	InputBuffer inptr_param(ptr + 8 + 4, size_param);
+	if (checksum.enabled) {
+		ChecksumCalculatorThreadInfo::validOrDie(checksum.calc, ptr, 8 + 4 + size_param, ptr + 8 + 4 + size_param, checksum.size, 
+			"foo_decoder_context_t::decode, OP_fooTakeConstVoidPtrConstPtr: GL checksumCalculator failure\n");
+	}
+	DEBUG("foo(%p): fooTakeConstVoidPtrConstPtr(%p(%u) )\n", stream,(const void* const*)(inptr_param.get()), size_param);
+	ctx->fooTakeConstVoidPtrConstPtr((const void* const*)(inptr_param.get()));
+}
+
+// Commands with fixed-size arguments only are decoded inline, and
+// have no handler.
+const DecoderHandler kDecoderHandlers[] = {
+	NULL,
+	decode_fooIsBuffer,
+	decode_fooUnsupported,
+	NULL,
+	decode_fooTakeConstVoidPtrConstPtr,
+};
+
+const char *const kDecoderNames[] = {
+	"fooAlphaFunc",
+	"fooIsBuffer",
+	"fooUnsupported",
+	"fooDoEncoderFlush",
+	"fooTakeConstVoidPtrConstPtr",
+};
+
+DecoderProfiler sProfiler("foo", 200U, 5U, kDecoderNames);
+
+}  // namespace
+
 size_t foo_decoder_context_t::decode(void *buf, size_t len, IOStream *stream)
 {
-                           
 	size_t pos = 0;
-	if (len < 8) return pos; 
+	if (len < 8) return pos;
 	unsigned char *ptr = (unsigned char *)buf;
-	bool unknownOpcode = false;  
-#ifdef CHECK_GL_ERROR 
-	char lastCall[256] = {0}; 
-#endif 
-	while ((len - pos >= 8) && !unknownOpcode) {   
-		uint32_t opcode = *(uint32_t *)ptr;   
+	bool unknownOpcode = false;
+#ifdef CHECK_GL_ERROR
+	char lastCall[256] = {0};
+#endif
+	ChecksumState checksum;
+	const bool profiling = DecoderProfiler::isEnabled();
+	while ((len - pos >= 8) && !unknownOpcode) {
+		uint32_t opcode = *(uint32_t *)ptr;
 		size_t packetLen = *(uint32_t *)(ptr + 4);
-		if (len - pos < packetLen)  return pos; 
-		bool useChecksum = ChecksumCalculatorThreadInfo::getVersion() > 0;
-		size_t checksumSize = 0;
-		if (useChecksum) {
-			checksumSize = ChecksumCalculatorThreadInfo::checksumByteSize();
-		}
+		if (len - pos < packetLen)  return pos;
+		uint64_t startNs = profiling ? DecoderProfiler::nowNs() : 0;
 		switch(opcode) {
 		case OP_fooAlphaFunc: {
 			FooInt var_func = Unpack<FooInt,uint32_t>(ptr + 8);
 			FooFloat var_ref = Unpack<FooFloat,uint32_t>(ptr + 8 + 4);
-			if (useChecksum) {
-				ChecksumCalculatorThreadInfo::validOrDie(ptr, 8 + 4 + 4, ptr + 8 + 4 + 4, checksumSize, 
-					"8 + 4 + 4::decode, OP_foo_decoder_context_t: GL checksumCalculator failure\n");
+			if (checksum.enabled) {
+				ChecksumCalculatorThreadInfo::validOrDie(checksum.calc, ptr, 8 + 4 + 4, ptr + 8 + 4 + 4, checksum.size, 
+					"foo_decoder_context_t::decode, OP_fooAlphaFunc: GL checksumCalculator failure\n");
 			}
 			DEBUG("foo(%p): fooAlphaFunc(%d %f )\n", stream,var_func, var_ref);
 			this->fooAlphaFunc(var_func, var_ref);
 			SET_LASTCALL("fooAlphaFunc");
 			break;
 		}
-		case OP_fooIsBuffer: {
-			uint32_t size_stuff __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
-			InputBuffer inptr_stuff(ptr + 8 + 4, size_stuff);
-			if (useChecksum) {
-				ChecksumCalculatorThreadInfo::validOrDie(ptr, 8 + 4 + size_stuff, ptr + 8 + 4 + size_stuff, checksumSize, 
-					"8 + 4 + size_stuff::decode, OP_foo_decoder_context_t: GL checksumCalculator failure\n");
-			}
-			size_t totalTmpSize = sizeof(FooBoolean);
-			totalTmpSize += checksumSize;
-			unsigned char *tmpBuf = stream->alloc(totalTmpSize);
-			DEBUG("foo(%p): fooIsBuffer(%p(%u) )\n", stream,(void*)(inptr_stuff.get()), size_stuff);
-			*(FooBoolean *)(&tmpBuf[0]) = 			this->fooIsBuffer((void*)(inptr_stuff.get()));
-			if (useChecksum) {
-				ChecksumCalculatorThreadInfo::writeChecksum(&tmpBuf[0], totalTmpSize - checksumSize, &tmpBuf[totalTmpSize - checksumSize], checksumSize);
-			}
-			stream->flush();
-			SET_LASTCALL("fooIsBuffer");
-			break;
-		}
-		case OP_fooUnsupported: {
-			uint32_t size_params __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
-			InputBuffer inptr_params(ptr + 8 + 4, size_params);
-			if (useChecksum) {
-				ChecksumCalculatorThreadInfo::validOrDie(ptr, 8 + 4 + size_params, ptr + 8 + 4 + size_params, checksumSize, 
-					"8 + 4 + size_params::decode, OP_foo_decoder_context_t: GL checksumCalculator failure\n");
-			}
-			DEBUG("foo(%p): fooUnsupported(%p(%u) )\n", stream,(void*)(inptr_params.get()), size_params);
-			this->fooUnsupported((void*)(inptr_params.get()));
-			SET_LASTCALL("fooUnsupported");
-			break;
-		}
 		case OP_fooDoEncoderFlush: {
 			FooInt var_param = Unpack<FooInt,uint32_t>(ptr + 8);
-			if (useChecksum) {
-				ChecksumCalculatorThreadInfo::validOrDie(ptr, 8 + 4, ptr + 8 + 4, checksumSize, 
-					"8 + 4::decode, OP_foo_decoder_context_t: GL checksumCalculator failure\n");
+			if (checksum.enabled) {
+				ChecksumCalculatorThreadInfo::validOrDie(checksum.calc, ptr, 8 + 4, ptr + 8 + 4, checksum.size, 
+					"foo_decoder_context_t::decode, OP_fooDoEncoderFlush: GL checksumCalculator failure\n");
 			}
 			DEBUG("foo(%p): fooDoEncoderFlush(%d )\n", stream,var_param);
 			this->fooDoEncoderFlush(var_param);
 			SET_LASTCALL("fooDoEncoderFlush");
 			break;
 		}
-		case OP_fooTakeConstVoidPtrConstPtr: {
-			uint32_t size_param __attribute__((unused)) = Unpack<uint32_t,uint32_t>(ptr + 8);
-			InputBuffer inptr_param(ptr + 8 + 4, size_param);
-			if (useChecksum) {
-				ChecksumCalculatorThreadInfo::validOrDie(ptr, 8 + 4 + size_param, ptr + 8 + 4 + size_param, checksumSize, 
-					"8 + 4 + size_param::decode, OP_foo_decoder_context_t: GL checksumCalculator failure\n");
+		default: {
+			uint32_t index = opcode - 200U;
+			DecoderHandler handler = index < 5U ? kDecoderHandlers[index] : NULL;
+			if (handler) {
+				handler(this, ptr, stream, checksum);
+				SET_LASTCALL(kDecoderNames[index]);
+			} else {
+				unknownOpcode = true;
 			}
-			DEBUG("foo(%p): fooTakeConstVoidPtrConstPtr(%p(%u) )\n", stream,(const void* const*)(inptr_param.get()), size_param);
-			this->fooTakeConstVoidPtrConstPtr((const void* const*)(inptr_param.get()));
-			SET_LASTCALL("fooTakeConstVoidPtrConstPtr");
-			break;
 		}
-			default:
-				unknownOpcode = true;
 		} //switch
 		if (!unknownOpcode) {
+			if (profiling) {
+				sProfiler.record(opcode - 200U, packetLen, DecoderProfiler::nowNs() - startNs);
+			}
 			pos += packetLen;
 			ptr += packetLen;
 		}
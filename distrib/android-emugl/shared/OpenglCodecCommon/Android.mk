@@ -7,6 +7,7 @@ commonSources := \
         glUtils.cpp \
         ChecksumCalculator.cpp \
         ChecksumCalculatorThreadInfo.cpp \
+        DecoderProfiler.cpp \
 
 host_commonSources := $(commonSources)
 
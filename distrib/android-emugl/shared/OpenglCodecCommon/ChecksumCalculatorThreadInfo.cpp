@@ -74,10 +74,8 @@ bool ChecksumCalculatorThreadInfo::writeChecksum(void* buf,
                                                  size_t bufLen,
                                                  void* outputChecksum,
                                                  size_t outputChecksumLen) {
-    ChecksumCalculator& protocol =
-            getChecksumCalculatorThreadInfo()->m_protocol;
-    protocol.addBuffer(buf, bufLen);
-    return protocol.writeChecksum(outputChecksum, outputChecksumLen);
+    return writeChecksum(get(), buf, bufLen, outputChecksum,
+                         outputChecksumLen);
 }
 
 bool ChecksumCalculatorThreadInfo::validate(void* buf,
@@ -95,9 +93,32 @@ void ChecksumCalculatorThreadInfo::validOrDie(void* buf,
                                               void* checksum,
                                               size_t checksumLen,
                                               const char* message) {
+    validOrDie(get(), buf, bufLen, checksum, checksumLen, message);
+}
+
+ChecksumCalculator* ChecksumCalculatorThreadInfo::get() {
+    return &getChecksumCalculatorThreadInfo()->m_protocol;
+}
+
+bool ChecksumCalculatorThreadInfo::writeChecksum(ChecksumCalculator* calc,
+                                                 void* buf,
+                                                 size_t bufLen,
+                                                 void* outputChecksum,
+                                                 size_t outputChecksumLen) {
+    calc->addBuffer(buf, bufLen);
+    return calc->writeChecksum(outputChecksum, outputChecksumLen);
+}
+
+void ChecksumCalculatorThreadInfo::validOrDie(ChecksumCalculator* calc,
+                                              void* buf,
+                                              size_t bufLen,
+                                              void* checksum,
+                                              size_t checksumLen,
+                                              const char* message) {
     // We should actually call crashhandler_die(message), but I don't think we
     // can link to that library from here
-    if (!validate(buf, bufLen, checksum, checksumLen)) {
+    calc->addBuffer(buf, bufLen);
+    if (!calc->validate(checksum, checksumLen)) {
         emugl_crash_reporter(message);
     }
 }
@@ -51,6 +51,23 @@ public:
                            size_t checksumLen,
                            const char* message);
 
+    // Returns the calculator of the current thread. Decoders look it up
+    // once per stream buffer instead of once per command, and then use the
+    // overloads below.
+    static ChecksumCalculator* get();
+
+    static bool writeChecksum(ChecksumCalculator* calc,
+                              void* buf,
+                              size_t bufLen,
+                              void* outputChecksum,
+                              size_t outputChecksumLen);
+    static void validOrDie(ChecksumCalculator* calc,
+                           void* buf,
+                           size_t bufLen,
+                           void* checksum,
+                           size_t checksumLen,
+                           const char* message);
+
 private:
     ChecksumCalculator m_protocol;
 };
@@ -0,0 +1,221 @@
+/*
+* Copyright (C) 2016 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "DecoderProfiler.h"
+
+#include "emugl/common/lazy_instance.h"
+#include "emugl/common/mutex.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+namespace {
+
+// Minimum time between two writes of the report file.
+const uint64_t kDumpIntervalNs = 5000000000ULL;
+
+struct ProfilerConfig {
+    ProfilerConfig() :
+            path(getenv("RENDERER_PROFILE_FILE")),
+            startNs(DecoderProfiler::nowNs()),
+            lastDumpNs(startNs),
+            lock() {}
+
+    const char* path;
+    uint64_t startNs;
+    std::atomic<uint64_t> lastDumpNs;
+    emugl::Mutex lock;  // Serializes writes to |path|.
+};
+
+emugl::LazyInstance<ProfilerConfig> sConfig = LAZY_INSTANCE_INIT;
+
+// Decoders register themselves during static initialization, before any
+// render thread runs, so this list doesn't need a lock.
+DecoderProfiler* sFirstProfiler = NULL;
+
+struct ReportLine {
+    const char* api;
+    const char* name;
+    uint32_t opcode;
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t timeNs;
+
+    bool operator<(const ReportLine& other) const {
+        return timeNs > other.timeNs;
+    }
+};
+
+}  // namespace
+
+DecoderProfiler::DecoderProfiler(const char* api,
+                                 uint32_t baseOpcode,
+                                 size_t count,
+                                 const char* const* names) :
+        m_api(api),
+        m_baseOpcode(baseOpcode),
+        m_count(count),
+        m_names(names),
+        m_counters(new Counters[count]),
+        m_next(sFirstProfiler) {
+    for (size_t i = 0; i < count; i++) {
+        m_counters[i].calls = 0;
+        m_counters[i].bytes = 0;
+        m_counters[i].timeNs = 0;
+    }
+    sFirstProfiler = this;
+}
+
+DecoderProfiler::~DecoderProfiler() {
+    DecoderProfiler** link = &sFirstProfiler;
+    while (*link && *link != this) {
+        link = &(*link)->m_next;
+    }
+    if (*link) {
+        *link = m_next;
+    }
+    delete [] m_counters;
+}
+
+// static
+bool DecoderProfiler::isEnabled() {
+    return sConfig->path != NULL;
+}
+
+// static
+uint64_t DecoderProfiler::nowNs() {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    static bool freqInit = false;
+    if (!freqInit) {
+        QueryPerformanceFrequency(&freq);
+        freqInit = true;
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    // Split the conversion to avoid overflowing on long uptimes.
+    uint64_t secs = now.QuadPart / freq.QuadPart;
+    uint64_t rest = now.QuadPart % freq.QuadPart;
+    return secs * 1000000000ULL + rest * 1000000000ULL / freq.QuadPart;
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+    if (!timebase.denom) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+// static
+std::string DecoderProfiler::report() {
+    if (!isEnabled()) {
+        return "# decoder profiling disabled, define RENDERER_PROFILE_FILE\n";
+    }
+
+    std::vector<ReportLine> lines;
+    uint64_t totalCalls = 0;
+    uint64_t totalBytes = 0;
+    for (DecoderProfiler* p = sFirstProfiler; p; p = p->m_next) {
+        for (size_t i = 0; i < p->m_count; i++) {
+            ReportLine line;
+            line.calls = p->m_counters[i].calls.load(std::memory_order_relaxed);
+            if (!line.calls) {
+                continue;
+            }
+            line.api = p->m_api;
+            line.name = p->m_names[i];
+            line.opcode = p->m_baseOpcode + (uint32_t)i;
+            line.bytes = p->m_counters[i].bytes.load(std::memory_order_relaxed);
+            line.timeNs = p->m_counters[i].timeNs.load(std::memory_order_relaxed);
+            lines.push_back(line);
+            totalCalls += line.calls;
+            totalBytes += line.bytes;
+        }
+    }
+    std::sort(lines.begin(), lines.end());
+
+    char buf[256];
+    std::string result;
+    double elapsed = (nowNs() - sConfig->startNs) / 1e9;
+    snprintf(buf, sizeof(buf),
+             "# %.3f s, %llu commands, %llu bytes (%.3f MB/s)\n",
+             elapsed,
+             (unsigned long long)totalCalls,
+             (unsigned long long)totalBytes,
+             elapsed > 0 ? totalBytes / elapsed / (1024.0 * 1024.0) : 0.0);
+    result += buf;
+    snprintf(buf, sizeof(buf), "# %-14s %-40s %6s %12s %14s %12s %10s\n",
+             "api", "command", "opcode", "calls", "bytes", "time_ms", "avg_us");
+    result += buf;
+    for (size_t n = 0; n < lines.size(); n++) {
+        const ReportLine& line = lines[n];
+        snprintf(buf, sizeof(buf), "%-16s %-40s %6u %12llu %14llu %12.3f %10.3f\n",
+                 line.api,
+                 line.name,
+                 line.opcode,
+                 (unsigned long long)line.calls,
+                 (unsigned long long)line.bytes,
+                 line.timeNs / 1e6,
+                 line.timeNs / 1e3 / line.calls);
+        result += buf;
+    }
+    return result;
+}
+
+// static
+void DecoderProfiler::dump(bool force) {
+    ProfilerConfig* config = sConfig.ptr();
+    if (!config->path) {
+        return;
+    }
+    uint64_t now = nowNs();
+    uint64_t last = config->lastDumpNs.load(std::memory_order_relaxed);
+    if (!force) {
+        // Only one of the render threads gets to write each report.
+        if (now - last < kDumpIntervalNs ||
+            !config->lastDumpNs.compare_exchange_strong(last, now)) {
+            return;
+        }
+    } else {
+        config->lastDumpNs.store(now, std::memory_order_relaxed);
+    }
+
+    std::string text = report();
+    emugl::Mutex::AutoLock lock(config->lock);
+    FILE* fp = fopen(config->path, "w");
+    if (!fp) {
+        fprintf(stderr, "Warning: could not write decoder profile to %s\n",
+                config->path);
+        return;
+    }
+    fwrite(text.data(), 1, text.size(), fp);
+    fclose(fp);
+}
@@ -0,0 +1,83 @@
+/*
+* Copyright (C) 2016 The Android Open Source Project
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// DecoderProfiler collects per-opcode statistics for the host decoders
+// generated by emugen: the number of calls, the number of command bytes,
+// and the host time spent decoding and executing each command.
+//
+// Each generated decoder has a single static instance, shared by all the
+// render threads. Profiling is disabled unless RENDERER_PROFILE_FILE is
+// defined in the environment, in which case a report of all decoders is
+// written to that file every few seconds, and when a render thread exits.
+// The same report can be retrieved by the guest with rcGetDecoderProfile.
+
+class DecoderProfiler {
+public:
+    // |api| is a short name for the decoder, used in reports. |names| must
+    // point to |count| opcode names, the first one being |baseOpcode|.
+    DecoderProfiler(const char* api,
+                    uint32_t baseOpcode,
+                    size_t count,
+                    const char* const* names);
+    ~DecoderProfiler();
+
+    // Returns true if profiling is enabled. Decoders check this once per
+    // buffer, and don't touch the counters or the clock otherwise.
+    static bool isEnabled();
+
+    // Returns a monotonic time in nanoseconds.
+    static uint64_t nowNs();
+
+    // Accounts for one command at |index| from the base opcode.
+    void record(uint32_t index, size_t bytes, uint64_t timeNs) {
+        Counters& c = m_counters[index];
+        c.calls.fetch_add(1, std::memory_order_relaxed);
+        c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        c.timeNs.fetch_add(timeNs, std::memory_order_relaxed);
+    }
+
+    // Returns a text report of all the decoders, with one line per opcode
+    // that was called at least once, the most expensive ones first.
+    static std::string report();
+
+    // Writes the report to RENDERER_PROFILE_FILE if profiling is enabled.
+    // With |force| false, this only happens when the dump interval elapsed
+    // since the last write, which makes it cheap to call after every
+    // decoded buffer.
+    static void dump(bool force);
+
+private:
+    struct Counters {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> timeNs;
+    };
+
+    const char* m_api;
+    uint32_t m_baseOpcode;
+    size_t m_count;
+    const char* const* m_names;
+    Counters* m_counters;
+    DecoderProfiler* m_next;
+};
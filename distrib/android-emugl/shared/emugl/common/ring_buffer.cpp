@@ -0,0 +1,192 @@
+// Copyright 2016 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/ring_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace emugl {
+
+// Note: the producer only modifies mCount (increasing it), and the
+// consumer modifies both mReadPos and mCount (decreasing it). Each side
+// can thus copy data outside of the lock, since the other side will
+// never touch the area being copied.
+
+RingBuffer::RingBuffer(size_t capacity) :
+        mData(static_cast<unsigned char*>(::malloc(capacity))),
+        mCapacity(capacity),
+        mReadPos(0U),
+        mCount(0U),
+        mClosed(false),
+        mLock(),
+        mCanRead(),
+        mCanWrite() {}
+
+RingBuffer::~RingBuffer() {
+    ::free(mData);
+}
+
+size_t RingBuffer::tryWrite(const void* data, size_t len) {
+    mLock.lock();
+    if (mClosed) {
+        mLock.unlock();
+        return 0U;
+    }
+    size_t writePos = mReadPos + mCount;
+    if (writePos >= mCapacity) {
+        writePos -= mCapacity;
+    }
+    size_t avail = mCapacity - mCount;
+    mLock.unlock();
+
+    if (len > avail) {
+        len = avail;
+    }
+    if (len == 0U) {
+        return 0U;
+    }
+    size_t first = mCapacity - writePos;
+    if (first > len) {
+        first = len;
+    }
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    ::memcpy(mData + writePos, src, first);
+    ::memcpy(mData, src + first, len - first);
+
+    mLock.lock();
+    mCount += len;
+    mCanRead.signal();
+    mLock.unlock();
+    return len;
+}
+
+bool RingBuffer::writeFully(const void* data, size_t len) {
+    const unsigned char* src = static_cast<const unsigned char*>(data);
+    while (len > 0U) {
+        size_t written = tryWrite(src, len);
+        if (written == 0U) {
+            Mutex::AutoLock lock(mLock);
+            while (!mClosed && mCount == mCapacity) {
+                mCanWrite.wait(&mLock);
+            }
+            if (mClosed) {
+                return false;
+            }
+            continue;
+        }
+        src += written;
+        len -= written;
+    }
+    return true;
+}
+
+size_t RingBuffer::writableBytes() {
+    Mutex::AutoLock lock(mLock);
+    return mClosed ? 0U : mCapacity - mCount;
+}
+
+size_t RingBuffer::tryRead(void* data, size_t len) {
+    mLock.lock();
+    size_t readPos = mReadPos;
+    size_t avail = mCount;
+    mLock.unlock();
+
+    if (len > avail) {
+        len = avail;
+    }
+    if (len == 0U) {
+        return 0U;
+    }
+    size_t first = mCapacity - readPos;
+    if (first > len) {
+        first = len;
+    }
+    unsigned char* dst = static_cast<unsigned char*>(data);
+    ::memcpy(dst, mData + readPos, first);
+    ::memcpy(dst + first, mData, len - first);
+
+    consume(len);
+    return len;
+}
+
+bool RingBuffer::readFully(void* data, size_t len) {
+    unsigned char* dst = static_cast<unsigned char*>(data);
+    while (len > 0U) {
+        size_t count = tryRead(dst, len);
+        if (count == 0U) {
+            Mutex::AutoLock lock(mLock);
+            while (!mClosed && mCount == 0U) {
+                mCanRead.wait(&mLock);
+            }
+            if (mCount == 0U) {
+                return false;
+            }
+            continue;
+        }
+        dst += count;
+        len -= count;
+    }
+    return true;
+}
+
+size_t RingBuffer::readableBytes() {
+    Mutex::AutoLock lock(mLock);
+    return mCount;
+}
+
+unsigned char* RingBuffer::peek(size_t minSize, size_t* size) {
+    Mutex::AutoLock lock(mLock);
+    for (;;) {
+        size_t contiguous = mCapacity - mReadPos;
+        if (contiguous > mCount) {
+            contiguous = mCount;
+        }
+        if (contiguous > minSize ||
+            (contiguous > 0U && (mReadPos + contiguous == mCapacity ||
+                                 mCount == mCapacity))) {
+            *size = contiguous;
+            return mData + mReadPos;
+        }
+        if (mClosed) {
+            *size = 0U;
+            return NULL;
+        }
+        mCanRead.wait(&mLock);
+    }
+}
+
+void RingBuffer::consume(size_t size) {
+    Mutex::AutoLock lock(mLock);
+    mReadPos += size;
+    if (mReadPos >= mCapacity) {
+        mReadPos -= mCapacity;
+    }
+    mCount -= size;
+    mCanWrite.signal();
+}
+
+void RingBuffer::close() {
+    Mutex::AutoLock lock(mLock);
+    mClosed = true;
+    mCanRead.signal();
+    mCanWrite.signal();
+}
+
+bool RingBuffer::isClosed() {
+    Mutex::AutoLock lock(mLock);
+    return mClosed;
+}
+
+}  // namespace emugl
@@ -0,0 +1,106 @@
+// Copyright 2016 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EMUGL_COMMON_RING_BUFFER_H
+#define EMUGL_COMMON_RING_BUFFER_H
+
+#include "emugl/common/condition_variable.h"
+#include "emugl/common/mutex.h"
+
+#include <stddef.h>
+
+namespace emugl {
+
+// A fixed-capacity byte stream between exactly one producer thread and
+// one consumer thread. Data is copied into the buffer by the producer,
+// and the consumer can either copy it out, or process it in place with
+// peek() and consume(), which avoids any copy at all.
+//
+// The try*() methods never block, the other ones wait for the buffer to
+// have enough data or free space. Either side can close() the buffer,
+// which wakes up the other one.
+class RingBuffer {
+public:
+    // Constructor. |capacity| is the buffer size in bytes.
+    explicit RingBuffer(size_t capacity);
+
+    // Destructor.
+    ~RingBuffer();
+
+    size_t capacity() const { return mCapacity; }
+
+    // Producer side.
+
+    // Copy up to |len| bytes from |data| into the buffer, without
+    // blocking. Return the number of bytes copied, which can be 0 if
+    // the buffer is full or was closed.
+    size_t tryWrite(const void* data, size_t len);
+
+    // Copy |len| bytes from |data| into the buffer, blocking while it is
+    // full. Return false if the buffer was closed before that.
+    bool writeFully(const void* data, size_t len);
+
+    // Return the number of bytes that can be written without blocking.
+    size_t writableBytes();
+
+    // Consumer side.
+
+    // Copy up to |len| bytes from the buffer into |data|, without
+    // blocking. Return the number of bytes copied, which can be 0 if
+    // the buffer is empty.
+    size_t tryRead(void* data, size_t len);
+
+    // Copy |len| bytes from the buffer into |data|, blocking while it is
+    // empty. Return false if the buffer was closed before that.
+    bool readFully(void* data, size_t len);
+
+    // Return the number of bytes that can be read without blocking.
+    size_t readableBytes();
+
+    // Return the address of the contiguous data at the start of the
+    // buffer, and set |*size| to its length. Blocks until this is more
+    // than |minSize| bytes, unless the data can't grow contiguously
+    // anymore, either because it reaches the end of the storage area or
+    // because the buffer is full. In that case, |*size| can be less than
+    // or equal to |minSize|, and the caller must consume() or copy the
+    // data to go further.
+    //
+    // Return NULL if the buffer was closed and there is nothing new to
+    // read. The data remains valid until it is consumed.
+    unsigned char* peek(size_t minSize, size_t* size);
+
+    // Release the first |size| bytes of data, after a call to peek().
+    void consume(size_t size);
+
+    // Close the buffer. Pending and future writes fail, while reads
+    // succeed until the remaining data has been consumed.
+    void close();
+
+    // Return true iff the buffer was closed.
+    bool isClosed();
+
+private:
+    unsigned char* mData;
+    size_t mCapacity;
+    size_t mReadPos;
+    size_t mCount;
+    bool mClosed;
+    Mutex mLock;
+    ConditionVariable mCanRead;
+    ConditionVariable mCanWrite;
+};
+
+}  // namespace emugl
+
+#endif  // EMUGL_COMMON_RING_BUFFER_H
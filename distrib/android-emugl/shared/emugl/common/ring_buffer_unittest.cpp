@@ -0,0 +1,157 @@
+// Copyright 2016 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "emugl/common/ring_buffer.h"
+
+#include "emugl/common/testing/test_thread.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+namespace emugl {
+
+namespace {
+
+const size_t kStreamSize = 100000U;
+
+struct StreamState {
+    RingBuffer buffer;
+    bool ok;
+
+    StreamState() : buffer(97U), ok(true) {}
+};
+
+unsigned char streamByte(size_t n) {
+    return static_cast<unsigned char>(n * 7U + (n >> 8));
+}
+
+// Write kStreamSize bytes in chunks of varying sizes, then close.
+void* producerFunction(void* param) {
+    StreamState* s = static_cast<StreamState*>(param);
+    unsigned char chunk[61];
+    size_t pos = 0;
+    size_t chunkSize = 1;
+    while (pos < kStreamSize) {
+        if (chunkSize > sizeof(chunk)) {
+            chunkSize = 1;
+        }
+        size_t len = kStreamSize - pos;
+        if (len > chunkSize) {
+            len = chunkSize;
+        }
+        for (size_t n = 0; n < len; ++n) {
+            chunk[n] = streamByte(pos + n);
+        }
+        if (!s->buffer.writeFully(chunk, len)) {
+            s->ok = false;
+            break;
+        }
+        pos += len;
+        chunkSize += 3;
+    }
+    s->buffer.close();
+    return NULL;
+}
+
+}  // namespace
+
+TEST(RingBuffer, SingleThread) {
+    RingBuffer buffer(8U);
+    EXPECT_EQ(8U, buffer.capacity());
+    EXPECT_EQ(8U, buffer.writableBytes());
+    EXPECT_EQ(0U, buffer.readableBytes());
+
+    EXPECT_EQ(5U, buffer.tryWrite("hello", 5U));
+    EXPECT_EQ(3U, buffer.tryWrite("world", 5U));
+    EXPECT_EQ(0U, buffer.tryWrite("!", 1U));
+    EXPECT_EQ(8U, buffer.readableBytes());
+
+    char str[9] = {};
+    EXPECT_EQ(6U, buffer.tryRead(str, 6U));
+    EXPECT_STREQ("hellow", str);
+
+    // This write wraps around the end of the storage area.
+    EXPECT_EQ(4U, buffer.tryWrite("abcd", 4U));
+    memset(str, 0, sizeof(str));
+    EXPECT_TRUE(buffer.readFully(str, 6U));
+    EXPECT_STREQ("orabcd", str);
+    EXPECT_EQ(0U, buffer.tryRead(str, 1U));
+}
+
+TEST(RingBuffer, PeekAndConsume) {
+    RingBuffer buffer(8U);
+    size_t size = 0;
+
+    EXPECT_EQ(6U, buffer.tryWrite("012345", 6U));
+    unsigned char* data = buffer.peek(0U, &size);
+    ASSERT_TRUE(data);
+    EXPECT_EQ(6U, size);
+    EXPECT_EQ(0, memcmp(data, "012345", 6U));
+    buffer.consume(4U);
+
+    // Wrap around: only the data before the end of the storage area is
+    // contiguous, and it can't grow, so peek() doesn't block even if
+    // more data is asked for.
+    EXPECT_EQ(4U, buffer.tryWrite("6789", 4U));
+    data = buffer.peek(5U, &size);
+    ASSERT_TRUE(data);
+    EXPECT_EQ(4U, size);
+    EXPECT_EQ(0, memcmp(data, "4567", 4U));
+    buffer.consume(size);
+
+    data = buffer.peek(0U, &size);
+    ASSERT_TRUE(data);
+    EXPECT_EQ(2U, size);
+    EXPECT_EQ(0, memcmp(data, "89", 2U));
+    buffer.consume(size);
+
+    // Closing doesn't discard remaining data.
+    EXPECT_EQ(1U, buffer.tryWrite("X", 1U));
+    buffer.close();
+    EXPECT_TRUE(buffer.isClosed());
+    EXPECT_EQ(0U, buffer.tryWrite("Y", 1U));
+    data = buffer.peek(0U, &size);
+    ASSERT_TRUE(data);
+    EXPECT_EQ(1U, size);
+    buffer.consume(size);
+    EXPECT_FALSE(buffer.peek(0U, &size));
+}
+
+TEST(RingBuffer, TwoThreadsStreaming) {
+    StreamState state;
+    TestThread* thread = new TestThread(producerFunction, &state);
+
+    size_t pos = 0;
+    size_t size = 0;
+    bool match = true;
+    unsigned char* data;
+    while ((data = state.buffer.peek(0U, &size)) != NULL) {
+        for (size_t n = 0; n < size; ++n) {
+            if (data[n] != streamByte(pos + n)) {
+                match = false;
+            }
+        }
+        pos += size;
+        state.buffer.consume(size);
+    }
+    thread->join();
+    delete thread;
+
+    EXPECT_TRUE(state.ok);
+    EXPECT_TRUE(match);
+    EXPECT_EQ(kStreamSize, pos);
+}
+
+}  // namespace emugl
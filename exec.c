@@ -586,6 +586,8 @@ void cpu_tlb_update_dirty(CPUArchState *env)
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         for(i = 0; i < CPU_TLB_SIZE; i++)
             tlb_update_dirty(&env->tlb_table[mmu_idx][i]);
+        for(i = 0; i < CPU_VTLB_SIZE; i++)
+            tlb_update_dirty(&env->tlb_v_table[mmu_idx][i]);
     }
 }
 
@@ -14,9 +14,11 @@
 #include "android/android.h"
 #include "android/utils/debug.h"
 #include "android/utils/duff.h"
+#include "android/utils/pixel_diff.h"
 #include "exec/ram_addr.h"
 #include "hw/android/goldfish/device.h"
 #include "hw/hw.h"
+#include "qemu/thread.h"
 #include "ui/console.h"
 
 /* These values *must* match the platform definitions found under
@@ -48,6 +50,24 @@ enum {
     FB_INT_BASE_UPDATE_DONE  = 1U << 1
 };
 
+/* This structure is used to hold a rectangle of changed pixels,
+ * with inclusive bounds. An empty rectangle has xmin > xmax.
+ */
+typedef struct {
+    int xmin, ymin, xmax, ymax;
+} FbUpdateRect;
+
+/* The framebuffer is split into square tiles of FB_TILE_SIZE pixels,
+ * and each refresh records the bounds of the changed pixels within
+ * each tile. Adjacent dirty tiles are then merged into at most
+ * FB_MAX_UPDATE_RECTS rectangles that are sent separately to the
+ * display listeners, so that small changes far apart (e.g. a blinking
+ * cursor and the status bar clock) don't result in a near full-screen
+ * update.
+ */
+#define  FB_TILE_SIZE         64
+#define  FB_MAX_UPDATE_RECTS  16
+
 struct goldfish_fb_state {
     struct goldfish_device dev;
     DisplayState*  ds;
@@ -63,6 +83,10 @@ struct goldfish_fb_state {
     uint32_t int_enable;
     int      rotation;   /* 0, 1, 2 or 3 */
     int      dpi;
+    FbUpdateRect* tiles;  /* per-tile update bounds, not saved */
+    int      tiles_count;
+    struct FbWorkerPool* workers;  /* NULL if not used */
+    uint32_t workers_checked : 1;
 };
 
 #define  GOLDFISH_FB_SAVE_VERSION  2
@@ -237,7 +261,8 @@ static long  stats_total_full_updates;
 /* This structure is used to hold the inputs for
  * compute_fb_update_rect_linear below.
  * This corresponds to the source framebuffer and destination
- * surface pixel buffers.
+ * surface pixel buffers, and to the array of per-tile bounds that
+ * is filled by the function.
  */
 typedef struct {
     int            width;
@@ -247,187 +272,460 @@ typedef struct {
     int            src_pitch;
     uint8_t*       dst_pixels;
     int            dst_pitch;
+    FbUpdateRect*  tiles;
+    int            tiles_x;
+    int            tiles_y;
 } FbUpdateState;
 
-/* This structure is used to hold the outputs for
- * compute_fb_update_rect_linear below.
- * This corresponds to the smalled bounding rectangle of the
- * latest framebuffer update.
+static void
+fb_update_rect_reset(FbUpdateRect* rect)
+{
+    rect->xmin = rect->ymin = INT_MAX;
+    rect->xmax = rect->ymax = INT_MIN;
+}
+
+static int
+fb_update_rect_is_empty(const FbUpdateRect* rect)
+{
+    return rect->xmin > rect->xmax;
+}
+
+/* Grow '*rect' to include pixels 'x1' to 'x2' of line 'y'. */
+static void
+fb_update_rect_add(FbUpdateRect* rect, int x1, int x2, int y)
+{
+    if (x1 < rect->xmin) rect->xmin = x1;
+    if (x2 > rect->xmax) rect->xmax = x2;
+    if (y < rect->ymin) rect->ymin = y;
+    if (y > rect->ymax) rect->ymax = y;
+}
+
+static void
+fb_update_rect_union(FbUpdateRect* rect, const FbUpdateRect* other)
+{
+    if (other->xmin < rect->xmin) rect->xmin = other->xmin;
+    if (other->xmax > rect->xmax) rect->xmax = other->xmax;
+    if (other->ymin < rect->ymin) rect->ymin = other->ymin;
+    if (other->ymax > rect->ymax) rect->ymax = other->ymax;
+}
+
+#if defined(HOST_WORDS_BIGENDIAN) != defined(TARGET_WORDS_BIGENDIAN)
+/* Find the span of changed pixels between the source and destination
+ * lines, and convert them into host byte order in the destination.
+ *
+ * Return -1 for unsupported pixel depths, 0 if there was no change,
+ * otherwise set '*pxx1' and '*pxx2' to the span bounds and return 1.
  */
-typedef struct {
-    int xmin, ymin, xmax, ymax;
-} FbUpdateRect;
+static int
+update_fb_line_swapped(const FbUpdateState* fbs,
+                       const uint8_t*       src_line,
+                       uint8_t*             dst_line,
+                       int*                 pxx1,
+                       int*                 pxx2)
+{
+    int  width = fbs->width;
+    int  xx1, xx2;
+
+    switch (fbs->bytes_per_pixel) {
+    case 2:
+    {
+        const uint16_t* src = (const uint16_t*) src_line;
+        uint16_t*       dst = (uint16_t*) dst_line;
+
+        xx1 = 0;
+        DUFF4(width, {
+            uint16_t spix = src[xx1];
+            spix = (uint16_t)((spix << 8) | (spix >> 8));
+            if (spix != dst[xx1])
+                break;
+            xx1++;
+        });
+        if (xx1 == width) {
+            return 0;
+        }
+        xx2 = width-1;
+        DUFF4(xx2-xx1, {
+            if (src[xx2] != dst[xx2])
+                break;
+            xx2--;
+        });
+        /* Convert the guest pixels into host ones */
+        int xx = xx1;
+        DUFF4(xx2-xx1+1,{
+            unsigned   spix = src[xx];
+            dst[xx] = (uint16_t)((spix << 8) | (spix >> 8));
+            xx++;
+        });
+        break;
+    }
+
+    case 3:
+    {
+        xx1 = 0;
+        DUFF4(width, {
+            int xx = xx1*3;
+            if (src_line[xx+0] != dst_line[xx+0] ||
+                src_line[xx+1] != dst_line[xx+1] ||
+                src_line[xx+2] != dst_line[xx+2]) {
+                break;
+            }
+            xx1 ++;
+        });
+        if (xx1 == width) {
+            return 0;
+        }
+        xx2 = width-1;
+        DUFF4(xx2-xx1,{
+            int xx = xx2*3;
+            if (src_line[xx+0] != dst_line[xx+0] ||
+                src_line[xx+1] != dst_line[xx+1] ||
+                src_line[xx+2] != dst_line[xx+2]) {
+                break;
+            }
+            xx2--;
+        });
+        memcpy( dst_line+xx1*3, src_line+xx1*3, (xx2-xx1+1)*3 );
+        break;
+    }
 
-/* Determine the smallest bounding rectangle of pixels which changed
- * between the source (framebuffer) and destination (surface) pixel
- * buffers.
+    case 4:
+    {
+        const uint32_t* src = (const uint32_t*) src_line;
+        uint32_t*       dst = (uint32_t*) dst_line;
+
+        xx1 = 0;
+        DUFF4(width, {
+            uint32_t spix = src[xx1];
+            spix = (spix << 16) | (spix >> 16);
+            spix = ((spix << 8) & 0xff00ff00) | ((spix >> 8) & 0x00ff00ff);
+            if (spix != dst[xx1]) {
+                break;
+            }
+            xx1++;
+        });
+        if (xx1 == width) {
+            return 0;
+        }
+        xx2 = width-1;
+        DUFF4(xx2-xx1,{
+            if (src[xx2] != dst[xx2]) {
+                break;
+            }
+            xx2--;
+        });
+        /* Convert the guest pixels into host ones */
+        int xx = xx1;
+        DUFF4(xx2-xx1+1,{
+            uint32_t   spix = src[xx];
+            spix = (spix << 16) | (spix >> 16);
+            spix = ((spix << 8) & 0xff00ff00) | ((spix >> 8) & 0x00ff00ff);
+            dst[xx] = spix;
+            xx++;
+        });
+        break;
+    }
+    default:
+        return -1;
+    }
+    *pxx1 = xx1;
+    *pxx2 = xx2;
+    return 1;
+}
+#endif
+
+/* Determine which pixels changed in the lines of tile rows 'ty1' to
+ * 'ty2' (excluded), and copy them from the source (framebuffer) to the
+ * destination (surface) pixel buffers.
  *
- * Return 0 if there was no change, otherwise, populate '*rect'
- * and return 1.
+ * The bounds of the changed pixels within each tile of the band are
+ * recorded in 'fbs->tiles', and their overall bounding rectangle in
+ * '*rect', which is left empty if there was no change.
  *
  * If 'dirty_base' is not 0, it is a physical address that will be
  * used to speed-up the check using the VGA dirty bits. In practice
  * this is only used if your kernel driver does not implement.
  *
- * This function assumes that the framebuffers are in linear memory.
- * This may change later when we want to support larger framebuffers
- * that exceed the max DMA aperture size though.
+ * This only touches the tiles and pixels of the band, so different
+ * bands can be processed concurrently.
  */
-static int
-compute_fb_update_rect_linear(FbUpdateState*  fbs,
-                              uint32_t        dirty_base,
-                              FbUpdateRect*   rect)
+static void
+compute_fb_update_band(FbUpdateState*  fbs,
+                       uint32_t        dirty_base,
+                       int             ty1,
+                       int             ty2,
+                       FbUpdateRect*   rect)
 {
-    int  yy;
-    int  width = fbs->width;
-    const uint8_t* src_line = fbs->src_pixels;
-    uint8_t*       dst_line = fbs->dst_pixels;
-    uint32_t       dirty_addr = dirty_base;
-    rect->xmin = rect->ymin = INT_MAX;
-    rect->xmax = rect->ymax = INT_MIN;
-    for (yy = 0; yy < fbs->height; yy++) {
-        int xx1, xx2;
-        /* If dirty_addr is != 0, then use it as a physical address to
+    int  yy, nn;
+    int  y1 = ty1 * FB_TILE_SIZE;
+    int  y2 = MIN(ty2 * FB_TILE_SIZE, fbs->height);
+    const uint8_t* src_line = fbs->src_pixels + y1 * fbs->src_pitch;
+    uint8_t*       dst_line = fbs->dst_pixels + y1 * fbs->dst_pitch;
+
+    for (nn = ty1 * fbs->tiles_x; nn < ty2 * fbs->tiles_x; nn++) {
+        fb_update_rect_reset(&fbs->tiles[nn]);
+    }
+    fb_update_rect_reset(rect);
+
+    for (yy = y1; yy < y2; yy++) {
+        FbUpdateRect* tile_row = fbs->tiles + (yy / FB_TILE_SIZE) * fbs->tiles_x;
+        int xx1, xx2, tx;
+        /* If dirty_base is != 0, then use it as a physical address to
          * use the VGA dirty bits table to speed up the detection of
          * changed pixels.
          */
-        if (dirty_addr != 0) {
-            int  dirty = cpu_physical_memory_get_dirty(dirty_addr,
-                                                       fbs->src_pitch,
-                                                       DIRTY_MEMORY_VGA);
+        if (dirty_base != 0) {
+            int  dirty = cpu_physical_memory_get_dirty(
+                                dirty_base + yy * fbs->src_pitch,
+                                fbs->src_pitch,
+                                DIRTY_MEMORY_VGA);
             if (!dirty) { /* this line was not modified, skip to next one */
                 goto NEXT_LINE;
             }
         }
-
-        /* Then compute actual bounds of the changed pixels, while
-         * copying them from 'src' to 'dst'. This depends on the pixel depth.
+        /* Then compute actual bounds of the changed pixels in each tile,
+         * while copying them from 'src' to 'dst'.
+         */
+#if defined(HOST_WORDS_BIGENDIAN) == defined(TARGET_WORDS_BIGENDIAN)
+        /* Same byte order, so lines can be compared and copied as plain
+         * bytes with the vectorized helpers, whatever the pixel depth.
+         * A first pass over the whole line quickly skips unchanged ones,
+         * then only the tiles covering the changed span are compared.
          */
-        switch (fbs->bytes_per_pixel) {
-        case 2:
         {
-            const uint16_t* src = (const uint16_t*) src_line;
-            uint16_t*       dst = (uint16_t*) dst_line;
+            int    bpp = fbs->bytes_per_pixel;
+            size_t first, last;
 
-            xx1 = 0;
-            DUFF4(width, {
-                uint16_t spix = src[xx1];
-#if defined(HOST_WORDS_BIGENDIAN) != defined(TARGET_WORDS_BIGENDIAN)
-                spix = (uint16_t)((spix << 8) | (spix >> 8));
-#endif
-                if (spix != dst[xx1])
-                    break;
-                xx1++;
-            });
-            if (xx1 == width) {
-                break;
+            if (!pixel_diff_range(src_line, dst_line, (size_t)fbs->width * bpp,
+                                  &first, &last)) {
+                goto NEXT_LINE;
             }
-            xx2 = width-1;
-            DUFF4(xx2-xx1, {
-                if (src[xx2] != dst[xx2])
-                    break;
-                xx2--;
-            });
-#if defined(HOST_WORDS_BIGENDIAN) != defined(TARGET_WORDS_BIGENDIAN)
-            /* Convert the guest pixels into host ones */
-            int xx = xx1;
-            DUFF4(xx2-xx1+1,{
-                unsigned   spix = src[xx];
-                dst[xx] = (uint16_t)((spix << 8) | (spix >> 8));
-                xx++;
-            });
-#else
-            memcpy( dst+xx1, src+xx1, (xx2-xx1+1)*2 );
-#endif
-            break;
-        }
-
-        case 3:
-        {
-            xx1 = 0;
-            DUFF4(width, {
-                int xx = xx1*3;
-                if (src_line[xx+0] != dst_line[xx+0] ||
-                    src_line[xx+1] != dst_line[xx+1] ||
-                    src_line[xx+2] != dst_line[xx+2]) {
-                    break;
+            xx1 = (int)(first / bpp);
+            xx2 = (int)(last / bpp);
+            for (tx = xx1 / FB_TILE_SIZE; tx <= xx2 / FB_TILE_SIZE; tx++) {
+                int x0 = tx * FB_TILE_SIZE;
+                int tw = MIN(FB_TILE_SIZE, fbs->width - x0);
+                int tx1, tx2;
+
+                if (pixel_diff_update_line(src_line + x0 * bpp,
+                                           dst_line + x0 * bpp,
+                                           tw, bpp, &tx1, &tx2)) {
+                    fb_update_rect_add(&tile_row[tx], x0 + tx1, x0 + tx2, yy);
                 }
-                xx1 ++;
-            });
-            if (xx1 == width) {
-                break;
             }
-            xx2 = width-1;
-            DUFF4(xx2-xx1,{
-                int xx = xx2*3;
-                if (src_line[xx+0] != dst_line[xx+0] ||
-                    src_line[xx+1] != dst_line[xx+1] ||
-                    src_line[xx+2] != dst_line[xx+2]) {
-                    break;
-                }
-                xx2--;
-            });
-            memcpy( dst_line+xx1*3, src_line+xx1*3, (xx2-xx1+1)*3 );
-            break;
         }
-
-        case 4:
-        {
-            const uint32_t* src = (const uint32_t*) src_line;
-            uint32_t*       dst = (uint32_t*) dst_line;
-
-            xx1 = 0;
-            DUFF4(width, {
-                uint32_t spix = src[xx1];
-#if defined(HOST_WORDS_BIGENDIAN) != defined(TARGET_WORDS_BIGENDIAN)
-                spix = (spix << 16) | (spix >> 16);
-                spix = ((spix << 8) & 0xff00ff00) | ((spix >> 8) & 0x00ff00ff);
-#endif
-                if (spix != dst[xx1]) {
-                    break;
-                }
-                xx1++;
-            });
-            if (xx1 == width) {
-                break;
-            }
-            xx2 = width-1;
-            DUFF4(xx2-xx1,{
-                if (src[xx2] != dst[xx2]) {
-                    break;
-                }
-                xx2--;
-            });
-#if defined(HOST_WORDS_BIGENDIAN) != defined(TARGET_WORDS_BIGENDIAN)
-            /* Convert the guest pixels into host ones */
-            int xx = xx1;
-            DUFF4(xx2-xx1+1,{
-                uint32_t   spix = src[xx];
-                spix = (spix << 16) | (spix >> 16);
-                spix = ((spix << 8) & 0xff00ff00) | ((spix >> 8) & 0x00ff00ff);
-                dst[xx] = spix;
-                xx++;
-            })
 #else
-            memcpy( dst+xx1, src+xx1, (xx2-xx1+1)*4 );
-#endif
-            break;
-        }
-        default:
-            return 0;
+        /* Pixels must be byte-swapped, this only finds the changed span
+         * of each line, and marks all the tiles it covers.
+         */
+        if (update_fb_line_swapped(fbs, src_line, dst_line, &xx1, &xx2) <= 0) {
+            goto NEXT_LINE;
         }
-        /* Update bounds if pixels on this line were modified */
-        if (xx1 < width) {
-            if (xx1 < rect->xmin) rect->xmin = xx1;
-            if (xx2 > rect->xmax) rect->xmax = xx2;
-            if (yy < rect->ymin) rect->ymin = yy;
-            if (yy > rect->ymax) rect->ymax = yy;
+        for (tx = xx1 / FB_TILE_SIZE; tx <= xx2 / FB_TILE_SIZE; tx++) {
+            int x0 = tx * FB_TILE_SIZE;
+            fb_update_rect_add(&tile_row[tx],
+                               MAX(xx1, x0),
+                               MIN(xx2, x0 + FB_TILE_SIZE - 1),
+                               yy);
         }
+#endif
+        /* Update bounds since pixels on this line were modified */
+        fb_update_rect_add(rect, xx1, xx2, yy);
     NEXT_LINE:
         src_line += fbs->src_pitch;
         dst_line += fbs->dst_pitch;
     }
 
+}
+
+/* Split the framebuffer into bands of this many tile rows per worker
+ * thread (including the caller's). Using several bands per thread
+ * keeps them all busy when the changes are concentrated in a few
+ * areas of the screen.
+ */
+#define  FB_BANDS_PER_THREAD   4
+
+/* Maximum number of worker threads used to compare the framebuffer,
+ * and minimum framebuffer size, in pixels, to use them at all. Below
+ * that, the cost of waking the threads up exceeds the gain. */
+#define  FB_MAX_WORKERS        3
+#define  FB_PARALLEL_MIN_PIXELS  (1920 * 1080)
+
+#define  FB_MAX_BANDS   ((FB_MAX_WORKERS + 1) * FB_BANDS_PER_THREAD)
+
+/* A small pool of threads used to process the bands of a framebuffer
+ * update in parallel. The thread calling goldfish_fb_update_display()
+ * posts a job, processes bands itself, then waits for all of them to
+ * complete. This happens while it holds the global lock, so no vCPU
+ * can modify the guest framebuffer or the VGA dirty bits meanwhile.
+ */
+typedef struct FbWorkerPool {
+    QemuMutex       lock;
+    QemuCond        work_cond;  /* signalled when a job is posted */
+    QemuCond        done_cond;  /* signalled when a job is complete */
+    QemuThread      threads[FB_MAX_WORKERS];
+    int             num_threads;
+
+    /* current job, protected by 'lock' */
+    FbUpdateState*  fbs;
+    uint32_t        dirty_base;
+    int             num_bands;
+    int             next_band;
+    int             pending_bands;
+    FbUpdateRect    band_rects[FB_MAX_BANDS];
+} FbWorkerPool;
+
+static int
+fb_get_host_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO  system_info;
+    GetSystemInfo(&system_info);
+    return (int)system_info.dwNumberOfProcessors;
+#else
+    long  count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+/* Grab the next unprocessed band of the current job, and process it.
+ * Return false if there is none. Must be called with 'pool->lock' held,
+ * which is released during the processing.
+ */
+static bool
+fb_worker_pool_run_band(FbWorkerPool* pool)
+{
+    int  band, ty1, ty2;
+
+    if (pool->next_band >= pool->num_bands) {
+        return false;
+    }
+    band = pool->next_band++;
+    ty1  = band * pool->fbs->tiles_y / pool->num_bands;
+    ty2  = (band + 1) * pool->fbs->tiles_y / pool->num_bands;
+
+    qemu_mutex_unlock(&pool->lock);
+    compute_fb_update_band(pool->fbs, pool->dirty_base, ty1, ty2,
+                           &pool->band_rects[band]);
+    qemu_mutex_lock(&pool->lock);
+
+    if (--pool->pending_bands == 0) {
+        qemu_cond_signal(&pool->done_cond);
+    }
+    return true;
+}
+
+static void*
+fb_worker_thread_main(void* opaque)
+{
+    FbWorkerPool*  pool = opaque;
+
+    qemu_mutex_lock(&pool->lock);
+    for (;;) {
+        if (!fb_worker_pool_run_band(pool)) {
+            qemu_cond_wait(&pool->work_cond, &pool->lock);
+        }
+    }
+    qemu_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Create a worker pool, or return NULL if the host doesn't have enough
+ * CPUs to make it worthwhile. */
+static FbWorkerPool*
+fb_worker_pool_create(void)
+{
+    FbWorkerPool*  pool;
+    int            nn, num_threads;
+
+    num_threads = MIN(fb_get_host_cpu_count() - 1, FB_MAX_WORKERS);
+    if (num_threads <= 0) {
+        return NULL;
+    }
+
+    /* Select the pixel diff kernels now, rather than from all the
+     * threads at once on the first update. */
+    (void)pixel_diff_get_impl();
+
+    pool = g_malloc0(sizeof(*pool));
+    qemu_mutex_init(&pool->lock);
+    qemu_cond_init(&pool->work_cond);
+    qemu_cond_init(&pool->done_cond);
+    pool->num_threads = num_threads;
+    for (nn = 0; nn < num_threads; nn++) {
+        qemu_thread_create(&pool->threads[nn], "goldfish_fb",
+                           fb_worker_thread_main, pool,
+                           QEMU_THREAD_DETACHED);
+    }
+    return pool;
+}
+
+/* Process all bands of 'fbs' with the worker pool, and store the
+ * bounding rectangle of their changes in '*rect'. */
+static void
+fb_worker_pool_compute(FbWorkerPool*   pool,
+                       FbUpdateState*  fbs,
+                       uint32_t        dirty_base,
+                       FbUpdateRect*   rect)
+{
+    int  nn, num_bands;
+
+    num_bands = MIN((pool->num_threads + 1) * FB_BANDS_PER_THREAD,
+                    fbs->tiles_y);
+
+    qemu_mutex_lock(&pool->lock);
+    pool->fbs           = fbs;
+    pool->dirty_base    = dirty_base;
+    pool->num_bands     = num_bands;
+    pool->next_band     = 0;
+    pool->pending_bands = num_bands;
+    qemu_cond_broadcast(&pool->work_cond);
+
+    while (fb_worker_pool_run_band(pool)) {
+    }
+    while (pool->pending_bands > 0) {
+        qemu_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pool->fbs = NULL;
+    qemu_mutex_unlock(&pool->lock);
+
+    fb_update_rect_reset(rect);
+    for (nn = 0; nn < num_bands; nn++) {
+        if (!fb_update_rect_is_empty(&pool->band_rects[nn])) {
+            fb_update_rect_union(rect, &pool->band_rects[nn]);
+        }
+    }
+}
+
+/* Determine which pixels changed between the source (framebuffer) and
+ * destination (surface) pixel buffers, and copy them to the latter.
+ *
+ * The bounds of the changed pixels within each tile are recorded in
+ * 'fbs->tiles', and their overall bounding rectangle in '*rect'.
+ * Return 0 if there was no change, otherwise return 1.
+ *
+ * If 'pool' is not NULL, the work is split into horizontal bands
+ * processed in parallel by its threads.
+ *
+ * This function assumes that the framebuffers are in linear memory.
+ * This may change later when we want to support larger framebuffers
+ * that exceed the max DMA aperture size though.
+ */
+static int
+compute_fb_update_rect_linear(FbUpdateState*  fbs,
+                              FbWorkerPool*   pool,
+                              uint32_t        dirty_base,
+                              FbUpdateRect*   rect)
+{
+    if (fbs->bytes_per_pixel < 2 || fbs->bytes_per_pixel > 4) {
+        return 0;
+    }
+
+    if (pool != NULL) {
+        fb_worker_pool_compute(pool, fbs, dirty_base, rect);
+    } else {
+        compute_fb_update_band(fbs, dirty_base, 0, fbs->tiles_y, rect);
+    }
+
     if (rect->ymin > rect->ymax) { /* nothing changed */
         return 0;
     }
@@ -439,6 +737,85 @@ compute_fb_update_rect_linear(FbUpdateState*  fbs,
     return 1;
 }
 
+/* This structure is used by merge_fb_update_tiles below to track a
+ * rectangle made of the same columns of tiles in consecutive rows.
+ */
+typedef struct {
+    FbUpdateRect  rect;
+    int           tx1, tx2;   /* first and last tile column */
+    int           ty;         /* last tile row */
+} FbTileRun;
+
+/* Merge the dirty tiles recorded by compute_fb_update_rect_linear into
+ * rectangles. Horizontally adjacent dirty tiles are joined into runs,
+ * and runs spanning the same tile columns in consecutive rows are then
+ * joined together. Each rectangle is the bounding box of the changed
+ * pixels of its tiles.
+ *
+ * Return the number of rectangles written to 'rects', or -1 if more
+ * than 'max_rects' would be needed.
+ */
+static int
+merge_fb_update_tiles(const FbUpdateState*  fbs,
+                      FbUpdateRect*         rects,
+                      int                   max_rects)
+{
+    FbTileRun  runs[FB_MAX_UPDATE_RECTS];
+    int        count = 0;
+    int        tx, ty, nn;
+
+    if (max_rects > FB_MAX_UPDATE_RECTS) {
+        max_rects = FB_MAX_UPDATE_RECTS;
+    }
+
+    for (ty = 0; ty < fbs->tiles_y; ty++) {
+        const FbUpdateRect* tile_row = fbs->tiles + ty * fbs->tiles_x;
+
+        tx = 0;
+        while (tx < fbs->tiles_x) {
+            FbUpdateRect  run;
+            int           tx1;
+
+            if (fb_update_rect_is_empty(&tile_row[tx])) {
+                tx++;
+                continue;
+            }
+            tx1 = tx;
+            run = tile_row[tx];
+            while (++tx < fbs->tiles_x &&
+                   !fb_update_rect_is_empty(&tile_row[tx])) {
+                fb_update_rect_union(&run, &tile_row[tx]);
+            }
+
+            /* Extend a run of the previous tile row if possible */
+            for (nn = 0; nn < count; nn++) {
+                if (runs[nn].ty == ty - 1 &&
+                    runs[nn].tx1 == tx1 &&
+                    runs[nn].tx2 == tx - 1) {
+                    break;
+                }
+            }
+            if (nn == count) {
+                if (count == max_rects) {
+                    return -1;
+                }
+                runs[nn].tx1 = tx1;
+                runs[nn].tx2 = tx - 1;
+                runs[nn].rect = run;
+                count++;
+            } else {
+                fb_update_rect_union(&runs[nn].rect, &run);
+            }
+            runs[nn].ty = ty;
+        }
+    }
+
+    for (nn = 0; nn < count; nn++) {
+        rects[nn] = runs[nn].rect;
+    }
+    return count;
+}
+
 
 static void goldfish_fb_update_display(void *opaque)
 {
@@ -477,7 +854,8 @@ static void goldfish_fb_update_display(void *opaque)
     height    = s->ds->surface->height;
 
     FbUpdateState  fbs;
-    FbUpdateRect   rect;
+    FbUpdateRect   rects[FB_MAX_UPDATE_RECTS];
+    int            rect_count, nn;
 
     fbs.width      = width;
     fbs.height     = height;
@@ -488,6 +866,19 @@ static void goldfish_fb_update_display(void *opaque)
     fbs.src_pixels = src_line;
     fbs.src_pitch  = width*s->ds->surface->pf.bytes_per_pixel;
 
+    fbs.tiles_x = (width + FB_TILE_SIZE - 1) / FB_TILE_SIZE;
+    fbs.tiles_y = (height + FB_TILE_SIZE - 1) / FB_TILE_SIZE;
+    if (fbs.tiles_x * fbs.tiles_y > s->tiles_count) {
+        s->tiles_count = fbs.tiles_x * fbs.tiles_y;
+        s->tiles = g_renew(FbUpdateRect, s->tiles, s->tiles_count);
+    }
+    fbs.tiles = s->tiles;
+
+    /* Only start the worker threads once a large display is used */
+    if (!s->workers_checked && width * height >= FB_PARALLEL_MIN_PIXELS) {
+        s->workers = fb_worker_pool_create();
+        s->workers_checked = 1;
+    }
 
 #if STATS
     if (full_update)
@@ -508,29 +899,42 @@ static void goldfish_fb_update_display(void *opaque)
     if (s->blank)
     {
         memset( dst_line, 0, height*pitch );
-        rect.xmin = 0;
-        rect.ymin = 0;
-        rect.xmax = width-1;
-        rect.ymax = height-1;
+        rects[0].xmin = 0;
+        rects[0].ymin = 0;
+        rects[0].xmax = width-1;
+        rects[0].ymax = height-1;
+        rect_count = 1;
     }
     else
     {
         if (full_update) { /* don't use dirty-bits optimization */
             base = 0;
         }
-        if (compute_fb_update_rect_linear(&fbs, base, &rect) == 0) {
+        if (compute_fb_update_rect_linear(&fbs, s->workers, base,
+                                          &rects[0]) == 0) {
             return;
         }
+        /* Fall back to the bounding rectangle, already in rects[0],
+         * if the changes are too scattered. */
+        rect_count = merge_fb_update_tiles(&fbs, rects + 1,
+                                           FB_MAX_UPDATE_RECTS - 1);
+        if (rect_count < 0) {
+            rect_count = 1;
+        } else {
+            memmove(rects, rects + 1, rect_count * sizeof(rects[0]));
+        }
     }
 
-    rect.xmax += 1;
-    rect.ymax += 1;
+    for (nn = 0; nn < rect_count; nn++) {
+        FbUpdateRect*  rect = &rects[nn];
 #if 0
-    printf("goldfish_fb_update_display (y:%d,h:%d,x=%d,w=%d)\n",
-           rect.ymin, rect.ymax-rect.ymin, rect.xmin, rect.xmax-rect.xmin);
+        printf("goldfish_fb_update_display (y:%d,h:%d,x=%d,w=%d)\n",
+               rect->ymin, rect->ymax-rect->ymin+1,
+               rect->xmin, rect->xmax-rect->xmin+1);
 #endif
-
-    dpy_update(s->ds, rect.xmin, rect.ymin, rect.xmax-rect.xmin, rect.ymax-rect.ymin);
+        dpy_update(s->ds, rect->xmin, rect->ymin,
+                   rect->xmax-rect->xmin+1, rect->ymax-rect->ymin+1);
+    }
 }
 
 static void goldfish_fb_invalidate_display(void * opaque)
@@ -214,45 +214,69 @@ static const char* get_command_name(int command)
 }
 #endif
 
-static int  goldfish_mmc_bdrv_read(struct goldfish_mmc_state *s,
-                                   int64_t                    sector_number,
-                                   hwaddr         dst_address,
-                                   int                        num_sectors)
+/* Transfer |num_sectors| sectors between the block device and guest memory
+ * at |address|. Whenever possible, the guest buffer is mapped and handed to
+ * the block layer directly, so that a whole command results in a single
+ * request per physically contiguous run of guest RAM. Sectors that straddle
+ * a discontinuity, or that can't be mapped at all, go through s->buf.
+ */
+static int  goldfish_mmc_bdrv_rw(struct goldfish_mmc_state *s,
+                                 int64_t                    sector_number,
+                                 hwaddr                     address,
+                                 int                        num_sectors,
+                                 int                        is_write)
 {
     int  ret;
 
     while (num_sectors > 0) {
-        ret = bdrv_read(s->bs, sector_number, s->buf, 1);
+        hwaddr  len = (hwaddr)num_sectors * 512;
+        void*   ptr = cpu_physical_memory_map(address, &len, !is_write);
+        int     count = ptr ? (int)(len / 512) : 0;
+
+        if (count > 0) {
+            if (is_write)
+                ret = bdrv_write(s->bs, sector_number, ptr, count);
+            else
+                ret = bdrv_read(s->bs, sector_number, ptr, count);
+            cpu_physical_memory_unmap(ptr, len, !is_write,
+                                      ret < 0 ? 0 : (hwaddr)count * 512);
+        } else {
+            if (ptr)
+                cpu_physical_memory_unmap(ptr, len, !is_write, 0);
+            count = 1;
+            if (is_write) {
+                cpu_physical_memory_read(address, s->buf, 512);
+                ret = bdrv_write(s->bs, sector_number, s->buf, 1);
+            } else {
+                ret = bdrv_read(s->bs, sector_number, s->buf, 1);
+                if (ret >= 0)
+                    cpu_physical_memory_write(address, s->buf, 512);
+            }
+        }
         if (ret < 0)
             return ret;
 
-        cpu_physical_memory_write(dst_address, s->buf, 512);
-        dst_address   += 512;
-        num_sectors   -= 1;
-        sector_number += 1;
+        address       += (hwaddr)count * 512;
+        num_sectors   -= count;
+        sector_number += count;
     }
     return 0;
 }
 
+static int  goldfish_mmc_bdrv_read(struct goldfish_mmc_state *s,
+                                   int64_t                    sector_number,
+                                   hwaddr         dst_address,
+                                   int                        num_sectors)
+{
+    return goldfish_mmc_bdrv_rw(s, sector_number, dst_address, num_sectors, 0);
+}
+
 static int  goldfish_mmc_bdrv_write(struct goldfish_mmc_state *s,
                                     int64_t                    sector_number,
                                     hwaddr         dst_address,
                                     int                        num_sectors)
 {
-    int  ret;
-
-    while (num_sectors > 0) {
-        cpu_physical_memory_read(dst_address, s->buf, 512);
-
-        ret = bdrv_write(s->bs, sector_number, s->buf, 1);
-        if (ret < 0)
-            return ret;
-
-        dst_address   += 512;
-        num_sectors   -= 1;
-        sector_number += 1;
-    }
-    return 0;
+    return goldfish_mmc_bdrv_rw(s, sector_number, dst_address, num_sectors, 1);
 }
 
 
@@ -15,11 +15,19 @@
 #include "hw/android/goldfish/nand.h"
 #include "hw/android/goldfish/vmem.h"
 #include "hw/hw.h"
+#include "exec/ram_addr.h"
+#include "qemu/bitmap.h"
+#include "qemu/iov.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "sysemu/char.h"
 
 #ifdef CONFIG_NAND_LIMITS
 #include "android/emulation/nand_limits.h"
 #endif
+#include "android/emulation/nand_overlay.h"
 #include "android/utils/assert.h"
+#include "android/utils/file_io.h"
 #include "android/utils/path.h"
 #include "android/utils/tempfile.h"
 #include "android/qemu-debug.h"
@@ -48,6 +56,12 @@
 
 #define  XLOG  xlog
 
+/* Asynchronous commands need vectored I/O into guest memory, and a pipe
+ * to wake up the main loop when they complete. */
+#if defined(CONFIG_IOVEC) && defined(CONFIG_POSIX)
+#  define  NAND_ASYNC_IO  1
+#endif
+
 AASSERT_STATIC(sizeof(off_t) >= 8U)
 
 static void
@@ -73,6 +87,33 @@ typedef struct {
     uint32_t   erase_size;   /* size of the data buffer mentioned above */
     uint64_t   max_size;     /* Capacity limit for the image. The actual underlying
                               * file may be smaller. */
+
+    /* Incremental snapshot support, only used when the device was added
+     * with the 'incremental' option. |snapshot_base| identifies the disk
+     * contents at the last full snapshot save/load (0 if none yet), and
+     * |dirty_blocks| has one bit per erase block modified since then. The
+     * original contents of each dirty block are preserved in |cow_fd|, a
+     * sparse temporary file using the same layout as the image. */
+    int             incremental;
+    uint64_t        snapshot_base;
+    uint32_t        block_count;
+    unsigned long*  dirty_blocks;
+    int             cow_fd;
+    /* |base_file| records the snapshot base of the image file, so that an
+     * incremental snapshot saved by one emulator run can be loaded by the
+     * next one, see nand_dev_save_base_file(). |base_file_valid| is set as
+     * long as that file may still match the image. */
+    char*           base_file;
+    int             base_file_valid;
+
+    /* Set if the device was added with the 'async' option and reports
+     * NAND_DEV_FLAG_ASYNC_CAP to the guest. */
+    int             async;
+
+    /* Copy-on-write overlay on top of the read-only initial image, only
+     * used when the device was added with an 'initfile' option. The image
+     * at |fd| then starts empty, see android/emulation/nand_overlay.h. */
+    AndroidNandOverlay* overlay;
 } nand_dev;
 
 #ifdef CONFIG_NAND_LIMITS
@@ -102,8 +143,35 @@ static uint32_t nand_dev_count = 0;
 /* The controller is the single access point for all NAND images currently
  * attached to the system.
  */
+#ifdef NAND_ASYNC_IO
+/* A read, write or erase command handed to the I/O thread. The guest
+ * buffer is mapped by the vCPU thread before queuing, and unmapped once
+ * the request is back on the main loop. */
+typedef struct {
+    nand_dev*      dev;
+    uint32_t       cmd;
+    uint64_t       addr;
+    uint32_t       size;
+    struct iovec*  iov;
+    int            iov_count;
+    uint32_t       result;
+} nand_dev_async_request;
+
+/* The controller only accepts one command at a time, so a single I/O
+ * thread is enough to take the disk accesses off the vCPU thread. */
+typedef struct {
+    QemuThread               thread;
+    QemuMutex                lock;
+    QemuCond                 cond;
+    nand_dev_async_request*  pending;    /* waiting for the I/O thread */
+    nand_dev_async_request*  completed;  /* waiting for the main loop */
+    int                      notify_fds[2];
+} nand_dev_io_thread;
+#endif
+
 typedef struct {
     uint32_t base;
+    struct goldfish_device *gdev;
 
     // register state
     uint32_t dev;            /* offset in nand_devs for the device that is
@@ -115,14 +183,24 @@ typedef struct {
     uint32_t batch_addr_low;
     uint32_t batch_addr_high;
     uint32_t result;
+    uint32_t status;
+    uint32_t async_enable;
+
+#ifdef NAND_ASYNC_IO
+    nand_dev_io_thread *io;  /* NULL if no device supports async commands */
+#endif
 } nand_dev_controller_state;
 
 /* update this everytime you change the nand_dev_controller_state structure
  * 1: initial version, saving only nand_dev_controller_state fields
  * 2: saving actual disk contents as well
  * 3: use the correct data length and truncate to avoid padding.
+ * 6: per-disk full or incremental (delta) records.
+ * 7: async command status and enable registers.
  */
-#define  NAND_DEV_STATE_SAVE_VERSION  5
+#define  NAND_DEV_STATE_SAVE_VERSION  7
+#define  NAND_DEV_STATE_SAVE_VERSION_INCREMENTAL  6
+#define  NAND_DEV_STATE_SAVE_VERSION_FULL_DISKS  5
 #define  NAND_DEV_STATE_SAVE_VERSION_LEGACY  4
 
 #define  QFIELD_STRUCT  nand_dev_controller_state
@@ -198,14 +276,233 @@ static int  do_ftruncate(int  fd, size_t  size)
 
 #define NAND_DEV_SAVE_DISK_BUF_SIZE 2048
 
+/* Kinds of per-disk records in a version 6 snapshot */
+#define NAND_DEV_SNAPSHOT_FULL   0  /* complete disk contents follow */
+#define NAND_DEV_SNAPSHOT_DELTA  1  /* only blocks modified since a base */
+
+/* Returns a new, non-zero identifier for the current contents of a disk. */
+static uint64_t nand_dev_new_snapshot_base(void)
+{
+    static uint64_t counter = 0;
+    uint64_t base = (uint64_t)get_clock_realtime() ^
+                    ((uint64_t)getpid() << 32) ^
+                    (++counter * 0x9E3779B97F4A7C15ULL);
+    return base ? base : 1;
+}
+
+/* Reads the erase block at |index| into |buf|, padding any part that lies
+ * beyond the end of the file with 0xff, just like nand_dev_read_file().
+ * Returns 0 on success, or -errno on failure. */
+static int nand_dev_read_block(nand_dev *dev, int fd, uint32_t index,
+                               uint8_t *buf)
+{
+    off_t offset = (off_t)index * dev->erase_size;
+    int ret;
+
+    if (do_lseek(fd, offset, SEEK_SET) == -1) {
+        return -errno;
+    }
+    ret = do_read(fd, buf, dev->erase_size);
+    if (ret < 0) {
+        return -errno;
+    }
+    if (ret < dev->erase_size) {
+        memset(buf + ret, 0xff, dev->erase_size - ret);
+    }
+    return 0;
+}
+
+/* Writes |size| bytes from |buf| to the erase block at |index|.
+ * Returns 0 on success, or -errno on failure. */
+static int nand_dev_write_block(nand_dev *dev, int fd, uint32_t index,
+                                const uint8_t *buf, uint32_t size)
+{
+    off_t offset = (off_t)index * dev->erase_size;
+    int ret;
+
+    if (do_lseek(fd, offset, SEEK_SET) == -1) {
+        return -errno;
+    }
+    ret = do_write(fd, buf, size);
+    if (ret < 0) {
+        return -errno;
+    }
+    return (ret == size) ? 0 : -EIO;
+}
+
+/* Drops all dirty block information and makes the current disk contents
+ * the new base identified by |base|. */
+static void nand_dev_reset_snapshot_base(nand_dev *dev, uint64_t base)
+{
+    dev->snapshot_base = base;
+    bitmap_zero(dev->dirty_blocks, dev->block_count);
+    if (dev->cow_fd >= 0) {
+        /* Release the disk space used by preserved blocks. */
+        do_ftruncate(dev->cow_fd, 0);
+    }
+}
+
+/* Writes the snapshot base and the current size and modification time of
+ * the image file to |dev->base_file|, right after saving a snapshot. */
+static void nand_dev_save_base_file(nand_dev *dev)
+{
+    struct stat st;
+    FILE *file;
+
+    if (fstat(dev->fd, &st) < 0) {
+        return;
+    }
+    file = android_fopen(dev->base_file, "w");
+    if (!file) {
+        XLOG("%s: could not create %s: %s\n", __FUNCTION__, dev->base_file,
+             strerror(errno));
+        return;
+    }
+    fprintf(file, "%" PRIx64 " %" PRIu64 " %" PRId64 "\n", dev->snapshot_base,
+            (uint64_t)st.st_size, (int64_t)st.st_mtime);
+    dev->base_file_valid = (fclose(file) == 0);
+}
+
+/* Removes |dev->base_file| once the image file is modified. */
+static void nand_dev_invalidate_base_file(nand_dev *dev)
+{
+    if (dev->base_file_valid) {
+        path_delete_file(dev->base_file);
+        dev->base_file_valid = 0;
+    }
+}
+
+/* Returns 1 if |dev->base_file| shows that the image file still holds the
+ * contents it had when a snapshot derived from |base| was saved. */
+static int nand_dev_check_base_file(nand_dev *dev, uint64_t base)
+{
+    uint64_t file_base, size;
+    int64_t mtime;
+    struct stat st;
+    FILE *file;
+    int ok;
+
+    if (!dev->base_file_valid || fstat(dev->fd, &st) < 0) {
+        return 0;
+    }
+    file = android_fopen(dev->base_file, "r");
+    if (!file) {
+        return 0;
+    }
+    ok = fscanf(file, "%" SCNx64 " %" SCNu64 " %" SCNd64,
+                &file_base, &size, &mtime) == 3;
+    fclose(file);
+    return ok && file_base == base && size == (uint64_t)st.st_size &&
+           mtime == (int64_t)st.st_mtime;
+}
+
+/* Called before the range [addr, addr + len) of the disk is modified.
+ * Preserves the current contents of each erase block that is about to be
+ * modified for the first time since the snapshot base, so that it can be
+ * reverted when an incremental snapshot is loaded. Uses |dev->data| as
+ * scratch space. Returns 0 on success, or -errno on failure. */
+static int nand_dev_mark_dirty(nand_dev *dev, uint64_t addr, uint32_t len)
+{
+    uint32_t index, last;
+    int ret;
+
+    if (!dev->incremental || !len) {
+        return 0;
+    }
+    nand_dev_invalidate_base_file(dev);
+    if (!dev->snapshot_base) {
+        return 0;
+    }
+
+    last = (addr + len - 1) / dev->erase_size;
+    for (index = addr / dev->erase_size; index <= last; index++) {
+        if (test_bit(index, dev->dirty_blocks)) {
+            continue;
+        }
+        if (dev->cow_fd < 0) {
+            TempFile* tmp = tempfile_create();
+            if (!tmp) {
+                XLOG("%s: could not create copy-on-write file\n", __FUNCTION__);
+                return -EIO;
+            }
+            dev->cow_fd = open(tempfile_path(tmp), O_BINARY | O_RDWR);
+            if (dev->cow_fd < 0) {
+                ret = -errno;
+                XLOG("%s: could not open copy-on-write file %s: %s\n",
+                     __FUNCTION__, tempfile_path(tmp), strerror(errno));
+                return ret;
+            }
+            atexit_close_fd(dev->cow_fd);
+        }
+        ret = nand_dev_read_block(dev, dev->fd, index, dev->data);
+        if (!ret) {
+            ret = nand_dev_write_block(dev, dev->cow_fd, index,
+                                       dev->data, dev->erase_size);
+        }
+        if (ret) {
+            XLOG("%s: could not preserve block %u: %s\n",
+                 __FUNCTION__, index, strerror(-ret));
+            return ret;
+        }
+        set_bit(index, dev->dirty_blocks);
+    }
+    return 0;
+}
+
+/* Called before the range [addr, addr + len) of the disk is modified, and
+ * before nand_dev_mark_dirty(). Copies each erase block that is still only
+ * in the initial image to the overlay. Blocks that are entirely overwritten
+ * don't need their initial contents, unless these must be preserved for an
+ * incremental snapshot. Returns 0 on success, or -errno on failure. */
+static int nand_dev_fill_overlay(nand_dev *dev, uint64_t addr, uint64_t len)
+{
+    int ret;
+
+    if (!dev->overlay) {
+        return 0;
+    }
+    ret = android_nand_overlay_fill(dev->overlay, dev->fd, addr, len,
+                                    dev->incremental);
+    if (ret) {
+        XLOG("%s: could not copy blocks to the overlay: %s\n",
+             __FUNCTION__, strerror(-ret));
+    }
+    return ret;
+}
+
+/* Stops using the initial image. Blocks that were not copied to the
+ * overlay yet are lost, so this is only for callers that are about to
+ * rewrite the whole disk. */
+static void nand_dev_drop_overlay(nand_dev *dev)
+{
+    android_nand_overlay_free(dev->overlay);
+    dev->overlay = NULL;
+}
+
+/* Copies everything still in the initial image to the overlay, which then
+ * becomes a regular disk image. This is needed before snapshots, which
+ * save and restore the image file as a whole. */
+static int nand_dev_merge_overlay(nand_dev *dev)
+{
+    int ret;
+
+    if (!dev->overlay) {
+        return 0;
+    }
+    ret = android_nand_overlay_merge(dev->overlay, dev->fd);
+    if (ret) {
+        XLOG("%s: could not merge the overlay: %s\n",
+             __FUNCTION__, strerror(-ret));
+        return ret;
+    }
+    nand_dev_drop_overlay(dev);
+    return 0;
+}
 
 /**
  * Copies the current contents of a disk image into the snapshot file.
- *
- * TODO optimize this using some kind of copy-on-write mechanism for
- *      unchanged disk sections.
  */
-static void  nand_dev_save_disk_state(QEMUFile *f, nand_dev *dev)
+static void  nand_dev_save_disk_full(QEMUFile *f, nand_dev *dev)
 {
     int buf_size = NAND_DEV_SAVE_DISK_BUF_SIZE;
     uint8_t buffer[NAND_DEV_SAVE_DISK_BUF_SIZE] = {0};
@@ -213,18 +510,6 @@ static void  nand_dev_save_disk_state(QEMUFile *f, nand_dev *dev)
     int ret;
     uint64_t total_copied = 0;
 
-    /* Size of file to restore, hence size of data block following.
-     * TODO Work out whether to use lseek64 here. */
-
-    lseek_ret = do_lseek(dev->fd, 0, SEEK_END);
-    if (lseek_ret == -1) {
-      qemu_file_set_error(f, -errno);
-      XLOG("%s EOF seek failed: %s\n", __FUNCTION__, strerror(errno));
-      return;
-    }
-    const uint64_t total_size = lseek_ret;
-    qemu_put_be64(f, total_size);
-
     /* copy all data from the stream to the stored image */
     lseek_ret = do_lseek(dev->fd, 0, SEEK_SET);
     if (lseek_ret == -1) {
@@ -248,6 +533,91 @@ static void  nand_dev_save_disk_state(QEMUFile *f, nand_dev *dev)
     /* TODO Maybe check that we've written total_size bytes */
 }
 
+/**
+ * Copies the erase blocks modified since the snapshot base into the
+ * snapshot file, as a sorted list of (index, contents) pairs.
+ */
+static void  nand_dev_save_disk_delta(QEMUFile *f, nand_dev *dev,
+                                      uint64_t total_size)
+{
+    uint32_t count = 0;
+    uint32_t index;
+    int ret;
+
+    for (index = find_first_bit(dev->dirty_blocks, dev->block_count);
+         index < dev->block_count;
+         index = find_next_bit(dev->dirty_blocks, dev->block_count, index + 1)) {
+        count++;
+    }
+    qemu_put_be32(f, count);
+
+    for (index = find_first_bit(dev->dirty_blocks, dev->block_count);
+         index < dev->block_count;
+         index = find_next_bit(dev->dirty_blocks, dev->block_count, index + 1)) {
+        uint64_t offset = (uint64_t)index * dev->erase_size;
+        uint32_t size = 0;
+
+        ret = nand_dev_read_block(dev, dev->fd, index, dev->data);
+        if (ret) {
+            qemu_file_set_error(f, ret);
+            XLOG("%s read failed: %s\n", __FUNCTION__, strerror(-ret));
+            return;
+        }
+        if (offset < total_size) {
+            size = MIN(total_size - offset, dev->erase_size);
+        }
+        qemu_put_be32(f, index);
+        qemu_put_buffer(f, dev->data, size);
+    }
+}
+
+/**
+ * Saves the state of a single disk into the snapshot file. Devices using
+ * incremental snapshots only save the blocks modified since their last
+ * full snapshot; everything else saves the whole image.
+ */
+static void  nand_dev_save_disk_state(QEMUFile *f, nand_dev *dev)
+{
+    off_t lseek_ret;
+    int ret;
+
+    ret = nand_dev_merge_overlay(dev);
+    if (ret) {
+        qemu_file_set_error(f, ret);
+        return;
+    }
+
+    /* Size of file to restore, hence size of data block following.
+     * TODO Work out whether to use lseek64 here. */
+
+    lseek_ret = do_lseek(dev->fd, 0, SEEK_END);
+    if (lseek_ret == -1) {
+      qemu_file_set_error(f, -errno);
+      XLOG("%s EOF seek failed: %s\n", __FUNCTION__, strerror(errno));
+      return;
+    }
+    const uint64_t total_size = lseek_ret;
+    qemu_put_be64(f, total_size);
+
+    if (dev->incremental && dev->snapshot_base) {
+        qemu_put_byte(f, NAND_DEV_SNAPSHOT_DELTA);
+        qemu_put_be64(f, dev->snapshot_base);
+        nand_dev_save_disk_delta(f, dev, total_size);
+    } else {
+        uint64_t base = dev->incremental ? nand_dev_new_snapshot_base() : 0;
+        qemu_put_byte(f, NAND_DEV_SNAPSHOT_FULL);
+        qemu_put_be64(f, base);
+        nand_dev_save_disk_full(f, dev);
+        if (dev->incremental && !qemu_file_get_error(f)) {
+            nand_dev_reset_snapshot_base(dev, base);
+        }
+    }
+
+    if (dev->incremental && !qemu_file_get_error(f)) {
+        nand_dev_save_base_file(dev);
+    }
+}
+
 
 /**
  * Saves the state of all disks managed by this controller to a snapshot file.
@@ -262,22 +632,17 @@ static void nand_dev_save_disks(QEMUFile *f)
 
 /**
  * Overwrites the contents of the disk image managed by this device with the
- * contents as they were at the point the snapshot was made.
+ * full contents stored in the snapshot. If the snapshot is the current base
+ * of an incremental device, only the blocks modified since then are written.
  */
-static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
+static int  nand_dev_load_disk_full(QEMUFile *f, nand_dev *dev,
+                                    uint64_t total_size, uint64_t base)
 {
     int buf_size = NAND_DEV_SAVE_DISK_BUF_SIZE;
     uint8_t buffer[NAND_DEV_SAVE_DISK_BUF_SIZE] = {0};
     off_t lseek_ret;
     int ret;
-
-    /* File size for restore and truncate */
-    uint64_t total_size = qemu_get_be64(f);
-    if (total_size > dev->max_size) {
-        XLOG("%s, restore failed: size required (%lld) exceeds device limit (%lld)\n",
-             __FUNCTION__, total_size, dev->max_size);
-        return -EIO;
-    }
+    int only_dirty = dev->incremental && base && base == dev->snapshot_base;
 
     /* overwrite disk contents with snapshot contents */
     uint64_t next_offset = 0;
@@ -299,6 +664,18 @@ static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
                  __FUNCTION__, buf_size, ret);
             return -EIO;
         }
+        if (only_dirty) {
+            uint64_t last_offset = next_offset + buf_size - 1;
+            if (!test_bit(next_offset / dev->erase_size, dev->dirty_blocks) &&
+                !test_bit(last_offset / dev->erase_size, dev->dirty_blocks)) {
+                next_offset += buf_size;
+                continue;
+            }
+            if (do_lseek(dev->fd, next_offset, SEEK_SET) == -1) {
+                XLOG("%s seek failed: %s\n", __FUNCTION__, strerror(errno));
+                return -EIO;
+            }
+        }
         ret = do_write(dev->fd, buffer, buf_size);
         if (ret != buf_size) {
             XLOG("%s, write failed: %s\n", __FUNCTION__, strerror(errno));
@@ -308,6 +685,145 @@ static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
         next_offset += buf_size;
     }
 
+    if (dev->incremental) {
+        nand_dev_reset_snapshot_base(dev,
+                base ? base : nand_dev_new_snapshot_base());
+    }
+    return 0;
+}
+
+/**
+ * Restores a disk from an incremental snapshot. The disk must still be
+ * derived from the snapshot's base: blocks modified since the base are
+ * reverted from the copy-on-write file, then the snapshot's blocks are
+ * applied on top.
+ */
+static int  nand_dev_load_disk_delta(QEMUFile *f, nand_dev *dev,
+                                     uint64_t total_size, uint64_t base)
+{
+    uint32_t count, index, next;
+    uint64_t offset;
+    uint32_t size;
+    int ret;
+
+    if (!dev->incremental || !base || base != dev->snapshot_base) {
+        XLOG("%s: incremental snapshot of %.*s does not match the current "
+             "disk contents, please save a new snapshot\n",
+             __FUNCTION__, (int)dev->devname_len, dev->devname);
+        return -EIO;
+    }
+
+    count = qemu_get_be32(f);
+    next = count ? qemu_get_be32(f) : dev->block_count;
+    for (index = 0; index < dev->block_count; index++) {
+        if (index == next) {
+            offset = (uint64_t)index * dev->erase_size;
+            size = 0;
+            if (offset < total_size) {
+                size = MIN(total_size - offset, dev->erase_size);
+            }
+            /* Keep the base contents of the block in the copy-on-write
+             * file first, this uses |dev->data| as scratch space. */
+            if (!test_bit(index, dev->dirty_blocks)) {
+                ret = nand_dev_mark_dirty(dev, offset, 1);
+                if (ret) {
+                    return ret;
+                }
+            }
+            if (qemu_get_buffer(f, dev->data, size) != size) {
+                XLOG("%s: truncated snapshot block %u\n", __FUNCTION__, index);
+                return -EIO;
+            }
+            ret = nand_dev_write_block(dev, dev->fd, index, dev->data, size);
+            if (--count) {
+                next = qemu_get_be32(f);
+                if (next <= index || next >= dev->block_count) {
+                    XLOG("%s: invalid snapshot block %u\n", __FUNCTION__, next);
+                    return -EIO;
+                }
+            } else {
+                next = dev->block_count;
+            }
+        } else if (test_bit(index, dev->dirty_blocks)) {
+            ret = nand_dev_read_block(dev, dev->cow_fd, index, dev->data);
+            if (!ret) {
+                ret = nand_dev_write_block(dev, dev->fd, index,
+                                           dev->data, dev->erase_size);
+            }
+            clear_bit(index, dev->dirty_blocks);
+        } else {
+            continue;
+        }
+        if (ret) {
+            XLOG("%s: could not restore block %u: %s\n",
+                 __FUNCTION__, index, strerror(-ret));
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Overwrites the contents of the disk image managed by this device with the
+ * contents as they were at the point the snapshot was made.
+ */
+static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev, int version_id)
+{
+    int kind = NAND_DEV_SNAPSHOT_FULL;
+    uint64_t base = 0;
+    int ret;
+
+    /* File size for restore and truncate */
+    uint64_t total_size = qemu_get_be64(f);
+    if (total_size > dev->max_size) {
+        XLOG("%s, restore failed: size required (%lld) exceeds device limit (%lld)\n",
+             __FUNCTION__, total_size, dev->max_size);
+        return -EIO;
+    }
+
+    if (version_id >= NAND_DEV_STATE_SAVE_VERSION_INCREMENTAL) {
+        kind = qemu_get_byte(f);
+        base = qemu_get_be64(f);
+    }
+
+    /* A delta saved by an earlier emulator run still applies if the image
+     * file wasn't modified since. */
+    if (kind == NAND_DEV_SNAPSHOT_DELTA && dev->incremental &&
+        !dev->snapshot_base && nand_dev_check_base_file(dev, base)) {
+        nand_dev_reset_snapshot_base(dev, base);
+    }
+    if (dev->incremental) {
+        nand_dev_invalidate_base_file(dev);
+    }
+
+    /* Partial restores rely on the image file for the unchanged blocks,
+     * while full ones rewrite all of it. */
+    if (kind == NAND_DEV_SNAPSHOT_DELTA ||
+        (dev->incremental && base && base == dev->snapshot_base)) {
+        ret = nand_dev_merge_overlay(dev);
+        if (ret) {
+            return ret;
+        }
+    } else {
+        nand_dev_drop_overlay(dev);
+    }
+
+    switch (kind) {
+    case NAND_DEV_SNAPSHOT_FULL:
+        ret = nand_dev_load_disk_full(f, dev, total_size, base);
+        break;
+    case NAND_DEV_SNAPSHOT_DELTA:
+        ret = nand_dev_load_disk_delta(f, dev, total_size, base);
+        break;
+    default:
+        XLOG("%s, restore failed: unknown disk record type %d\n",
+             __FUNCTION__, kind);
+        ret = -EIO;
+    }
+    if (ret) {
+        return ret;
+    }
+
     ret = do_ftruncate(dev->fd, total_size);
     if (ret < 0) {
         XLOG("%s ftruncate failed: %s\n", __FUNCTION__, strerror(errno));
@@ -320,11 +836,11 @@ static int  nand_dev_load_disk_state(QEMUFile *f, nand_dev *dev)
 /**
  * Restores the state of all disks managed by this driver from a snapshot file.
  */
-static int nand_dev_load_disks(QEMUFile *f)
+static int nand_dev_load_disks(QEMUFile *f, int version_id)
 {
     int i, ret;
     for (i = 0; i < nand_dev_count; i++) {
-        ret = nand_dev_load_disk_state(f, nand_devs + i);
+        ret = nand_dev_load_disk_state(f, nand_devs + i, version_id);
         if (ret)
             return ret; // abort on error
     }
@@ -332,11 +848,18 @@ static int nand_dev_load_disks(QEMUFile *f)
     return 0;
 }
 
+static void nand_dev_async_flush(nand_dev_controller_state *s);
+static void nand_dev_update_irq(nand_dev_controller_state *s);
+
 static void  nand_dev_controller_state_save(QEMUFile *f, void  *opaque)
 {
     nand_dev_controller_state* s = opaque;
 
+    nand_dev_async_flush(s);
+
     qemu_put_struct(f, nand_dev_controller_state_fields, s);
+    qemu_put_be32(f, s->status);
+    qemu_put_be32(f, s->async_enable);
 
     /* The guest will continue writing to the disk image after the state has
      * been saved. To guarantee that the state is identical after resume, save
@@ -350,8 +873,20 @@ static int   nand_dev_controller_state_load(QEMUFile *f, void  *opaque, int  ver
     nand_dev_controller_state*  s = opaque;
     int ret;
 
+    /* Don't let a command in flight modify the disks after restoring them. */
+    nand_dev_async_flush(s);
+    s->status = 0;
+    s->async_enable = 0;
+
     if (version_id == NAND_DEV_STATE_SAVE_VERSION) {
         ret = qemu_get_struct(f, nand_dev_controller_state_fields, s);
+        if (!ret) {
+            s->status = qemu_get_be32(f) & NAND_STATUS_DONE;
+            s->async_enable = qemu_get_be32(f);
+        }
+    } else if (version_id == NAND_DEV_STATE_SAVE_VERSION_INCREMENTAL ||
+               version_id == NAND_DEV_STATE_SAVE_VERSION_FULL_DISKS) {
+        ret = qemu_get_struct(f, nand_dev_controller_state_fields, s);
     } else if (version_id == NAND_DEV_STATE_SAVE_VERSION_LEGACY) {
         ret = qemu_get_struct(f, nand_dev_controller_state_legacy_1_fields, s);
         if (!ret) {
@@ -364,18 +899,20 @@ static int   nand_dev_controller_state_load(QEMUFile *f, void  *opaque, int  ver
         // Invalid encoding.
         ret = -1;
     }
-    return ret ? ret : nand_dev_load_disks(f);
+    nand_dev_update_irq(s);
+    return ret ? ret : nand_dev_load_disks(f, version_id);
 }
 
-static uint32_t nand_dev_read_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
+/* Reads |total_len| bytes at |addr| from the image at |fd| into the guest
+ * buffer at virtual address |data|, going through |dev->data|. Anything
+ * beyond the end of the file reads as 0xff. */
+static void nand_dev_read_file_bounce(nand_dev *dev, int fd, target_ulong data, uint64_t addr, uint32_t total_len)
 {
     uint32_t len = total_len;
     size_t read_len = dev->erase_size;
     int eof = 0;
 
-    NAND_UPDATE_READ_THRESHOLD(total_len);
-
-    do_lseek(dev->fd, addr, SEEK_SET);
+    do_lseek(fd, addr, SEEK_SET);
     while(len > 0) {
         if(read_len < dev->erase_size) {
             memset(dev->data, 0xff, dev->erase_size);
@@ -385,23 +922,23 @@ static uint32_t nand_dev_read_file(nand_dev *dev, target_ulong data, uint64_t ad
         if(len < read_len)
             read_len = len;
         if(!eof) {
-            read_len = do_read(dev->fd, dev->data, read_len);
+            read_len = do_read(fd, dev->data, read_len);
         }
         safe_memory_rw_debug(current_cpu, data, dev->data, read_len, 1);
         data += read_len;
         len -= read_len;
     }
-    return total_len;
 }
 
-static uint32_t nand_dev_write_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
+/* Writes |total_len| bytes from the guest buffer at virtual address |data|
+ * to the disk at |addr|, going through |dev->data|. Returns the number of
+ * bytes written. */
+static uint32_t nand_dev_write_file_bounce(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
 {
     uint32_t len = total_len;
     size_t write_len = dev->erase_size;
     int ret;
 
-    NAND_UPDATE_WRITE_THRESHOLD(total_len);
-
     do_lseek(dev->fd, addr, SEEK_SET);
     while(len > 0) {
         if(len < write_len)
@@ -418,12 +955,247 @@ static uint32_t nand_dev_write_file(nand_dev *dev, target_ulong data, uint64_t a
     return total_len - len;
 }
 
+#ifdef CONFIG_IOVEC
+
+/* Maximum number of host ranges used by a single vectored disk access */
+#define NAND_DEV_MAX_IOV  64
+
+/* Maps as much as possible of the guest buffer at virtual address |data|
+ * into host memory, one guest page at a time, storing the resulting host
+ * ranges in |iov| (up to NAND_DEV_MAX_IOV entries, physically adjacent
+ * pages are merged). Stops at the first page that is not backed by RAM.
+ * Returns the number of bytes mapped, which must be released with
+ * nand_dev_unmap_guest_buffer(). */
+static uint32_t nand_dev_map_guest_buffer(target_ulong data, uint32_t len,
+                                          int is_write, struct iovec *iov,
+                                          int *iov_count)
+{
+    CPUState *cpu = current_cpu;
+    uint32_t mapped = 0;
+    int count = 0;
+
+    while (mapped < len) {
+        target_ulong vaddr = data + mapped;
+        target_ulong page = vaddr & TARGET_PAGE_MASK;
+        hwaddr l = MIN(len - mapped, page + TARGET_PAGE_SIZE - vaddr);
+        hwaddr phys;
+        ram_addr_t ram_addr;
+        uint8_t *ptr;
+
+        /* Only the first lookup needs to pull the MMU state from KVM. */
+        if (!mapped) {
+            phys = safe_get_phys_page_debug(cpu, page);
+        } else {
+            phys = cpu_get_phys_page_debug(cpu->env_ptr, page);
+        }
+        if (phys == -1) {
+            break;
+        }
+#ifdef TARGET_X86_64
+        phys = phys & TARGET_PTE_MASK;
+#endif
+        ptr = cpu_physical_memory_map(phys + (vaddr - page), &l, is_write);
+        if (!ptr) {
+            break;
+        }
+        /* MMIO pages are mapped through a single bounce buffer, leave
+         * them to the slow path. */
+        if (qemu_ram_addr_from_host(ptr, &ram_addr)) {
+            cpu_physical_memory_unmap(ptr, l, 0, 0);
+            break;
+        }
+        if (count > 0 &&
+            (uint8_t*)iov[count - 1].iov_base + iov[count - 1].iov_len == ptr) {
+            iov[count - 1].iov_len += l;
+        } else if (count < NAND_DEV_MAX_IOV) {
+            iov[count].iov_base = ptr;
+            iov[count].iov_len = l;
+            count++;
+        } else {
+            cpu_physical_memory_unmap(ptr, l, 0, 0);
+            break;
+        }
+        mapped += l;
+    }
+    *iov_count = count;
+    return mapped;
+}
+
+static void nand_dev_unmap_guest_buffer(struct iovec *iov, int iov_count,
+                                        int is_write)
+{
+    int i;
+    for (i = 0; i < iov_count; i++) {
+        cpu_physical_memory_unmap(iov[i].iov_base, iov[i].iov_len,
+                                  is_write, iov[i].iov_len);
+    }
+}
+
+/* EINTR-proof vectored read or write at |offset|. */
+static ssize_t do_rw_iov(int fd, struct iovec *iov, int iov_count,
+                         uint64_t offset, int is_write)
+{
+    ssize_t ret;
+#ifdef CONFIG_PREADV
+    do {
+        ret = is_write ? pwritev(fd, iov, iov_count, offset)
+                       : preadv(fd, iov, iov_count, offset);
+    } while (ret < 0 && errno == EINTR);
+#else
+    if (do_lseek(fd, offset, SEEK_SET) == -1) {
+        return -1;
+    }
+    do {
+        ret = is_write ? writev(fd, iov, iov_count)
+                       : readv(fd, iov, iov_count);
+    } while (ret < 0 && errno == EINTR);
+#endif
+    return ret;
+}
+
+/* Fills the bytes after the first |skip| ones of |iov| with 0xff. */
+static void iov_fill_erased(struct iovec *iov, int iov_count, size_t skip)
+{
+    int i;
+    for (i = 0; i < iov_count; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        memset((uint8_t*)iov[i].iov_base + skip, 0xff, iov[i].iov_len - skip);
+        skip = 0;
+    }
+}
+
+#endif  /* CONFIG_IOVEC */
+
+/* Reads from the image at |fd| straight into guest RAM where possible,
+ * only falling back to nand_dev_read_file_bounce() for pages that are not
+ * backed by RAM. */
+static void nand_dev_read_image(nand_dev *dev, int fd, target_ulong data, uint64_t addr, uint32_t total_len)
+{
+#ifdef CONFIG_IOVEC
+    struct iovec iov[NAND_DEV_MAX_IOV];
+    int iov_count;
+    uint32_t len = total_len;
+    uint32_t chunk;
+    ssize_t ret;
+
+    while (len > 0) {
+        chunk = nand_dev_map_guest_buffer(data, len, 1, iov, &iov_count);
+        if (!chunk) {
+            chunk = MIN(len, TARGET_PAGE_SIZE - (data & ~TARGET_PAGE_MASK));
+            nand_dev_read_file_bounce(dev, fd, data, addr, chunk);
+        } else {
+            ret = do_rw_iov(fd, iov, iov_count, addr, 0);
+            if (ret < 0) {
+                XLOG("nand_dev_read_file, read failed: %s\n", strerror(errno));
+                ret = 0;
+            }
+            if (ret < (ssize_t)chunk) {
+                iov_fill_erased(iov, iov_count, ret);
+            }
+            nand_dev_unmap_guest_buffer(iov, iov_count, 1);
+        }
+        data += chunk;
+        addr += chunk;
+        len -= chunk;
+    }
+#else
+    nand_dev_read_file_bounce(dev, fd, data, addr, total_len);
+#endif
+}
+
+static uint32_t nand_dev_read_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
+{
+    uint32_t len = total_len;
+
+    NAND_UPDATE_READ_THRESHOLD(total_len);
+
+    /* With an overlay, read each run of erase blocks from the image that
+     * currently holds them. */
+    while (dev->overlay && len > 0) {
+        uint32_t index = addr / dev->erase_size;
+        bool in_overlay = android_nand_overlay_has_block(dev->overlay, index);
+        uint64_t end = (uint64_t)(index + 1) * dev->erase_size;
+        uint32_t chunk;
+
+        while (end < addr + len &&
+               android_nand_overlay_has_block(dev->overlay, ++index) ==
+                       in_overlay) {
+            end += dev->erase_size;
+        }
+        chunk = MIN(end - addr, len);
+
+        nand_dev_read_image(dev, in_overlay ? dev->fd :
+                                 android_nand_overlay_base_fd(dev->overlay),
+                            data, addr, chunk);
+        data += chunk;
+        addr += chunk;
+        len -= chunk;
+    }
+    if (len > 0) {
+        nand_dev_read_image(dev, dev->fd, data, addr, len);
+    }
+    return total_len;
+}
+
+/* Writes to the disk straight from guest RAM where possible, only
+ * falling back to nand_dev_write_file_bounce() for pages that are not
+ * backed by RAM. */
+static uint32_t nand_dev_write_file(nand_dev *dev, target_ulong data, uint64_t addr, uint32_t total_len)
+{
+    NAND_UPDATE_WRITE_THRESHOLD(total_len);
+
+    if (nand_dev_fill_overlay(dev, addr, total_len) < 0 ||
+        nand_dev_mark_dirty(dev, addr, total_len) < 0) {
+        return 0;
+    }
+
+#ifdef CONFIG_IOVEC
+    struct iovec iov[NAND_DEV_MAX_IOV];
+    int iov_count;
+    uint32_t len = total_len;
+    uint32_t chunk;
+    ssize_t ret;
+
+    while (len > 0) {
+        chunk = nand_dev_map_guest_buffer(data, len, 0, iov, &iov_count);
+        if (!chunk) {
+            chunk = MIN(len, TARGET_PAGE_SIZE - (data & ~TARGET_PAGE_MASK));
+            ret = nand_dev_write_file_bounce(dev, data, addr, chunk);
+        } else {
+            ret = do_rw_iov(dev->fd, iov, iov_count, addr, 1);
+            nand_dev_unmap_guest_buffer(iov, iov_count, 0);
+            if (ret < (ssize_t)chunk) {
+                XLOG("nand_dev_write_file, write failed: %s\n", strerror(errno));
+            }
+        }
+        if (ret < (ssize_t)chunk) {
+            if (ret > 0)
+                len -= ret;
+            break;
+        }
+        data += chunk;
+        addr += chunk;
+        len -= chunk;
+    }
+    return total_len - len;
+#else
+    return nand_dev_write_file_bounce(dev, data, addr, total_len);
+#endif
+}
+
 static uint32_t nand_dev_erase_file(nand_dev *dev, uint64_t addr, uint32_t total_len)
 {
     uint32_t len = total_len;
     size_t write_len = dev->erase_size;
     int ret;
 
+    if (nand_dev_fill_overlay(dev, addr, total_len) < 0 ||
+        nand_dev_mark_dirty(dev, addr, total_len) < 0) {
+        return 0;
+    }
     do_lseek(dev->fd, addr, SEEK_SET);
     memset(dev->data, 0xff, dev->erase_size);
     while(len > 0) {
@@ -439,6 +1211,272 @@ static uint32_t nand_dev_erase_file(nand_dev *dev, uint64_t addr, uint32_t total
     return total_len - len;
 }
 
+#ifdef NAND_ASYNC_IO
+
+/* Performs the disk access of |req|. Runs on the I/O thread, so it must
+ * not touch any emulator state besides the request itself. */
+static void nand_dev_async_execute(nand_dev_async_request *req)
+{
+    nand_dev *dev = req->dev;
+    uint64_t addr = req->addr;
+    ssize_t ret = 0;
+    int i;
+
+    if (req->cmd == NAND_CMD_ERASE || req->cmd == NAND_CMD_ERASE_BATCH) {
+        uint32_t len = req->size;
+        uint8_t *buf = g_malloc(dev->erase_size);
+        memset(buf, 0xff, dev->erase_size);
+        while (len > 0) {
+            struct iovec iov = { buf, MIN(len, dev->erase_size) };
+            ret = do_rw_iov(dev->fd, &iov, 1, addr, 1);
+            if (ret < (ssize_t)iov.iov_len) {
+                XLOG("nand_dev_erase_file, write failed: %s\n", strerror(errno));
+                break;
+            }
+            addr += ret;
+            len -= ret;
+        }
+        g_free(buf);
+        req->result = req->size - len;
+        return;
+    }
+
+    int is_write = (req->cmd == NAND_CMD_WRITE ||
+                    req->cmd == NAND_CMD_WRITE_BATCH);
+    req->result = 0;
+    for (i = 0; i < req->iov_count; i += NAND_DEV_MAX_IOV) {
+        int count = MIN(req->iov_count - i, NAND_DEV_MAX_IOV);
+        size_t chunk = iov_size(req->iov + i, count);
+        ret = do_rw_iov(dev->fd, req->iov + i, count, addr, is_write);
+        if (is_write) {
+            if (ret < (ssize_t)chunk) {
+                XLOG("nand_dev_write_file, write failed: %s\n", strerror(errno));
+                if (ret > 0)
+                    req->result += ret;
+                return;
+            }
+        } else if (ret < (ssize_t)chunk) {
+            if (ret < 0) {
+                XLOG("nand_dev_read_file, read failed: %s\n", strerror(errno));
+                ret = 0;
+            }
+            iov_fill_erased(req->iov + i, count, ret);
+        }
+        req->result += chunk;
+        addr += chunk;
+    }
+}
+
+static void *nand_dev_io_thread_main(void *opaque)
+{
+    nand_dev_io_thread *io = opaque;
+    nand_dev_async_request *req;
+    char byte = 0;
+    int ret;
+
+    for (;;) {
+        qemu_mutex_lock(&io->lock);
+        while (!io->pending) {
+            qemu_cond_wait(&io->cond, &io->lock);
+        }
+        req = io->pending;
+        io->pending = NULL;
+        qemu_mutex_unlock(&io->lock);
+
+        nand_dev_async_execute(req);
+
+        qemu_mutex_lock(&io->lock);
+        io->completed = req;
+        qemu_cond_broadcast(&io->cond);
+        qemu_mutex_unlock(&io->lock);
+
+        do {
+            ret = write(io->notify_fds[1], &byte, 1);
+        } while (ret < 0 && errno == EINTR);
+    }
+    return NULL;
+}
+
+static void nand_dev_update_irq(nand_dev_controller_state *s)
+{
+    if (s->gdev->irq_count > 0) {
+        goldfish_device_set_irq(s->gdev, 0,
+                (s->status & NAND_STATUS_DONE) && s->async_enable);
+    }
+}
+
+static void nand_dev_write_batch_result(nand_dev_controller_state *s,
+                                        uint32_t cmd);
+
+/* Finishes the request returned by the I/O thread, if any, on the main
+ * loop: releases the guest buffer, publishes the result and raises the
+ * completion interrupt. */
+static void nand_dev_async_complete(nand_dev_controller_state *s)
+{
+    nand_dev_io_thread *io = s->io;
+    nand_dev_async_request *req;
+    int i, is_write;
+
+    qemu_mutex_lock(&io->lock);
+    req = io->completed;
+    io->completed = NULL;
+    qemu_mutex_unlock(&io->lock);
+    if (!req) {
+        return;
+    }
+
+    /* Data read from the disk was written to guest memory. */
+    is_write = (req->cmd == NAND_CMD_READ || req->cmd == NAND_CMD_READ_BATCH);
+    for (i = 0; i < req->iov_count; i++) {
+        cpu_physical_memory_unmap(req->iov[i].iov_base, req->iov[i].iov_len,
+                                  is_write, req->iov[i].iov_len);
+    }
+
+    s->result = req->result;
+    nand_dev_write_batch_result(s, req->cmd);
+    s->status = (s->status & ~NAND_STATUS_BUSY) | NAND_STATUS_DONE;
+    nand_dev_update_irq(s);
+
+    g_free(req->iov);
+    g_free(req);
+}
+
+static void nand_dev_async_notify(void *opaque)
+{
+    nand_dev_controller_state *s = opaque;
+    char bytes[16];
+    int ret;
+
+    do {
+        ret = read(s->io->notify_fds[0], bytes, sizeof(bytes));
+    } while (ret > 0 || (ret < 0 && errno == EINTR));
+
+    nand_dev_async_complete(s);
+}
+
+/* Waits until the command in flight, if any, has completed. Used before
+ * saving or restoring the disks. */
+static void nand_dev_async_flush(nand_dev_controller_state *s)
+{
+    nand_dev_io_thread *io = s->io;
+
+    if (!io || !(s->status & NAND_STATUS_BUSY)) {
+        return;
+    }
+    qemu_mutex_lock(&io->lock);
+    while (!io->completed) {
+        qemu_cond_wait(&io->cond, &io->lock);
+    }
+    qemu_mutex_unlock(&io->lock);
+    nand_dev_async_complete(s);
+}
+
+/* Queues a read, write or erase command for the I/O thread. Returns 1 on
+ * success, or 0 if the command must be executed synchronously, either
+ * because async commands are disabled or because part of the guest buffer
+ * is not backed by RAM. */
+static int nand_dev_async_submit(nand_dev_controller_state *s, nand_dev *dev,
+                                 uint32_t cmd, target_ulong data,
+                                 uint64_t addr, uint32_t size)
+{
+    nand_dev_async_request *req;
+    int to_guest = (cmd == NAND_CMD_READ || cmd == NAND_CMD_READ_BATCH);
+    int is_erase = (cmd == NAND_CMD_ERASE || cmd == NAND_CMD_ERASE_BATCH);
+    struct iovec *iov = NULL;
+    int iov_count = 0;
+    uint32_t mapped = 0;
+    int i;
+
+    if (!s->io || !s->async_enable || !dev->async) {
+        return 0;
+    }
+
+    while (!is_erase && mapped < size) {
+        int count;
+        uint32_t chunk;
+
+        iov = g_renew(struct iovec, iov, iov_count + NAND_DEV_MAX_IOV);
+        chunk = nand_dev_map_guest_buffer(data + mapped, size - mapped,
+                                          to_guest, iov + iov_count, &count);
+        iov_count += count;
+        mapped += chunk;
+        if (!chunk) {
+            for (i = 0; i < iov_count; i++) {
+                cpu_physical_memory_unmap(iov[i].iov_base, iov[i].iov_len,
+                                          0, 0);
+            }
+            g_free(iov);
+            return 0;
+        }
+    }
+
+    if (!to_guest) {
+        if (nand_dev_mark_dirty(dev, addr, size) < 0) {
+            for (i = 0; i < iov_count; i++) {
+                cpu_physical_memory_unmap(iov[i].iov_base, iov[i].iov_len,
+                                          0, 0);
+            }
+            g_free(iov);
+            return 0;
+        }
+    }
+
+    req = g_malloc0(sizeof(*req));
+    req->dev = dev;
+    req->cmd = cmd;
+    req->addr = addr;
+    req->size = size;
+    req->iov = iov;
+    req->iov_count = iov_count;
+
+    s->status = NAND_STATUS_BUSY;
+    nand_dev_update_irq(s);
+
+    qemu_mutex_lock(&s->io->lock);
+    s->io->pending = req;
+    qemu_cond_broadcast(&s->io->cond);
+    qemu_mutex_unlock(&s->io->lock);
+    return 1;
+}
+
+static void nand_dev_async_init(nand_dev_controller_state *s)
+{
+    nand_dev_io_thread *io;
+
+    io = g_malloc0(sizeof(*io));
+    if (qemu_pipe(io->notify_fds) < 0) {
+        XLOG("%s: could not create pipe: %s\n", __FUNCTION__, strerror(errno));
+        g_free(io);
+        return;
+    }
+    fcntl(io->notify_fds[0], F_SETFL, O_NONBLOCK);
+    qemu_mutex_init(&io->lock);
+    qemu_cond_init(&io->cond);
+    s->io = io;
+    qemu_set_fd_handler(io->notify_fds[0], nand_dev_async_notify, NULL, s);
+    qemu_thread_create(&io->thread, "nand_io", nand_dev_io_thread_main, io,
+                       QEMU_THREAD_DETACHED);
+}
+
+#else  /* !NAND_ASYNC_IO */
+
+static void nand_dev_async_flush(nand_dev_controller_state *s)
+{
+}
+
+static int nand_dev_async_submit(nand_dev_controller_state *s, nand_dev *dev,
+                                 uint32_t cmd, target_ulong data,
+                                 uint64_t addr, uint32_t size)
+{
+    return 0;
+}
+
+static void nand_dev_update_irq(nand_dev_controller_state *s)
+{
+}
+
+#endif  /* !NAND_ASYNC_IO */
+
 /* this is a huge hack required to make the PowerPC emulator binary usable
  * on Mac OS X. If you define this function as 'static', the emulated kernel
  * will panic when attempting to mount the /data partition.
@@ -497,8 +1535,11 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
             return 0;
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
-        if(dev->fd >= 0)
+        if(dev->fd >= 0) {
+            if (nand_dev_async_submit(s, dev, cmd, s->data, addr, size))
+                return 0;
             return nand_dev_read_file(dev, s->data, addr, size);
+        }
         safe_memory_rw_debug(current_cpu, s->data, &dev->data[addr], size, 1);
         return size;
     case NAND_CMD_WRITE_BATCH:
@@ -511,8 +1552,11 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
             return 0;
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
-        if(dev->fd >= 0)
+        if(dev->fd >= 0) {
+            if (nand_dev_async_submit(s, dev, cmd, s->data, addr, size))
+                return 0;
             return nand_dev_write_file(dev, s->data, addr, size);
+        }
         safe_memory_rw_debug(current_cpu, s->data, &dev->data[addr], size, 0);
         return size;
     case NAND_CMD_ERASE_BATCH:
@@ -525,8 +1569,11 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
             return 0;
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
-        if(dev->fd >= 0)
+        if(dev->fd >= 0) {
+            if (nand_dev_async_submit(s, dev, cmd, 0, addr, size))
+                return 0;
             return nand_dev_erase_file(dev, addr, size);
+        }
         memset(&dev->data[addr], 0xff, size);
         return size;
     case NAND_CMD_BLOCK_BAD_GET: // no bad block support
@@ -543,10 +1590,30 @@ uint32_t nand_dev_do_cmd(nand_dev_controller_state *s, uint32_t cmd)
     }
 }
 
+/* Copies the result of a batch command back to its guest descriptor. */
+static void nand_dev_write_batch_result(nand_dev_controller_state *s,
+                                        uint32_t cmd)
+{
+    if (cmd == NAND_CMD_WRITE_BATCH || cmd == NAND_CMD_READ_BATCH ||
+        cmd == NAND_CMD_ERASE_BATCH) {
+        struct batch_data bd;
+        struct batch_data_64 bd64;
+        uint64_t bd_addr = ((uint64_t)s->batch_addr_high << 32) | s->batch_addr_low;
+        if (goldfish_guest_is_64bit()) {
+            bd64.result = s->result;
+            cpu_physical_memory_write(bd_addr, (void*)&bd64, sizeof(struct batch_data_64));
+        } else {
+            bd.result = s->result;
+            cpu_physical_memory_write(bd_addr, (void*)&bd, sizeof(struct batch_data));
+        }
+    }
+}
+
 /* I/O write */
 static void nand_dev_write(void *opaque, hwaddr offset, uint32_t value)
 {
     nand_dev_controller_state *s = (nand_dev_controller_state *)opaque;
+    uint32_t result;
 
     switch (offset) {
     case NAND_DEV:
@@ -577,20 +1644,26 @@ static void nand_dev_write(void *opaque, hwaddr offset, uint32_t value)
         uint64_set_high(&s->data, value);
         break;
     case NAND_COMMAND:
-        s->result = nand_dev_do_cmd(s, value);
-        if (value == NAND_CMD_WRITE_BATCH || value == NAND_CMD_READ_BATCH ||
-            value == NAND_CMD_ERASE_BATCH) {
-            struct batch_data bd;
-            struct batch_data_64 bd64;
-            uint64_t bd_addr = ((uint64_t)s->batch_addr_high << 32) | s->batch_addr_low;
-            if (goldfish_guest_is_64bit()) {
-                bd64.result = s->result;
-                cpu_physical_memory_write(bd_addr, (void*)&bd64, sizeof(struct batch_data_64));
-            } else {
-                bd.result = s->result;
-                cpu_physical_memory_write(bd_addr, (void*)&bd, sizeof(struct batch_data));
-            }
+        if (s->status & NAND_STATUS_BUSY) {
+            XLOG("nand_dev_write: command %x while busy, ignored\n", value);
+            break;
+        }
+        result = nand_dev_do_cmd(s, value);
+        if (s->status & NAND_STATUS_BUSY) {
+            /* Queued, see nand_dev_async_complete(). */
+            break;
         }
+        s->result = result;
+        nand_dev_write_batch_result(s, value);
+        break;
+    case NAND_STATUS:
+        /* Writing acknowledges the completion of an async command. */
+        s->status &= ~(value & NAND_STATUS_DONE);
+        nand_dev_update_irq(s);
+        break;
+    case NAND_ASYNC_ENABLE:
+        s->async_enable = (value != 0);
+        nand_dev_update_irq(s);
         break;
     default:
         cpu_abort(cpu_single_env,
@@ -612,7 +1685,15 @@ static uint32_t nand_dev_read(void *opaque, hwaddr offset)
     case NAND_NUM_DEV:
         return nand_dev_count;
     case NAND_RESULT:
+        if (s->status & NAND_STATUS_DONE) {
+            s->status &= ~NAND_STATUS_DONE;
+            nand_dev_update_irq(s);
+        }
         return s->result;
+    case NAND_STATUS:
+        return s->status;
+    case NAND_ASYNC_ENABLE:
+        return s->async_enable;
     }
 
     if(s->dev >= nand_dev_count)
@@ -674,16 +1755,39 @@ static CPUWriteMemoryFunc *nand_dev_writefn[] = {
 };
 
 /* initialize the QFB device */
-void nand_dev_init(uint32_t base)
+void nand_dev_init(struct goldfish_device *gdev)
 {
     int iomemtype;
     static int  instance_id = 0;
     nand_dev_controller_state *s;
+    int has_async = 0;
+    uint32_t i;
+
+#ifdef NAND_ASYNC_IO
+    for (i = 0; i < nand_dev_count; i++) {
+        has_async |= nand_devs[i].async;
+    }
+#else
+    for (i = 0; i < nand_dev_count; i++) {
+        nand_devs[i].async = 0;
+    }
+#endif
+    /* Only claim an interrupt line when it can be used, to keep the IRQ
+     * assignment of the other devices unchanged. */
+    gdev->irq_count = has_async ? 1 : 0;
+    goldfish_add_device_no_io(gdev);
 
     s = (nand_dev_controller_state *)g_malloc0(sizeof(nand_dev_controller_state));
     iomemtype = cpu_register_io_memory(nand_dev_readfn, nand_dev_writefn, s);
-    cpu_register_physical_memory(base, 0x00000fff, iomemtype);
-    s->base = base;
+    cpu_register_physical_memory(gdev->base, 0x00000fff, iomemtype);
+    s->base = gdev->base;
+    s->gdev = gdev;
+
+#ifdef NAND_ASYNC_IO
+    if (has_async) {
+        nand_dev_async_init(s);
+    }
+#endif
 
     register_savevm(NULL,
                     "nand_dev",
@@ -713,7 +1817,10 @@ void nand_add_dev(const char *arg)
     char *devname = NULL;
     size_t devname_len = 0;
     char *rwfilename = NULL;
+    char *initfilename = NULL;
     int read_only = 0;
+    int incremental = 0;
+    int async = 0;
     int pad;
     uint32_t page_size = 2048;
     uint32_t extra_size = 64;
@@ -755,6 +1862,12 @@ void nand_add_dev(const char *arg)
             if(arg_match("readonly", arg, arg_len)) {
                 read_only = 1;
             }
+            else if(arg_match("incremental", arg, arg_len)) {
+                incremental = 1;
+            }
+            else if(arg_match("async", arg, arg_len)) {
+                async = 1;
+            }
             else {
                 XLOG("bad arg: %.*s\n", arg_len, arg);
                 exit(1);
@@ -794,6 +1907,14 @@ void nand_add_dev(const char *arg)
                 // Restore unusual characters that confuse parsing
                 path_unescape_path(rwfilename);
             }
+            else if(arg_match("initfile", arg, arg_len)) {
+                initfilename = malloc(value_len + 1);
+                if(initfilename == NULL)
+                    goto out_of_memory;
+                memcpy(initfilename, value, value_len);
+                initfilename[value_len] = '\0';
+                path_unescape_path(initfilename);
+            }
             else {
                 goto bad_arg_and_value;
             }
@@ -812,6 +1933,12 @@ void nand_add_dev(const char *arg)
         exit(1);
     }
 
+    if (initfilename && read_only) {
+        XLOG("Read-only %.*s NAND disk can't have an initial image!\n",
+             devname_len, devname);
+        exit(1);
+    }
+
     new_devs = realloc(nand_devs, sizeof(nand_devs[0]) * (nand_dev_count + 1));
     if(new_devs == NULL)
         goto out_of_memory;
@@ -839,6 +1966,16 @@ void nand_add_dev(const char *arg)
 #ifdef TARGET_I386
     dev->flags |= NAND_DEV_FLAG_BATCH_CAP;
 #endif
+    /* The I/O thread doesn't know about overlays. */
+    if (initfilename) {
+        async = 0;
+    }
+#ifdef NAND_ASYNC_IO
+    if (async) {
+        dev->flags |= NAND_DEV_FLAG_ASYNC_CAP;
+    }
+#endif
+    dev->async = async;
 
     dev->fd = open(rwfilename, O_BINARY | (read_only ? O_RDONLY : O_RDWR));
     if(dev->fd < 0) {
@@ -851,6 +1988,31 @@ void nand_add_dev(const char *arg)
     if (!read_only)
         atexit_close_fd(dev->fd);
 
+    /* read-only images never change, so their snapshots can't either */
+    dev->incremental = incremental && !read_only;
+    dev->snapshot_base = 0;
+    dev->block_count = dev->max_size / dev->erase_size;
+    dev->dirty_blocks = dev->incremental ? bitmap_new(dev->block_count) : NULL;
+    dev->cow_fd = -1;
+    dev->base_file = NULL;
+    dev->base_file_valid = 0;
+    if (dev->incremental) {
+        dev->base_file = g_strdup_printf("%s.snapshot-base", rwfilename);
+        dev->base_file_valid = path_exists(dev->base_file);
+    }
+
+    dev->overlay = NULL;
+    if (initfilename) {
+        dev->overlay = android_nand_overlay_new(initfilename, dev->erase_size,
+                                                dev->block_count);
+        if (!dev->overlay) {
+            XLOG("could not open initial image %s, %s\n", initfilename,
+                 strerror(errno));
+            exit(1);
+        }
+        free(initfilename);
+    }
+
     nand_dev_count++;
 
     return;
@@ -44,7 +44,19 @@ struct batch_data_64 {
 
 enum nand_dev_flags {
     NAND_DEV_FLAG_READ_ONLY = 0x00000001,
-    NAND_DEV_FLAG_BATCH_CAP = 0x00000002
+    NAND_DEV_FLAG_BATCH_CAP = 0x00000002,
+    NAND_DEV_FLAG_ASYNC_CAP = 0x00000004  // Supports NAND_ASYNC_ENABLE.
+};
+
+// Bits of NAND_STATUS. When NAND_ASYNC_ENABLE is set, read/write/erase
+// commands on a device with NAND_DEV_FLAG_ASYNC_CAP return immediately
+// with NAND_STATUS_BUSY set. Once the transfer completes, BUSY is cleared,
+// DONE is set and the device interrupt is raised. Reading NAND_RESULT, or
+// writing DONE to NAND_STATUS, clears DONE and lowers the interrupt.
+// Commands issued while BUSY are ignored.
+enum nand_status {
+    NAND_STATUS_BUSY = 0x00000001,
+    NAND_STATUS_DONE = 0x00000002
 };
 
 #define NAND_VERSION_CURRENT (1)
@@ -74,6 +86,10 @@ enum nand_reg {
     NAND_BATCH_ADDR_LOW = 0x058,
     NAND_BATCH_ADDR_HIGH= 0x05c,
 
+    // Asynchronous commands
+    NAND_STATUS         = 0x060,
+    NAND_ASYNC_ENABLE   = 0x064,
+
     NAND_DATA_HIGH      = 0x100,  // For 64-bit guest CPUs.
 };
 
@@ -55,7 +55,7 @@
 /* Set to 1 to enable the 'throttle' pipe type, useful for debugging */
 #define DEBUG_THROTTLE_PIPE 1
 
-#define GOLDFISH_PIPE_SAVE_VERSION  4
+#define GOLDFISH_PIPE_SAVE_VERSION  5
 #define GOLDFISH_PIPE_SAVE_LEGACY_VERSION  3
 
 /***********************************************************************
@@ -77,7 +77,7 @@ typedef struct PipeDevice  PipeDevice;
 // An HwPipe instance models the virtual hardware view of a given
 // Android pipe.
 typedef struct HwPipe {
-    struct HwPipe* next;
+    struct HwPipe* next;            /* next pipe in the same hash bucket */
     struct HwPipe* next_waked;
     uint64_t channel;
     unsigned char wakes;
@@ -105,8 +105,19 @@ static void hwpipe_free(HwPipe* hwp) {
     free(hwp);
 }
 
-static HwPipe** hwpipe_findp_by_channel(HwPipe** list, uint64_t channel) {
-    HwPipe** pnode = list;
+/* Pipes are indexed by channel in a hash table of PIPE_HASH_SIZE buckets,
+ * the guest can have hundreds of them opened at once. */
+#define PIPE_HASH_BITS  8
+#define PIPE_HASH_SIZE  (1 << PIPE_HASH_BITS)
+
+static unsigned hwpipe_hash(uint64_t channel) {
+    /* Channels are guest kernel pointers, mix their upper bits down. */
+    return (unsigned)((channel * 0x9E3779B97F4A7C15ULL) >>
+                      (64 - PIPE_HASH_BITS));
+}
+
+static HwPipe** hwpipe_findp_by_channel(HwPipe** table, uint64_t channel) {
+    HwPipe** pnode = &table[hwpipe_hash(channel)];
     for (;;) {
         HwPipe* node = *pnode;
         if (!node) {
@@ -180,8 +191,8 @@ static HwPipe* hwpipe_load(PipeDevice* dev, Stream* file, int version_id) {
 struct PipeDevice {
     struct goldfish_device dev;
 
-    /* the list of all pipes */
-    HwPipe*  pipes;
+    /* all pipes, indexed by channel */
+    HwPipe*  pipes[PIPE_HASH_SIZE];
 
     /* the list of signalled pipes */
     HwPipe*  signaled_pipes;
@@ -193,8 +204,20 @@ struct PipeDevice {
     uint64_t  channel;
     uint32_t  wakes;
     uint64_t  params_addr;
+    uint64_t  batch_addr;
 };
 
+static void hwpipe_insert(PipeDevice* dev, HwPipe* pipe) {
+    HwPipe** bucket = &dev->pipes[hwpipe_hash(pipe->channel)];
+    pipe->next = *bucket;
+    *bucket = pipe;
+}
+
+/* Iterate over all pipes of |dev|. */
+#define HWPIPE_FOREACH(pipe, dev, bucket) \
+    for ((bucket) = 0; (bucket) < PIPE_HASH_SIZE; (bucket)++) \
+        for ((pipe) = (dev)->pipes[(bucket)]; (pipe); (pipe) = (pipe)->next)
+
 /* Update this version number if the device's interface changes. */
 #define PIPE_DEVICE_VERSION  1
 
@@ -260,7 +283,7 @@ static void *map_guest_buffer(target_ulong xaddr, size_t size, int is_write)
 static void
 pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
 {
-    HwPipe** lookup = hwpipe_findp_by_channel(&dev->pipes, dev->channel);
+    HwPipe** lookup = hwpipe_findp_by_channel(dev->pipes, dev->channel);
     HwPipe*  pipe = *lookup;
 
     /* Check that we're referring a known pipe channel */
@@ -283,8 +306,7 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
             break;
         }
         pipe = hwpipe_new(dev->channel, dev);
-        pipe->next = dev->pipes;
-        dev->pipes = pipe;
+        hwpipe_insert(dev, pipe);
         dev->status = 0;
         break;
 
@@ -295,6 +317,7 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
         pipe->next = NULL;
         hwpipe_remove_signaled(&dev->signaled_pipes, pipe);
         hwpipe_free(pipe);
+        dev->status = 0;
         break;
 
     case PIPE_CMD_POLL:
@@ -368,6 +391,55 @@ pipeDevice_doCommand( PipeDevice* dev, uint32_t command )
     }
 }
 
+/* Returns true if a batch can go on after an entry that ran |command|
+ * with a |size| bytes buffer and returned |status|. */
+static bool
+pipeDevice_batchCanContinue( uint32_t command, uint32_t size, int32_t status )
+{
+    if (command == PIPE_CMD_READ_BUFFER || command == PIPE_CMD_WRITE_BUFFER) {
+        return status >= 0 && (uint32_t)status == size;
+    }
+    return status >= 0;
+}
+
+/* Run the |count| commands of the batch at dev->batch_addr, see the
+ * description of struct pipe_batch_entry. */
+static void
+pipeDevice_doBatch( PipeDevice* dev, uint32_t count )
+{
+    struct pipe_batch_entry entry;
+    hwaddr addr = dev->batch_addr;
+    uint32_t n;
+
+    if (addr == 0 || count > PIPE_BATCH_MAX_ENTRIES) {
+        dev->status = PIPE_ERROR_INVAL;
+        return;
+    }
+
+    for (n = 0; n < count; ) {
+        cpu_physical_memory_read(addr, (void*)&entry, sizeof(entry));
+        dev->channel = entry.channel;
+        dev->address = entry.address;
+        dev->size = entry.size;
+        dev->status = PIPE_ERROR_INVAL;
+        pipeDevice_doCommand(dev, entry.cmd);
+
+        entry.result = (int32_t)dev->status;
+        cpu_physical_memory_write(
+                addr + offsetof(struct pipe_batch_entry, result),
+                (void*)&entry.result, sizeof(entry.result));
+        n++;
+        addr += sizeof(entry);
+
+        if (!pipeDevice_batchCanContinue(entry.cmd, entry.size,
+                                         entry.result)) {
+            break;
+        }
+    }
+    DD("%s: ran %u of %u entries", __FUNCTION__, n, count);
+    dev->status = n;
+}
+
 static void pipe_dev_write(void *opaque, hwaddr offset, uint32_t value)
 {
     PipeDevice *s = (PipeDevice *)opaque;
@@ -412,6 +484,19 @@ static void pipe_dev_write(void *opaque, hwaddr offset, uint32_t value)
         s->params_addr = (s->params_addr & ~(0xFFFFFFFFULL) ) | value;
         break;
 
+    case PIPE_REG_BATCH_ADDR_HIGH:
+        uint64_set_high(&s->batch_addr, value);
+        break;
+
+    case PIPE_REG_BATCH_ADDR_LOW:
+        uint64_set_low(&s->batch_addr, value);
+        break;
+
+    case PIPE_REG_BATCH_COMMAND:
+        DR("%s: batch of %d commands", __FUNCTION__, value);
+        pipeDevice_doBatch(s, value);
+        break;
+
     case PIPE_REG_ACCESS_PARAMS:
     {
         struct access_params aps;
@@ -513,10 +598,19 @@ static uint32_t pipe_dev_read(void *opaque, hwaddr offset)
     case PIPE_REG_PARAMS_ADDR_LOW:
         return (uint32_t)(dev->params_addr & 0xFFFFFFFFUL);
 
+    case PIPE_REG_BATCH_ADDR_HIGH:
+        return (uint32_t)(dev->batch_addr >> 32);
+
+    case PIPE_REG_BATCH_ADDR_LOW:
+        return (uint32_t)(dev->batch_addr & 0xFFFFFFFFUL);
+
     case PIPE_REG_VERSION:
         deviceMode = USE_PA;
         return PIPE_DEVICE_VERSION;
 
+    case PIPE_REG_FEATURES:
+        return PIPE_FEATURE_BATCH;
+
     default:
         D("%s: offset=%lld (0x%llx)\n", __FUNCTION__, (long long)offset,
           (long long)offset);
@@ -549,17 +643,19 @@ goldfish_pipe_save( QEMUFile* file, void* opaque )
     stream_put_be64(stream, dev->channel);
     stream_put_be32(stream, dev->wakes);
     stream_put_be64(stream, dev->params_addr);
+    stream_put_be64(stream, dev->batch_addr);
 
     /* Count the number of pipe connections */
     HwPipe* pipe;
+    int bucket;
     int count = 0;
-    for (pipe = dev->pipes; pipe; pipe = pipe->next) {
+    HWPIPE_FOREACH(pipe, dev, bucket) {
         count++;
     }
     stream_put_be32(stream, count);
 
     /* Now save each pipe one after the other */
-    for (pipe = dev->pipes; pipe; pipe = pipe->next) {
+    HWPIPE_FOREACH(pipe, dev, bucket) {
         hwpipe_save(pipe, stream);
     }
     stream_free(stream);
@@ -571,6 +667,7 @@ goldfish_pipe_load( QEMUFile* file, void* opaque, int version_id )
     PipeDevice* dev = opaque;
 
     if ((version_id != GOLDFISH_PIPE_SAVE_VERSION) &&
+        (version_id != GOLDFISH_PIPE_SAVE_VERSION - 1) &&
         (version_id != GOLDFISH_PIPE_SAVE_LEGACY_VERSION)) {
         return -EINVAL;
     }
@@ -584,9 +681,14 @@ goldfish_pipe_load( QEMUFile* file, void* opaque, int version_id )
 
     dev->wakes = stream_get_be32(stream);
     dev->params_addr = stream_get_be64(stream);
+    dev->batch_addr = 0;
+    if (version_id >= 5) {
+        dev->batch_addr = stream_get_be64(stream);
+    }
 
     /* Count the number of pipe connections */
     HwPipe* pipe;
+    int bucket;
     int count = stream_get_be32(stream);
 
     /* Load all pipe connections */
@@ -596,12 +698,11 @@ goldfish_pipe_load( QEMUFile* file, void* opaque, int version_id )
             stream_free(stream);
             return -EIO;
         }
-        pipe->next = dev->pipes;
-        dev->pipes = pipe;
+        hwpipe_insert(dev, pipe);
     }
 
     /* Now we need to wake/close all relevant pipes */
-    for (pipe = dev->pipes; pipe; pipe = pipe->next) {
+    HWPIPE_FOREACH(pipe, dev, bucket) {
         if (pipe->wakes != 0) {
             android_pipe_wake(pipe, pipe->wakes);
         }
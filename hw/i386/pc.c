@@ -1041,8 +1041,7 @@ static void pc_init1(ram_addr_t ram_size,
     goldfish_battery_init(android_hw->hw_battery);
 
 #ifdef CONFIG_ANDROID
-    goldfish_add_device_no_io(&nand_device);
-    nand_dev_init(nand_device.base);
+    nand_dev_init(&nand_device);
 #endif
     bool newDeviceNaming =
             (androidHwConfig_getKernelDeviceNaming(android_hw) >= 1);
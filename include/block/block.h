@@ -14,6 +14,11 @@ typedef struct BlockDriverInfo {
     int cluster_size;
     /* offset at which the VM state can be saved (0 if not possible) */
     int64_t vm_state_offset;
+    /* metadata cache lookups, 0 if the format has no such caches */
+    uint64_t l2_cache_hits;
+    uint64_t l2_cache_misses;
+    uint64_t refcount_cache_hits;
+    uint64_t refcount_cache_misses;
 } BlockDriverInfo;
 
 typedef struct QEMUSnapshotInfo {
@@ -163,6 +168,9 @@ void bdrv_set_geometry_hint(BlockDriverState *bs,
                             int cyls, int heads, int secs);
 void bdrv_set_type_hint(BlockDriverState *bs, int type);
 void bdrv_set_translation_hint(BlockDriverState *bs, int translation);
+void bdrv_set_metadata_cache_hint(BlockDriverState *bs,
+                                  int64_t l2_cache_size,
+                                  int64_t refcount_cache_size);
 void bdrv_get_geometry_hint(BlockDriverState *bs,
                             int *pcyls, int *pheads, int *psecs);
 int bdrv_get_type_hint(BlockDriverState *bs);
@@ -225,6 +233,13 @@ int bdrv_save_vmstate(BlockDriverState *bs, const uint8_t *buf,
 int bdrv_load_vmstate(BlockDriverState *bs, uint8_t *buf,
                       int64_t pos, int size);
 
+/* Find where the VM state bytes at |pos| are stored in the image file.
+ * Returns their offset in the file opened by bdrv_open_vmstate_file(),
+ * and sets *pnum to the number of bytes stored contiguously from there,
+ * or returns -errno. */
+int64_t bdrv_map_vmstate(BlockDriverState *bs, int64_t pos, int64_t *pnum);
+int bdrv_open_vmstate_file(BlockDriverState *bs);
+
 #define BDRV_SECTORS_PER_DIRTY_CHUNK 2048
 
 void bdrv_set_dirty_tracking(BlockDriverState *bs, int enable);
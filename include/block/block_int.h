@@ -99,6 +99,8 @@ struct BlockDriver {
                              int64_t pos, int size);
     int (*bdrv_load_vmstate)(BlockDriverState *bs, uint8_t *buf,
                              int64_t pos, int size);
+    int64_t (*bdrv_map_vmstate)(BlockDriverState *bs, int64_t pos,
+                                int64_t *pnum);
 
     int (*bdrv_change_backing_file)(BlockDriverState *bs,
         const char *backing_file, const char *backing_fmt);
@@ -188,6 +190,11 @@ struct BlockDriverState {
     /* do we need to tell the quest if we have a volatile write cache? */
     int enable_write_cache;
 
+    /* sizes in bytes of the format driver's metadata caches, 0 to use the
+       driver's defaults. Must be set before bdrv_open() */
+    int64_t l2_cache_size_hint;
+    int64_t refcount_cache_size_hint;
+
     /* NOTE: the following infos are only hints for real hardware
        drivers. They are not used by the block driver */
     int cyls, heads, secs, translation;
@@ -512,6 +512,9 @@ void cpu_tlb_update_dirty(CPUArchState *env);
 
 void dump_exec_info(FILE *f,
                     int (*cpu_fprintf)(FILE *f, const char *fmt, ...));
+void dump_tb_hot_blocks(FILE *f,
+                        int (*cpu_fprintf)(FILE *f, const char *fmt, ...),
+                        int count);
 
 /* Coalesced MMIO regions are areas where write operations can be reordered.
  * This usually implies that write operations are side-effect free.  This allows
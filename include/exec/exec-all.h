@@ -105,6 +105,8 @@ void tlb_flush(CPUArchState *env, int flush_global);
 void tlb_set_page(CPUArchState *env, target_ulong vaddr,
                   hwaddr paddr, int prot,
                   int mmu_idx, target_ulong size);
+bool tlb_victim_hit(CPUArchState *env, int mmu_idx, int index,
+                    size_t elt_ofs, target_ulong addr);
 void tb_invalidate_phys_addr(hwaddr addr);
 #else
 static inline void tlb_flush_page(CPUArchState *env, target_ulong addr)
@@ -141,6 +143,10 @@ int io_mem_watch;
 #define CODE_GEN_AVG_BLOCK_SIZE 64
 #endif
 
+/* maximum number of regions the code buffer is split into, see
+   tb_evict_region() */
+#define CODE_GEN_MAX_REGIONS 8
+
 #if defined(__arm__) || defined(_ARCH_PPC) \
     || defined(__x86_64__) || defined(__i386__) \
     || defined(__sparc__) || defined(__aarch64__) \
@@ -181,23 +187,47 @@ struct TranslationBlock {
     struct TranslationBlock *jmp_next[2];
     struct TranslationBlock *jmp_first;
     uint32_t icount;
+    /* number of executions, only counted when tb_exec_profiling is set */
+    uint64_t exec_count;
+    /* set once tb_phys_invalidate() unlinked the TB */
+    int invalid;
 };
 
 #include "exec/spinlock.h"
 
 typedef struct TBContext TBContext;
 
+/* A slice of the code buffer, and the slice of tbs[] for the blocks that
+   were generated in it. */
+typedef struct TBRegion {
+    uint8_t *code_start;
+    uint8_t *code_end;  /* no block may start past this */
+    uint8_t *code_ptr;  /* end of the generated code, unless current */
+    int first_tb;
+    int nb_tbs;
+} TBRegion;
+
 struct TBContext {
 
     TranslationBlock *tbs;
     TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
-    int nb_tbs;
+    int nb_tbs;         /* in all the regions */
+    TBRegion regions[CODE_GEN_MAX_REGIONS];
+    int nb_regions;
+    int cur_region;
+    int tbs_per_region;
     /* any access to the tbs or the page table must use this lock */
     spinlock_t tb_lock;
 
     /* statistics */
     int tb_flush_count;
+    int tb_evict_count;         /* regions evicted because the buffer was full */
     int tb_phys_invalidate_count;
+    uint64_t tb_find_count;     /* tb_find_fast() lookups */
+    uint64_t tb_find_slow_count; /* lookups that missed the jump cache */
+    uint64_t tb_find_miss_count; /* slow lookups that had to translate */
+    uint64_t tb_gen_count;      /* translations, including retranslations */
+    int64_t tb_gen_time;        /* time spent in tb_gen_code(), in ns */
 
     int tb_invalidated_flag;
 };
@@ -224,6 +254,10 @@ static inline unsigned int tb_phys_hash_func(tb_page_addr_t pc)
 
 void tb_free(TranslationBlock *tb);
 void tb_flush(CPUArchState *env);
+/* Toggling this changes the code generated for every TB, so it must only
+   be done through tb_set_exec_profiling(), which flushes the TB cache. */
+extern int tb_exec_profiling;
+void tb_set_exec_profiling(int enable);
 void tb_link_phys(TranslationBlock *tb,
                   target_ulong phys_pc, target_ulong phys_page2);
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
@@ -48,6 +48,26 @@ static void gen_icount_end(TranslationBlock *tb, int num_insns)
     }
 }
 
+/* Count the executions of |tb| for dump_tb_hot_blocks(). This must be
+   generated right after gen_icount_start(), so that blocks exited early
+   because of a pending exit request are not counted. */
+static inline void gen_tb_exec_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr;
+    TCGv_i64 count;
+
+    if (!tb_exec_profiling)
+        return;
+
+    ptr = tcg_const_ptr(&tb->exec_count);
+    count = tcg_temp_new_i64();
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
 static inline void gen_io_start(void)
 {
     TCGv_i32 tmp = tcg_const_i32(1);
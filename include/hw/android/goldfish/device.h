@@ -60,7 +60,7 @@ void goldfish_battery_display(void *data,
 // these do not add a device
 void trace_dev_init();
 void events_dev_init(uint32_t base, qemu_irq irq);
-void nand_dev_init(uint32_t base);
+void nand_dev_init(struct goldfish_device *dev);
 
 #ifdef TARGET_I386
 /* Maximum IRQ number available for a device on x86. */
@@ -12,7 +12,9 @@
 #ifndef NAND_DEVICE_H
 #define NAND_DEVICE_H
 
-void nand_dev_init(uint32_t base);
+struct goldfish_device;
+
+void nand_dev_init(struct goldfish_device *dev);
 void nand_add_dev(const char *arg);
 void nand_parse_limits(const char* limits);
 
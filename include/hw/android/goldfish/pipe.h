@@ -38,6 +38,15 @@
 #define PIPE_REG_VERSION             0x24 /* read: device version */
 #define PIPE_REG_CHANNEL_HIGH        0x30 /* read/write: high 32 bit channel id */
 #define PIPE_REG_ADDRESS_HIGH        0x34 /* write: high 32 bit physical address */
+/* read/write: address of a batch of commands, see struct pipe_batch_entry */
+#define PIPE_REG_BATCH_ADDR_LOW      0x38
+#define PIPE_REG_BATCH_ADDR_HIGH     0x3c
+/* write: run the batch, value = number of entries */
+#define PIPE_REG_BATCH_COMMAND       0x40
+#define PIPE_REG_FEATURES            0x44 /* read: PIPE_FEATURE_XXX flags */
+
+/* PIPE_REG_FEATURES flags. Older devices return 0 for this register. */
+#define PIPE_FEATURE_BATCH           (1 << 0)  /* PIPE_REG_BATCH_XXX */
 
 /* list of commands for PIPE_REG_COMMAND */
 #define PIPE_CMD_OPEN               1  /* open new channel */
@@ -78,6 +87,27 @@ struct access_params_64 {
     uint32_t flags;
 };
 
+/* A batch is an array of these entries in guest physical memory. The
+ * commands are run in order, and each entry's |result| is set to what
+ * PIPE_REG_STATUS would have returned for it. The batch stops early at
+ * the first read or write that doesn't transfer its whole buffer, or at
+ * the first other command that fails, so that later buffers of the same
+ * pipe are never sent out of order. PIPE_REG_STATUS then returns the
+ * number of entries that were run, and the others are left untouched.
+ */
+struct pipe_batch_entry {
+    uint64_t channel;
+    uint64_t address;
+    uint32_t size;
+    uint32_t cmd;
+    int32_t  result;
+    /* reserved for future extension */
+    uint32_t flags;
+};
+
+/* Maximum number of entries in a batch */
+#define PIPE_BATCH_MAX_ENTRIES  256
+
 // Register 'zero' pipe service.
 extern void android_pipe_add_type_zero(void);
 extern void android_pipe_add_type_pingpong(void);
@@ -109,4 +109,17 @@ uint64_t ram_bytes_total(void);
 int ram_save_live(QEMUFile *f, int stage, void *opaque);
 int ram_load(QEMUFile *f, void *opaque, int version_id);
 
+/* Deflate the RAM pages saved from now on. Loading always supports it. */
+void ram_set_compression(int enable);
+
+/* Save the RAM pages in a layout that can be loaded lazily, and load them
+ * lazily from the snapshots that use it. */
+void ram_set_lazy_load(int enable);
+/* Called around qemu_loadvm_state() when loading a snapshot from |bs|. */
+void ram_lazy_load_begin(BlockDriverState *bs);
+void ram_lazy_load_end(int success);
+/* Read all the pages that are still to be loaded lazily. This must be done
+ * before the snapshot they come from can be modified or deleted. */
+void ram_lazy_load_finish(void);
+
 #endif
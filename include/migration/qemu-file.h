@@ -142,6 +142,10 @@ void qemu_put_be32(QEMUFile *f, unsigned int v);
 void qemu_put_be64(QEMUFile *f, uint64_t v);
 int qemu_get_buffer(QEMUFile *f, uint8_t *buf, int size);
 int qemu_get_byte(QEMUFile *f);
+/* Position of the next byte to read, and skip |size| bytes without
+ * reading them when they aren't buffered yet. */
+int64_t qemu_get_pos(QEMUFile *f);
+void qemu_get_skip(QEMUFile *f, int64_t size);
 #ifdef CONFIG_ANDROID
 void qemu_put_float(QEMUFile *f, float v);
 #endif
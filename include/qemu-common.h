@@ -273,8 +273,21 @@ typedef void IOReadHandler(void *opaque, const uint8_t *buf, int size);
 typedef int IOCanReadHandler(void *opaque);
 typedef void IOHandler(void *opaque);
 
-void qemu_iohandler_fill(int *pnfds, fd_set *readfds, fd_set *writefds, fd_set *xfds);
-void qemu_iohandler_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds, int rc);
+void qemu_iohandler_fill(void);
+void qemu_iohandler_poll(int rc);
+
+/* File descriptors polled by main_loop_wait(). These must be registered
+ * again before each wait with main_loop_poll_fd(), but the host only sees
+ * the changes between two iterations. Call main_loop_poll_forget() before
+ * closing a registered descriptor. */
+#define MAIN_LOOP_POLL_READ    (1 << 0)
+#define MAIN_LOOP_POLL_WRITE   (1 << 1)
+#define MAIN_LOOP_POLL_URGENT  (1 << 2)
+
+void main_loop_poll_fd(int fd, int events);
+void main_loop_poll_forget(int fd);
+/* Return the MAIN_LOOP_POLL_XXX events of |fd| after the last wait. */
+int main_loop_poll_result(int fd);
 
 struct ParallelIOArg {
     void *buffer;
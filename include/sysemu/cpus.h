@@ -34,4 +34,13 @@ void pause_all_vcpus(void);
 int qemu_init_main_loop(void);
 void main_loop(void);
 
+/* Run the virtual CPUs on a dedicated thread from now on, see cpus.c.
+ * Must be called from the main loop thread. */
+void qemu_start_vcpu_thread(void);
+bool qemu_vcpu_thread_enabled(void);
+
+/* Wake up the main loop thread from its I/O wait. Can be called from
+ * any thread, or from a signal handler. */
+void qemu_main_loop_wakeup(void);
+
 #endif /* QEMU_CPUS_H */
@@ -25,6 +25,7 @@
 #include "config-host.h"
 #include "qemu-common.h"
 #include "sysemu/char.h"
+#include "sysemu/cpus.h"
 #include "qemu/queue.h"
 
 #ifndef _WIN32
@@ -59,6 +60,8 @@ int qemu_set_fd_handler2(int fd,
         QLIST_FOREACH(ioh, &io_handlers, next) {
             if (ioh->fd == fd) {
                 ioh->deleted = 1;
+                /* The caller is likely to close |fd| right after this. */
+                main_loop_poll_forget(fd);
                 break;
             }
         }
@@ -77,6 +80,11 @@ int qemu_set_fd_handler2(int fd,
         ioh->opaque = opaque;
         ioh->deleted = 0;
     }
+    /* With -vcpu-thread, device code runs on another thread while the main
+     * loop may be waiting on the previous set of file descriptors. */
+    if (qemu_vcpu_thread_enabled()) {
+        qemu_main_loop_wakeup();
+    }
     return 0;
 }
 
@@ -88,38 +96,41 @@ int qemu_set_fd_handler(int fd,
     return qemu_set_fd_handler2(fd, NULL, fd_read, fd_write, opaque);
 }
 
-void qemu_iohandler_fill(int *pnfds, fd_set *readfds, fd_set *writefds, fd_set *xfds)
+void qemu_iohandler_fill(void)
 {
     IOHandlerRecord *ioh;
 
     QLIST_FOREACH(ioh, &io_handlers, next) {
+        int events = 0;
+
         if (ioh->deleted)
             continue;
         if (ioh->fd_read &&
             (!ioh->fd_read_poll ||
              ioh->fd_read_poll(ioh->opaque) != 0)) {
-            FD_SET(ioh->fd, readfds);
-            if (ioh->fd > *pnfds)
-                *pnfds = ioh->fd;
+            events |= MAIN_LOOP_POLL_READ;
         }
         if (ioh->fd_write) {
-            FD_SET(ioh->fd, writefds);
-            if (ioh->fd > *pnfds)
-                *pnfds = ioh->fd;
+            events |= MAIN_LOOP_POLL_WRITE;
         }
+        main_loop_poll_fd(ioh->fd, events);
     }
 }
 
-void qemu_iohandler_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds, int ret)
+void qemu_iohandler_poll(int ret)
 {
     if (ret > 0) {
         IOHandlerRecord *pioh, *ioh;
 
         QLIST_FOREACH_SAFE(ioh, &io_handlers, next, pioh) {
-            if (!ioh->deleted && ioh->fd_read && FD_ISSET(ioh->fd, readfds)) {
+            int events = ioh->deleted ? 0 : main_loop_poll_result(ioh->fd);
+
+            if (!ioh->deleted && ioh->fd_read &&
+                (events & MAIN_LOOP_POLL_READ)) {
                 ioh->fd_read(ioh->opaque);
             }
-            if (!ioh->deleted && ioh->fd_write && FD_ISSET(ioh->fd, writefds)) {
+            if (!ioh->deleted && ioh->fd_write &&
+                (events & MAIN_LOOP_POLL_WRITE)) {
                 ioh->fd_write(ioh->opaque);
             }
 
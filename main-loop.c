@@ -25,6 +25,7 @@
 #include "android-qemu1-glue/emulation/charpipe.h"
 #include "android/log-rotate.h"
 #include "android/snaphost-android.h"
+#include "android/utils/iolooper.h"
 #include "block/aio.h"
 #include "exec/hax.h"
 #include "hw/hw.h"
@@ -100,6 +101,20 @@ fail:
     close(fds[1]);
     return err;
 }
+
+void qemu_main_loop_wakeup(void)
+{
+    static const char byte = 0;
+    ssize_t ret;
+
+    if (io_thread_fd < 0) {
+        return;
+    }
+    /* A full pipe already has a pending wakeup. */
+    do {
+        ret = write(io_thread_fd, &byte, sizeof(byte));
+    } while (ret < 0 && errno == EINTR);
+}
 #else
 HANDLE qemu_event_handle;
 
@@ -117,6 +132,13 @@ static int qemu_main_loop_event_init(void)
     qemu_add_wait_object(qemu_event_handle, dummy_event_handler, NULL);
     return 0;
 }
+
+void qemu_main_loop_wakeup(void)
+{
+    if (qemu_event_handle) {
+        SetEvent(qemu_event_handle);
+    }
+}
 #endif
 
 int qemu_init_main_loop(void)
@@ -257,44 +279,251 @@ void os_host_main_loop_wait(int *timeout)
 
 #endif  // _WIN32
 
+/***********************************************************/
+/* File descriptor polling */
+
+/* Result of the last wait. */
+static int poll_ret;
+
+#ifndef _WIN32
+
+/* The descriptors are kept registered in an IoLooper between iterations,
+ * which uses epoll() on Linux. |poll_wanted| holds the events requested
+ * for each descriptor during the current iteration, and |poll_fds| the
+ * list of these descriptors, which is compared with the previous one to
+ * unregister the descriptors that are no longer polled. */
+static IoLooper* poll_looper;
+static uint8_t* poll_wanted;
+static int poll_wanted_size;
+
+typedef struct {
+    int* fds;
+    int count;
+    int capacity;
+} PollFdList;
+
+static PollFdList poll_lists[2];
+static PollFdList* poll_fds = &poll_lists[0];
+static PollFdList* poll_prev_fds = &poll_lists[1];
+
+static void poll_fd_list_add(PollFdList* list, int fd)
+{
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->fds = g_realloc(list->fds, list->capacity * sizeof(int));
+    }
+    list->fds[list->count++] = fd;
+}
+
+void main_loop_poll_fd(int fd, int events)
+{
+    if (fd < 0 || events == 0) {
+        return;
+    }
+    if (fd >= poll_wanted_size) {
+        int new_size = poll_wanted_size ? poll_wanted_size : 64;
+        while (new_size <= fd) {
+            new_size *= 2;
+        }
+        poll_wanted = g_realloc(poll_wanted, new_size);
+        memset(poll_wanted + poll_wanted_size, 0, new_size - poll_wanted_size);
+        poll_wanted_size = new_size;
+    }
+    if (poll_wanted[fd] == 0) {
+        poll_fd_list_add(poll_fds, fd);
+    }
+    poll_wanted[fd] |= events;
+}
+
+void main_loop_poll_forget(int fd)
+{
+    if (fd < 0 || !poll_looper) {
+        return;
+    }
+    iolooper_modify(poll_looper, fd, 0, 0);
+    if (fd < poll_wanted_size) {
+        poll_wanted[fd] = 0;
+    }
+}
+
+int main_loop_poll_result(int fd)
+{
+    int events = 0;
+
+    if (poll_ret <= 0 || fd < 0) {
+        return 0;
+    }
+    if (iolooper_is_read(poll_looper, fd)) {
+        events |= MAIN_LOOP_POLL_READ;
+    }
+    if (iolooper_is_write(poll_looper, fd)) {
+        events |= MAIN_LOOP_POLL_WRITE;
+    }
+    if (iolooper_is_urgent(poll_looper, fd)) {
+        events |= MAIN_LOOP_POLL_URGENT;
+    }
+    return events;
+}
+
+/* Start a new iteration, descriptors must be registered again. */
+static void main_loop_poll_begin(void)
+{
+    PollFdList* list;
+    int n;
+
+    if (!poll_looper) {
+        poll_looper = iolooper_new_persistent();
+    }
+    for (n = 0; n < poll_fds->count; n++) {
+        poll_wanted[poll_fds->fds[n]] = 0;
+    }
+    list = poll_prev_fds;
+    poll_prev_fds = poll_fds;
+    poll_fds = list;
+    poll_fds->count = 0;
+}
+
+static int to_iolooper_flags(int events)
+{
+    int flags = 0;
+
+    if (events & MAIN_LOOP_POLL_READ) {
+        flags |= IOLOOPER_READ;
+    }
+    if (events & MAIN_LOOP_POLL_WRITE) {
+        flags |= IOLOOPER_WRITE;
+    }
+    if (events & MAIN_LOOP_POLL_URGENT) {
+        flags |= IOLOOPER_URGENT;
+    }
+    return flags;
+}
+
+static int main_loop_poll_wait(int timeout)
+{
+    int n, fd;
+
+    /* Only the changes since the previous iteration reach the kernel. */
+    for (n = 0; n < poll_fds->count; n++) {
+        fd = poll_fds->fds[n];
+        iolooper_modify(poll_looper, fd, 0, to_iolooper_flags(poll_wanted[fd]));
+    }
+    for (n = 0; n < poll_prev_fds->count; n++) {
+        fd = poll_prev_fds->fds[n];
+        if (poll_wanted[fd] == 0) {
+            iolooper_modify(poll_looper, fd, 0, 0);
+        }
+    }
+
+    if (!iolooper_has_operations(poll_looper)) {
+        usleep(timeout * 1000);
+        poll_ret = 0;
+    } else {
+        poll_ret = iolooper_wait(poll_looper, timeout);
+    }
+    return poll_ret;
+}
+
+#else  /* _WIN32 */
+
+/* Winsock's select() accepts any SOCKET value, which the IoLooper doesn't,
+ * so just rebuild fd_sets on each iteration. */
+static fd_set poll_rfds, poll_wfds, poll_xfds;
+static int poll_nfds;
+
+void main_loop_poll_fd(int fd, int events)
+{
+    if (fd < 0) {
+        return;
+    }
+    if (events & MAIN_LOOP_POLL_READ) {
+        FD_SET(fd, &poll_rfds);
+    }
+    if (events & MAIN_LOOP_POLL_WRITE) {
+        FD_SET(fd, &poll_wfds);
+    }
+    if (events & MAIN_LOOP_POLL_URGENT) {
+        FD_SET(fd, &poll_xfds);
+    }
+    if (events && fd > poll_nfds) {
+        poll_nfds = fd;
+    }
+}
+
+void main_loop_poll_forget(int fd)
+{
+    if (fd < 0) {
+        return;
+    }
+    FD_CLR(fd, &poll_rfds);
+    FD_CLR(fd, &poll_wfds);
+    FD_CLR(fd, &poll_xfds);
+}
+
+int main_loop_poll_result(int fd)
+{
+    int events = 0;
+
+    if (poll_ret <= 0 || fd < 0) {
+        return 0;
+    }
+    if (FD_ISSET(fd, &poll_rfds)) {
+        events |= MAIN_LOOP_POLL_READ;
+    }
+    if (FD_ISSET(fd, &poll_wfds)) {
+        events |= MAIN_LOOP_POLL_WRITE;
+    }
+    if (FD_ISSET(fd, &poll_xfds)) {
+        events |= MAIN_LOOP_POLL_URGENT;
+    }
+    return events;
+}
+
+static void main_loop_poll_begin(void)
+{
+    poll_nfds = -1;
+    FD_ZERO(&poll_rfds);
+    FD_ZERO(&poll_wfds);
+    FD_ZERO(&poll_xfds);
+}
+
+static int main_loop_poll_wait(int timeout)
+{
+    struct timeval tv;
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    poll_ret = select(poll_nfds + 1, &poll_rfds, &poll_wfds, &poll_xfds, &tv);
+    return poll_ret;
+}
+
+#endif  /* _WIN32 */
+
 static void qemu_run_alarm_timer(void);  // forward
 
 void main_loop_wait(int timeout)
 {
-    fd_set rfds, wfds, xfds;
-    int ret, nfds;
-    struct timeval tv;
+    int ret;
 
     qemu_bh_update_timeout(&timeout);
 
     os_host_main_loop_wait(&timeout);
 
-    tv.tv_sec = timeout / 1000;
-    tv.tv_usec = (timeout % 1000) * 1000;
-
     /* poll any events */
 
     /* XXX: separate device handlers from system ones */
-    nfds = -1;
-    FD_ZERO(&rfds);
-    FD_ZERO(&wfds);
-    FD_ZERO(&xfds);
-    qemu_iohandler_fill(&nfds, &rfds, &wfds, &xfds);
+    main_loop_poll_begin();
+    qemu_iohandler_fill();
     if (slirp_is_inited()) {
-        slirp_select_fill(&nfds, &rfds, &wfds, &xfds);
+        slirp_pollfds_fill();
     }
 
     qemu_mutex_unlock_iothread();
-    ret = select(nfds + 1, &rfds, &wfds, &xfds, &tv);
+    ret = main_loop_poll_wait(timeout);
     qemu_mutex_lock_iothread();
-    qemu_iohandler_poll(&rfds, &wfds, &xfds, ret);
+    qemu_iohandler_poll(ret);
     if (slirp_is_inited()) {
-        if (ret < 0) {
-            FD_ZERO(&rfds);
-            FD_ZERO(&wfds);
-            FD_ZERO(&xfds);
-        }
-        slirp_select_poll(&rfds, &wfds, &xfds);
+        slirp_pollfds_poll();
     }
     charpipe_poll();
 
@@ -326,7 +555,9 @@ void main_loop(void)
 #ifdef CONFIG_PROFILER
             int64_t ti;
 #endif
-            tcg_cpu_exec();
+            if (!qemu_vcpu_thread_enabled()) {
+                tcg_cpu_exec();
+            }
 #ifdef CONFIG_PROFILER
             ti = profile_getclock();
 #endif
@@ -996,7 +1227,7 @@ int qemu_calculate_timeout(void)
 
     if (!vm_running)
         timeout = 5000;
-    else if (tcg_has_work())
+    else if (!qemu_vcpu_thread_enabled() && tcg_has_work())
         timeout = 0;
     else {
 #ifdef WIN32
@@ -1101,7 +1101,7 @@ void net_slirp_smb(const char *exported_dir)
 
 void do_info_slirp(Monitor *mon)
 {
-    //slirp_stats();
+    slirp_stats();
 }
 
 struct VMChannel {
@@ -92,6 +92,7 @@ DEF("drive", HAS_ARG, QEMU_OPTION_drive,
     "-drive [file=file][,if=type][,bus=n][,unit=m][,media=d][,index=i]\n"
     "       [,cyls=c,heads=h,secs=s[,trans=t]][,snapshot=on|off]\n"
     "       [,cache=writethrough|writeback|none][,format=f][,serial=s]\n"
+    "       [,l2-cache-size=size][,refcount-cache-size=size]\n"
     "                use 'file' as a drive image\n")
 STEXI
 @item -drive @var{option}[,@var{option}[,@var{option}[,...]]]
@@ -126,6 +127,10 @@ the format.  Can be used to specifiy format=raw to avoid interpreting
 an untrusted format header.
 @item serial=@var{serial}
 This option specifies the serial number to assign to the device.
+@item l2-cache-size=@var{size},refcount-cache-size=@var{size}
+These options set the size in bytes (with an optional k, M or G suffix) of
+the qcow2 L2 table and refcount block caches. Each table takes one cluster.
+Larger caches avoid rereading metadata on random accesses to large images.
 @end table
 
 By default, writethrough caching is used for all block device.  This means that
@@ -1635,6 +1640,15 @@ DEF("tb-size", HAS_ARG, QEMU_OPTION_tb_size, \
 STEXI
 ETEXI
 
+DEF("vcpu-thread", 0, QEMU_OPTION_vcpu_thread, \
+    "-vcpu-thread    run the virtual CPUs on a thread separate from I/O (TCG only)\n")
+STEXI
+@item -vcpu-thread
+Run the emulated CPUs on a dedicated thread, while the main thread handles
+device I/O, timers and the monitor. Both threads synchronize through a
+global mutex. Ignored with KVM or HAX.
+ETEXI
+
 DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming p     prepare for incoming migration, listen on port p\n")
 STEXI
@@ -1785,6 +1799,15 @@ DEF("audio-test-out", 0, QEMU_OPTION_audio_test_out, \
 DEF("snapshot-no-time-update", 0, QEMU_OPTION_snapshot_no_time_update, \
     "-snapshot-no-time-update Disable time update when restoring snapshots\n")
 
+DEF("snapshot-compress", 0, QEMU_OPTION_snapshot_compress, \
+    "-snapshot-compress Compress RAM pages when saving snapshots\n")
+
+DEF("snapshot-lazy-ram", 0, QEMU_OPTION_snapshot_lazy_ram, \
+    "-snapshot-lazy-ram Load snapshot RAM pages on demand after loadvm\n")
+
+DEF("snapshot-incremental", 0, QEMU_OPTION_snapshot_incremental, \
+    "-snapshot-incremental Only save modified disk blocks in snapshots\n")
+
 DEF("list-webcam", 0, QEMU_OPTION_list_webcam, \
     "-list-webcam List web cameras available for emulation\n")
 
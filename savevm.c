@@ -950,6 +950,28 @@ int qemu_get_buffer(QEMUFile *f, uint8_t *buf, int size)
     return done;
 }
 
+int64_t qemu_get_pos(QEMUFile *f)
+{
+    assert(!qemu_file_is_writable(f));
+
+    return f->pos - (f->buf_size - f->buf_index);
+}
+
+void qemu_get_skip(QEMUFile *f, int64_t size)
+{
+    int pending = f->buf_size - f->buf_index;
+
+    assert(!qemu_file_is_writable(f));
+
+    if (size <= pending) {
+        f->buf_index += size;
+        return;
+    }
+    f->buf_index = 0;
+    f->buf_size = 0;
+    f->pos += size - pending;
+}
+
 static int qemu_peek_byte(QEMUFile *f, int offset)
 {
     int index = f->buf_index + offset;
@@ -2503,6 +2525,10 @@ void do_savevm(Monitor *err, const char *name)
     saved_vm_running = vm_running;
     vm_stop(0);
 
+    /* The old snapshot may be deleted below, and the new state must not
+     * be saved before it's complete. */
+    ram_lazy_load_finish();
+
     must_delete = 0;
     if (name) {
         ret = bdrv_snapshot_find(bs, old_sn, name);
@@ -2600,6 +2626,8 @@ void do_loadvm(Monitor *err, const char *name)
     saved_vm_running = vm_running;
     vm_stop(0);
 
+    ram_lazy_load_finish();
+
     bs1 = bs;
     do {
         if (bdrv_can_snapshot(bs1)) {
@@ -2647,8 +2675,10 @@ void do_loadvm(Monitor *err, const char *name)
         monitor_printf(err, "Could not open VM state file\n");
         goto the_end;
     }
+    ram_lazy_load_begin(bs);
     ret = qemu_loadvm_state(f);
     qemu_fclose(f);
+    ram_lazy_load_end(ret >= 0);
     if (ret < 0) {
         monitor_printf(err, "Error %d while loading VM state\n", ret);
     }
@@ -2668,6 +2698,8 @@ void do_delvm(Monitor *err, const char *name)
         return;
     }
 
+    ram_lazy_load_finish();
+
     bs1 = NULL;
     while ((bs1 = bdrv_next(bs1))) {
         if (bdrv_can_snapshot(bs1)) {
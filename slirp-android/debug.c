@@ -350,3 +350,23 @@ slirp_exit(exit_status)
 	exit(exit_status);
 }
 #endif
+
+static void
+mbufstats(void)
+{
+	lprint("Mbuf stats:\r\n");
+	lprint("  %6d mbufs allocated in %d slabs\r\n",
+	       mbstat.mbs_alloced, mbstat.mbs_slabs);
+	lprint("  %6d mbufs in use (%d max)\r\n",
+	       mbstat.mbs_inuse, mbstat.mbs_maxinuse);
+	lprint("  %6u mbufs handed out\r\n", mbstat.mbs_gets);
+	lprint("  %6u external buffers handed out\r\n", mbstat.mbs_ext_gets);
+	lprint("  %6u of them reused\r\n", mbstat.mbs_ext_hits);
+	lprint("  %6u of them too large to be reused\r\n", mbstat.mbs_ext_large);
+}
+
+void
+slirp_stats(void)
+{
+	mbufstats();
+}
@@ -26,10 +26,11 @@ struct mbuf;
 
 void slirp_init(int restricted, const char *special_ip);
 
-void slirp_select_fill(int *pnfds,
-                       fd_set *readfds, fd_set *writefds, fd_set *xfds);
+/* Register the descriptors of the slirp sockets with main_loop_poll_fd(). */
+void slirp_pollfds_fill(void);
 
-void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds);
+/* Handle the events reported by main_loop_poll_result() for the sockets. */
+void slirp_pollfds_poll(void);
 
 void slirp_input(const uint8_t *pkt, int pkt_len);
 
@@ -17,10 +17,8 @@
 
 #include <slirp.h>
 
-int mbuf_alloced = 0;
+struct mbstat mbstat;
 struct mbuf m_freelist, m_usedlist;
-#define MBUF_THRESH 30
-int mbuf_max = 0;
 
 /*
  * Find a nice value for msize
@@ -28,6 +26,27 @@ int mbuf_max = 0;
  */
 #define SLIRP_MSIZE (IF_MTU + IF_MAXLINKHDR + sizeof(struct m_hdr ) + 6)
 
+/*
+ * mbufs are carved out of slabs of MBUF_SLAB_COUNT, and go back to the
+ * free list when released, so the pool grows to the working set once and
+ * a steady stream of packets then doesn't malloc() or free() anything.
+ */
+#define MBUF_SLAB_COUNT 64
+#define MBUF_STRIDE ((SLIRP_MSIZE + 15) & ~15)
+
+/*
+ * Data that doesn't fit in an mbuf goes to an external buffer. Those come
+ * in power of two size classes from 4 KiB to 64 KiB, which covers jumbo
+ * TCP segments and the largest datagrams, and up to MBUF_EXT_CACHE free
+ * buffers of each class are kept for reuse.
+ */
+#define MBUF_EXT_MIN 4096
+#define MBUF_EXT_CLASSES 5
+#define MBUF_EXT_CACHE 32
+
+static char *m_ext_cache[MBUF_EXT_CLASSES];
+static int m_ext_cached[MBUF_EXT_CLASSES];
+
 void
 m_init(void)
 {
@@ -36,37 +55,48 @@ m_init(void)
 }
 
 /*
- * Get an mbuf from the free list, if there are none
- * malloc one
- *
- * Because fragmentation can occur if we alloc new mbufs and
- * free old mbufs, we mark all mbufs above mbuf_thresh as M_DOFREE,
- * which tells m_free to actually free() it
+ * Put a new slab of mbufs on the free list
+ */
+static int
+m_grow(void)
+{
+	char *slab;
+	struct mbuf *m;
+	int i;
+
+	slab = (char *)malloc(MBUF_STRIDE * MBUF_SLAB_COUNT);
+	if (slab == NULL)
+		return -1;
+
+	for (i = 0; i < MBUF_SLAB_COUNT; i++) {
+		m = (struct mbuf *)(slab + i * MBUF_STRIDE);
+		m->m_flags = M_FREELIST;
+		insque(m, &m_freelist);
+	}
+	mbstat.mbs_slabs++;
+	mbstat.mbs_alloced += MBUF_SLAB_COUNT;
+	return 0;
+}
+
+/*
+ * Get an mbuf from the free list, growing the pool if there are none
  */
 struct mbuf *
 m_get(void)
 {
-	register struct mbuf *m;
-	int flags = 0;
+	register struct mbuf *m = NULL;
 
 	DEBUG_CALL("m_get");
 
-	if (m_freelist.m_next == &m_freelist) {
-		m = (struct mbuf *)malloc(SLIRP_MSIZE);
-		if (m == NULL) goto end_error;
-		mbuf_alloced++;
-		if (mbuf_alloced > MBUF_THRESH)
-			flags = M_DOFREE;
-		if (mbuf_alloced > mbuf_max)
-			mbuf_max = mbuf_alloced;
-	} else {
-		m = m_freelist.m_next;
-		remque(m);
-	}
+	if (m_freelist.m_next == &m_freelist && m_grow() < 0)
+		goto end_error;
+
+	m = m_freelist.m_next;
+	remque(m);
 
 	/* Insert it in the used list */
 	insque(m,&m_usedlist);
-	m->m_flags = (flags | M_USEDLIST);
+	m->m_flags = M_USEDLIST;
 
 	/* Initialise it */
 	m->m_size = SLIRP_MSIZE - sizeof(struct m_hdr);
@@ -74,11 +104,73 @@ m_get(void)
 	m->m_len = 0;
         m->m_nextpkt = NULL;
         m->m_prevpkt = NULL;
+
+	mbstat.mbs_gets++;
+	if (++mbstat.mbs_inuse > mbstat.mbs_maxinuse)
+		mbstat.mbs_maxinuse = mbstat.mbs_inuse;
 end_error:
 	DEBUG_ARG("m = %lx", (long )m);
 	return m;
 }
 
+/*
+ * Return the size class of an external buffer of at least size bytes,
+ * or -1 if it's larger than all of them
+ */
+static int
+m_ext_class(int size)
+{
+	int class = 0;
+
+	while ((MBUF_EXT_MIN << class) < size) {
+		if (++class == MBUF_EXT_CLASSES)
+			return -1;
+	}
+	return class;
+}
+
+/*
+ * Allocate an external buffer of at least *size bytes, and update
+ * *size to its actual size
+ */
+static char *
+m_ext_alloc(int *size)
+{
+	int class = m_ext_class(*size);
+	char *buf;
+
+	mbstat.mbs_ext_gets++;
+	if (class < 0) {
+		mbstat.mbs_ext_large++;
+		return (char *)malloc(*size);
+	}
+
+	*size = MBUF_EXT_MIN << class;
+	buf = m_ext_cache[class];
+	if (buf) {
+		m_ext_cache[class] = *(char **)buf;
+		m_ext_cached[class]--;
+		mbstat.mbs_ext_hits++;
+		return buf;
+	}
+	return (char *)malloc(*size);
+}
+
+static void
+m_ext_free(char *buf, int size)
+{
+	int class = m_ext_class(size);
+
+	if (class >= 0 && (MBUF_EXT_MIN << class) == size &&
+	    m_ext_cached[class] < MBUF_EXT_CACHE) {
+		*(char **)buf = m_ext_cache[class];
+		m_ext_cache[class] = buf;
+		m_ext_cached[class]++;
+		return;
+	}
+	free(buf);
+}
+
 void
 m_free(struct mbuf *m)
 {
@@ -88,20 +180,17 @@ m_free(struct mbuf *m)
 
   if(m) {
 	/* Remove from m_usedlist */
-	if (m->m_flags & M_USEDLIST)
+	if (m->m_flags & M_USEDLIST) {
 	   remque(m);
+	   mbstat.mbs_inuse--;
+	}
 
-	/* If it's M_EXT, free() it */
+	/* If it's M_EXT, release it */
 	if (m->m_flags & M_EXT)
-	   free(m->m_ext);
+	   m_ext_free(m->m_ext, m->m_size);
 
-	/*
-	 * Either free() it or put it on the free list
-	 */
-	if (m->m_flags & M_DOFREE) {
-		free(m);
-		mbuf_alloced--;
-	} else if ((m->m_flags & M_FREELIST) == 0) {
+	/* Put it back on the free list */
+	if ((m->m_flags & M_FREELIST) == 0) {
 		insque(m,&m_freelist);
 		m->m_flags = M_FREELIST; /* Clobber other flags */
 	}
@@ -133,34 +222,29 @@ m_cat(struct mbuf *m, struct mbuf *n)
 void
 m_inc(struct mbuf *m, int size)
 {
+	char *dat;
 	int datasize;
 
 	/* some compiles throw up on gotos.  This one we can fake. */
         if(m->m_size>size) return;
 
+	dat = m_ext_alloc(&size);
+/*	if (dat == NULL)
+ *		return (struct mbuf *)NULL;
+ */
         if (m->m_flags & M_EXT) {
 	  datasize = m->m_data - m->m_ext;
-	  m->m_ext = (char *)realloc(m->m_ext,size);
-/*		if (m->m_ext == NULL)
- *			return (struct mbuf *)NULL;
- */
-	  m->m_data = m->m_ext + datasize;
+	  memcpy(dat, m->m_ext, m->m_size);
+	  m_ext_free(m->m_ext, m->m_size);
         } else {
-	  char *dat;
 	  datasize = m->m_data - m->m_dat;
-	  dat = (char *)malloc(size);
-/*		if (dat == NULL)
- *			return (struct mbuf *)NULL;
- */
 	  memcpy(dat, m->m_dat, m->m_size);
-
-	  m->m_ext = dat;
-	  m->m_data = m->m_ext + datasize;
 	  m->m_flags |= M_EXT;
         }
 
+	m->m_ext = dat;
+	m->m_data = m->m_ext + datasize;
         m->m_size = size;
-
 }
 
 
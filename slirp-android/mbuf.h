@@ -113,8 +113,6 @@ struct mbuf {
 #define M_EXT			0x01	/* m_ext points to more (malloced) data */
 #define M_FREELIST		0x02	/* mbuf is on free list */
 #define M_USEDLIST		0x04	/* XXX mbuf is on used list (for dtom()) */
-#define M_DOFREE		0x08	/* when m_free is called on the mbuf, free()
-					 * it rather than putting it on the free list */
 
 /*
  * Mbuf statistics. XXX
@@ -122,13 +120,17 @@ struct mbuf {
 
 struct mbstat {
 	int mbs_alloced;		/* Number of mbufs allocated */
-
+	int mbs_slabs;			/* Number of slabs they came in */
+	int mbs_inuse;			/* Number of mbufs in use */
+	int mbs_maxinuse;		/* Most mbufs ever in use at once */
+	u_int mbs_gets;			/* Calls to m_get() */
+	u_int mbs_ext_gets;		/* External buffers handed out */
+	u_int mbs_ext_hits;		/* ... reused from a size class */
+	u_int mbs_ext_large;		/* ... too large for any size class */
 };
 
 extern struct	mbstat mbstat;
-extern int mbuf_alloced;
 extern struct mbuf m_freelist, m_usedlist;
-extern int mbuf_max;
 
 void m_init _P((void));
 struct mbuf * m_get _P((void));
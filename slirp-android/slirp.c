@@ -78,7 +78,6 @@ FILE *lfd;
 struct ex_list *exec_list;
 
 /* XXX: suppress those select globals */
-fd_set *global_readfds, *global_writefds, *global_xfds;
 
 char slirp_hostname[33];
 
@@ -164,7 +163,6 @@ void slirp_init(int restricted, const char *special_ip)
 
 #define CONN_CANFSEND(so) (((so)->so_state & (SS_FCANTSENDMORE|SS_ISFCONNECTED)) == SS_ISFCONNECTED)
 #define CONN_CANFRCV(so) (((so)->so_state & (SS_FCANTRCVMORE|SS_ISFCONNECTED)) == SS_ISFCONNECTED)
-#define UPD_NFDS(x) if (nfds < (x)) nfds = (x)
 
 /*
  * curtime kept to an accuracy of 1ms
@@ -191,20 +189,12 @@ static void updtime(void)
 }
 #endif
 
-void slirp_select_fill(int *pnfds,
-                       fd_set *readfds, fd_set *writefds, fd_set *xfds)
+void slirp_pollfds_fill(void)
 {
     struct socket *so, *so_next;
     struct timeval timeout;
-    int nfds;
     int tmp_time;
 
-    /* fail safe */
-    global_readfds = NULL;
-    global_writefds = NULL;
-    global_xfds = NULL;
-
-    nfds = *pnfds;
 	/*
 	 * First, TCP sockets
 	 */
@@ -243,8 +233,7 @@ void slirp_select_fill(int *pnfds,
 			 * Set for reading sockets which are accepting
 			 */
 			if (so->so_state & SS_FACCEPTCONN) {
-                                FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
+				main_loop_poll_fd(so->s, MAIN_LOOP_POLL_READ);
 				continue;
 			}
 
@@ -252,8 +241,7 @@ void slirp_select_fill(int *pnfds,
 			 * Set for writing sockets which are connecting
 			 */
 			if (so->so_state & SS_ISFCONNECTING) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
+				main_loop_poll_fd(so->s, MAIN_LOOP_POLL_WRITE);
 				continue;
 			}
 
@@ -262,8 +250,7 @@ void slirp_select_fill(int *pnfds,
 			 * we have something to send
 			 */
 			if (CONN_CANFSEND(so) && so->so_rcv.sb_cc) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
+				main_loop_poll_fd(so->s, MAIN_LOOP_POLL_WRITE);
 			}
 
 			/*
@@ -271,9 +258,8 @@ void slirp_select_fill(int *pnfds,
 			 * receive more, and we have room for it XXX /2 ?
 			 */
 			if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2))) {
-				FD_SET(so->s, readfds);
-				FD_SET(so->s, xfds);
-				UPD_NFDS(so->s);
+				main_loop_poll_fd(so->s, MAIN_LOOP_POLL_READ |
+				                         MAIN_LOOP_POLL_URGENT);
 			}
 		}
 
@@ -308,8 +294,7 @@ void slirp_select_fill(int *pnfds,
 			 * (XXX <= 4 ?)
 			 */
 			if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4) {
-				FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
+				main_loop_poll_fd(so->s, MAIN_LOOP_POLL_READ);
 			}
 		}
 	}
@@ -347,18 +332,13 @@ void slirp_select_fill(int *pnfds,
 			   timeout.tv_usec = (u_int)tmp_time;
 		}
 	}
-    *pnfds = nfds;
 }
 
-void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
+void slirp_pollfds_poll(void)
 {
     struct socket *so, *so_next;
     int ret;
 
-    global_readfds = readfds;
-    global_writefds = writefds;
-    global_xfds = xfds;
-
 	/* Update time */
 	updtime();
 
@@ -388,7 +368,7 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			so_next = so->so_next;
 
 			/*
-			 * FD_ISSET is meaningless on these sockets
+			 * Poll results are meaningless on these sockets
 			 * (and they can crash the program)
 			 */
 			if (so->so_state & SS_NOFDREF || so->s == -1)
@@ -401,17 +381,24 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
             if ((so->so_state & SS_PROXIFIED) != 0)
                 continue;
 
+			/*
+			 * Keep the events in the socket, so that
+			 * sofcantrcvmore() and sofcantsendmore() can
+			 * drop the ones that no longer apply.
+			 */
+			so->so_poll_events = main_loop_poll_result(so->s);
+
 			/*
 			 * Check for URG data
 			 * This will soread as well, so no need to
 			 * test for readfds below if this succeeds
 			 */
-			if (FD_ISSET(so->s, xfds))
+			if (so->so_poll_events & MAIN_LOOP_POLL_URGENT)
 			   sorecvoob(so);
 			/*
 			 * Check sockets for reading
 			 */
-			else if (FD_ISSET(so->s, readfds)) {
+			else if (so->so_poll_events & MAIN_LOOP_POLL_READ) {
 				/*
 				 * Check for incoming connections
 				 */
@@ -429,7 +416,7 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 			/*
 			 * Check sockets for writing
 			 */
-			if (FD_ISSET(so->s, writefds)) {
+			if (so->so_poll_events & MAIN_LOOP_POLL_WRITE) {
 			  /*
 			   * Check for non-blocking, still-connecting sockets
 			   */
@@ -511,7 +498,8 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
             if ((so->so_state & SS_PROXIFIED) != 0)
                 continue;
 
-			if (so->s != -1 && FD_ISSET(so->s, readfds)) {
+			if (so->s != -1 &&
+			    (main_loop_poll_result(so->s) & MAIN_LOOP_POLL_READ)) {
                             sorecvfrom(so);
                         }
 		}
@@ -522,15 +510,6 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 	 */
 	if (if_queued && link_up)
 	   if_start();
-
-	/* clear global file descriptor sets.
-	 * these reside on the stack in vl.c
-	 * so they're unusable if we're not in
-	 * slirp_select_fill or slirp_select_poll.
-	 */
-	 global_readfds = NULL;
-	 global_writefds = NULL;
-	 global_xfds = NULL;
 }
 
 #define ETH_ALEN 6
@@ -1049,6 +1028,7 @@ int slirp_redir_rm(int is_udp, int host_port)
  loop_again:
     for (so = head->so_next; so != head; so = so->so_next) {
         if (so->so_faddr_port == host_port) {
+            main_loop_poll_forget(so->s);
             close(so->s);
             sofree(so);
             n++;
@@ -1323,6 +1303,7 @@ static int slirp_socket_load(QEMUFile *f, struct socket *so)
     so->so_laddr_ip = qemu_get_be32(f);
     so->so_faddr_port = qemu_get_be16(f);
     so->so_laddr_port = qemu_get_be16(f);
+    sohash(so, &tcb);
     so->so_iptos = qemu_get_byte(f);
     so->so_emu = qemu_get_byte(f);
     so->so_type = qemu_get_byte(f);
@@ -28,24 +28,93 @@ so_init()
 }
 #endif
 
+/*
+ * Sockets are looked up through a hash table per list. TCP sockets are
+ * hashed by their 4-tuple, UDP sockets by their local address only, since
+ * udp_input() matches them without the foreign address. The so_next list
+ * is still what the timers and the main loop walk.
+ */
+#define SO_HASH_SIZE 1024
+
+static struct socket *tcb_hash[SO_HASH_SIZE];
+static struct socket *udb_hash[SO_HASH_SIZE];
+
+static struct socket **
+so_hash_bucket(struct socket *head, uint32_t laddr, u_int lport,
+               uint32_t faddr, u_int fport)
+{
+	uint32_t h = laddr ^ (lport << 16);
+
+	if (head == &tcb) {
+		h ^= faddr * 0x9e3779b1 ^ fport;
+		return &tcb_hash[(h * 0x9e3779b1) >> 22];
+	}
+	return &udb_hash[(h * 0x9e3779b1) >> 22];
+}
+
+/*
+ * Index a socket of |head| (&tcb or &udb) by its current addresses.
+ * This must be done again whenever they change.
+ */
+void
+sohash(struct socket *so, struct socket *head)
+{
+	struct socket **bucket;
+
+	sounhash(so);
+	bucket = so_hash_bucket(head, so->so_laddr_ip, so->so_laddr_port,
+	                        so->so_faddr_ip, so->so_faddr_port);
+	so->so_hash_next = *bucket;
+	if (*bucket)
+		(*bucket)->so_hash_pprev = &so->so_hash_next;
+	*bucket = so;
+	so->so_hash_pprev = bucket;
+}
+
+void
+sounhash(struct socket *so)
+{
+	if (!so->so_hash_pprev)
+		return;
+	*so->so_hash_pprev = so->so_hash_next;
+	if (so->so_hash_next)
+		so->so_hash_next->so_hash_pprev = so->so_hash_pprev;
+	so->so_hash_next = NULL;
+	so->so_hash_pprev = NULL;
+}
+
 struct socket *
 solookup(struct socket *head, uint32_t laddr, u_int lport,
          uint32_t faddr, u_int fport)
 {
 	struct socket *so;
 
-	for (so = head->so_next; so != head; so = so->so_next) {
+	so = *so_hash_bucket(head, laddr, lport, faddr, fport);
+	for (; so != NULL; so = so->so_hash_next) {
 		if (so->so_laddr_port == lport &&
 		    so->so_laddr_ip   == laddr &&
 		    so->so_faddr_ip   == faddr &&
 		    so->so_faddr_port == fport)
 		   break;
 	}
-
-	if (so == head)
-	   return (struct socket *)NULL;
 	return so;
+}
+
+/*
+ * Find a UDP socket by its local address only.
+ */
+struct socket *
+solookup_laddr(struct socket *head, uint32_t laddr, u_int lport)
+{
+	struct socket *so;
 
+	so = *so_hash_bucket(head, laddr, lport, 0, 0);
+	for (; so != NULL; so = so->so_hash_next) {
+		if (so->so_laddr_port == lport &&
+		    so->so_laddr_ip   == laddr)
+		   break;
+	}
+	return so;
 }
 
 /*
@@ -87,6 +156,7 @@ sofree(struct socket *so)
 
   m_free(so->so_m);
 
+  sounhash(so);
   if(so->so_next && so->so_prev)
     remque(so);  /* crashes if so is not in a queue */
 
@@ -667,6 +737,7 @@ solisten(u_int port, u_int32_t laddr, u_int lport, int flags)
         so->so_faddr_ip = addr_ip;
 
 	so->s = s;
+	sohash(so, &tcb);
 	return so;
 }
 
@@ -748,9 +819,7 @@ sofcantrcvmore(struct socket *so)
 {
 	if ((so->so_state & SS_NOFDREF) == 0) {
 		shutdown(so->s,0);
-		if(global_writefds) {
-		  FD_CLR(so->s,global_writefds);
-		}
+		so->so_poll_events &= ~MAIN_LOOP_POLL_WRITE;
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTSENDMORE)
@@ -764,12 +833,8 @@ sofcantsendmore(struct socket *so)
 {
 	if ((so->so_state & SS_NOFDREF) == 0) {
             shutdown(so->s,1);           /* send FIN to fhost */
-            if (global_readfds) {
-                FD_CLR(so->s,global_readfds);
-            }
-            if (global_xfds) {
-                FD_CLR(so->s,global_xfds);
-            }
+            so->so_poll_events &= ~(MAIN_LOOP_POLL_READ |
+                                    MAIN_LOOP_POLL_URGENT);
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTRCVMORE)
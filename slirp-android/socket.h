@@ -19,6 +19,8 @@
 
 struct socket {
   struct socket *so_next,*so_prev;      /* For a linked list of sockets */
+  struct socket *so_hash_next;          /* For the lookup hash table, see sohash() */
+  struct socket **so_hash_pprev;
 
   int s;                           /* The actual socket */
 
@@ -40,6 +42,7 @@ struct socket {
 
   u_char	so_type;		/* Type of socket, UDP or TCP */
   int	so_state;		/* internal state flags SS_*, below */
+  int	so_poll_events;		/* MAIN_LOOP_POLL_XXX events being handled */
 
   struct 	tcpcb *so_tcpcb;	/* pointer to TCP protocol control block */
   u_int	so_expire;		/* When the socket will expire */
@@ -78,6 +81,9 @@ extern struct socket tcb;
 
 void so_init _P((void));
 struct socket * solookup _P((struct socket *, uint32_t, u_int, uint32_t, u_int));
+struct socket * solookup_laddr _P((struct socket *, uint32_t, u_int));
+void sohash _P((struct socket *, struct socket *));
+void sounhash _P((struct socket *));
 struct socket * socreate _P((void));
 void sofree _P((struct socket *));
 int soread _P((struct socket *));
@@ -422,6 +422,7 @@ findso:
 	  so->so_laddr_port = port_geth(ti->ti_sport);
 	  so->so_faddr_ip   = ip_geth(ti->ti_dst);
 	  so->so_faddr_port = port_geth(ti->ti_dport);
+	  sohash(so, &tcb);
 
 	  if ((so->so_iptos = tcp_tos(so)) == 0)
 	    so->so_iptos = ((struct ip *)ti)->ip_tos;
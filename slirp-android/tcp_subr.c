@@ -39,6 +39,7 @@
  */
 
 #define WANT_SYS_IOCTL_H
+#include "qemu-common.h"
 #include <slirp.h>
 #include "android/proxy/proxy_common.h"
 
@@ -280,6 +281,7 @@ tcp_close(struct tcpcb *tp)
 	/* clobber input socket cache if we're closing the cached connection */
 	if (so == tcp_last_so)
 		tcp_last_so = &tcb;
+	main_loop_poll_forget(so->s);
 	socket_close(so->s);
 	sbfree(&so->so_rcv);
 	sbfree(&so->so_snd);
@@ -635,9 +637,11 @@ tcp_connect(struct socket *inso)
 	/* Translate connections from localhost to the real hostname */
 	if (addr_ip == 0 || addr_ip == loopback_addr_ip)
 	   so->so_faddr_ip = alias_addr_ip;
+	sohash(so, &tcb);
 
 	/* Close the accept() socket, set right state */
 	if (inso->so_state & SS_FACCEPTONCE) {
+		main_loop_poll_forget(so->s);
 		socket_close(so->s); /* If we only accept once, close the accept() socket */
 		so->so_state = SS_NOFDREF; /* Don't select it yet, even though we have an FD */
 					   /* if it's not FACCEPTONCE, it's already NOFDREF */
@@ -38,6 +38,7 @@
  * terms and conditions of the copyright.
  */
 
+#include "qemu-common.h"
 #include <slirp.h>
 #include "ip_icmp.h"
 #define SLIRP_COMPILATION  1
@@ -218,20 +219,11 @@ udp_input(register struct mbuf *m, int iphlen)
 	so = udp_last_so;
 	if (so->so_laddr_port != port_geth(uh->uh_sport) ||
 	    so->so_laddr_ip   != ip_geth(ip->ip_src)) {
-		struct socket *tmp;
-
-		for (tmp = udb.so_next; tmp != &udb; tmp = tmp->so_next) {
-			if (tmp->so_laddr_port == port_geth(uh->uh_sport) &&
-			    tmp->so_laddr_ip   == ip_geth(ip->ip_src)) {
-				tmp->so_faddr_ip   = ip_geth(ip->ip_dst);
-				tmp->so_faddr_port = port_geth(uh->uh_dport);
-				so = tmp;
-				break;
-			}
-		}
-		if (tmp == &udb) {
-		  so = NULL;
-		} else {
+		so = solookup_laddr(&udb, ip_geth(ip->ip_src),
+		                    port_geth(uh->uh_sport));
+		if (so != NULL) {
+		  so->so_faddr_ip   = ip_geth(ip->ip_dst);
+		  so->so_faddr_port = port_geth(uh->uh_dport);
 		  STAT(udpstat.udpps_pcbcachemiss++);
 		  udp_last_so = so;
 		}
@@ -256,6 +248,7 @@ udp_input(register struct mbuf *m, int iphlen)
 	  /* udp_last_so = so; */
 	  so->so_laddr_ip   = ip_geth(ip->ip_src);
 	  so->so_laddr_port = port_geth(uh->uh_sport);
+	  sohash(so, &udb);
 
 	  if ((so->so_iptos = udp_tos(so)) == 0)
 	    so->so_iptos = ip->ip_tos;
@@ -406,6 +399,7 @@ udp_attach(struct socket *so)
 void
 udp_detach(struct socket *so)
 {
+	main_loop_poll_forget(so->s);
 	socket_close(so->s);
 	/* if (so->so_m) m_free(so->so_m);    done by sofree */
 
@@ -515,6 +509,7 @@ udp_listen(u_int port, u_int32_t laddr, u_int lport, int flags)
 
 	so->so_laddr_port = lport;
 	so->so_laddr_ip   = laddr;
+	sohash(so, &udb);
 	if (flags != SS_FACCEPTONCE)
 	   so->so_expire = 0;
 
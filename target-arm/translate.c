@@ -9756,6 +9756,7 @@ static inline void gen_intermediate_code_internal(CPUARMState *env,
         max_insns = CF_COUNT_MASK;
 
     gen_icount_start();
+    gen_tb_exec_count(tb);
 
     if (code_profile_record_func != NULL && code_profile_dirname != NULL)
         gen_profileBB(tb);
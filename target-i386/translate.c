@@ -7856,6 +7856,7 @@ static inline void gen_intermediate_code_internal(CPUX86State *env,
         max_insns = CF_COUNT_MASK;
 
     gen_icount_start();
+    gen_tb_exec_count(tb);
     for(;;) {
         if (unlikely(!QTAILQ_EMPTY(&env->breakpoints))) {
             QTAILQ_FOREACH(bp, &env->breakpoints, entry) {
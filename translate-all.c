@@ -103,6 +103,8 @@ static void* l1_phys_map[V_L1_SIZE];
 /* code generation context */
 TCGContext tcg_ctx;
 
+int tb_exec_profiling;
+
 /* XXX: suppress that */
 unsigned long code_gen_max_block_size(void)
 {
@@ -631,6 +633,55 @@ static inline void code_gen_alloc(size_t tb_size)
             g_malloc(tcg_ctx.code_gen_max_blocks * sizeof(TranslationBlock));
 }
 
+/* Empty all the regions, and start generating code in the first one. */
+static void tb_regions_reset(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    int i;
+
+    for (i = 0; i < ctx->nb_regions; i++) {
+        ctx->regions[i].code_ptr = ctx->regions[i].code_start;
+        ctx->regions[i].nb_tbs = 0;
+    }
+    ctx->cur_region = 0;
+    ctx->nb_tbs = 0;
+    tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
+}
+
+/* Split the code buffer and tbs[] in regions of the same size, which are
+   filled in turn. Each region must hold a fair number of maximum sized
+   blocks, so small buffers get fewer regions. With a single region, a
+   full buffer is flushed entirely as before. */
+static void tb_regions_init(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    size_t max_block_size = TCG_MAX_OP_SIZE * OPC_BUF_SIZE;
+    size_t region_size;
+    int i, n;
+
+    n = tcg_ctx.code_gen_buffer_size / (8 * max_block_size);
+    if (n > CODE_GEN_MAX_REGIONS) {
+        n = CODE_GEN_MAX_REGIONS;
+    } else if (n < 1) {
+        n = 1;
+    }
+    region_size = (tcg_ctx.code_gen_buffer_size / n) & ~(CODE_GEN_ALIGN - 1);
+
+    ctx->nb_regions = n;
+    ctx->tbs_per_region = tcg_ctx.code_gen_max_blocks / n;
+    for (i = 0; i < n; i++) {
+        TBRegion *r = &ctx->regions[i];
+
+        r->code_start = tcg_ctx.code_gen_buffer + i * region_size;
+        r->code_end = r->code_start + region_size - max_block_size;
+        r->first_tb = i * ctx->tbs_per_region;
+    }
+    /* the last region also gets the rounding leftovers */
+    ctx->regions[n - 1].code_end = tcg_ctx.code_gen_buffer +
+                                   tcg_ctx.code_gen_buffer_max_size;
+    tb_regions_reset();
+}
+
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
    (in bytes) allocated to the translation buffer. Zero means default
    size. */
@@ -638,7 +689,7 @@ void tcg_exec_init(unsigned long tb_size)
 {
     cpu_gen_init();
     code_gen_alloc(tb_size);
-    tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
+    tb_regions_init();
     page_init();
 #if !defined(CONFIG_USER_ONLY) || !defined(CONFIG_USE_GUEST_BASE)
     /* There's no guest base to take into account, so go ahead and
@@ -652,35 +703,52 @@ bool tcg_enabled(void)
     return tcg_ctx.code_gen_buffer != NULL;
 }
 
-/* Allocate a new translation block. Flush the translation buffer if
-   too many translation blocks or too much generated code. */
+/* Allocate a new translation block in the current region. Returns NULL
+   if the region has too many translation blocks or too much generated
+   code, and another region must be evicted. */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &ctx->regions[ctx->cur_region];
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs >= tcg_ctx.code_gen_max_blocks ||
-        (tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer) >=
-         tcg_ctx.code_gen_buffer_max_size) {
+    if (r->nb_tbs >= ctx->tbs_per_region ||
+        tcg_ctx.code_gen_ptr >= r->code_end) {
         return NULL;
     }
-    tb = &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs++];
+    tb = &ctx->tbs[r->first_tb + r->nb_tbs++];
+    ctx->nb_tbs++;
     tb->pc = pc;
     tb->cflags = 0;
+    tb->exec_count = 0;
+    tb->invalid = 0;
     return tb;
 }
 
 void tb_free(TranslationBlock *tb)
 {
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &ctx->regions[ctx->cur_region];
+
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
-    if (tcg_ctx.tb_ctx.nb_tbs > 0 &&
-            tb == &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs - 1]) {
+    if (r->nb_tbs > 0 && tb == &ctx->tbs[r->first_tb + r->nb_tbs - 1]) {
         tcg_ctx.code_gen_ptr = tb->tc_ptr;
-        tcg_ctx.tb_ctx.nb_tbs--;
+        r->nb_tbs--;
+        ctx->nb_tbs--;
     }
 }
 
+/* Return the end of the code generated in region |i|. */
+static inline uint8_t *tb_region_code_ptr(int i)
+{
+    if (i == tcg_ctx.tb_ctx.cur_region) {
+        return tcg_ctx.code_gen_ptr;
+    }
+    return tcg_ctx.tb_ctx.regions[i].code_ptr;
+}
+
 static inline void invalidate_page_bitmap(PageDesc *p)
 {
     if (p->code_bitmap) {
@@ -739,7 +807,7 @@ void tb_flush(CPUArchState *env1)
         > tcg_ctx.code_gen_buffer_size) {
         cpu_abort(env1, "Internal error: code buffer overflow\n");
     }
-    tcg_ctx.tb_ctx.nb_tbs = 0;
+    tb_regions_reset();
 
     CPU_FOREACH(cpu) {
         CPUArchState *env = cpu->env_ptr;
@@ -750,12 +818,26 @@ void tb_flush(CPUArchState *env1)
             CODE_GEN_PHYS_HASH_SIZE * sizeof(void *));
     page_flush_tb();
 
-    tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     tcg_ctx.tb_ctx.tb_flush_count++;
 }
 
+void tb_set_exec_profiling(int enable)
+{
+    enable = !!enable;
+    if (enable == tb_exec_profiling) {
+        return;
+    }
+    /* cpu_restore_state() retranslates blocks and expects the exact same
+       code, so blocks generated with the other setting must go. This also
+       restarts all the execution counts from zero. */
+    tb_exec_profiling = enable;
+    if (first_cpu) {
+        tb_flush(first_cpu->env_ptr);
+    }
+}
+
 #ifdef DEBUG_TB_CHECK
 
 static void tb_invalidate_check(target_ulong address)
@@ -920,9 +1002,35 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     }
     tb->jmp_first = (TranslationBlock *)((uintptr_t)tb | 2); /* fail safe */
 
+    tb->invalid = 1;
     tcg_ctx.tb_ctx.tb_phys_invalidate_count++;
 }
 
+/* Make room for new blocks in the region after the current one, which
+   holds the oldest blocks since regions are filled in turn. Only these
+   blocks are invalidated and unlinked from the blocks that jump to them,
+   the rest of the translated code survives. */
+static void tb_evict_region(void)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &ctx->regions[ctx->cur_region];
+    int i;
+
+    r->code_ptr = tcg_ctx.code_gen_ptr;
+    ctx->cur_region = (ctx->cur_region + 1) % ctx->nb_regions;
+    r = &ctx->regions[ctx->cur_region];
+    for (i = 0; i < r->nb_tbs; i++) {
+        TranslationBlock *tb = &ctx->tbs[r->first_tb + i];
+
+        if (!tb->invalid) {
+            tb_phys_invalidate(tb, -1);
+        }
+    }
+    ctx->nb_tbs -= r->nb_tbs;
+    r->nb_tbs = 0;
+    tcg_ctx.code_gen_ptr = r->code_start;
+}
+
 static inline void set_bits(uint8_t *tab, int start, int len)
 {
     int end, mask, end1;
@@ -988,12 +1096,18 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     tb_page_addr_t phys_pc, phys_page2;
     target_ulong virt_page2;
     int code_gen_size;
+    int64_t ti;
 
     phys_pc = get_page_addr_code(env, pc);
     tb = tb_alloc(pc);
     if (!tb) {
-        /* flush must be done */
-        tb_flush(env);
+        /* eviction or flush must be done */
+        tcg_ctx.tb_ctx.tb_evict_count++;
+        if (tcg_ctx.tb_ctx.nb_regions > 1) {
+            tb_evict_region();
+        } else {
+            tb_flush(env);
+        }
         /* cannot fail at this point */
         tb = tb_alloc(pc);
         /* Don't forget to invalidate previous TB info.  */
@@ -1004,7 +1118,10 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
+    ti = get_clock();
     cpu_gen_code(env, tb, &code_gen_size);
+    tcg_ctx.tb_ctx.tb_gen_time += get_clock() - ti;
+    tcg_ctx.tb_ctx.tb_gen_count++;
     tcg_ctx.code_gen_ptr = (void *)(((uintptr_t)tcg_ctx.code_gen_ptr +
             code_gen_size + CODE_GEN_ALIGN - 1) & ~(CODE_GEN_ALIGN - 1));
 
@@ -1358,20 +1475,29 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
    tb[1].tc_ptr. Return NULL if not found */
 TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
 {
-    int m_min, m_max, m;
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    int m_min, m_max, m, i;
     uintptr_t v;
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs <= 0) {
+    if (ctx->nb_tbs <= 0) {
+        return NULL;
+    }
+    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer) {
         return NULL;
     }
-    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer ||
-        tc_ptr >= (uintptr_t)tcg_ctx.code_gen_ptr) {
+    /* blocks are sorted by tc_ptr within their region only */
+    i = ctx->nb_regions - 1;
+    while (i > 0 && tc_ptr < (uintptr_t)ctx->regions[i].code_start) {
+        i--;
+    }
+    if (ctx->regions[i].nb_tbs <= 0 ||
+        tc_ptr >= (uintptr_t)tb_region_code_ptr(i)) {
         return NULL;
     }
     /* binary search (cf Knuth) */
-    m_min = 0;
-    m_max = tcg_ctx.tb_ctx.nb_tbs - 1;
+    m_min = ctx->regions[i].first_tb;
+    m_max = m_min + ctx->regions[i].nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
         tb = &tcg_ctx.tb_ctx.tbs[m];
@@ -1527,8 +1653,10 @@ void tb_flush_jmp_cache(CPUArchState *env, target_ulong addr)
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    int i, target_code_size, max_target_code_size;
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    int i, r, target_code_size, max_target_code_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    ptrdiff_t code_size;
     TranslationBlock *tb;
 
     target_code_size = 0;
@@ -1536,27 +1664,31 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
-    for (i = 0; i < tcg_ctx.tb_ctx.nb_tbs; i++) {
-        tb = &tcg_ctx.tb_ctx.tbs[i];
-        target_code_size += tb->size;
-        if (tb->size > max_target_code_size) {
-            max_target_code_size = tb->size;
-        }
-        if (tb->page_addr[1] != -1) {
-            cross_page++;
-        }
-        if (tb->tb_next_offset[0] != 0xffff) {
-            direct_jmp_count++;
-            if (tb->tb_next_offset[1] != 0xffff) {
-                direct_jmp2_count++;
+    code_size = 0;
+    for (r = 0; r < ctx->nb_regions; r++) {
+        code_size += tb_region_code_ptr(r) - ctx->regions[r].code_start;
+        for (i = 0; i < ctx->regions[r].nb_tbs; i++) {
+            tb = &ctx->tbs[ctx->regions[r].first_tb + i];
+            target_code_size += tb->size;
+            if (tb->size > max_target_code_size) {
+                max_target_code_size = tb->size;
+            }
+            if (tb->page_addr[1] != -1) {
+                cross_page++;
+            }
+            if (tb->tb_next_offset[0] != 0xffff) {
+                direct_jmp_count++;
+                if (tb->tb_next_offset[1] != 0xffff) {
+                    direct_jmp2_count++;
+                }
             }
         }
     }
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
-    cpu_fprintf(f, "gen code size       %td/%zd\n",
-                tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer,
-                tcg_ctx.code_gen_buffer_max_size);
+    cpu_fprintf(f, "gen code size       %td/%zd in %d regions\n",
+                code_size, tcg_ctx.code_gen_buffer_max_size,
+                ctx->nb_regions);
     cpu_fprintf(f, "TB count            %d/%d\n",
             tcg_ctx.tb_ctx.nb_tbs, tcg_ctx.code_gen_max_blocks);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
@@ -1564,12 +1696,8 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
                     tcg_ctx.tb_ctx.nb_tbs : 0,
             max_target_code_size);
     cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-            tcg_ctx.tb_ctx.nb_tbs ? (tcg_ctx.code_gen_ptr -
-                                     tcg_ctx.code_gen_buffer) /
-                                     tcg_ctx.tb_ctx.nb_tbs : 0,
-                target_code_size ? (double) (tcg_ctx.code_gen_ptr -
-                                             tcg_ctx.code_gen_buffer) /
-                                             target_code_size : 0);
+            tcg_ctx.tb_ctx.nb_tbs ? code_size / tcg_ctx.tb_ctx.nb_tbs : 0,
+                target_code_size ? (double) code_size / target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n", cross_page,
             tcg_ctx.tb_ctx.nb_tbs ? (cross_page * 100) /
                                     tcg_ctx.tb_ctx.nb_tbs : 0);
@@ -1582,12 +1710,89 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
                         tcg_ctx.tb_ctx.nb_tbs : 0);
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %d\n", tcg_ctx.tb_ctx.tb_flush_count);
+    cpu_fprintf(f, "TB evict count      %d (code buffer full)\n",
+                tcg_ctx.tb_ctx.tb_evict_count);
+    cpu_fprintf(f, "TB lookup count     %" PRIu64 " (jump cache hits %d%%)\n",
+                tcg_ctx.tb_ctx.tb_find_count,
+                tcg_ctx.tb_ctx.tb_find_count ?
+                        (int)((tcg_ctx.tb_ctx.tb_find_count -
+                               tcg_ctx.tb_ctx.tb_find_slow_count) * 100 /
+                              tcg_ctx.tb_ctx.tb_find_count) : 0);
+    cpu_fprintf(f, "TB slow lookups     %" PRIu64 " (hash hits %d%%)\n",
+                tcg_ctx.tb_ctx.tb_find_slow_count,
+                tcg_ctx.tb_ctx.tb_find_slow_count ?
+                        (int)((tcg_ctx.tb_ctx.tb_find_slow_count -
+                               tcg_ctx.tb_ctx.tb_find_miss_count) * 100 /
+                              tcg_ctx.tb_ctx.tb_find_slow_count) : 0);
+    cpu_fprintf(f, "TB translations     %" PRIu64 " (avg %" PRId64 " ns, "
+                "total %" PRId64 " ms)\n",
+                tcg_ctx.tb_ctx.tb_gen_count,
+                tcg_ctx.tb_ctx.tb_gen_count ?
+                        tcg_ctx.tb_ctx.tb_gen_time /
+                        (int64_t)tcg_ctx.tb_ctx.tb_gen_count : 0,
+                tcg_ctx.tb_ctx.tb_gen_time / 1000000);
     cpu_fprintf(f, "TB invalidate count %d\n",
             tcg_ctx.tb_ctx.tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
+    cpu_fprintf(f, "TLB victim hits     %" PRIu64 "\n", tlb_victim_hits);
+    cpu_fprintf(f, "TLB victim misses   %" PRIu64 "\n", tlb_victim_misses);
     tcg_dump_info(f, cpu_fprintf);
 }
 
+/* Print the |count| most executed blocks currently in the TB cache. */
+void dump_tb_hot_blocks(FILE *f, fprintf_function cpu_fprintf, int count)
+{
+    TBContext *ctx = &tcg_ctx.tb_ctx;
+    TranslationBlock **hot;
+    uint64_t total = 0;
+    int i, j, r, n = 0;
+
+    if (!tb_exec_profiling) {
+        cpu_fprintf(f, "TB execution profiling is disabled\n");
+        return;
+    }
+    /* There can't be more hot blocks than translated ones, whatever the
+     * caller asked for. */
+    if (count > ctx->nb_tbs) {
+        count = ctx->nb_tbs;
+    }
+    if (count <= 0) {
+        return;
+    }
+    /* Keep the hottest blocks sorted in |hot|, count is small. */
+    hot = g_malloc(count * sizeof(*hot));
+    for (r = 0; r < ctx->nb_regions; r++) {
+        for (i = 0; i < ctx->regions[r].nb_tbs; i++) {
+            TranslationBlock *tb = &ctx->tbs[ctx->regions[r].first_tb + i];
+
+            total += tb->exec_count;
+            if (!tb->exec_count ||
+                (n == count && tb->exec_count <= hot[n - 1]->exec_count)) {
+                continue;
+            }
+            j = (n < count) ? n++ : n - 1;
+            while (j > 0 && hot[j - 1]->exec_count < tb->exec_count) {
+                hot[j] = hot[j - 1];
+                j--;
+            }
+            hot[j] = tb;
+        }
+    }
+
+    cpu_fprintf(f, "%d hottest of %d TBs, %" PRIu64 " executions:\n",
+                n, tcg_ctx.tb_ctx.nb_tbs, total);
+    cpu_fprintf(f, "%-18s %5s %5s %14s %6s\n",
+                "guest pc", "size", "insns", "executions", "share");
+    for (i = 0; i < n; i++) {
+        cpu_fprintf(f, "0x" TARGET_FMT_lx "%*s %5d %5d %14" PRIu64
+                    " %5.1f%%\n",
+                    hot[i]->pc, (int)(16 - sizeof(target_ulong) * 2), "",
+                    hot[i]->size, hot[i]->icount, hot[i]->exec_count,
+                    hot[i]->exec_count * 100.0 / total);
+    }
+    g_free(hot);
+}
+
 #else /* CONFIG_USER_ONLY */
 
 void cpu_interrupt(CPUState *cpu, int mask)
@@ -78,6 +78,14 @@ static QemuOptsList qemu_drive_opts = {
         },{
             .name = "readonly",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "l2-cache-size",
+            .type = QEMU_OPT_SIZE,
+            .help = "qcow2 L2 table cache size in bytes",
+        },{
+            .name = "refcount-cache-size",
+            .type = QEMU_OPT_SIZE,
+            .help = "qcow2 refcount block cache size in bytes",
         },
         { /* end of list */ }
     },
@@ -1806,14 +1806,16 @@ serial_hds_add(const char* devname)
     return -1;
 }
 
-// Callback for android_partition_config().
+// Callback for android_partition_config(). |opaque| points to an int that
+// is non-zero if -snapshot-incremental was used.
 static void android_add_nand_image(void *opaque, const char *part_name,
                                    uint64_t part_size, const char *part_file,
+                                   const char *part_init_file,
                                    AndroidPartitionType part_type,
                                    bool readonly) {
   // Create the configuration string for nand_add_dev().
   // Take care of escaping special characters in file names.
-  char tmp[PATH_MAX * 2 + 1];
+  char tmp[PATH_MAX * 4 + 1];
   snprintf(tmp, sizeof tmp, "%s,size=0x%" PRIx64, part_name, part_size);
 
   char *escaped_part_file = path_escape_path(part_file);
@@ -1823,6 +1825,15 @@ static void android_add_nand_image(void *opaque, const char *part_name,
     free(escaped_part_file);
   }
 
+  if (part_init_file) {
+    char *escaped_init_file = path_escape_path(part_init_file);
+    if (escaped_init_file) {
+      pstrcat(tmp, sizeof tmp, ",initfile=");
+      pstrcat(tmp, sizeof tmp, escaped_init_file);
+      free(escaped_init_file);
+    }
+  }
+
   if (part_type == ANDROID_PARTITION_TYPE_EXT4) {
     // Using a nand device to approximate a block device until full
     // support is added.
@@ -1831,6 +1842,10 @@ static void android_add_nand_image(void *opaque, const char *part_name,
 
   if (readonly) {
     pstrcat(tmp, sizeof(tmp), ",readonly");
+  } else if (*(const int *)opaque && !part_init_file) {
+    // Partitions with an initial image here are temporary ones, which
+    // the next emulator run couldn't apply a delta snapshot to.
+    pstrcat(tmp, sizeof(tmp), ",incremental");
   }
 
   nand_add_dev(tmp);
@@ -1949,6 +1964,9 @@ int main(int argc, char **argv, char **envp)
     QEMUMachine *machine;
     const char *cpu_model;
     int tb_size;
+    int vcpu_thread = 0;
+    int snapshot_compress = 0, snapshot_lazy_ram = 0;
+    int snapshot_incremental = 0;
     const char *pid_file = NULL;
     const char *incoming = NULL;
     const char* log_mask = NULL;
@@ -2701,6 +2719,9 @@ int main(int argc, char **argv, char **envp)
                 if (tb_size < 0)
                     tb_size = 0;
                 break;
+            case QEMU_OPTION_vcpu_thread:
+                vcpu_thread = 1;
+                break;
             case QEMU_OPTION_icount:
                 icount_option = optarg;
                 break;
@@ -2840,6 +2861,18 @@ int main(int argc, char **argv, char **envp)
                 android_snapshot_update_time = 0;
                 break;
 
+            case QEMU_OPTION_snapshot_compress:
+                snapshot_compress = 1;
+                break;
+
+            case QEMU_OPTION_snapshot_lazy_ram:
+                snapshot_lazy_ram = 1;
+                break;
+
+            case QEMU_OPTION_snapshot_incremental:
+                snapshot_incremental = 1;
+                break;
+
             case QEMU_OPTION_list_webcam:
                 android_list_web_cameras();
                 return 0;
@@ -2850,6 +2883,16 @@ int main(int argc, char **argv, char **envp)
         }
     }
 
+    /* Compressed pages can't be read on demand, so a snapshot saved with
+     * both options wouldn't load lazily anyway. */
+    if (snapshot_compress && snapshot_lazy_ram) {
+        PANIC("-snapshot-compress and -snapshot-lazy-ram can't be used "
+              "together.");
+        return 1;
+    }
+    ram_set_compression(snapshot_compress);
+    ram_set_lazy_load(snapshot_lazy_ram);
+
     /* Initialize character map. */
     if (skin_charmap_setup(op_charmap_file)) {
         if (op_charmap_file) {
@@ -2962,12 +3005,14 @@ int main(int argc, char **argv, char **envp)
 
             .wipe_data = android_op_wipe_data,
             .writable_system = android_op_writable_system,
+            .copy_on_write = true,
         };
 
         char *error = NULL;
 
         if (!android_partition_configuration_setup(
-                &partitions, android_add_nand_image, NULL, &error)) {
+                &partitions, android_add_nand_image, &snapshot_incremental,
+                &error)) {
             PANIC("%s", error);
             return 1;
         }
@@ -3853,6 +3898,10 @@ int main(int argc, char **argv, char **envp)
 
     android_check_for_updates();
 
+    if (vcpu_thread) {
+        qemu_start_vcpu_thread();
+    }
+
     main_loop();
 #ifdef CONFIG_ANDROID
     crashhandler_exitmode("after main_loop");